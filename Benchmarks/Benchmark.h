@@ -0,0 +1,42 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+
+/**
+* Small helpers shared by the benchmarks. Each benchmark is a function that prints its timings and
+* returns 0 on success or nonzero if the results it checks do not match.
+*/
+
+typedef int (*BenchmarkFunction)();
+
+/**
+* Measures wall clock time from construction (or the last call to reset)
+*/
+class Stopwatch
+{
+private:
+	std::chrono::steady_clock::time_point start;
+
+public:
+	Stopwatch() : start(std::chrono::steady_clock::now()) {}
+
+	void reset() {
+		start = std::chrono::steady_clock::now();
+	}
+
+	double elapsed_ms() const {
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+};
+
+int run_projection_benchmark();
+int run_erase_benchmark();
+int run_marker_render_benchmark();
+int run_grid_benchmark();
+int run_homography_benchmark();
+int run_export_benchmark();
+int run_undistortion_benchmark();
+int run_pose_benchmark();
+int run_detection_benchmark();
+int run_marker_index_benchmark();
+int run_output_benchmark();
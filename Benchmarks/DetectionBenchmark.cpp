@@ -0,0 +1,166 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+#include "Benchmark.h"
+#include "MarkerDetector.h"
+
+/**
+* Marker detection as Image::find_markers did it before the two pass detector: one full resolution search of the
+* color image with contour refinement
+*/
+static void legacy_detect(const cv::Mat& img, std::vector<int>& ids, std::vector<std::vector<cv::Point2f>>& corners) {
+	cv::aruco::DetectorParameters detectorParams = cv::aruco::DetectorParameters();
+	detectorParams.perspectiveRemovePixelPerCell = 10;
+	detectorParams.cornerRefinementMethod = cv::aruco::CORNER_REFINE_CONTOUR;
+	detectorParams.cornerRefinementMinAccuracy = 0.01;
+	detectorParams.cornerRefinementMaxIterations = 5000;
+
+	cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+	cv::aruco::ArucoDetector detector(dictionary, detectorParams);
+
+	std::vector<std::vector<cv::Point2f>> rejected;
+	detector.detectMarkers(img, corners, ids, rejected);
+}
+
+/**
+* Draws a board of markers of different sizes and rotations on a large, slightly noisy image, like a marker layout
+* photographed at high resolution
+*
+* @param size image size
+* @param marker_count number of markers, ids 0 to marker_count - 1
+*
+* @return BGR image
+*/
+static cv::Mat synthetic_board(cv::Size size, int marker_count) {
+	cv::Mat gray(size, CV_8UC1, cv::Scalar(170));
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<double> marker_side(90.0, 320.0);
+	std::uniform_real_distribution<double> angle(-35.0, 35.0);
+	cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
+
+	// One marker per cell of a grid, so they never overlap
+	int cols = (int)std::ceil(std::sqrt(marker_count * (double)size.width / size.height));
+	int rows = (marker_count + cols - 1) / cols;
+	double cell_width = (double)size.width / cols;
+	double cell_height = (double)size.height / rows;
+	for (int id = 0; id < marker_count; id++) {
+		int side = (int)std::min(marker_side(rng), std::min(cell_width, cell_height) / 2);
+		cv::Mat marker;
+		cv::aruco::generateImageMarker(dictionary, id, side, marker, 1);
+
+		// Marker with a white quiet zone, rotated about the center of its cell
+		cv::Mat patch(side * 2, side * 2, CV_8UC1, cv::Scalar(255));
+		marker.copyTo(patch(cv::Rect(side / 2, side / 2, side, side)));
+		cv::Point2d center((id % cols + 0.5) * cell_width, (id / cols + 0.5) * cell_height);
+		cv::Mat transform = cv::getRotationMatrix2D(cv::Point2f((float)side, (float)side), angle(rng), 1.0);
+		transform.at<double>(0, 2) += center.x - side;
+		transform.at<double>(1, 2) += center.y - side;
+		cv::warpAffine(patch, gray, transform, size, cv::INTER_LINEAR, cv::BORDER_TRANSPARENT);
+	}
+
+	cv::GaussianBlur(gray, gray, cv::Size(5, 5), 1.0);
+	cv::Mat noise(size, CV_8UC1);
+	cv::randn(noise, cv::Scalar(0), cv::Scalar(3));
+	cv::add(gray, noise, gray);
+
+	cv::Mat img;
+	cv::cvtColor(gray, img, cv::COLOR_GRAY2BGR);
+	return img;
+}
+
+/**
+* Times the legacy full resolution detection against the two pass detector, synchronously and with the completion
+* callback, on a 48 MP synthetic board, and checks both find the same markers with the same corners
+*/
+int run_detection_benchmark() {
+	const int marker_count = 40;
+	const double corner_tolerance = 0.5;
+
+	cv::Mat img = synthetic_board(cv::Size(8000, 6000), marker_count);
+
+	std::vector<int> legacy_ids;
+	std::vector<std::vector<cv::Point2f>> legacy_corners;
+	Stopwatch timer;
+	legacy_detect(img, legacy_ids, legacy_corners);
+	double legacy_ms = timer.elapsed_ms();
+
+	MarkerDetector detector;
+	MarkerDetection detection;
+	timer.reset();
+	detector.detect(img, detection);
+	double detect_ms = timer.elapsed_ms();
+
+	// The GUI path: detect on a worker thread and wait for the callback
+	std::mutex mutex;
+	std::condition_variable finished;
+	bool done = false;
+	size_t async_count = 0;
+	timer.reset();
+	detector.detect_async(img, [&](MarkerDetection& async_detection) {
+		std::unique_lock<std::mutex> lock(mutex);
+		async_count = async_detection.ids.size();
+		done = true;
+		finished.notify_all();
+	});
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&] { return done; });
+	}
+	double async_ms = timer.elapsed_ms();
+
+	printf("legacy (full resolution) | two pass | two pass, async\n");
+	printf("%21.1f ms | %5.1f ms | %12.1f ms\n", legacy_ms, detect_ms, async_ms);
+
+	std::map<int, std::vector<cv::Point2f>> legacy_markers;
+	for (size_t i = 0; i < legacy_ids.size(); i++) {
+		legacy_markers[legacy_ids[i]] = legacy_corners[i];
+	}
+
+	int missing = 0;
+	double max_corner_error = 0;
+	for (size_t i = 0; i < detection.ids.size(); i++) {
+		std::map<int, std::vector<cv::Point2f>>::iterator legacy = legacy_markers.find(detection.ids[i]);
+		if (legacy == legacy_markers.end()) {
+			missing++;
+			continue;
+		}
+		for (int c = 0; c < 4; c++) {
+			max_corner_error = std::max(max_corner_error, (double)cv::norm(detection.corners[i][c] - legacy->second[c]));
+		}
+	}
+	missing += (int)legacy_markers.size() - ((int)detection.ids.size() - missing);
+
+	printf("markers: legacy %d, two pass %d, async %d of %d, largest corner difference %.3f px\n",
+		(int)legacy_ids.size(), (int)detection.ids.size(), (int)async_count, marker_count, max_corner_error);
+
+	if (legacy_ids.size() != (size_t)marker_count || missing != 0 || async_count != detection.ids.size() ||
+		max_corner_error > corner_tolerance) {
+		printf("Two pass detection does not match the full resolution detection\n");
+		return 1;
+	}
+
+	return 0;
+}
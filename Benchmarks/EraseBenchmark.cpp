@@ -0,0 +1,116 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "Painter.h"
+
+/**
+* Painter::erase as it was before the spatial index, kept here as the reference the new erase is timed against.
+* Note that it skips the point following every erased point.
+*/
+static void legacy_erase(std::vector<cv::Point2f>& points, float x, float y, int erase_radius) {
+	for (unsigned int i = 0; i < points.size(); i++) {
+		if (sqrt(pow(points[i].x - x, 2) + pow(points[i].y - y, 2)) <= erase_radius) {
+			points.erase(std::remove(points.begin(), points.end(), points[i]), points.end());
+		}
+	}
+}
+
+/**
+* Erases a stroke across a 1M point annotation with the legacy erase and with Painter::erase
+*/
+int run_erase_benchmark() {
+	const size_t point_count = 1000000;
+	const int stroke_length = 50;
+
+	PainterConfig paint_config;
+	paint_config.paint_mode = 1;
+	paint_config.erase_radius = 10;
+	paint_config.paint_density_counter = 0;
+	paint_config.paint_density_interval = 10;
+
+	// erase only uses the painter config, the rest of the session can stay empty
+	SessionConfig session_config = SessionConfig();
+	session_config.paint_config = &paint_config;
+
+	// Points spread over a 12 MP image in scene coordinates (origin at the center of the image)
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> x_dist(-2000.0f, 2000.0f);
+	std::uniform_real_distribution<float> y_dist(-1500.0f, 1500.0f);
+
+	std::vector<cv::Point2f> points(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		points[i] = cv::Point2f(x_dist(rng), y_dist(rng));
+	}
+
+	// Diagonal eraser stroke, one erase call per mouse move event
+	std::vector<cv::Point2f> stroke(stroke_length);
+	for (int i = 0; i < stroke_length; i++) {
+		stroke[i] = cv::Point2f(-1000.0f + 40.0f * i, -800.0f + 32.0f * i);
+	}
+
+	Stopwatch timer;
+	Painter painter(&session_config);
+	painter.add_points(points);
+	double load_ms = timer.elapsed_ms();
+
+	timer.reset();
+	for (int i = 0; i < stroke_length; i++) {
+		painter.erase(stroke[i].x, stroke[i].y);
+	}
+	double indexed_ms = timer.elapsed_ms();
+
+	std::vector<cv::Point2f> legacy = points;
+	timer.reset();
+	for (int i = 0; i < stroke_length; i++) {
+		legacy_erase(legacy, stroke[i].x, stroke[i].y, paint_config.erase_radius);
+	}
+	double legacy_ms = timer.elapsed_ms();
+
+	// Expected result: every point within the radius of any stroke position removed, order of the rest kept
+	std::vector<cv::Point2f> expected;
+	expected.reserve(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		bool erased = false;
+		for (int j = 0; j < stroke_length && !erased; j++) {
+			double dx = points[i].x - stroke[j].x;
+			double dy = points[i].y - stroke[j].y;
+			erased = dx * dx + dy * dy <= (double)paint_config.erase_radius * paint_config.erase_radius;
+		}
+		if (!erased) {
+			expected.push_back(points[i]);
+		}
+	}
+
+	std::vector<cv::Point2f> result = painter.get_points();
+
+	printf("%zu points, %d erase calls: legacy %10.2f ms | indexed %8.2f ms (%6.1fx) | index build %.2f ms\n",
+		point_count, stroke_length, legacy_ms, indexed_ms, legacy_ms / indexed_ms, load_ms);
+	printf("erased %zu points, legacy erase missed %zu\n",
+		point_count - result.size(), legacy.size() - expected.size());
+
+	if (result != expected) {
+		printf("Painter::erase does not match the expected points\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,243 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "Grid.h"
+#include "OutputFile.h"
+#include "Painter.h"
+
+// Every operator new of the benchmark executable is counted. OpenCV allocates Mat data with its own allocator, so
+// only std containers and other C++ allocations show up here.
+static std::atomic<size_t> allocation_count(0);
+static std::atomic<size_t> allocated_bytes(0);
+
+void* operator new(size_t size) {
+	allocation_count++;
+	allocated_bytes += size;
+	void* ptr = malloc(size > 0 ? size : 1);
+	if (ptr == NULL) {
+		throw std::bad_alloc();
+	}
+	return ptr;
+}
+
+void* operator new[](size_t size) {
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+	free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+	free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+	free(ptr);
+}
+
+/**
+* Painter::project_points in marker calibration mode as it was before it wrote into a reused buffer
+*/
+static std::vector<cv::Point2f> legacy_project_points(const std::vector<cv::Point2f>& points, const cv::Mat& pM_inv) {
+	std::vector<cv::Point2f> projected_points(points.size());
+	cv::perspectiveTransform(points, projected_points, pM_inv);
+
+	for (unsigned int i = 0; i < projected_points.size(); i++) {
+		projected_points[i].x = (projected_points[i].x) / 100;
+		projected_points[i].y = (projected_points[i].y) / 100;
+	}
+	return projected_points;
+}
+
+/**
+* OutputFile::write_output as it was before, taking the points by value and flushing every row
+*/
+static void legacy_write_output(std::ofstream& outfile, std::vector<cv::Point2f> data_points) {
+	for (size_t i = 0; i < data_points.size(); i++) {
+		data_points[i].x = data_points[i].x;
+		data_points[i].y = data_points[i].y;
+	}
+
+	outfile << "x,y,description,img_last4,neck,seat_track,seat_height" << std::endl;
+	for (unsigned int i = 0; i < data_points.size(); i++) {
+		outfile << std::fixed << data_points[i].x << "," <<
+			std::fixed << data_points[i].y << "," <<
+			"driver" << "," <<
+			std::setw(4) << std::setfill('0') << 1234 << "," <<
+			"50th_male" << "," <<
+			"mid" << "," <<
+			"down" << std::endl;
+	}
+}
+
+/**
+* Counts the lines of a file
+*/
+static size_t count_lines(const char* path) {
+	std::ifstream file(path);
+	std::string line;
+	size_t lines = 0;
+	while (std::getline(file, line)) {
+		lines++;
+	}
+	return lines;
+}
+
+/**
+* Exports a 200k point annotation in marker calibration mode three times, the legacy way and through
+* Painter::project_points and OutputFile::write_output, counting the heap allocations of each
+*/
+int run_export_benchmark() {
+	const size_t point_count = 200000;
+	const int export_count = 3;
+	const char* legacy_path = "export_benchmark_legacy.csv";
+	const char* export_path = "export_benchmark.csv";
+
+	GridConfig grid_config = GridConfig();
+	grid_config.width = 8.5f;
+	grid_config.height = 15.0f;
+	grid_config.divs_x = 17;
+	grid_config.divs_y = 30;
+	grid_config.calibration_mode = 2;
+
+	ImageConfig img_config = ImageConfig();
+	ApplicationConfig app_config = ApplicationConfig();
+	MeasurementConfig measurement_config = MeasurementConfig();
+	PainterConfig paint_config = PainterConfig();
+
+	SessionConfig session_config = SessionConfig();
+	session_config.grid_config = &grid_config;
+	session_config.img_config = &img_config;
+	session_config.app_config = &app_config;
+	session_config.measurement_config = &measurement_config;
+	session_config.paint_config = &paint_config;
+
+	// Marker corners seen through a known homography, as in the grid benchmark
+	cv::Mat world_to_scene = (cv::Mat_<double>(3, 3) <<
+		0.9, -0.35, -400.0,
+		0.05, 0.25, -900.0,
+		0.00002, 0.0004, 1.0);
+
+	std::vector<cv::Point2f> scaled_world_points;
+	for (int i = 0; i < 10; i++) {
+		cv::Point2f origin((float)(i % 5) * 2.0f, (float)(i / 5) * 6.0f + 1.0f);
+		img_config.world_points.push_back(origin);
+		img_config.world_points.push_back(origin + cv::Point2f(0.0f, 0.3f));
+		img_config.world_points.push_back(origin + cv::Point2f(0.3f, 0.3f));
+		img_config.world_points.push_back(origin + cv::Point2f(0.3f, 0.0f));
+	}
+	for (size_t i = 0; i < img_config.world_points.size(); i++) {
+		scaled_world_points.push_back(img_config.world_points[i] * 100);
+	}
+	cv::perspectiveTransform(scaled_world_points, img_config.scene_points, world_to_scene);
+
+	Grid grid(&session_config, -100, -100, -100, 100, 100, 100, 100, -100);
+	grid_config.grid = &grid;
+	grid.compute_perspective_transform();
+
+	// Points in the scene where the grid is
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> x_dist(-900.0f, 300.0f);
+	std::uniform_real_distribution<float> y_dist(-900.0f, -300.0f);
+
+	std::vector<cv::Point2f> points(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		points[i] = cv::Point2f(x_dist(rng), y_dist(rng));
+	}
+
+	Painter painter(&session_config);
+	painter.add_points(points);
+
+	// Legacy export, the projected points were passed to write_output as a temporary
+	allocation_count = 0;
+	allocated_bytes = 0;
+	Stopwatch timer;
+	for (int i = 0; i < export_count; i++) {
+		std::ofstream outfile(legacy_path, std::ios::out | std::ios::trunc);
+		legacy_write_output(outfile, legacy_project_points(points, grid.get_inverse_transform()));
+	}
+	double legacy_ms = timer.elapsed_ms();
+	size_t legacy_allocations = allocation_count;
+	size_t legacy_bytes = allocated_bytes;
+
+	// Export through the painter's reused buffer
+	snprintf(app_config.outfile_path, sizeof(app_config.outfile_path), "%s", export_path);
+	OutputFile outfile(&session_config);
+	snprintf(outfile.get_img_description_buf(), 50, "%s", "driver");
+	outfile.set_img_last4(1234);
+	*outfile.get_neck_ptr() = 1;
+	*outfile.get_seat_track_ptr() = 1;
+	*outfile.get_seat_height_ptr() = 0;
+
+	allocation_count = 0;
+	allocated_bytes = 0;
+	timer.reset();
+	for (int i = 0; i < export_count; i++) {
+		remove(export_path);
+		if (outfile.open() != FILE_OPEN_SUCCESS) {
+			printf("Could not open %s\n", export_path);
+			return 1;
+		}
+		outfile.write_output(painter.project_points());
+		outfile.close();
+	}
+	double export_ms = timer.elapsed_ms();
+	size_t export_allocations = allocation_count;
+	size_t export_bytes = allocated_bytes;
+
+	printf("%d exports of %d points\n", export_count, (int)point_count);
+	printf("  legacy %8.2f ms, %6d allocations, %8.2f MB allocated\n",
+		legacy_ms, (int)legacy_allocations, legacy_bytes / 1048576.0);
+	printf("  reused %8.2f ms, %6d allocations, %8.2f MB allocated\n",
+		export_ms, (int)export_allocations, export_bytes / 1048576.0);
+
+	std::vector<cv::Point2f> legacy_points = legacy_project_points(points, grid.get_inverse_transform());
+	const std::vector<cv::Point2f>& exported = painter.project_points();
+	double max_error = 0;
+	for (size_t i = 0; i < point_count; i++) {
+		max_error = std::fmax(max_error, std::fabs(exported[i].x - legacy_points[i].x));
+		max_error = std::fmax(max_error, std::fabs(exported[i].y - legacy_points[i].y));
+	}
+	printf("max difference %.7f m\n", max_error);
+
+	size_t legacy_lines = count_lines(legacy_path);
+	size_t export_lines = count_lines(export_path);
+	remove(legacy_path);
+	remove(export_path);
+
+	if (max_error > 1e-5 || legacy_lines != export_lines) {
+		printf("Export does not match the legacy export\n");
+		return 1;
+	}
+
+	return 0;
+}
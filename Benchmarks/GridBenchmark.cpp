@@ -0,0 +1,156 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmark.h"
+#include "Grid.h"
+
+/**
+* Per frame work of Grid::draw in marker calibration mode as it was before the transform and lines were cached,
+* kept here as the reference the cached grid is checked and timed against. Returns the grid line vertices.
+*/
+static std::vector<cv::Point2f> legacy_grid_frame(const GridConfig& grid_config, const std::vector<cv::Point2f>& scene_points,
+	const std::vector<cv::Point2f>& world_points) {
+
+	std::vector<cv::Point2f> scaled_world_points(world_points.size());
+	for (size_t i = 0; i < world_points.size(); i++) {
+		scaled_world_points[i] = world_points[i] * 100;
+	}
+
+	cv::Mat pM = cv::findHomography(scaled_world_points, scene_points, cv::RHO, 8, cv::noArray(), 5000);
+	cv::Mat pM_inv = cv::findHomography(scene_points, scaled_world_points, cv::RHO, 8, cv::noArray(), 5000);
+
+	std::vector<cv::Point2f> ortho_corners(4);
+	ortho_corners[1].y = grid_config.height * 100;
+	ortho_corners[2] = cv::Point2f(grid_config.width * 100, grid_config.height * 100);
+	ortho_corners[3].x = grid_config.width * 100;
+
+	std::vector<cv::Point2f> corners(4);
+	cv::perspectiveTransform(ortho_corners, corners, pM);
+	cv::perspectiveTransform(corners, ortho_corners, pM_inv);
+
+	std::vector<cv::Point2f> vertices;
+
+	float x_offset = (grid_config.width * 100) / grid_config.divs_x;
+	for (int i = 1; i < grid_config.divs_x; i++) {
+		std::vector<cv::Point2f> points(2);
+		std::vector<cv::Point2f> ortho(2);
+		points[0] = cv::Point2f(ortho_corners[0].x + x_offset * i, ortho_corners[0].y);
+		points[1] = cv::Point2f(ortho_corners[1].x + x_offset * i, ortho_corners[1].y);
+		cv::perspectiveTransform(points, ortho, pM);
+		vertices.insert(vertices.end(), ortho.begin(), ortho.end());
+	}
+
+	float y_offset = (grid_config.height * 100) / grid_config.divs_y;
+	for (int i = 1; i < grid_config.divs_y; i++) {
+		std::vector<cv::Point2f> points(2);
+		std::vector<cv::Point2f> ortho(2);
+		points[0] = cv::Point2f(ortho_corners[0].x, ortho_corners[0].y + y_offset * i);
+		points[1] = cv::Point2f(ortho_corners[3].x, ortho_corners[3].y + y_offset * i);
+		cv::perspectiveTransform(points, ortho, pM);
+		vertices.insert(vertices.end(), ortho.begin(), ortho.end());
+	}
+
+	return vertices;
+}
+
+/**
+* Runs the per frame grid work of marker calibration mode with 10 detected markers, the legacy way and with the
+* cached Grid, for 200 frames in which nothing changes
+*/
+int run_grid_benchmark() {
+	const int frame_count = 200;
+	const int marker_count = 10;
+
+	GridConfig grid_config = GridConfig();
+	grid_config.width = 8.5f;
+	grid_config.height = 15.0f;
+	grid_config.divs_x = 17;
+	grid_config.divs_y = 30;
+	grid_config.calibration_mode = 2;
+
+	ImageConfig img_config = ImageConfig();
+	ApplicationConfig app_config = ApplicationConfig();
+
+	SessionConfig session_config = SessionConfig();
+	session_config.grid_config = &grid_config;
+	session_config.img_config = &img_config;
+	session_config.app_config = &app_config;
+
+	// Marker corners on the ground (meters) seen through a known homography from world centimeters to the scene
+	cv::Mat world_to_scene = (cv::Mat_<double>(3, 3) <<
+		0.9, -0.35, -400.0,
+		0.05, 0.25, -900.0,
+		0.00002, 0.0004, 1.0);
+
+	std::vector<cv::Point2f> scaled_world_points;
+	for (int i = 0; i < marker_count; i++) {
+		cv::Point2f origin((float)(i % 5) * 2.0f, (float)(i / 5) * 6.0f + 1.0f);
+		img_config.world_points.push_back(origin);
+		img_config.world_points.push_back(origin + cv::Point2f(0.0f, 0.3f));
+		img_config.world_points.push_back(origin + cv::Point2f(0.3f, 0.3f));
+		img_config.world_points.push_back(origin + cv::Point2f(0.3f, 0.0f));
+	}
+	for (size_t i = 0; i < img_config.world_points.size(); i++) {
+		scaled_world_points.push_back(img_config.world_points[i] * 100);
+	}
+	cv::perspectiveTransform(scaled_world_points, img_config.scene_points, world_to_scene);
+
+	std::vector<cv::Point2f> legacy_vertices;
+	Stopwatch timer;
+	for (int i = 0; i < frame_count; i++) {
+		legacy_vertices = legacy_grid_frame(grid_config, img_config.scene_points, img_config.world_points);
+	}
+	double legacy_ms = timer.elapsed_ms();
+
+	Grid grid(&session_config, -100, -100, -100, 100, 100, 100, 100, -100);
+	std::vector<cv::Point2f> cached_vertices;
+	timer.reset();
+	for (int i = 0; i < frame_count; i++) {
+		grid.compute_perspective_transform();
+		cached_vertices = grid.get_line_vertices();
+	}
+	double cached_ms = timer.elapsed_ms();
+
+	printf("%d frames, %d markers: legacy %8.2f ms | cached %8.2f ms (%6.1fx)\n",
+		frame_count, marker_count, legacy_ms, cached_ms, legacy_ms / cached_ms);
+	printf("transform solved %u times, solve took %.3f ms\n", grid.get_solve_count(), grid.get_last_solve_ms());
+
+	// The cached vertices start with the 4 outline segments through the corners
+	const size_t outline_vertices = 8;
+	if (grid.get_solve_count() != 1 || cached_vertices.size() != legacy_vertices.size() + outline_vertices) {
+		printf("Grid did not cache the transform and lines\n");
+		return 1;
+	}
+
+	double max_error = 0;
+	for (size_t i = 0; i < legacy_vertices.size(); i++) {
+		cv::Point2f d = cached_vertices[i + outline_vertices] - legacy_vertices[i];
+		max_error = std::max<double>(max_error, std::sqrt(d.x * d.x + d.y * d.y));
+	}
+	printf("max grid line difference %.5f px\n", max_error);
+
+	if (max_error > 0.05) {
+		printf("Grid lines do not match the legacy grid\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmark.h"
+#include "HomographySolver.h"
+
+/**
+* Solve of point and marker calibration as Grid did it before the homography solver: both directions estimated
+* separately with RHO
+*/
+static void legacy_solve(const std::vector<cv::Point2f>& world_points, const std::vector<cv::Point2f>& scene_points,
+	cv::Mat& pM, cv::Mat& pM_inv) {
+	pM = cv::findHomography(world_points, scene_points, cv::RHO, 8, cv::noArray(), 5000);
+	pM_inv = cv::findHomography(scene_points, world_points, cv::RHO, 8, cv::noArray(), 5000);
+}
+
+/**
+* Times the legacy solve against the homography solver for growing numbers of points, 20% of which are outliers,
+* and checks that the solver flags every outlier
+*/
+int run_homography_benchmark() {
+	const int point_counts[] = { 8, 20, 40, 100, 400, 1000 };
+	const int repeats = 20;
+	const double outlier_fraction = 0.2;
+
+	cv::Mat world_to_scene = (cv::Mat_<double>(3, 3) <<
+		0.9, -0.35, -400.0,
+		0.05, 0.25, -900.0,
+		0.00002, 0.0004, 1.0);
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> world_x(0.0f, 850.0f);
+	std::uniform_real_distribution<float> world_y(0.0f, 1500.0f);
+	std::normal_distribution<float> noise(0.0f, 0.5f);
+	std::uniform_real_distribution<float> outlier_offset(50.0f, 200.0f);
+
+	HomographySolver solver;
+	int failures = 0;
+
+	printf("points | legacy (2x RHO) | solver (4 methods) | method  inliers  inlier RMS\n");
+	for (int point_count : point_counts) {
+		std::vector<cv::Point2f> world_points(point_count);
+		std::vector<cv::Point2f> scene_points;
+		for (int i = 0; i < point_count; i++) {
+			world_points[i] = cv::Point2f(world_x(rng), world_y(rng));
+		}
+		cv::perspectiveTransform(world_points, scene_points, world_to_scene);
+
+		int outlier_count = (int)(point_count * outlier_fraction);
+		std::vector<bool> is_outlier(point_count, false);
+		for (int i = 0; i < outlier_count; i++) {
+			// Spread the outliers over the point set instead of taking the first ones
+			is_outlier[(i * 7919) % point_count] = true;
+		}
+		for (int i = 0; i < point_count; i++) {
+			scene_points[i] += cv::Point2f(noise(rng), noise(rng));
+			if (is_outlier[i]) {
+				scene_points[i] += cv::Point2f(outlier_offset(rng), -outlier_offset(rng));
+			}
+		}
+
+		cv::Mat pM, pM_inv;
+		Stopwatch timer;
+		for (int r = 0; r < repeats; r++) {
+			legacy_solve(world_points, scene_points, pM, pM_inv);
+		}
+		double legacy_ms = timer.elapsed_ms() / repeats;
+
+		HomographySolution solution;
+		int status = HOMOGRAPHY_SUCCESS;
+		timer.reset();
+		for (int r = 0; r < repeats; r++) {
+			status = solver.solve(world_points, scene_points, solution);
+		}
+		double solver_ms = timer.elapsed_ms() / repeats;
+
+		if (status != HOMOGRAPHY_SUCCESS) {
+			printf("%6d | no solution\n", point_count);
+			failures++;
+			continue;
+		}
+
+		printf("%6d | %12.3f ms | %15.3f ms | %-6s %4d/%-4d %8.3f px\n", point_count, legacy_ms, solver_ms,
+			HomographySolver::method_name(solution.method).c_str(), solution.inlier_count, point_count, solution.inlier_rms);
+
+		int missed = 0;
+		for (int i = 0; i < point_count; i++) {
+			if (is_outlier[i] && solution.inliers[i]) {
+				missed++;
+			}
+		}
+
+		cv::Mat identity = solution.H * solution.H_inv;
+		identity /= identity.at<double>(2, 2);
+		double inverse_error = cv::norm(identity, cv::Mat::eye(3, 3, CV_64F), cv::NORM_INF);
+
+		if (missed > 0 || solution.inlier_rms > 2.0 || inverse_error > 1e-6) {
+			printf("       %d outliers not flagged, inverse error %g\n", missed, inverse_error);
+			failures++;
+		}
+	}
+
+	if (failures > 0) {
+		printf("Homography solver failed for %d point sets\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,65 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstring>
+#include "Benchmark.h"
+
+typedef struct {
+	const char* name;
+	BenchmarkFunction run;
+} BenchmarkEntry;
+
+static const BenchmarkEntry benchmarks[] = {
+	{ "projection", run_projection_benchmark },
+	{ "erase", run_erase_benchmark },
+	{ "markers", run_marker_render_benchmark },
+	{ "grid", run_grid_benchmark },
+	{ "homography", run_homography_benchmark },
+	{ "export", run_export_benchmark },
+	{ "undistortion", run_undistortion_benchmark },
+	{ "pose", run_pose_benchmark },
+	{ "detection", run_detection_benchmark },
+	{ "marker-index", run_marker_index_benchmark },
+	{ "output", run_output_benchmark },
+};
+
+/**
+* Runs every benchmark, or only the ones named on the command line, e.g. Benchmarks.exe projection
+*/
+int main(int argc, char** argv) {
+	int failures = 0;
+
+	for (const BenchmarkEntry& benchmark : benchmarks) {
+		bool selected = (argc < 2);
+		for (int i = 1; i < argc; i++) {
+			if (strcmp(argv[i], benchmark.name) == 0) {
+				selected = true;
+			}
+		}
+
+		if (!selected) {
+			continue;
+		}
+
+		printf("== %s ==\n", benchmark.name);
+		if (benchmark.run() != 0) {
+			printf("%s: FAILED\n", benchmark.name);
+			failures++;
+		}
+	}
+
+	return failures;
+}
@@ -0,0 +1,133 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "MarkerIndex.h"
+
+/**
+* Marker index loading as MarkerIndex::build_index did it before the board model: whitespace separated text read
+* with ifstream >>, coordinates indexed by id
+*/
+static void legacy_build_index(const char* path, std::vector<float>& x_coords, std::vector<float>& y_coords) {
+	std::ifstream index_file(path);
+
+	int id;
+	float x, y;
+	std::string ignore;
+	while (index_file >> ignore >> id >> ignore >> x >> ignore >> y) {
+		x_coords.push_back(x);
+		y_coords.push_back(y);
+	}
+}
+
+/**
+* Times loading a site wide marker index of 1000 boards of 50 markers as text the old way, as text into the board
+* model and as the compiled binary, and looking up markers in it. Checks that every marker reads the same from all
+* three.
+*/
+int run_marker_index_benchmark() {
+	const char* text_path = "marker_index_benchmark.txt";
+	const char* binary_path = "marker_index_benchmark.bin";
+	const int marker_count = 50000;
+	const int lookups = 1000000;
+
+	{
+		// Boards on a 15 x 8.5 m grid, 50 markers each, ids consecutive like the legacy format needs
+		std::ofstream text_file(text_path, std::ios::out | std::ios::trunc);
+		for (int id = 0; id < marker_count; id++) {
+			int marker = id % 50;
+			text_file << "id " << id << " x " << (marker % 5) * 3.0f + (id / 50) * 20.0f << " y " << (marker / 5) * 0.85f << "\n";
+		}
+	}
+
+	std::vector<float> legacy_x, legacy_y;
+	Stopwatch timer;
+	legacy_build_index(text_path, legacy_x, legacy_y);
+	double legacy_ms = timer.elapsed_ms();
+
+	MarkerIndex text_index;
+	timer.reset();
+	int status = text_index.load(text_path);
+	double text_ms = timer.elapsed_ms();
+
+	if (status != MARKER_INDEX_SUCCESS || text_index.save_binary(binary_path) != MARKER_INDEX_SUCCESS) {
+		printf("Could not compile %s\n", text_path);
+		remove(text_path);
+		return 1;
+	}
+
+	MarkerIndex binary_index;
+	timer.reset();
+	status = binary_index.load(binary_path);
+	double map_ms = timer.elapsed_ms();
+	timer.reset();
+	status = (status == MARKER_INDEX_SUCCESS) ? binary_index.validate() : status;
+	double validate_ms = timer.elapsed_ms();
+
+	std::mt19937 rng(5);
+	std::uniform_int_distribution<int> random_id(0, marker_count - 1);
+	std::vector<int> ids(lookups);
+	for (int i = 0; i < lookups; i++) {
+		ids[i] = random_id(rng);
+	}
+
+	float legacy_sum = 0;
+	timer.reset();
+	for (int i = 0; i < lookups; i++) {
+		legacy_sum += legacy_x[ids[i]] + legacy_y[ids[i]];
+	}
+	double legacy_lookup_ms = timer.elapsed_ms();
+
+	float binary_sum = 0;
+	MarkerPlacement marker;
+	timer.reset();
+	for (int i = 0; i < lookups; i++) {
+		if (binary_index.find(ids[i], marker)) {
+			binary_sum += marker.x + marker.y;
+		}
+	}
+	double binary_lookup_ms = timer.elapsed_ms();
+
+	int mismatches = 0;
+	for (int id = 0; id < marker_count; id++) {
+		MarkerPlacement from_text, from_binary;
+		if (!text_index.find(id, from_text) || !binary_index.find(id, from_binary) ||
+			from_text.x != legacy_x[id] || from_text.y != legacy_y[id] ||
+			from_binary.x != legacy_x[id] || from_binary.y != legacy_y[id]) {
+			mismatches++;
+		}
+	}
+
+	remove(text_path);
+	remove(binary_path);
+
+	printf("load: legacy text %.2f ms | board model text %.2f ms | binary map %.3f ms + first lookup check %.2f ms\n",
+		legacy_ms, text_ms, map_ms, validate_ms);
+	printf("%d lookups: legacy %.2f ms | binary hash %.2f ms\n", lookups, legacy_lookup_ms, binary_lookup_ms);
+
+	if (status != MARKER_INDEX_SUCCESS || binary_index.size() != (size_t)marker_count || mismatches > 0 ||
+		legacy_sum != binary_sum) {
+		printf("Binary marker index does not match the text index, %d markers differ\n", mismatches);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,211 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <GL/glew.h>
+#include <glfw3.h>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include "Benchmark.h"
+#include "Painter.h"
+
+static const int target_width = 1024;
+static const int target_height = 768;
+
+/**
+* Painter::draw as it was before the marker buffer, kept here as the reference the new renderer is timed against
+*/
+static void legacy_draw(const std::vector<cv::Point2f>& points, int view_radius) {
+	glColor3f(1.0f, 0.0f, 0.0f);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	for (unsigned int i = 0; i < points.size(); i++) {
+		glBegin(GL_POLYGON);
+			glVertex2f(points[i].x - view_radius, points[i].y - view_radius);
+			glVertex2f(points[i].x - view_radius, points[i].y + view_radius);
+			glVertex2f(points[i].x + view_radius, points[i].y + view_radius);
+			glVertex2f(points[i].x + view_radius, points[i].y - view_radius);
+		glEnd();
+
+		glBegin(GL_LINES);
+			glVertex2f(points[i].x - 2, points[i].y);
+			glVertex2f(points[i].x + 2, points[i].y);
+		glEnd();
+
+		glBegin(GL_LINES);
+			glVertex2f(points[i].x, points[i].y + 2);
+			glVertex2f(points[i].x, points[i].y - 2);
+		glEnd();
+	}
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glColor3f(1.0f, 1.0f, 1.0f);
+}
+
+/**
+* Clears the render target and sets up the same kind of projection the perspective panel uses
+*/
+static void begin_frame() {
+	glViewport(0, 0, target_width, target_height);
+	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(-2000.0, 2000.0, -1500.0, 1500.0, -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+}
+
+/**
+* Reads back the red channel of the render target
+*/
+static std::vector<unsigned char> read_frame() {
+	std::vector<unsigned char> pixels(target_width * target_height);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, target_width, target_height, GL_RED, GL_UNSIGNED_BYTE, pixels.data());
+	return pixels;
+}
+
+/**
+* Draws 20k painted points with the legacy immediate mode loop and with Painter::draw, first as a static annotation and
+* then while a stroke appends a point every frame. Needs an OpenGL context. For a headless run on a machine without a
+* GPU, put the Mesa llvmpipe opengl32.dll next to the executable.
+*/
+int run_marker_render_benchmark() {
+	const size_t point_count = 20000;
+	const int frame_count = 100;
+
+	if (!glfwInit()) {
+		printf("Could not initialize GLFW, skipping\n");
+		return 0;
+	}
+
+	// Same context the application asks for, the window is never shown
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	GLFWwindow* window = glfwCreateWindow(64, 64, "Benchmarks", NULL, NULL);
+	if (window == NULL) {
+		printf("Could not create an OpenGL context, skipping\n");
+		glfwTerminate();
+		return 0;
+	}
+	glfwMakeContextCurrent(window);
+
+	if (glewInit() != GLEW_OK) {
+		printf("Could not initialize GLEW, skipping\n");
+		glfwDestroyWindow(window);
+		glfwTerminate();
+		return 0;
+	}
+	printf("renderer: %s, OpenGL %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+	// Render into an offscreen target so hidden windows and window sizes do not matter
+	GLuint fbo, color_buffer;
+	glGenRenderbuffers(1, &color_buffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_buffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, target_width, target_height);
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_buffer);
+
+	// draw only uses the points, the rest of the session can stay empty
+	PainterConfig paint_config = PainterConfig();
+	SessionConfig session_config = SessionConfig();
+	session_config.paint_config = &paint_config;
+
+	// Points spread over a 12 MP image in scene coordinates (origin at the center of the image)
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> x_dist(-1900.0f, 1900.0f);
+	std::uniform_real_distribution<float> y_dist(-1400.0f, 1400.0f);
+
+	std::vector<cv::Point2f> points(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		points[i] = cv::Point2f(x_dist(rng), y_dist(rng));
+	}
+
+	Painter painter(&session_config);
+	painter.add_points(points);
+
+	// Static annotation
+	Stopwatch timer;
+	for (int i = 0; i < frame_count; i++) {
+		begin_frame();
+		legacy_draw(points, 6);
+	}
+	glFinish();
+	double legacy_ms = timer.elapsed_ms();
+	std::vector<unsigned char> legacy_frame = read_frame();
+
+	timer.reset();
+	for (int i = 0; i < frame_count; i++) {
+		begin_frame();
+		painter.draw();
+	}
+	glFinish();
+	double buffered_ms = timer.elapsed_ms();
+	std::vector<unsigned char> buffered_frame = read_frame();
+
+	// Painting, one point appended per frame
+	std::vector<cv::Point2f> stroke = points;
+	timer.reset();
+	for (int i = 0; i < frame_count; i++) {
+		stroke.push_back(cv::Point2f(-1000.0f + 20.0f * i, -500.0f + 10.0f * i));
+		begin_frame();
+		legacy_draw(stroke, 6);
+	}
+	glFinish();
+	double legacy_paint_ms = timer.elapsed_ms();
+
+	timer.reset();
+	for (int i = 0; i < frame_count; i++) {
+		painter.add_point_at_click(-1000.0f + 20.0f * i, -500.0f + 10.0f * i);
+		begin_frame();
+		painter.draw();
+	}
+	glFinish();
+	double buffered_paint_ms = timer.elapsed_ms();
+
+	printf("%zu points, %d frames: legacy %8.2f ms | buffered %8.2f ms (%6.1fx)\n",
+		point_count, frame_count, legacy_ms, buffered_ms, legacy_ms / buffered_ms);
+	printf("painting, 1 point per frame: legacy %8.2f ms | buffered %8.2f ms (%6.1fx)\n",
+		legacy_paint_ms, buffered_paint_ms, legacy_paint_ms / buffered_paint_ms);
+
+	// Lines are rasterized the same way, only the corners of the squares may differ by a pixel
+	size_t lit = 0;
+	size_t mismatched = 0;
+	for (size_t i = 0; i < legacy_frame.size(); i++) {
+		if (legacy_frame[i] != 0) {
+			lit++;
+		}
+		if ((legacy_frame[i] != 0) != (buffered_frame[i] != 0)) {
+			mismatched++;
+		}
+	}
+	printf("%zu of %zu lit pixels differ\n", mismatched, lit);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteRenderbuffers(1, &color_buffer);
+	glfwDestroyWindow(window);
+	glfwTerminate();
+
+	if (lit == 0 || mismatched > lit / 50) {
+		printf("Painter::draw does not match the legacy markers\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,310 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+#include "Benchmark.h"
+#include "OutputFile.h"
+#include "OutputJournal.h"
+#include "ReferencePoint.h"
+
+/**
+* OutputFile::write_output as it was before the write buffer, streaming each row through std::fixed and
+* flushing every line
+*/
+static void legacy_write_output(std::ofstream& outfile, const std::vector<cv::Point2f>& data_points, bool header = true) {
+	if (header) {
+		outfile << "x,y,description,img_last4,neck,seat_track,seat_height" << std::endl;
+	}
+	for (unsigned int i = 0; i < data_points.size(); i++) {
+		outfile << std::fixed << data_points[i].x << "," <<
+			std::fixed << data_points[i].y << "," <<
+			"driver" << "," <<
+			std::setw(4) << std::setfill('0') << 1234 << "," <<
+			"50th_male" << "," <<
+			"mid" << "," <<
+			"down" << std::endl;
+	}
+}
+
+/**
+* Reads a whole file
+*/
+static std::string read_file(const char* path) {
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+/**
+* Writes a file
+*/
+static void write_file(const char* path, const std::string& bytes) {
+	std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	file.write(bytes.data(), bytes.size());
+}
+
+/**
+* Appends small annotations one click at a time, the legacy way opening and closing the file for every click and
+* through the journal of OutputFile, and checks that both files are the same. Then a copy of the files taken in the
+* middle of the appends, with half a row more in the output file, stands in for a crash and is recovered. So does a
+* copy taken in the middle of an append large enough to go to the journal in several blocks.
+*
+* @return number of failed checks
+*/
+static int run_append_benchmark(SessionConfig* session_config, OutputFile& outfile) {
+	const int click_count = 500;
+	const size_t click_points = 200;
+	const char* legacy_path = "output_benchmark_append_legacy.csv";
+	const char* append_path = "output_benchmark_append.csv";
+	const char* crash_path = "output_benchmark_crash.csv";
+	const std::string crash_journal_path = std::string(crash_path) + ".journal";
+
+	std::mt19937 rng(9);
+	std::uniform_real_distribution<float> dist(-5.0f, 25.0f);
+	std::vector<std::vector<cv::Point2f> > clicks(click_count, std::vector<cv::Point2f>(click_points));
+	for (int c = 0; c < click_count; c++) {
+		for (size_t i = 0; i < click_points; i++) {
+			clicks[c][i] = cv::Point2f(dist(rng), dist(rng));
+		}
+	}
+
+	Stopwatch timer;
+	for (int c = 0; c < click_count; c++) {
+		std::ofstream file(legacy_path, std::ios::out | (c == 0 ? std::ios::trunc : std::ios::app));
+		legacy_write_output(file, clicks[c], c == 0);
+	}
+	double legacy_ms = timer.elapsed_ms();
+
+	ApplicationConfig* app_config = session_config->app_config;
+	*outfile.get_format_ptr() = OUTPUT_FORMAT_CSV;
+	snprintf(app_config->outfile_path, sizeof(app_config->outfile_path), "%s", append_path);
+	remove(append_path);
+
+	int failures = 0;
+	std::string crash_bytes;
+	timer.reset();
+	for (int c = 0; c < click_count; c++) {
+		*outfile.get_append_ptr() = c > 0;
+		if (outfile.open() != FILE_OPEN_SUCCESS) {
+			printf("Could not open %s\n", append_path);
+			return failures + 1;
+		}
+		outfile.write_output(clicks[c].data(), clicks[c].size());
+		if (outfile.close() != FILE_OPEN_SUCCESS) {
+			failures++;
+		}
+
+		if (c == click_count / 2) {
+			crash_bytes = read_file(append_path);
+			write_file(crash_path, crash_bytes + "1.2345");
+			write_file(crash_journal_path.c_str(), read_file((std::string(append_path) + ".journal").c_str()));
+		}
+	}
+	outfile.close_session();
+	double append_ms = timer.elapsed_ms();
+
+	printf("%d appends of %d points | write ms\n", click_count, (int)click_points);
+	printf("legacy open per click | %8.2f\n", legacy_ms);
+	printf("journal               | %8.2f\n", append_ms);
+
+	if (read_file(append_path) != read_file(legacy_path)) {
+		printf("Appended CSV does not match the legacy CSV\n");
+		failures++;
+	}
+	if (std::ifstream(std::string(append_path) + ".journal").good()) {
+		printf("Journal was not removed\n");
+		failures++;
+	}
+
+	if (OutputJournal::recover(crash_path) != JOURNAL_SUCCESS || read_file(crash_path) != crash_bytes) {
+		printf("Recovered CSV does not match the CSV before the crash\n");
+		failures++;
+	}
+
+	// The blocks of a large append are in the journal before the append is committed, none of them are kept
+	std::vector<cv::Point2f> large_click(100000);
+	for (size_t i = 0; i < large_click.size(); i++) {
+		large_click[i] = cv::Point2f(dist(rng), dist(rng));
+	}
+	crash_bytes = read_file(append_path);
+	if (outfile.open() != FILE_OPEN_SUCCESS) {
+		printf("Could not open %s\n", append_path);
+		return failures + 1;
+	}
+	outfile.write_output(large_click.data(), large_click.size());
+	write_file(crash_path, read_file(append_path));
+	write_file(crash_journal_path.c_str(), read_file((std::string(append_path) + ".journal").c_str()));
+	if (outfile.close() != FILE_OPEN_SUCCESS) {
+		failures++;
+	}
+	outfile.close_session();
+	if (read_file(crash_path).size() <= crash_bytes.size()) {
+		printf("Large append did not reach the file before it was committed\n");
+		failures++;
+	}
+	if (OutputJournal::recover(crash_path) != JOURNAL_SUCCESS || read_file(crash_path) != crash_bytes) {
+		printf("Recovered CSV still has part of the large append\n");
+		failures++;
+	}
+
+	// Appending to a file with another header is refused
+	write_file(crash_path, "a,b,c\n");
+	snprintf(app_config->outfile_path, sizeof(app_config->outfile_path), "%s", crash_path);
+	if (outfile.open() != FILE_OPEN_SCHEMA_MISMATCH) {
+		printf("Appended to a file with another header\n");
+		failures++;
+	}
+	outfile.close();
+	*outfile.get_append_ptr() = false;
+
+	remove(legacy_path);
+	remove(append_path);
+	remove(crash_path);
+	remove(crash_journal_path.c_str());
+	return failures;
+}
+
+/**
+* Writes the same 1M points through the legacy stream and the buffered writer and checks that the CSV files are
+* identical, then writes them again in the columnar format and reads the columns back. Then appends small
+* annotations, see run_append_benchmark.
+*/
+int run_output_benchmark() {
+	const size_t point_count = 1000000;
+	const char* legacy_path = "output_benchmark_legacy.csv";
+	const char* csv_path = "output_benchmark.csv";
+	const char* columnar_path = "output_benchmark.pgcol";
+
+	GridConfig grid_config = GridConfig();
+	grid_config.calibration_mode = 3;
+	ApplicationConfig app_config = ApplicationConfig();
+	MeasurementConfig measurement_config = MeasurementConfig();
+
+	SessionConfig session_config = SessionConfig();
+	session_config.grid_config = &grid_config;
+	session_config.app_config = &app_config;
+	session_config.measurement_config = &measurement_config;
+
+	// Ground points in meters around the vehicle, with some exact ties and negative zeros for the formatter
+	std::mt19937 rng(5);
+	std::uniform_real_distribution<float> x_dist(-12.0f, 12.0f);
+	std::uniform_real_distribution<float> y_dist(-3.0f, 40.0f);
+	std::vector<cv::Point2f> points(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		points[i] = cv::Point2f(x_dist(rng), y_dist(rng));
+	}
+	points[0] = cv::Point2f(-0.0f, 0.0f);
+	points[1] = cv::Point2f(0.0000005f, -2.5f);
+	points[2] = cv::Point2f(1e7f, -123456.789f);
+
+	Stopwatch timer;
+	{
+		std::ofstream outfile(legacy_path, std::ios::out | std::ios::trunc);
+		legacy_write_output(outfile, points);
+	}
+	double legacy_ms = timer.elapsed_ms();
+
+	OutputFile outfile(&session_config);
+	snprintf(outfile.get_img_description_buf(), 50, "%s", "driver");
+	outfile.set_img_last4(1234);
+	*outfile.get_neck_ptr() = 1;
+	*outfile.get_seat_track_ptr() = 1;
+	*outfile.get_seat_height_ptr() = 0;
+
+	snprintf(app_config.outfile_path, sizeof(app_config.outfile_path), "%s", csv_path);
+	remove(csv_path);
+	timer.reset();
+	if (outfile.open() != FILE_OPEN_SUCCESS) {
+		printf("Could not open %s\n", csv_path);
+		return 1;
+	}
+	outfile.write_output(points.data(), points.size());
+	outfile.close();
+	double csv_ms = timer.elapsed_ms();
+
+	*outfile.get_format_ptr() = OUTPUT_FORMAT_COLUMNAR;
+	snprintf(app_config.outfile_path, sizeof(app_config.outfile_path), "%s", columnar_path);
+	remove(columnar_path);
+	timer.reset();
+	if (outfile.open() != FILE_OPEN_SUCCESS) {
+		printf("Could not open %s\n", columnar_path);
+		return 1;
+	}
+	outfile.write_output(points.data(), points.size());
+	outfile.close();
+	double columnar_ms = timer.elapsed_ms();
+
+	std::string legacy_bytes = read_file(legacy_path);
+	std::string csv_bytes = read_file(csv_path);
+	std::string columnar_bytes = read_file(columnar_path);
+	remove(legacy_path);
+	remove(csv_path);
+	remove(columnar_path);
+
+	printf("%d points | write ms | MB\n", (int)point_count);
+	printf("legacy     | %8.2f | %6.2f\n", legacy_ms, legacy_bytes.size() / 1048576.0);
+	printf("buffered   | %8.2f | %6.2f\n", csv_ms, csv_bytes.size() / 1048576.0);
+	printf("columnar   | %8.2f | %6.2f\n", columnar_ms, columnar_bytes.size() / 1048576.0);
+
+	int failures = 0;
+	if (csv_bytes != legacy_bytes) {
+		printf("Buffered CSV does not match the legacy CSV\n");
+		failures++;
+	}
+
+	// One chunk: magic, version, metadata length, row count, metadata, x column, y column
+	uint32_t version = 0;
+	uint32_t metadata_length = 0;
+	uint64_t row_count = 0;
+	if (columnar_bytes.size() >= 24) {
+		memcpy(&version, columnar_bytes.data() + 8, sizeof(version));
+		memcpy(&metadata_length, columnar_bytes.data() + 12, sizeof(metadata_length));
+		memcpy(&row_count, columnar_bytes.data() + 16, sizeof(row_count));
+	}
+	size_t x_offset = 24 + (size_t)metadata_length;
+	size_t y_offset = x_offset + point_count * sizeof(float);
+	if (columnar_bytes.compare(0, 8, "PGRIDCOL") != 0 || version != 1 || row_count != point_count ||
+		columnar_bytes.size() != y_offset + point_count * sizeof(float) ||
+		columnar_bytes.compare(24, strlen("driver,1234"), "driver,1234") != 0) {
+		printf("Columnar header does not match\n");
+		return 1;
+	}
+
+	size_t mismatches = 0;
+	for (size_t i = 0; i < point_count; i++) {
+		float x, y;
+		memcpy(&x, columnar_bytes.data() + x_offset + i * sizeof(float), sizeof(float));
+		memcpy(&y, columnar_bytes.data() + y_offset + i * sizeof(float), sizeof(float));
+		if (memcmp(&x, &points[i].x, sizeof(float)) != 0 || memcmp(&y, &points[i].y, sizeof(float)) != 0) {
+			mismatches++;
+		}
+	}
+	if (mismatches > 0) {
+		printf("%d columnar values do not match\n", (int)mismatches);
+		failures++;
+	}
+
+	failures += run_append_benchmark(&session_config, outfile);
+
+	return failures > 0 ? 1 : 0;
+}
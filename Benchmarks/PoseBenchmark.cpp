@@ -0,0 +1,133 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmark.h"
+#include "MarkerIndex.h"
+#include "PoseEstimator.h"
+
+/**
+* Solves the camera pose from synthetic marker corners seen by a camera at known poses, with pixel noise and some
+* markers detected in the wrong place, and checks that the estimator recovers each pose
+*/
+int run_pose_benchmark() {
+	const int repeats = 20;
+	const int marker_rows = 8;
+	const int marker_cols = 5;
+	const double outlier_fraction = 0.1;
+
+	cv::Mat camera_intrinsic = (cv::Mat_<double>(3, 3) <<
+		1400.0, 0.0, 960.0,
+		0.0, 1400.0, 540.0,
+		0.0, 0.0, 1.0);
+	cv::Mat dist_coeffs = (cv::Mat_<double>(1, 5) << -0.12, 0.025, 0.0005, -0.0003, -0.002);
+
+	// Camera poses around a driver seat, looking forward and down at the markers
+	CameraPose poses[3];
+	poses[0] = CameraPose();
+	poses[0].x_pos = 40; poses[0].y_pos = -150; poses[0].z_pos = 120;
+	poses[0].roll_angle = 0; poses[0].pitch_angle = -20; poses[0].yaw_angle = 0;
+	poses[1] = poses[0];
+	poses[1].x_pos = -30; poses[1].roll_angle = 3; poses[1].pitch_angle = -25; poses[1].yaw_angle = 10;
+	poses[2] = poses[0];
+	poses[2].z_pos = 160; poses[2].roll_angle = -2; poses[2].pitch_angle = -15; poses[2].yaw_angle = -4;
+
+	// Markers on a grid in front of the camera, in meters like the marker index. Every third marker is on a 0.5 m
+	// stand, so the solve also covers a board that is not flat.
+	std::vector<cv::Point3f> world_points;
+	for (int row = 0; row < marker_rows; row++) {
+		for (int col = 0; col < marker_cols; col++) {
+			float z = ((row * marker_cols + col) % 3 == 2) ? 0.5f : 0.0f;
+			cv::Point3f p(-1.0f + col * 0.6f, 1.0f + row * 1.0f, z);
+			world_points.push_back(p);
+			world_points.push_back(cv::Point3f(p.x, p.y + MARKER_DEFAULT_SIZE_M, z));
+			world_points.push_back(cv::Point3f(p.x + MARKER_DEFAULT_SIZE_M, p.y + MARKER_DEFAULT_SIZE_M, z));
+			world_points.push_back(cv::Point3f(p.x + MARKER_DEFAULT_SIZE_M, p.y, z));
+		}
+	}
+	std::vector<cv::Point3f> object_points(world_points.size());
+	for (size_t i = 0; i < world_points.size(); i++) {
+		object_points[i] = world_points[i] * 100.0f;
+	}
+
+	std::mt19937 rng(11);
+	std::normal_distribution<float> noise(0.0f, 0.3f);
+	std::uniform_real_distribution<float> outlier_offset(40.0f, 120.0f);
+
+	PoseEstimator estimator;
+	int failures = 0;
+
+	printf("pose | corners | solve ms | inliers  inlier RMS | position error cm  angle error deg\n");
+	for (int p = 0; p < 3; p++) {
+		cv::Mat rvec, tvec;
+		PoseEstimator::extrinsics_from_pose(poses[p], rvec, tvec);
+
+		std::vector<cv::Point2f> img_points;
+		cv::projectPoints(object_points, rvec, tvec, camera_intrinsic, dist_coeffs, img_points);
+
+		// Whole markers are misplaced, like a marker detected under the wrong id
+		int marker_count = (int)world_points.size() / 4;
+		int outlier_count = (int)(marker_count * outlier_fraction);
+		for (size_t i = 0; i < img_points.size(); i++) {
+			img_points[i] += cv::Point2f(noise(rng), noise(rng));
+		}
+		for (int m = 0; m < outlier_count; m++) {
+			int marker = (m * 13 + 5) % marker_count;
+			cv::Point2f offset(outlier_offset(rng), outlier_offset(rng));
+			for (int c = 0; c < 4; c++) {
+				img_points[marker * 4 + c] += offset;
+			}
+		}
+
+		PoseSolution solution;
+		int status = POSE_SUCCESS;
+		Stopwatch timer;
+		for (int r = 0; r < repeats; r++) {
+			status = estimator.solve(img_points, world_points, camera_intrinsic, dist_coeffs, solution);
+		}
+		double solve_ms = timer.elapsed_ms() / repeats;
+
+		if (status != POSE_SUCCESS) {
+			printf("%4d | no solution (%d)\n", p, status);
+			failures++;
+			continue;
+		}
+
+		const CameraPose& solved = solution.pose;
+		double position_error = std::sqrt(std::pow(solved.x_pos - poses[p].x_pos, 2) +
+			std::pow(solved.y_pos - poses[p].y_pos, 2) + std::pow(solved.z_pos - poses[p].z_pos, 2));
+		double angle_error = std::max(std::abs(solved.roll_angle - poses[p].roll_angle),
+			std::max(std::abs(solved.pitch_angle - poses[p].pitch_angle), std::abs(solved.yaw_angle - poses[p].yaw_angle)));
+
+		printf("%4d | %7d | %8.3f | %3d/%-3d %8.3f px | %17.3f  %15.3f\n", p, (int)img_points.size(), solve_ms,
+			solution.inlier_count, (int)img_points.size(), solution.inlier_rms, position_error, angle_error);
+
+		if (position_error > 2.0 || angle_error > 0.2 || solution.inlier_count != (int)img_points.size() - outlier_count * 4) {
+			failures++;
+		}
+	}
+
+	if (failures > 0) {
+		printf("Pose estimator failed for %d poses\n", failures);
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,227 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "Benchmark.h"
+#include "GroundProjector.h"
+
+/**
+* Per point implementation of CameraProfile::img_to_world_transform used before GroundProjector, kept here as the
+* reference the batched kernel is checked and timed against.
+*/
+static std::vector<cv::Point2f> legacy_img_to_world_transform(const cv::Mat& camera_intrinsic, float focal_length_mm,
+	const std::vector<cv::Point2f>& img_points, const CameraPose& camera_pose) {
+
+	cv::Mat cam_translation = (cv::Mat_<double>(3, 1) << camera_pose.x_pos, camera_pose.y_pos, camera_pose.z_pos);
+	cv::Mat cam_rotation = (cv::Mat_<double>(3, 3) << 1., 0., 0.,
+		0., 0., -1.,
+		0., 1., 0.);
+
+	cv::Mat yaw_matrix = cv::getRotationMatrix2D(cv::Point2f(camera_pose.x_pos, camera_pose.y_pos), camera_pose.yaw_angle, 1.0);
+
+	std::vector<cv::Point2f> world_points(img_points.size());
+	for (size_t i = 0; i < img_points.size(); i++) {
+
+		cv::Mat img_pixel = (cv::Mat_<double>(3, 1) << img_points[i].x, img_points[i].y, 1);
+
+		cv::Mat r = (camera_intrinsic.inv() * img_pixel);
+
+		cv::Mat r_scaled = r * (focal_length_mm / 10.f);
+
+		cv::Mat world_coord = cam_rotation * r_scaled + cam_translation;
+
+		float s = (cam_translation.at<double>(2, 0)) / (world_coord.at<double>(2, 0) - cam_translation.at<double>(2, 0));
+
+		cv::Mat intercept = (cv::Mat_<double>(3, 1) <<
+			(world_coord.at<double>(0, 0) - cam_translation.at<double>(0, 0)) * s + cam_translation.at<double>(0, 0),
+			-1 * (world_coord.at<double>(1, 0) - cam_translation.at<double>(1, 0)) * s + cam_translation.at<double>(1, 0), 1.0);
+
+		cv::Mat ground_point = yaw_matrix * intercept;
+
+		world_points[i].x = (float)ground_point.at<double>(0, 0);
+		world_points[i].y = (float)ground_point.at<double>(1, 0);
+	}
+
+	return world_points;
+}
+
+/**
+* Projects ground points into the image of a tilted and rolled camera with cv::projectPoints and back onto the ground
+* with GroundProjector. The camera axes are built here from the viewing direction, independently of the rotation
+* GroundProjector composes, so the round trip checks the pose model.
+*
+* @param camera_intrinsic 3x3 camera intrinsic matrix
+*
+* @return 0 if every point comes back where it started
+*/
+static int tilted_round_trip(const cv::Mat& camera_intrinsic) {
+	CameraPose camera_pose;
+	camera_pose.x_pos = 135.0;
+	camera_pose.y_pos = -37.5;
+	camera_pose.z_pos = 120.0;
+	camera_pose.roll_angle = 4.0;
+	camera_pose.pitch_angle = -15.0;
+	camera_pose.yaw_angle = 30.0;
+
+	const double roll = camera_pose.roll_angle * CV_PI / 180;
+	const double pitch = camera_pose.pitch_angle * CV_PI / 180;
+	const double yaw = camera_pose.yaw_angle * CV_PI / 180;
+
+	// Viewing direction, and the right and up directions of the camera before it is rolled
+	cv::Vec3d forward(sin(yaw) * cos(pitch), cos(yaw) * cos(pitch), sin(pitch));
+	cv::Vec3d level_right(cos(yaw), -sin(yaw), 0);
+	cv::Vec3d level_up(-sin(yaw) * sin(pitch), -cos(yaw) * sin(pitch), cos(pitch));
+
+	// Rolling turns the top of the camera towards its right
+	cv::Vec3d right = cos(roll) * level_right - sin(roll) * level_up;
+	cv::Vec3d up = cos(roll) * level_up + sin(roll) * level_right;
+
+	// Rows are the camera axes in world coordinates: x right, y down, z forward
+	cv::Matx33d world_to_camera(
+		right[0], right[1], right[2],
+		-up[0], -up[1], -up[2],
+		forward[0], forward[1], forward[2]);
+	cv::Vec3d position(camera_pose.x_pos, camera_pose.y_pos, camera_pose.z_pos);
+
+	cv::Mat rvec;
+	cv::Rodrigues(world_to_camera, rvec);
+	cv::Mat tvec(-(world_to_camera * position));
+
+	std::mt19937 rng(7);
+	std::uniform_real_distribution<float> offset(-400.0f, 400.0f);
+	std::vector<cv::Point3f> ground_points;
+	while (ground_points.size() < 10000) {
+		cv::Point3f point((float)camera_pose.x_pos + offset(rng), (float)camera_pose.y_pos + offset(rng), 0.0f);
+		cv::Vec3d in_camera = world_to_camera * (cv::Vec3d(point.x, point.y, point.z) - position);
+		if (in_camera[2] > 50) {
+			ground_points.push_back(point);
+		}
+	}
+
+	std::vector<cv::Point2f> img_points;
+	cv::projectPoints(ground_points, rvec, tvec, camera_intrinsic, cv::noArray(), img_points);
+
+	std::vector<cv::Point2f> projected;
+	GroundProjector(camera_intrinsic, camera_pose).project(img_points, projected);
+
+	double max_error = 0;
+	for (size_t i = 0; i < ground_points.size(); i++) {
+		max_error = std::max<double>(max_error, std::max<double>(fabs(projected[i].x - ground_points[i].x),
+			fabs(projected[i].y - ground_points[i].y)));
+	}
+
+	printf("tilted camera (roll %.0f, pitch %.0f, yaw %.0f deg): max round trip error %.2e cm\n",
+		camera_pose.roll_angle, camera_pose.pitch_angle, camera_pose.yaw_angle, max_error);
+
+	if (max_error > 0.05) {
+		printf("Ground projection of a tilted camera does not invert projectPoints\n");
+		return 1;
+	}
+	return 0;
+}
+
+/**
+* Compares the legacy per point projection against GroundProjector for 1k, 100k and 10M points
+*/
+int run_projection_benchmark() {
+	// 12 MP camera looking at the ground from roughly the driver's eye point
+	const int img_width = 4000;
+	const int img_height = 3000;
+	cv::Mat camera_intrinsic = (cv::Mat_<double>(3, 3) <<
+		3100., 0., img_width / 2.,
+		0., 3100., img_height / 2.,
+		0., 0., 1.);
+	const float focal_length_mm = 6.8f;
+
+	CameraPose camera_pose;
+	camera_pose.x_pos = 135.0;
+	camera_pose.y_pos = -37.5;
+	camera_pose.z_pos = 120.0;
+	camera_pose.roll_angle = 0.0;
+	camera_pose.pitch_angle = 0.0;
+	camera_pose.yaw_angle = 30.0;
+
+	const size_t point_counts[] = { 1000, 100000, 10000000 };
+
+	int result = 0;
+	std::mt19937 rng(42);
+
+	// Only pixels below the horizon intersect the ground in front of the camera
+	std::uniform_real_distribution<float> u_dist(0.0f, (float)img_width);
+	std::uniform_real_distribution<float> v_dist(img_height / 2.0f + 50.0f, (float)img_height);
+
+	for (size_t count : point_counts) {
+		std::vector<cv::Point2f> img_points(count);
+		for (size_t i = 0; i < count; i++) {
+			img_points[i] = cv::Point2f(u_dist(rng), v_dist(rng));
+		}
+
+		Stopwatch timer;
+		std::vector<cv::Point2f> legacy = legacy_img_to_world_transform(camera_intrinsic, focal_length_mm, img_points, camera_pose);
+		double legacy_ms = timer.elapsed_ms();
+
+		std::vector<cv::Point2f> batched;
+		timer.reset();
+		GroundProjector projector(camera_intrinsic, camera_pose);
+		projector.project(img_points, batched);
+		double batched_ms = timer.elapsed_ms();
+
+		// Separate u/v arrays, which is the layout the kernel is written for
+		std::vector<float> u(count), v(count), x(count), y(count);
+		for (size_t i = 0; i < count; i++) {
+			u[i] = img_points[i].x;
+			v[i] = img_points[i].y;
+		}
+		timer.reset();
+		projector.project(u.data(), v.data(), x.data(), y.data(), count);
+		double soa_ms = timer.elapsed_ms();
+
+		// Results are in cm, the legacy path rounds the intersection parameter to float so allow for that
+		double max_error = 0;
+		size_t mismatches = 0;
+		for (size_t i = 0; i < count; i++) {
+			double tolerance = 1e-3 + 1e-5 * (fabs(legacy[i].x) + fabs(legacy[i].y));
+			double error = std::max<double>(fabs(legacy[i].x - batched[i].x), fabs(legacy[i].y - batched[i].y));
+			error = std::max<double>(error, std::max<double>(fabs(legacy[i].x - x[i]), fabs(legacy[i].y - y[i])));
+			max_error = std::max(max_error, error);
+			if (error > tolerance) {
+				mismatches++;
+			}
+		}
+
+		printf("%9zu points: legacy %10.2f ms | batched %8.2f ms (%6.1fx) | soa %8.2f ms (%6.1fx, %6.1f M points/s) | max error %.2e cm\n",
+			count, legacy_ms,
+			batched_ms, legacy_ms / batched_ms,
+			soa_ms, legacy_ms / soa_ms, count / (soa_ms * 1000),
+			max_error);
+
+		if (mismatches > 0) {
+			printf("%zu of %zu points do not match the legacy projection\n", mismatches, count);
+			result = 1;
+		}
+	}
+
+	if (tilted_round_trip(camera_intrinsic) != 0) {
+		result = 1;
+	}
+
+	return result;
+}
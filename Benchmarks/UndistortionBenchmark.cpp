@@ -0,0 +1,189 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+#include <opencv2/calib3d.hpp>
+#include "Benchmark.h"
+#include "CameraProfile.h"
+
+/**
+* Markerless projection with the lens distortion removed by calling cv::undistortPoints on every point and
+* projecting the normalized rays, the way the commented out code in the painter would have done it
+*/
+static void legacy_project_undistorted(const std::vector<cv::Point2f>& img_points, const cv::Mat& camera_matrix,
+	const cv::Mat& dist_coeffs, const GroundProjector& projector, std::vector<cv::Point2f>& world_points) {
+	std::vector<float> ray_x(img_points.size());
+	std::vector<float> ray_y(img_points.size());
+	std::vector<float> x(img_points.size());
+	std::vector<float> y(img_points.size());
+
+	std::vector<cv::Point2f> point(1);
+	std::vector<cv::Point2f> ray(1);
+	for (size_t i = 0; i < img_points.size(); i++) {
+		point[0] = img_points[i];
+		cv::undistortPoints(point, ray, camera_matrix, dist_coeffs);
+		ray_x[i] = ray[0].x;
+		ray_y[i] = ray[0].y;
+	}
+
+	projector.project_rays(ray_x.data(), ray_y.data(), x.data(), y.data(), img_points.size());
+
+	world_points.resize(img_points.size());
+	for (size_t i = 0; i < img_points.size(); i++) {
+		world_points[i] = cv::Point2f(x[i], y[i]);
+	}
+}
+
+/**
+* Writes a wide angle camera profile the benchmark can load, so the table is cached next to it like a real one
+*/
+static void write_wide_angle_profile(const char* path, const cv::Mat& camera_matrix, const cv::Mat& dist_coeffs,
+	cv::Size image_size) {
+	cv::FileStorage outfile(path, cv::FileStorage::WRITE);
+	outfile << "device" << "benchmark";
+	outfile << "profile_descriptor" << "wide angle";
+	outfile << "camera_matrix" << camera_matrix;
+	outfile << "dist_coeffs" << dist_coeffs;
+	outfile << "zoom_level" << 0.5f;
+	outfile << "focal_length_mm" << 2.2f;
+	outfile << "image_size" << image_size;
+}
+
+/**
+* Projects 200k points of a wide angle image onto the ground with the undistortion table, and compares the time
+* and result with undistorting every point with cv::undistortPoints and with ignoring the distortion
+*/
+int run_undistortion_benchmark() {
+	const size_t point_count = 200000;
+	const char* profile_path = "undistortion_benchmark.ocp";
+	const cv::Size image_size(4000, 3000);
+
+	cv::Mat camera_matrix = (cv::Mat_<double>(3, 3) <<
+		2000.0, 0.0, 2010.5,
+		0.0, 2000.0, 1495.5,
+		0.0, 0.0, 1.0);
+	cv::Mat dist_coeffs = (cv::Mat_<double>(1, 5) << -0.12, 0.025, 0.0005, -0.0003, -0.002);
+
+	write_wide_angle_profile(profile_path, camera_matrix, dist_coeffs, image_size);
+
+	CameraProfile profile;
+	profile.load_profile(profile_path);
+	std::string lut_path = profile.get_lut_path();
+	remove(lut_path.c_str());
+
+	Stopwatch timer;
+	std::shared_ptr<const UndistortionLut> lut = profile.get_undistortion_lut();
+	double build_ms = timer.elapsed_ms();
+
+	if (!lut) {
+		printf("No undistortion table was built\n");
+		return 1;
+	}
+
+	// A second profile loaded from the same file reads the cached table
+	CameraProfile cached_profile;
+	cached_profile.load_profile(profile_path);
+	timer.reset();
+	std::shared_ptr<const UndistortionLut> cached_lut = cached_profile.get_undistortion_lut();
+	double load_ms = timer.elapsed_ms();
+
+	printf("table of %d x %d pixels every %d pixels: built in %.2f ms, loaded from cache in %.2f ms\n",
+		image_size.width, image_size.height, lut->get_step(), build_ms, load_ms);
+
+	// Points below the horizon, the only ones that hit the ground
+	std::mt19937 rng(11);
+	std::uniform_real_distribution<float> u_dist(0.0f, (float)image_size.width);
+	std::uniform_real_distribution<float> v_dist(1700.0f, (float)image_size.height);
+
+	std::vector<cv::Point2f> img_points(point_count);
+	for (size_t i = 0; i < point_count; i++) {
+		img_points[i] = cv::Point2f(u_dist(rng), v_dist(rng));
+	}
+
+	CameraPose pose = CameraPose();
+	pose.x_pos = 50;
+	pose.y_pos = -80;
+	pose.z_pos = 120;
+	pose.yaw_angle = 15;
+
+	GroundProjector distorted_projector(camera_matrix, pose);
+	GroundProjector lut_projector = profile.get_ground_projector(pose);
+
+	std::vector<cv::Point2f> distorted(point_count);
+	std::vector<cv::Point2f> with_lut(point_count);
+	std::vector<cv::Point2f> legacy;
+
+	timer.reset();
+	distorted_projector.project(img_points.data(), distorted.data(), point_count);
+	double distorted_ms = timer.elapsed_ms();
+
+	timer.reset();
+	lut_projector.project(img_points.data(), with_lut.data(), point_count);
+	double lut_ms = timer.elapsed_ms();
+
+	timer.reset();
+	legacy_project_undistorted(img_points, camera_matrix, dist_coeffs, distorted_projector, legacy);
+	double legacy_ms = timer.elapsed_ms();
+
+	printf("%d points\n", (int)point_count);
+	printf("  distortion ignored     %8.2f ms\n", distorted_ms);
+	printf("  undistortion table     %8.2f ms\n", lut_ms);
+	printf("  undistortPoints/point  %8.2f ms\n", legacy_ms);
+
+	double max_shift = 0;
+	double max_world_error = 0;
+	for (size_t i = 0; i < point_count; i++) {
+		max_shift = std::fmax(max_shift, cv::norm(with_lut[i] - distorted[i]));
+		max_world_error = std::fmax(max_world_error, cv::norm(with_lut[i] - legacy[i]));
+	}
+	printf("ignoring the distortion moves points up to %.1f cm, table and undistortPoints differ by up to %.3f cm\n",
+		max_shift, max_world_error);
+
+	// Reference rays, converged far past the default 5 iterations
+	std::vector<cv::Point2f> reference;
+	cv::undistortPoints(img_points, reference, camera_matrix, dist_coeffs, cv::noArray(), cv::noArray(),
+		cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-12));
+
+	std::vector<cv::Point2f> rays(point_count);
+	lut->lookup(img_points.data(), rays.data(), point_count);
+
+	std::vector<cv::Point2f> cached_rays(point_count);
+	cached_lut->lookup(img_points.data(), cached_rays.data(), point_count);
+
+	double max_ray_error = 0;
+	double max_cache_error = 0;
+	for (size_t i = 0; i < point_count; i++) {
+		max_ray_error = std::fmax(max_ray_error, cv::norm(rays[i] - reference[i]));
+		max_cache_error = std::fmax(max_cache_error, cv::norm(rays[i] - cached_rays[i]));
+	}
+
+	// Rays are in focal lengths, so this is the error in undistorted pixels
+	double max_pixel_error = max_ray_error * camera_matrix.at<double>(0, 0);
+	printf("max table error %.4f px, cached table difference %.7f\n", max_pixel_error, max_cache_error);
+
+	remove(profile_path);
+	remove(lut_path.c_str());
+
+	if (max_pixel_error > 0.05 || max_cache_error != 0) {
+		printf("Undistortion table does not match undistortPoints\n");
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,186 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "pch.h"
+#include "CppUnitTest.h"
+#include <cmath>
+#include <random>
+#include <vector>
+#include "../pgrid/CoordinateFrames.h"
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+// Fixed transforms compose and invert at compile time
+static_assert(scene_to_uv(4000, 3000).apply_x(0, 0) == 2000, "scene origin is the image center");
+static_assert(scene_to_uv(4000, 3000).apply_y(0, 1500) == 0, "scene y is up");
+static_assert(uv_to_scene(4000, 3000).apply_y(0, 0) == 1500, "uv origin is the top left corner");
+static_assert((uv_to_scene(4000, 3000) * scene_to_uv(4000, 3000)).xx == 1, "round trip is the identity");
+static_assert((uv_to_scene(4000, 3000) * scene_to_uv(4000, 3000)).x0 == 0, "round trip is the identity");
+
+namespace UnitTesting
+{
+	// Image sizes of the supported cameras, and odd sizes where the center is rounded down
+	static const int image_sizes[][2] = { { 4080, 3072 }, { 4032, 3024 }, { 1920, 1080 }, { 1001, 777 }, { 1, 1 } };
+
+	TEST_CLASS(CoordinateFramesTest) {
+
+	public:
+
+		TEST_METHOD(scene_to_uv_matches_image_layout) {
+			for (const int* size : image_sizes) {
+				Affine2D<SceneFrame, UvFrame> to_uv = scene_to_uv(size[0], size[1]);
+
+				// The scene origin is the image center and scene y points up
+				Assert::AreEqual((double)(size[0] / 2), to_uv.apply_x(0, 0));
+				Assert::AreEqual((double)(size[1] / 2), to_uv.apply_y(0, 0));
+				Assert::AreEqual((double)(size[1] / 2 - 10), to_uv.apply_y(0, 10));
+			}
+		}
+
+		TEST_METHOD(uv_to_scene_is_inverse_of_scene_to_uv) {
+			for (const int* size : image_sizes) {
+				Affine2D<UvFrame, SceneFrame> to_scene = uv_to_scene(size[0], size[1]);
+
+				// v grows down from the top of the image, scene y grows up from the center
+				Assert::AreEqual(-(double)(size[0] / 2), to_scene.apply_x(0, 0));
+				Assert::AreEqual((double)(size[1] / 2), to_scene.apply_y(0, 0));
+				Assert::AreEqual((double)(size[1] / 2 - 25), to_scene.apply_y(0, 25));
+			}
+		}
+
+		TEST_METHOD(round_trip_is_exact_on_pixel_lattice) {
+			std::mt19937 rng(1);
+
+			for (const int* size : image_sizes) {
+				std::uniform_int_distribution<int> u(0, 2 * size[0]);
+				std::uniform_int_distribution<int> v(0, 2 * size[1]);
+
+				// Pixel corners and centers, every one of them is representable exactly
+				std::vector<cv::Point2f> uv_points(1000);
+				for (size_t i = 0; i < uv_points.size(); i++) {
+					uv_points[i] = cv::Point2f(u(rng) * 0.5f, v(rng) * 0.5f);
+				}
+
+				std::vector<cv::Point2f> points = uv_points;
+				uv_to_scene(size[0], size[1]).apply(points);
+				scene_to_uv(size[0], size[1]).apply(points);
+
+				for (size_t i = 0; i < points.size(); i++) {
+					Assert::AreEqual(uv_points[i].x, points[i].x);
+					Assert::AreEqual(uv_points[i].y, points[i].y);
+				}
+			}
+		}
+
+		TEST_METHOD(round_trip_is_within_float_precision) {
+			std::mt19937 rng(2);
+
+			for (const int* size : image_sizes) {
+				std::uniform_real_distribution<float> x(-(float)size[0], (float)size[0]);
+				std::uniform_real_distribution<float> y(-(float)size[1], (float)size[1]);
+
+				std::vector<cv::Point2f> scene_points(1000);
+				for (size_t i = 0; i < scene_points.size(); i++) {
+					scene_points[i] = cv::Point2f(x(rng), y(rng));
+				}
+
+				std::vector<cv::Point2f> points = scene_points;
+				scene_to_uv(size[0], size[1]).apply(points);
+				uv_to_scene(size[0], size[1]).apply(points);
+
+				// One rounding per step, at the magnitude of the image size
+				float tolerance = 4 * std::ldexp(1.0f, -23) * (float)(size[0] + size[1]);
+				for (size_t i = 0; i < points.size(); i++) {
+					Assert::AreEqual(scene_points[i].x, points[i].x, tolerance);
+					Assert::AreEqual(scene_points[i].y, points[i].y, tolerance);
+				}
+			}
+		}
+
+		TEST_METHOD(array_apply_matches_point_apply) {
+			std::mt19937 rng(3);
+			std::uniform_real_distribution<float> coord(-5000.0f, 5000.0f);
+
+			Affine2D<MouseFrame, SceneFrame> to_scene = mouse_to_scene(120, 40, 810, 628, 0.35, -210, 75);
+
+			std::vector<cv::Point2f> mouse_points(257);
+			for (size_t i = 0; i < mouse_points.size(); i++) {
+				mouse_points[i] = cv::Point2f(coord(rng), coord(rng));
+			}
+
+			std::vector<cv::Point2f> points = mouse_points;
+			to_scene.apply(points);
+
+			for (size_t i = 0; i < points.size(); i++) {
+				cv::Point2d expected = to_scene.apply(cv::Point2d(mouse_points[i].x, mouse_points[i].y));
+				Assert::AreEqual(expected.x, (double)points[i].x, 1e-2);
+				Assert::AreEqual(expected.y, (double)points[i].y, 1e-2);
+			}
+		}
+
+		TEST_METHOD(mouse_to_scene_matches_panel_layout) {
+			// Center of the panel is the pan position, y is flipped and scaled by the zoom
+			Affine2D<MouseFrame, SceneFrame> to_scene = mouse_to_scene(100, 50, 800, 600, 2, 30, 40);
+
+			Assert::AreEqual(30.0, to_scene.apply_x(500, 350), 1e-9);
+			Assert::AreEqual(-40.0, to_scene.apply_y(500, 350), 1e-9);
+			Assert::AreEqual(35.0, to_scene.apply_x(510, 350), 1e-9);
+			Assert::AreEqual(-45.0, to_scene.apply_y(500, 360), 1e-9);
+		}
+
+		TEST_METHOD(mouse_to_scene_odd_panel_size) {
+			// The panel size is a float, so the center of a panel with an odd width or height is at a half pixel
+			float width = 801;
+			float height = 601;
+			Affine2D<MouseFrame, SceneFrame> to_scene = mouse_to_scene(100, 50, width + 10, height + 28, 2, 30, 40);
+
+			double mx = 517;
+			double my = 363;
+			Assert::AreEqual(((mx - 100) - (width + 10) / 2) / 2 + 30, to_scene.apply_x(mx, my), 1e-9);
+			Assert::AreEqual(-1 * ((my - 50) - (height + 28) / 2) / 2 - 40, to_scene.apply_y(mx, my), 1e-9);
+		}
+
+		TEST_METHOD(compose_and_invert) {
+			std::mt19937 rng(4);
+			std::uniform_real_distribution<double> coord(-1000.0, 1000.0);
+
+			Affine2D<MouseFrame, SceneFrame> mouse_scene = mouse_to_scene(12, 34, 640, 480, 1.7, 55, -20);
+			Affine2D<SceneFrame, UvFrame> scene_uv = scene_to_uv(4032, 3024);
+			Affine2D<MouseFrame, UvFrame> mouse_uv = scene_uv * mouse_scene;
+			Affine2D<UvFrame, MouseFrame> uv_mouse = mouse_uv.inverse();
+
+			for (int i = 0; i < 1000; i++) {
+				cv::Point2d mouse(coord(rng), coord(rng));
+				cv::Point2d uv = mouse_uv.apply(mouse);
+				cv::Point2d expected = scene_uv.apply(mouse_scene.apply(mouse));
+				cv::Point2d back = uv_mouse.apply(uv);
+
+				Assert::AreEqual(expected.x, uv.x, 1e-9);
+				Assert::AreEqual(expected.y, uv.y, 1e-9);
+				Assert::AreEqual(mouse.x, back.x, 1e-9);
+				Assert::AreEqual(mouse.y, back.y, 1e-9);
+			}
+		}
+
+		TEST_METHOD(ortho_to_world_scales_to_meters) {
+			Affine2D<OrthoFrame, WorldFrame> to_world = ortho_to_world(-120, 80);
+
+			Assert::AreEqual(1.2, to_world.apply_x(0, 0), 1e-12);
+			Assert::AreEqual(-0.8, to_world.apply_y(0, 0), 1e-12);
+			Assert::AreEqual(2.2, to_world.apply_x(100, 0), 1e-12);
+		}
+	};
+}
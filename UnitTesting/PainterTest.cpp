@@ -42,12 +42,13 @@ namespace UnitTesting
 		}
 		TEST_METHOD(add_point) {
 
+			// Value initialized, so there is no grid or camera and the new points are not projected
 			SessionConfig* config = new SessionConfig;
 
-			config->app_config = new ApplicationConfig;
-			config->grid_config = new GridConfig;
-			config->img_config = new ImageConfig;
-			config->measurement_config = new MeasurementConfig;
+			config->app_config = new ApplicationConfig();
+			config->grid_config = new GridConfig();
+			config->img_config = new ImageConfig();
+			config->measurement_config = new MeasurementConfig();
 			config->ortho_view_config = new ViewConfig;
 			config->perspective_view_config = new ViewConfig;
 			config->paint_config = new PainterConfig;
@@ -76,8 +77,13 @@ namespace UnitTesting
 
 		}
 		TEST_METHOD(add_point_at_click) {
+			// Value initialized, so there is no grid or camera and the new points are not projected
 			SessionConfig* config = new SessionConfig;
 
+			config->app_config = new ApplicationConfig();
+			config->grid_config = new GridConfig();
+			config->img_config = new ImageConfig();
+			config->measurement_config = new MeasurementConfig();
 			config->paint_config = new PainterConfig;
 
 			Painter painter(config);
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+
+#define BATCH_SUCCESS 0
+#define BATCH_USAGE_ERROR 1
+#define BATCH_FILE_ERROR 2
+#define BATCH_PROCESSING_ERROR 3
+
+typedef int (*BatchCommandFunction)(int argc, char** argv);
+
+int run_project_command(int argc, char** argv);
+
+int run_calibrate_command(int argc, char** argv);
+
+int run_homography_command(int argc, char** argv);
+
+int run_pose_command(int argc, char** argv);
+
+int run_compile_markers_command(int argc, char** argv);
+
+std::string resolve_path(const std::string& base_dir, const std::string& path);
+
+std::string parent_dir(const std::string& path);
+
+std::string file_stem(const std::string& path);
+
+bool make_dir(const std::string& path);
@@ -0,0 +1,134 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+#include "BatchCommands.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+typedef struct {
+	const char* name;
+	BatchCommandFunction run;
+	const char* description;
+} BatchCommand;
+
+static const BatchCommand commands[] = {
+	{ "project", run_project_command, "Project the annotated points of every image in a manifest onto the ground plane (markerless mode)" },
+	{ "calibrate", run_calibrate_command, "Calibrate a camera from a directory of checkerboard images and write a camera profile" },
+	{ "solve-homography", run_homography_command, "Solve the grid homography of a set of reference points and report the residual of every point" },
+	{ "estimate-pose", run_pose_command, "Solve the camera pose of every image from the ArUco markers in it and write a pose file per image" },
+	{ "compile-markers", run_compile_markers_command, "Convert a text marker index to the binary format pgrid maps into memory" },
+};
+
+/**
+* Resolves a path from a manifest relative to the directory of the manifest
+*
+* @param base_dir directory relative paths are resolved against. Empty for the working directory.
+* @param path path as written in the manifest
+*
+* @return path that can be opened from the working directory
+*/
+std::string resolve_path(const std::string& base_dir, const std::string& path) {
+	bool absolute = (!path.empty() && (path[0] == '/' || path[0] == '\\')) ||
+		(path.size() > 1 && path[1] == ':');
+
+	if (absolute || base_dir.empty()) {
+		return path;
+	}
+	return base_dir + "/" + path;
+}
+
+/**
+* Get the directory part of a path
+*
+* @param path file path
+*
+* @return everything before the last / or \, or an empty string if there is none
+*/
+std::string parent_dir(const std::string& path) {
+	size_t last_slash = path.find_last_of("/\\");
+	if (last_slash == std::string::npos) {
+		return "";
+	}
+	return path.substr(0, last_slash);
+}
+
+/**
+* Get the file name of a path without the directory and extension
+*
+* @param path file path
+*
+* @return file name without extension
+*/
+std::string file_stem(const std::string& path) {
+	std::string base_file = path.substr(path.find_last_of("/\\") + 1);
+	return base_file.substr(0, base_file.find_last_of("."));
+}
+
+/**
+* Creates a directory if it does not exist yet. Parent directories are not created.
+*
+* @param path directory to create
+*
+* @return true if the directory exists afterwards
+*/
+bool make_dir(const std::string& path) {
+	struct stat buffer;
+	if (stat(path.c_str(), &buffer) == 0) {
+		return (buffer.st_mode & S_IFDIR) != 0;
+	}
+#ifdef _WIN32
+	return _mkdir(path.c_str()) == 0;
+#else
+	return mkdir(path.c_str(), 0755) == 0;
+#endif
+}
+
+/**
+* Prints the list of commands
+*/
+static void print_usage() {
+	printf("usage: pgrid-batch <command> [options]\n\ncommands:\n");
+	for (const BatchCommand& command : commands) {
+		printf("  %-20s %s\n", command.name, command.description);
+	}
+	printf("\nRun pgrid-batch <command> --help for the options of a command.\n");
+}
+
+/**
+* Headless entry point for processing whole vehicle studies without the GUI, e.g. pgrid-batch project study.yml
+*/
+int main(int argc, char** argv) {
+	if (argc < 2 || strcmp(argv[1], "--help") == 0 || strcmp(argv[1], "-h") == 0) {
+		print_usage();
+		return argc < 2 ? BATCH_USAGE_ERROR : BATCH_SUCCESS;
+	}
+
+	for (const BatchCommand& command : commands) {
+		if (strcmp(argv[1], command.name) == 0) {
+			// Commands get their own arguments with the command name in argv[0]
+			return command.run(argc - 1, argv + 1);
+		}
+	}
+
+	printf("Error: unknown command %s\n\n", argv[1]);
+	print_usage();
+	return BATCH_USAGE_ERROR;
+}
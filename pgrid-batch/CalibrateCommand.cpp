@@ -0,0 +1,156 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <opencv2/core.hpp>
+#include "BatchCommands.h"
+#include "CameraProfile.h"
+
+/**
+* Prints the options of the calibrate command
+*/
+static void print_calibrate_usage() {
+	printf("usage: pgrid-batch calibrate <image_dir> <board_width> <board_height> <profile.ocp> [options]\n\n");
+	printf("  board_width, board_height   number of inner corners of the checkerboard\n");
+	printf("  --threads N                 number of images processed at once (default: one per hardware thread)\n");
+	printf("  --device NAME               device name written to the profile, e.g. \"Pixel 6 Pro\"\n");
+	printf("  --descriptor NAME           profile descriptor written to the profile\n");
+	printf("  --zoom Z                    camera zoom level written to the profile\n");
+	printf("  --focal-length MM           focal length in mm written to the profile\n");
+	printf("  --max-error PX              drop views with a reprojection error above PX pixels and solve again\n");
+}
+
+/**
+* Calibrates a camera from a directory of checkerboard images and writes the camera profile, without the GUI.
+* The reprojection error of every image is printed and saved in the profile.
+*
+* @param argc number of arguments, including the command name
+* @param argv arguments
+*
+* @return BATCH_SUCCESS if the profile was written
+*/
+int run_calibrate_command(int argc, char** argv) {
+	std::vector<const char*> positional;
+	size_t thread_count = 0;
+	double max_error = -1;
+	CameraProfile camera_profile;
+	*camera_profile.get_zoom_level_ptr() = 1.0f;
+	*camera_profile.get_focal_length_ptr() = 0.0f;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_calibrate_usage();
+			return BATCH_SUCCESS;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			thread_count = (size_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+			*camera_profile.get_device_ptr() = argv[++i];
+		}
+		else if (strcmp(argv[i], "--descriptor") == 0 && i + 1 < argc) {
+			*camera_profile.get_profile_descriptor_ptr() = argv[++i];
+		}
+		else if (strcmp(argv[i], "--zoom") == 0 && i + 1 < argc) {
+			*camera_profile.get_zoom_level_ptr() = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--focal-length") == 0 && i + 1 < argc) {
+			*camera_profile.get_focal_length_ptr() = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max-error") == 0 && i + 1 < argc) {
+			max_error = atof(argv[++i]);
+		}
+		else if (argv[i][0] != '-' && positional.size() < 4) {
+			positional.push_back(argv[i]);
+		}
+		else {
+			printf("Error: unexpected argument %s\n\n", argv[i]);
+			print_calibrate_usage();
+			return BATCH_USAGE_ERROR;
+		}
+	}
+
+	if (positional.size() != 4) {
+		print_calibrate_usage();
+		return BATCH_USAGE_ERROR;
+	}
+
+	std::string image_dir = positional[0];
+	cv::Size board_dims(atoi(positional[1]), atoi(positional[2]));
+	std::string profile_path = positional[3];
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	int status = camera_profile.calibrate(image_dir, board_dims,
+		[](int images_done, int image_count, const CalibrationView& view) {
+			printf("[%d/%d] %s%s\n", images_done, image_count, view.image_path.c_str(),
+				view.found ? "" : " (checkerboard not found)");
+		},
+		thread_count);
+
+	if (status == CALIBRATION_INVALID_BOARD) {
+		return BATCH_USAGE_ERROR;
+	}
+	else if (status == CALIBRATION_NO_IMAGES) {
+		return BATCH_FILE_ERROR;
+	}
+	else if (status != CALIBRATION_SUCCESS) {
+		return BATCH_PROCESSING_ERROR;
+	}
+
+	if (max_error > 0) {
+		std::vector<int> bad_views;
+		const std::vector<CalibrationView>& views = camera_profile.get_calibration_views();
+		for (size_t i = 0; i < views.size(); i++) {
+			if (views[i].reprojection_error > max_error) {
+				printf("Dropping %s (%.3f px)\n", views[i].image_path.c_str(), views[i].reprojection_error);
+				bad_views.push_back((int)i);
+			}
+		}
+
+		if (!bad_views.empty() && camera_profile.drop_calibration_views(bad_views) != CALIBRATION_SUCCESS) {
+			return BATCH_PROCESSING_ERROR;
+		}
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	const std::vector<CalibrationView>& views = camera_profile.get_calibration_views();
+	int views_used = 0;
+	for (size_t i = 0; i < views.size(); i++) {
+		if (views[i].reprojection_error >= 0) {
+			printf("%8.3f px  %s\n", views[i].reprojection_error, views[i].image_path.c_str());
+			views_used++;
+		}
+	}
+
+	printf("Calibrated from %d of %d images in %.3f s, RMS reprojection error %.3f px\n",
+		views_used, (int)views.size(), seconds, camera_profile.get_calibration_rms());
+
+	try {
+		camera_profile.write_profile(profile_path);
+	}
+	catch (const cv::Exception& e) {
+		printf("Error: could not write camera profile %s: %s\n", profile_path.c_str(), e.what());
+		return BATCH_FILE_ERROR;
+	}
+
+	return BATCH_SUCCESS;
+}
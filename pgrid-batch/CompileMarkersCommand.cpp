@@ -0,0 +1,110 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "BatchCommands.h"
+#include "MarkerIndex.h"
+
+/**
+* Prints the options of the compile-markers command
+*/
+static void print_compile_markers_usage() {
+	printf("usage: pgrid-batch compile-markers <marker_index> <output>\n\n");
+	printf("Converts a text marker index to the binary format, which pgrid maps into memory instead of parsing.\n");
+	printf("The output can replace marker_index next to pgrid.exe, the format is told from the content.\n");
+}
+
+/**
+* Compiles a text marker index into the binary format, then loads the output back and checks that every marker
+* reads the same from both
+*
+* @param argc number of arguments, including the command name
+* @param argv arguments
+*
+* @return BATCH_SUCCESS, or BATCH_FILE_ERROR if either file cannot be read or written or they differ
+*/
+int run_compile_markers_command(int argc, char** argv) {
+	std::vector<std::string> positional;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_compile_markers_usage();
+			return BATCH_SUCCESS;
+		}
+		else if (argv[i][0] != '-') {
+			positional.push_back(argv[i]);
+		}
+		else {
+			printf("Error: unexpected argument %s\n\n", argv[i]);
+			print_compile_markers_usage();
+			return BATCH_USAGE_ERROR;
+		}
+	}
+
+	if (positional.size() != 2) {
+		print_compile_markers_usage();
+		return BATCH_USAGE_ERROR;
+	}
+
+	const std::string& input_path = positional[0];
+	const std::string& output_path = positional[1];
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	MarkerIndex text_index;
+	if (text_index.load(input_path) != MARKER_INDEX_SUCCESS || text_index.validate() != MARKER_INDEX_SUCCESS) {
+		return BATCH_FILE_ERROR;
+	}
+	double parse_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (text_index.save_binary(output_path) != MARKER_INDEX_SUCCESS) {
+		printf("Error: could not write %s\n", output_path.c_str());
+		return BATCH_FILE_ERROR;
+	}
+
+	start = std::chrono::steady_clock::now();
+	MarkerIndex binary_index;
+	if (binary_index.load(output_path) != MARKER_INDEX_SUCCESS) {
+		return BATCH_FILE_ERROR;
+	}
+	double map_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (binary_index.validate() != MARKER_INDEX_SUCCESS || binary_index.size() != text_index.size() ||
+		binary_index.get_dictionary() != text_index.get_dictionary()) {
+		printf("Error: %s does not read back the same as %s\n", output_path.c_str(), input_path.c_str());
+		return BATCH_FILE_ERROR;
+	}
+
+	for (size_t i = 0; i < text_index.size(); i++) {
+		MarkerPlacement expected, by_position, by_id;
+		text_index.get_marker(i, expected);
+		if (!binary_index.get_marker(i, by_position) || !binary_index.find(expected.id, by_id) ||
+			memcmp(&expected, &by_position, sizeof(MarkerPlacement)) != 0 ||
+			memcmp(&expected, &by_id, sizeof(MarkerPlacement)) != 0) {
+			printf("Error: marker %d differs between %s and %s\n", expected.id, input_path.c_str(), output_path.c_str());
+			return BATCH_FILE_ERROR;
+		}
+	}
+
+	printf("%zu markers (%s) compiled to %s\n", text_index.size(),
+		MarkerIndex::dictionary_name(text_index.get_dictionary()), output_path.c_str());
+	printf("text parse %.3f ms, binary map %.3f ms\n", parse_ms, map_ms);
+
+	return BATCH_SUCCESS;
+}
@@ -0,0 +1,171 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "BatchCommands.h"
+#include "HomographySolver.h"
+
+/*
+* Points file format (YAML):
+*
+*   world_points: [ x0, y0, x1, y1, ... ]   # ground coordinates in meters
+*   scene_points: [ u0, v0, u1, v1, ... ]   # scene coordinates of the same points, same order
+*
+* World points are scaled to cm like the grid does, so the homography matches the grid transform of the GUI and
+* residuals are in scene units.
+*/
+
+/**
+* Prints the options of the solve-homography command
+*/
+static void print_homography_usage() {
+	printf("usage: pgrid-batch solve-homography <points.yml> [options]\n\n");
+	printf("  --threshold PX    largest residual of an inlier in scene units (default: 8)\n");
+	printf("  --max-iters N     most iterations of the robust methods (default: 5000)\n");
+	printf("  --output FILE     write the homography and its inverse to a YAML file\n");
+}
+
+/**
+* Solves the grid homography of a set of reference points or marker corners with every method, prints how each
+* method did and the residual of every point under the best one. Points beyond the inlier threshold are flagged.
+*
+* @param argc number of arguments, including the command name
+* @param argv arguments
+*
+* @return BATCH_SUCCESS if a homography was found, even if some points are outliers
+*/
+int run_homography_command(int argc, char** argv) {
+	std::string points_path;
+	std::string output_path;
+	double threshold = 8;
+	int max_iters = 5000;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_homography_usage();
+			return BATCH_SUCCESS;
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--max-iters") == 0 && i + 1 < argc) {
+			max_iters = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+			output_path = argv[++i];
+		}
+		else if (argv[i][0] != '-' && points_path.empty()) {
+			points_path = argv[i];
+		}
+		else {
+			printf("Error: unexpected argument %s\n\n", argv[i]);
+			print_homography_usage();
+			return BATCH_USAGE_ERROR;
+		}
+	}
+
+	if (points_path.empty() || threshold <= 0 || max_iters <= 0) {
+		print_homography_usage();
+		return BATCH_USAGE_ERROR;
+	}
+
+	std::vector<cv::Point2f> world_points;
+	std::vector<cv::Point2f> scene_points;
+	try {
+		cv::FileStorage points_file(points_path, cv::FileStorage::READ);
+		if (!points_file.isOpened()) {
+			printf("Error: could not open points file %s\n", points_path.c_str());
+			return BATCH_FILE_ERROR;
+		}
+		points_file["world_points"] >> world_points;
+		points_file["scene_points"] >> scene_points;
+	}
+	catch (const cv::Exception& e) {
+		printf("Error: could not parse points file %s: %s\n", points_path.c_str(), e.what());
+		return BATCH_FILE_ERROR;
+	}
+
+	for (size_t i = 0; i < world_points.size(); i++) {
+		world_points[i] *= 100;
+	}
+
+	HomographySolver solver(threshold, max_iters);
+	HomographySolution solution;
+	int status = solver.solve(world_points, scene_points, solution);
+
+	if (status == HOMOGRAPHY_SIZE_MISMATCH) {
+		printf("Error: %d world points but %d scene points\n", (int)world_points.size(), (int)scene_points.size());
+		return BATCH_FILE_ERROR;
+	}
+	else if (status == HOMOGRAPHY_TOO_FEW_POINTS) {
+		printf("Error: at least 4 points are needed, got %d\n", (int)world_points.size());
+		return BATCH_FILE_ERROR;
+	}
+
+	printf("method    inliers     score    time\n");
+	for (size_t i = 0; i < solution.candidates.size(); i++) {
+		const HomographyCandidate& candidate = solution.candidates[i];
+		if (candidate.H.empty()) {
+			printf("%-8s  no solution        %6.2f ms\n", HomographySolver::method_name(candidate.method).c_str(), candidate.solve_ms);
+		}
+		else {
+			printf("%-8s  %4d/%-4d %8.3f  %6.2f ms\n", HomographySolver::method_name(candidate.method).c_str(),
+				candidate.inlier_count, (int)world_points.size(), candidate.score, candidate.solve_ms);
+		}
+	}
+
+	if (status != HOMOGRAPHY_SUCCESS) {
+		printf("Error: no method found a homography\n");
+		return BATCH_PROCESSING_ERROR;
+	}
+
+	printf("\npoint     world x    world y    scene x    scene y   residual\n");
+	for (size_t i = 0; i < solution.residuals.size(); i++) {
+		printf("%5d  %9.2f  %9.2f  %9.2f  %9.2f  %9.3f%s\n", (int)i,
+			world_points[i].x / 100, world_points[i].y / 100, scene_points[i].x, scene_points[i].y,
+			solution.residuals[i], solution.inliers[i] ? "" : "  outlier");
+	}
+
+	printf("\nUsing %s: %d of %d points within %.2f, inlier RMS %.3f\n",
+		HomographySolver::method_name(solution.method).c_str(), solution.inlier_count, (int)solution.residuals.size(),
+		threshold, solution.inlier_rms);
+
+	if (!output_path.empty()) {
+		try {
+			cv::FileStorage output_file(output_path, cv::FileStorage::WRITE);
+			if (!output_file.isOpened()) {
+				printf("Error: could not write %s\n", output_path.c_str());
+				return BATCH_FILE_ERROR;
+			}
+			output_file << "method" << HomographySolver::method_name(solution.method);
+			output_file << "homography" << solution.H;
+			output_file << "inverse_homography" << solution.H_inv;
+			output_file << "residuals" << solution.residuals;
+			output_file << "inlier_rms" << solution.inlier_rms;
+		}
+		catch (const cv::Exception& e) {
+			printf("Error: could not write %s: %s\n", output_path.c_str(), e.what());
+			return BATCH_FILE_ERROR;
+		}
+	}
+
+	return BATCH_SUCCESS;
+}
@@ -0,0 +1,261 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include "BatchCommands.h"
+#include "CameraProfile.h"
+#include "MarkerDetector.h"
+#include "MarkerIndex.h"
+#include "PoseEstimator.h"
+#include "ThreadPool.h"
+
+/*
+* Writes one pose file per image, named <image>_pose.yml, in the format the project command reads:
+*
+*   x_pos, y_pos, z_pos                       # camera position in cm
+*   roll_angle, pitch_angle, yaw_angle        # camera rotation in degrees
+*   marker_count, inlier_count, inlier_rms    # how well the markers agreed on the pose
+*/
+
+typedef struct {
+	int status;
+	int pose_status;
+	size_t marker_count;
+	PoseSolution solution;
+	std::string pose_path;
+	std::string message;
+} PoseResult;
+
+/**
+* Prints the options of the estimate-pose command
+*/
+static void print_pose_usage() {
+	printf("usage: pgrid-batch estimate-pose <profile.ocp> <marker_index> <image>... [options]\n\n");
+	printf("  --output-dir DIR   directory the pose files are written to (default: next to each image)\n");
+	printf("  --threads N        number of images processed at once (default: one per hardware thread)\n");
+	printf("  --threshold PX     largest reprojection error of an inlier corner in pixels (default: 8)\n");
+	printf("  --overwrite        replace existing pose files\n");
+}
+
+/**
+* Finds the markers in one image, solves the camera pose from them and writes the pose file. Runs on a worker
+* thread, the camera profile and marker index are only read.
+*
+* @param image_path image to process
+* @param pose_path pose file to write
+* @param camera_profile camera profile the image was taken with
+* @param marker_index marker board model
+* @param estimator pose estimator with the inlier threshold
+* @param overwrite replace an existing pose file
+*
+* @return status, solved pose and an error message if it failed
+*/
+static PoseResult process_image(const std::string& image_path, const std::string& pose_path, CameraProfile& camera_profile,
+	const MarkerIndex& marker_index, const PoseEstimator& estimator, bool overwrite) {
+	PoseResult result;
+	result.status = BATCH_SUCCESS;
+	result.pose_status = POSE_NO_SOLUTION;
+	result.marker_count = 0;
+	result.pose_path = pose_path;
+
+	if (!overwrite && std::ifstream(pose_path).good()) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = pose_path + " already exists, use --overwrite to replace it";
+		return result;
+	}
+
+	// Markers are detected in grayscale, so the color channels are not decoded at all
+	cv::Mat img = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
+	if (img.empty()) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = "could not read image";
+		return result;
+	}
+
+	// Images are already processed in parallel, so each searches its marker regions on its own thread
+	MarkerDetection detection;
+	MarkerDetector(marker_index.get_dictionary(), 1).detect(img, detection);
+	img.release();
+	result.marker_count = detection.ids.size();
+
+	std::vector<cv::Point2f> img_points;
+	std::vector<cv::Point3f> world_points;
+	MarkerDetector::corner_correspondences(detection, marker_index, img_points, world_points);
+
+	result.pose_status = estimator.solve(img_points, world_points, camera_profile.get_camera_matrix(),
+		camera_profile.get_dist_coeffs(), result.solution);
+	if (result.pose_status == POSE_TOO_FEW_POINTS) {
+		result.status = BATCH_PROCESSING_ERROR;
+		result.message = "no markers from the marker index found";
+		return result;
+	}
+	else if (result.pose_status != POSE_SUCCESS) {
+		result.status = BATCH_PROCESSING_ERROR;
+		result.message = "the markers do not agree on a pose";
+		return result;
+	}
+
+	try {
+		cv::FileStorage pose_file(pose_path, cv::FileStorage::WRITE);
+		if (!pose_file.isOpened()) {
+			result.status = BATCH_FILE_ERROR;
+			result.message = "could not write " + pose_path;
+			return result;
+		}
+		const CameraPose& pose = result.solution.pose;
+		pose_file << "x_pos" << pose.x_pos;
+		pose_file << "y_pos" << pose.y_pos;
+		pose_file << "z_pos" << pose.z_pos;
+		pose_file << "roll_angle" << pose.roll_angle;
+		pose_file << "pitch_angle" << pose.pitch_angle;
+		pose_file << "yaw_angle" << pose.yaw_angle;
+		pose_file << "marker_count" << (int)result.marker_count;
+		pose_file << "inlier_count" << result.solution.inlier_count;
+		pose_file << "inlier_rms" << result.solution.inlier_rms;
+	}
+	catch (const cv::Exception& e) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = std::string("could not write pose: ") + e.what();
+	}
+
+	return result;
+}
+
+/**
+* Solves the camera pose of every image from the ArUco markers in it and writes a pose file per image, which the
+* project command can use directly. Images are processed in parallel.
+*
+* @param argc number of arguments, including the command name
+* @param argv arguments
+*
+* @return BATCH_SUCCESS if every pose was written, otherwise the error of the first failure
+*/
+int run_pose_command(int argc, char** argv) {
+	std::vector<std::string> positional;
+	std::string output_dir;
+	size_t thread_count = 0;
+	double threshold = 8;
+	bool overwrite = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_pose_usage();
+			return BATCH_SUCCESS;
+		}
+		else if (strcmp(argv[i], "--output-dir") == 0 && i + 1 < argc) {
+			output_dir = argv[++i];
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			thread_count = (size_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+			threshold = atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--overwrite") == 0) {
+			overwrite = true;
+		}
+		else if (argv[i][0] != '-') {
+			positional.push_back(argv[i]);
+		}
+		else {
+			printf("Error: unexpected argument %s\n\n", argv[i]);
+			print_pose_usage();
+			return BATCH_USAGE_ERROR;
+		}
+	}
+
+	if (positional.size() < 3 || threshold <= 0) {
+		print_pose_usage();
+		return BATCH_USAGE_ERROR;
+	}
+
+	const std::string& profile_path = positional[0];
+	const std::string& index_path = positional[1];
+	std::vector<std::string> images(positional.begin() + 2, positional.end());
+
+	CameraProfile camera_profile;
+	if (camera_profile.load_profile(profile_path) != 0 || camera_profile.get_camera_matrix().empty()) {
+		printf("Error: could not load camera profile %s\n", profile_path.c_str());
+		return BATCH_FILE_ERROR;
+	}
+
+	// A binary index is checked here rather than on the first lookup, so a damaged one fails before any image
+	MarkerIndex marker_index;
+	if (marker_index.load(index_path) != MARKER_INDEX_SUCCESS || marker_index.validate() != MARKER_INDEX_SUCCESS) {
+		return BATCH_FILE_ERROR;
+	}
+
+	if (!output_dir.empty() && !make_dir(output_dir)) {
+		printf("Error: could not create output directory %s\n", output_dir.c_str());
+		return BATCH_FILE_ERROR;
+	}
+
+	PoseEstimator estimator(threshold);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<PoseResult> results(images.size());
+	size_t threads_used;
+	{
+		ThreadPool pool(thread_count);
+		threads_used = pool.size();
+
+		for (size_t i = 0; i < images.size(); i++) {
+			pool.submit([&, i] {
+				std::string dir = output_dir.empty() ? parent_dir(images[i]) : output_dir;
+				std::string pose_path = (dir.empty() ? "" : dir + "/") + file_stem(images[i]) + "_pose.yml";
+				results[i] = process_image(images[i], pose_path, camera_profile, marker_index, estimator, overwrite);
+			});
+		}
+		pool.wait();
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	printf("image                          markers  inliers  rms px     x cm     y cm     z cm   roll  pitch    yaw\n");
+	int status = BATCH_SUCCESS;
+	size_t failed = 0;
+	for (size_t i = 0; i < images.size(); i++) {
+		const PoseResult& result = results[i];
+		std::string name = file_stem(images[i]);
+		if (result.status != BATCH_SUCCESS) {
+			printf("%-30s %7d  %s\n", name.c_str(), (int)result.marker_count, result.message.c_str());
+			if (status == BATCH_SUCCESS) {
+				status = result.status;
+			}
+			failed++;
+			continue;
+		}
+
+		const CameraPose& pose = result.solution.pose;
+		printf("%-30s %7d  %3d/%-3d %7.2f %8.1f %8.1f %8.1f %6.1f %6.1f %6.1f\n", name.c_str(), (int)result.marker_count,
+			result.solution.inlier_count, (int)result.solution.residuals.size(), result.solution.inlier_rms,
+			pose.x_pos, pose.y_pos, pose.z_pos, pose.roll_angle, pose.pitch_angle, pose.yaw_angle);
+	}
+
+	printf("%zu of %zu poses written in %.3f s on %zu threads, %.1f images/s\n",
+		images.size() - failed, images.size(), seconds, threads_used, seconds > 0 ? images.size() / seconds : 0.0);
+
+	return status;
+}
@@ -0,0 +1,430 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "BatchCommands.h"
+#include "CameraPose.h"
+#include "CameraProfile.h"
+#include "GroundProjector.h"
+#include "OutputFile.h"
+#include "ReferencePoint.h"
+#include "ThreadPool.h"
+
+/*
+* Manifest format (YAML, paths are relative to the manifest):
+*
+*   camera_profile: pixel_6_pro.ocp
+*   output_dir: output
+*   images:
+*     - image: IMG_0001.jpg
+*       pose: IMG_0001_pose.yml          # x_pos, y_pos, z_pos, roll_angle, pitch_angle, yaw_angle
+*       annotation: IMG_0001_points.yml  # points: [ u0, v0, u1, v1, ... ] in image pixels
+*       description: driver
+*       neck: 50th_male                  # or the index 0-2
+*       seat_track: mid
+*       seat_height: down
+*
+* One CSV is written per image to output_dir, named after the image, or one .pgcol file with --columnar. Image
+* names must be unique without their folder and extension.
+*/
+
+typedef struct {
+	std::string image_path;
+	std::string pose_path;
+	std::string annotation_path;
+	std::string output_path;
+	std::string description;
+	int neck;
+	int seat_track;
+	int seat_height;
+} ProjectJob;
+
+typedef struct {
+	int status;
+	size_t point_count;
+	std::string message;
+} ProjectResult;
+
+/**
+* Reads a neck, seat track or seat height option from the manifest. Both the index and the output name are accepted.
+*
+* @param node manifest node with the option
+* @param names output names of the options, in index order
+* @param name_count number of options
+* @param value set to the index of the option
+*
+* @return true if the option is missing (value is left at its default) or valid
+*/
+static bool read_option(const cv::FileNode& node, const char* const* names, int name_count, int* value) {
+	if (node.empty()) {
+		return true;
+	}
+
+	if (node.isInt()) {
+		int idx = (int)node;
+		if (idx < 0 || idx >= name_count) {
+			return false;
+		}
+		*value = idx;
+		return true;
+	}
+
+	std::string name = (std::string)node;
+	for (int i = 0; i < name_count; i++) {
+		if (name == names[i]) {
+			*value = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Gets the last 4 digits of an image name (without the extension), the same way Image::get_last4 does
+*
+* @param image_path path of the image
+*
+* @return last 4 digits as a number
+*/
+static int image_last4(const std::string& image_path) {
+	std::string stem = file_stem(image_path);
+	if (stem.size() > 4) {
+		stem = stem.substr(stem.size() - 4);
+	}
+	return atoi(stem.c_str());
+}
+
+/**
+* Reads the manifest
+*
+* @param manifest_path path of the manifest file
+* @param extension extension of the output files, .csv or .pgcol
+* @param profile_path set to the path of the camera profile
+* @param jobs filled with one job per image
+*
+* @return BATCH_SUCCESS, or BATCH_FILE_ERROR if the manifest cannot be read or two images would write the same file
+*/
+static int read_manifest(const std::string& manifest_path, const char* extension, std::string& profile_path,
+	std::vector<ProjectJob>& jobs) {
+	// Option names are the same as in the CSV output
+	ApplicationConfig app_config = ApplicationConfig();
+	GridConfig grid_config = GridConfig();
+	MeasurementConfig measurement_config = MeasurementConfig();
+	SessionConfig session_config = SessionConfig();
+	session_config.app_config = &app_config;
+	session_config.grid_config = &grid_config;
+	session_config.measurement_config = &measurement_config;
+	OutputFile options(&session_config);
+
+	try {
+		cv::FileStorage manifest(manifest_path, cv::FileStorage::READ);
+		if (!manifest.isOpened()) {
+			printf("Error: could not open manifest %s\n", manifest_path.c_str());
+			return BATCH_FILE_ERROR;
+		}
+
+		std::string base_dir = parent_dir(manifest_path);
+
+		std::string output_dir;
+		manifest["camera_profile"] >> profile_path;
+		manifest["output_dir"] >> output_dir;
+
+		if (profile_path.empty()) {
+			printf("Error: manifest %s has no camera_profile\n", manifest_path.c_str());
+			return BATCH_FILE_ERROR;
+		}
+		profile_path = resolve_path(base_dir, profile_path);
+		output_dir = resolve_path(base_dir, output_dir.empty() ? "." : output_dir);
+
+		if (!make_dir(output_dir)) {
+			printf("Error: could not create output directory %s\n", output_dir.c_str());
+			return BATCH_FILE_ERROR;
+		}
+
+		// Output file of every job so far, by lower case path, to the image it belongs to
+		std::map<std::string, std::string> outputs;
+
+		cv::FileNode images = manifest["images"];
+		for (cv::FileNodeIterator it = images.begin(); it != images.end(); ++it) {
+			cv::FileNode entry = *it;
+			ProjectJob job;
+
+			entry["image"] >> job.image_path;
+			entry["pose"] >> job.pose_path;
+			entry["annotation"] >> job.annotation_path;
+			entry["description"] >> job.description;
+
+			if (job.image_path.empty() || job.pose_path.empty() || job.annotation_path.empty()) {
+				printf("Error: image %d of the manifest needs image, pose and annotation\n", (int)jobs.size());
+				return BATCH_FILE_ERROR;
+			}
+
+			job.neck = 0;
+			job.seat_track = 0;
+			job.seat_height = 0;
+			if (!read_option(entry["neck"], options.neck_options_output, 3, &job.neck) ||
+				!read_option(entry["seat_track"], options.seat_track_options_output, 3, &job.seat_track) ||
+				!read_option(entry["seat_height"], options.seat_height_options_output, 3, &job.seat_height)) {
+				printf("Error: invalid neck, seat_track or seat_height for %s\n", job.image_path.c_str());
+				return BATCH_FILE_ERROR;
+			}
+
+			job.output_path = output_dir + "/" + file_stem(job.image_path) + extension;
+			if (job.output_path.size() >= sizeof(app_config.outfile_path)) {
+				printf("Error: output path %s is too long\n", job.output_path.c_str());
+				return BATCH_FILE_ERROR;
+			}
+
+			// Images with the same name in different folders or formats would write the same file at the same time.
+			// Paths are compared without case, Windows file names are not case sensitive.
+			std::string output_key = job.output_path;
+			for (size_t i = 0; i < output_key.size(); i++) {
+				output_key[i] = (char)tolower((unsigned char)output_key[i]);
+			}
+			std::map<std::string, std::string>::iterator existing = outputs.find(output_key);
+			if (existing != outputs.end()) {
+				printf("Error: %s and %s would both be written to %s, rename one of the images\n",
+					existing->second.c_str(), job.image_path.c_str(), job.output_path.c_str());
+				return BATCH_FILE_ERROR;
+			}
+			outputs[output_key] = job.image_path;
+			job.image_path = resolve_path(base_dir, job.image_path);
+			job.pose_path = resolve_path(base_dir, job.pose_path);
+			job.annotation_path = resolve_path(base_dir, job.annotation_path);
+
+			jobs.push_back(job);
+		}
+	}
+	catch (const cv::Exception& e) {
+		printf("Error: could not parse manifest %s: %s\n", manifest_path.c_str(), e.what());
+		return BATCH_FILE_ERROR;
+	}
+
+	return BATCH_SUCCESS;
+}
+
+/**
+* Projects the annotation of one image and writes its output file. Runs on a worker thread, so everything except
+* the camera profile (which is only read) is local to the job.
+*
+* @param job image to process
+* @param camera_profile camera profile the images were taken with
+* @param format OUTPUT_FORMAT_CSV or OUTPUT_FORMAT_COLUMNAR
+* @param overwrite replace existing output files
+*
+* @return status, number of points written and an error message if it failed
+*/
+static ProjectResult process_image(const ProjectJob& job, CameraProfile& camera_profile, int format, bool overwrite) {
+	ProjectResult result;
+	result.status = BATCH_SUCCESS;
+	result.point_count = 0;
+
+	CameraPose camera_pose = CameraPose();
+	std::vector<cv::Point2f> points;
+
+	try {
+		cv::FileStorage pose_file(job.pose_path, cv::FileStorage::READ);
+		if (!pose_file.isOpened()) {
+			result.status = BATCH_FILE_ERROR;
+			result.message = "could not open pose " + job.pose_path;
+			return result;
+		}
+		pose_file["x_pos"] >> camera_pose.x_pos;
+		pose_file["y_pos"] >> camera_pose.y_pos;
+		pose_file["z_pos"] >> camera_pose.z_pos;
+		pose_file["roll_angle"] >> camera_pose.roll_angle; // missing in older pose files, reads as 0
+		pose_file["pitch_angle"] >> camera_pose.pitch_angle;
+		pose_file["yaw_angle"] >> camera_pose.yaw_angle;
+
+		cv::FileStorage annotation_file(job.annotation_path, cv::FileStorage::READ);
+		if (!annotation_file.isOpened()) {
+			result.status = BATCH_FILE_ERROR;
+			result.message = "could not open annotation " + job.annotation_path;
+			return result;
+		}
+		annotation_file["points"] >> points;
+	}
+	catch (const cv::Exception& e) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = std::string("could not parse pose or annotation: ") + e.what();
+		return result;
+	}
+
+	// Same projection the GUI exports with in markerless mode, including the lens distortion
+	GroundProjector projector = camera_profile.get_ground_projector(camera_pose);
+	projector.project_meters(points.data(), points.data(), points.size());
+
+	// OutputFile only needs the output path, calibration mode and measurement offsets
+	ApplicationConfig app_config = ApplicationConfig();
+	GridConfig grid_config = GridConfig();
+	MeasurementConfig measurement_config = MeasurementConfig();
+	grid_config.calibration_mode = 3;
+
+	SessionConfig session_config = SessionConfig();
+	session_config.app_config = &app_config;
+	session_config.grid_config = &grid_config;
+	session_config.measurement_config = &measurement_config;
+
+	snprintf(app_config.outfile_path, sizeof(app_config.outfile_path), "%s", job.output_path.c_str());
+
+	OutputFile outfile(&session_config);
+	snprintf(outfile.get_img_description_buf(), 50, "%s", job.description.c_str());
+	outfile.set_img_last4(image_last4(job.image_path));
+	*outfile.get_neck_ptr() = job.neck;
+	*outfile.get_seat_track_ptr() = job.seat_track;
+	*outfile.get_seat_height_ptr() = job.seat_height;
+	*outfile.get_format_ptr() = format;
+
+	// An existing file is only replaced once the new one is complete
+	int status = outfile.open(overwrite);
+	if (status == FILE_OPEN_CHECK_OVERWRITE) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = job.output_path + " already exists, use --overwrite to replace it";
+		return result;
+	}
+	else if (status != FILE_OPEN_SUCCESS) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = "could not open " + job.output_path;
+		return result;
+	}
+
+	outfile.write_output(points);
+	if (outfile.close() != FILE_OPEN_SUCCESS) {
+		result.status = BATCH_FILE_ERROR;
+		result.message = "could not write " + job.output_path;
+		return result;
+	}
+
+	result.point_count = points.size();
+	return result;
+}
+
+/**
+* Prints the options of the project command
+*/
+static void print_project_usage() {
+	printf("usage: pgrid-batch project <manifest.yml> [--threads N] [--overwrite] [--columnar]\n\n");
+	printf("  --threads N   number of worker threads (default: one per hardware thread)\n");
+	printf("  --overwrite   replace existing output files\n");
+	printf("  --columnar    write the columnar binary format (.pgcol) instead of CSV\n");
+}
+
+/**
+* Projects the annotated points of every image in a manifest onto the ground plane with the markerless projection
+* and writes one CSV (or columnar file) per image. Images are processed in parallel.
+*
+* @param argc number of arguments, including the command name
+* @param argv arguments
+*
+* @return BATCH_SUCCESS if every image was written, otherwise the error of the first failure
+*/
+int run_project_command(int argc, char** argv) {
+	std::string manifest_path;
+	size_t thread_count = 0;
+	bool overwrite = false;
+	int format = OUTPUT_FORMAT_CSV;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+			print_project_usage();
+			return BATCH_SUCCESS;
+		}
+		else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			thread_count = (size_t)atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--overwrite") == 0) {
+			overwrite = true;
+		}
+		else if (strcmp(argv[i], "--columnar") == 0) {
+			format = OUTPUT_FORMAT_COLUMNAR;
+		}
+		else if (manifest_path.empty() && argv[i][0] != '-') {
+			manifest_path = argv[i];
+		}
+		else {
+			printf("Error: unexpected argument %s\n\n", argv[i]);
+			print_project_usage();
+			return BATCH_USAGE_ERROR;
+		}
+	}
+
+	if (manifest_path.empty()) {
+		print_project_usage();
+		return BATCH_USAGE_ERROR;
+	}
+
+	std::string profile_path;
+	std::vector<ProjectJob> jobs;
+	int status = read_manifest(manifest_path, format == OUTPUT_FORMAT_COLUMNAR ? ".pgcol" : ".csv", profile_path, jobs);
+	if (status != BATCH_SUCCESS) {
+		return status;
+	}
+
+	CameraProfile camera_profile;
+	if (camera_profile.load_profile(profile_path) != 0 || camera_profile.get_camera_matrix().empty()) {
+		printf("Error: could not load camera profile %s\n", profile_path.c_str());
+		return BATCH_FILE_ERROR;
+	}
+
+	// Build or load the undistortion table up front, so the workers do not all wait on the first one to build it
+	camera_profile.get_undistortion_lut();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	std::vector<ProjectResult> results(jobs.size());
+	size_t threads_used;
+	{
+		ThreadPool pool(thread_count);
+		threads_used = pool.size();
+
+		for (size_t i = 0; i < jobs.size(); i++) {
+			pool.submit([&, i] {
+				results[i] = process_image(jobs[i], camera_profile, format, overwrite);
+			});
+		}
+		pool.wait();
+	}
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	status = BATCH_SUCCESS;
+	size_t failed = 0;
+	size_t total_points = 0;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (results[i].status != BATCH_SUCCESS) {
+			printf("Error: %s: %s\n", jobs[i].image_path.c_str(), results[i].message.c_str());
+			if (status == BATCH_SUCCESS) {
+				status = results[i].status;
+			}
+			failed++;
+		}
+		total_points += results[i].point_count;
+	}
+
+	printf("%zu of %zu images written (%zu points) in %.3f s on %zu threads, %.1f images/s\n",
+		jobs.size() - failed, jobs.size(), total_points, seconds, threads_used,
+		seconds > 0 ? jobs.size() / seconds : 0.0);
+
+	return status;
+}
@@ -42,6 +42,8 @@ Application::Application(SessionConfig* session_config)  :
 	img_config = session_config->img_config;
 	paint_config = session_config->paint_config;
 
+	active_frames = 0;
+
     // Create pointers to child classes
     //
     // Painter class manages the nearest visible point (NVP) paint
@@ -57,6 +59,10 @@ Application::Application(SessionConfig* session_config)  :
     // coordinates
     app_config->marker_index = new MarkerIndex(session_config);
 
+    // FramebufferPool owns the offscreen framebuffers the perspective
+    // and orthographic panels render into
+    app_config->framebuffer_pool = new FramebufferPool();
+
     // Add a reference to perspective panel in app_config so it
     // can be accessed by other objects
     app_config->perspective_panel = &perspective_panel;
@@ -240,7 +246,8 @@ void Application::glfw_error_callback(
 
 void Application::resize_callback(GLFWwindow* window, int new_width, int new_height) {
 
-	Application app = *(Application*)glfwGetWindowUserPointer(window);
+	Application& app = *(Application*)glfwGetWindowUserPointer(window);
+	app.active_frames = app.frames_after_input;
 
 	glViewport(0, 0,
 		new_width,
@@ -259,6 +266,7 @@ void Application::resize_callback(GLFWwindow* window, int new_width, int new_hei
 
 void Application::cursor_position_callback(GLFWwindow* window, double mx, double my) {
 	Application* app = (Application*)glfwGetWindowUserPointer(window);
+	app->active_frames = app->frames_after_input;
 
 	// TODO: maybe this belongs in app-config? haven't decided.
 	app->view_config->mouse_x = mx;
@@ -325,6 +333,7 @@ void Application::cursor_position_callback(GLFWwindow* window, double mx, double
 void Application::mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
 	Application* app = (Application*)glfwGetWindowUserPointer(window);
+	app->active_frames = app->frames_after_input;
 
 	double mx, my;
 
@@ -354,6 +363,7 @@ void Application::mouse_button_callback(GLFWwindow* window, int button, int acti
 
 void Application::scroll_callback(GLFWwindow* window, double delta_x, double delta_y) {
 	Application* app = (Application*)glfwGetWindowUserPointer(window);
+	app->active_frames = app->frames_after_input;
 
 	double xpos, ypos;
 
@@ -379,7 +389,8 @@ void Application::scroll_callback(GLFWwindow* window, double delta_x, double del
 }
 
 void Application::keypress_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
-	Application app = *(Application*)glfwGetWindowUserPointer(window);
+	Application& app = *(Application*)glfwGetWindowUserPointer(window);
+	app.active_frames = app.frames_after_input;
 }
 
 bool Application::init() {
@@ -442,8 +453,19 @@ void Application::load_camera_profile() {
 void Application::main_loop() {
 	while (!glfwWindowShouldClose(window)) 
 	{
+		// Keep rendering while the user interacts or a panel is still filling in. Otherwise sleep until the next
+		// event, background work (image decoding, calibration) posts an empty event when it has something to show.
+		// The panels only redraw when their contents changed, so an idle frame is cheap.
+		if (active_frames > 0) {
+			active_frames--;
+			glfwPollEvents();
+		}
+		else {
+			glfwWaitEventsTimeout(idle_timeout);
+		}
 
-		glfwPollEvents();
+		// The last append of a burst is synced once its interval is up, even if nothing else happens
+		app_config->outfile->sync_pending();
 
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -600,6 +622,11 @@ void Application::main_loop() {
 		perspective_panel.render();
 		ortho_panel.render();
 
+		// Image tiles still uploading, render at least one more frame
+		if (perspective_panel.needs_redraw() && active_frames < 1) {
+			active_frames = 1;
+		}
+
 		ImGui::End();
 		ImGui::Render();
 		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -613,9 +640,12 @@ void Application::main_loop() {
 }
 
 void Application::close() {
+	// Appends are synced and their journal removed before exit() skips the destructors
+	app_config->outfile->close_session();
 
 	ortho_panel.close();
 	perspective_panel.close();
+	app_config->framebuffer_pool->clear();
 
 	ImGui_ImplOpenGL3_Shutdown();
 	ImGui_ImplGlfw_Shutdown();
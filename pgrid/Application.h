@@ -42,6 +42,15 @@ private:
 	double last_mouse_x, last_mouse_y;
 
 	char window_label[100];
+
+	// Frames left to render before the main loop goes back to waiting for events
+	int active_frames;
+
+	// Frames rendered after every input event, ImGui needs a few to settle hover and layout changes
+	const int frames_after_input = 3;
+
+	// Longest the main loop sleeps while idle, in seconds
+	const double idle_timeout = 0.5;
 	
 	ImGuiWindowFlags window_flags;
 	ImGuiDockNodeFlags docknode_flags;
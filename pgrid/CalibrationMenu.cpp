@@ -20,6 +20,101 @@ limitations under the License.
 CalibrationMenu::CalibrationMenu(SessionConfig* config) {
 	checkerboard_dims[0] = 0;
 	checkerboard_dims[1] = 0;
+
+	calibration_running = false;
+	calibration_finished = false;
+	calibration_images_done = 0;
+	calibration_image_count = 0;
+	calibration_status = -1;
+}
+
+CalibrationMenu::~CalibrationMenu() {
+	if (calibration_thread.joinable()) {
+		calibration_thread.join();
+	}
+}
+
+/**
+* Starts calibrating from the selected directory on a background thread so the GUI keeps running
+*/
+void CalibrationMenu::start_calibration() {
+	if (calibration_running) {
+		return;
+	}
+
+	calibration_running = true;
+	calibration_finished = false;
+	calibration_images_done = 0;
+	calibration_image_count = 0;
+
+	std::string image_dir = cal_img_dir;
+	cv::Size board_dims(checkerboard_dims[0], checkerboard_dims[1]);
+	calibration_result = camera_profile;
+
+	calibration_thread = std::thread([this, image_dir, board_dims] {
+		calibration_status = calibration_result.calibrate(image_dir, board_dims,
+			[this](int images_done, int image_count, const CalibrationView&) {
+				calibration_images_done = images_done;
+				calibration_image_count = image_count;
+
+				// Wake the main loop so the progress bar moves while the application is idle
+				glfwPostEmptyEvent();
+			});
+		calibration_finished = true;
+		glfwPostEmptyEvent();
+	});
+}
+
+/**
+* Picks up the result of a background calibration once it is done. Called every frame from the GUI thread.
+*/
+void CalibrationMenu::finish_calibration() {
+	if (!calibration_running || !calibration_finished) {
+		return;
+	}
+
+	calibration_thread.join();
+	calibration_running = false;
+
+	if (calibration_status == CALIBRATION_SUCCESS) {
+		camera_profile.set_calibration(calibration_result);
+	}
+}
+
+/**
+* Lists the reprojection error of every calibration view, with a button to drop views that did not calibrate well
+*/
+void CalibrationMenu::calibration_results_layout() {
+	const std::vector<CalibrationView>& views = camera_profile.get_calibration_views();
+	if (views.empty()) {
+		return;
+	}
+
+	ImGui::Text("RMS reprojection error: %.3f px", camera_profile.get_calibration_rms());
+
+	int drop_idx = -1;
+	if (ImGui::BeginChild("Calibration Views", ImVec2(0, 150), true)) {
+		for (int i = 0; i < (int)views.size(); i++) {
+			std::string name = views[i].image_path.substr(views[i].image_path.find_last_of("/\\") + 1);
+			if (views[i].reprojection_error < 0) {
+				ImGui::TextDisabled("%s: checkerboard not found", name.c_str());
+				continue;
+			}
+
+			ImGui::Text("%s: %.3f px", name.c_str(), views[i].reprojection_error);
+			ImGui::SameLine();
+			ImGui::PushID(i);
+			if (ImGui::SmallButton("Drop")) {
+				drop_idx = i;
+			}
+			ImGui::PopID();
+		}
+	}
+	ImGui::EndChild();
+
+	if (drop_idx >= 0) {
+		calibration_status = camera_profile.drop_calibration_views(std::vector<int>(1, drop_idx));
+	}
 }
 
 void CalibrationMenu::choose_calibration_dir() {
@@ -91,8 +186,33 @@ void CalibrationMenu::layout() {
 
 	ImGui::InputInt2("Checkerboard Dimensions (width, height)", checkerboard_dims);
 
+	finish_calibration();
+
+	ImGui::BeginDisabled(calibration_running);
 	if (ImGui::Button("Run Calibration")) {
-		camera_profile.calibrate(cal_img_dir, checkerboard_dims);
+		start_calibration();
+	}
+	ImGui::EndDisabled();
+
+	if (calibration_running) {
+		int image_count = calibration_image_count;
+		int images_done = calibration_image_count > 0 ? (int)calibration_images_done : 0;
+
+		char progress_text[32];
+		snprintf(progress_text, sizeof(progress_text), "%d / %d images", images_done, image_count);
+		ImGui::ProgressBar(image_count > 0 ? (float)images_done / image_count : 0.0f, ImVec2(-FLT_MIN, 0), progress_text);
+	}
+	else if (calibration_status == CALIBRATION_NO_IMAGES) {
+		ImGui::Text("No calibration images found in the directory");
+	}
+	else if (calibration_status == CALIBRATION_TOO_FEW_VIEWS) {
+		ImGui::Text("The checkerboard was found in fewer than 3 images");
+	}
+	else if (calibration_status == CALIBRATION_INVALID_BOARD) {
+		ImGui::Text("Invalid checkerboard dimensions");
+	}
+	else {
+		calibration_results_layout();
 	}
 
 	ImGui::InputText("Camera Profile Save File", save_file_path, 100); ImGui::SameLine();
@@ -104,8 +224,10 @@ void CalibrationMenu::layout() {
 		ImGui::CloseCurrentPopup();
 	}
 	ImGui::SameLine();
+	ImGui::BeginDisabled(calibration_running);
 	if (ImGui::Button("Save Profile")) {
 		camera_profile.write_profile(save_file_path);
 		ImGui::CloseCurrentPopup();
 	}
+	ImGui::EndDisabled();
 }
\ No newline at end of file
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <thread>
 #include <GL/glew.h>
+#include <glfw3.h>
 #include "Config.h"
 #include "imgui.h"
+#include "imgui_stdlib.h"
 #include "CameraProfile.h"
 
 
@@ -16,8 +20,25 @@ private:
 	char save_file_path[100];
 	int checkerboard_dims[2];
 
+	// Calibration running in the background. calibration_result is only touched by the calibration thread until
+	// calibration_finished is set.
+	std::thread calibration_thread;
+	CameraProfile calibration_result;
+	std::atomic<bool> calibration_running;
+	std::atomic<bool> calibration_finished;
+	std::atomic<int> calibration_images_done;
+	std::atomic<int> calibration_image_count;
+	int calibration_status;
+
+	void start_calibration();
+
+	void finish_calibration();
+
+	void calibration_results_layout();
+
 public:
 	CalibrationMenu(SessionConfig* config);
+	~CalibrationMenu();
 
 	void choose_calibration_dir();
 
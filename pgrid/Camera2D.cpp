@@ -83,4 +83,24 @@ glm::dvec2 Camera2D::mouse_to_scene_coords(double u, double v) {
 	//test.y = -1*( test.y * height);
 	//
 	return test;
-}
\ No newline at end of file
+}
+
+/**
+* Get the zoom of the camera
+*
+* @return screen pixels per scene unit
+*/
+double Camera2D::get_scale() const {
+	return scale;
+}
+
+/**
+* Get the part of the scene the camera shows, i.e. the inverse of the transform applied by apply_cam
+*
+* @return min x, min y, max x and max y of the visible area in scene coordinates
+*/
+glm::dvec4 Camera2D::get_visible_scene_rect() const {
+	const double half_w = width / ppu / (2 * scale);
+	const double half_h = height / ppu / (2 * scale);
+	return glm::dvec4(x - half_w, -y - half_h, x + half_w, -y + half_h);
+}
@@ -45,5 +45,9 @@ public:
 
 	glm::dvec2 mouse_to_scene_coords(double u, double v);
 
+	double get_scale() const;
+
+	glm::dvec4 get_visible_scene_rect() const;
+
 };
 
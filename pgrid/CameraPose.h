@@ -6,11 +6,14 @@ typedef struct {
 	double y_pos;
 	double z_pos;
 
-	// Rotation of camera
-	double pitch_angle; // should be zero for most images unless camera was tilted towards the ground or the sky 
-						// avoid changing pitch angle if at all possible
+	// Rotation of camera. The camera is rolled about its optical axis, then pitched, then yawed.
+	double roll_angle; // rotation about the optical axis, positive turns the camera clockwise as seen from behind it
+					   // (the top of the image towards the right). zero if the phone was held level
+
+	double pitch_angle; // should be zero for most images unless camera was tilted towards the ground or the sky
+						// avoid changing pitch angle if at all possible. positive tilts the camera towards the sky
 
 	double yaw_angle; // z rotation in world coordinate frame. e.g. an image with angle 0 is frontal view
 					  // image towards drivers side is + 90
 					  // image towards passengers side is -90
-}CameraPose;
\ No newline at end of file
+}CameraPose;
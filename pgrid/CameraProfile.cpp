@@ -20,14 +20,37 @@ limitations under the License.
 #endif
 #define sind(x) (sin(fmod((x),360) * M_PI / 180))
 #define cosd(x) (cos(fmod((x),360) * M_PI / 180))
+#include <algorithm>
 #include <cassert>
+#include <cctype>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sys/stat.h>
+#include "ThreadPool.h"
+
+// Sidecar file in the calibration image directory with the corners found in each image
+#define CORNER_CACHE_FILE "pgrid_corner_cache.yml"
+
+// Corner cache entry of one image. Images are matched by file size and modification time.
+typedef struct {
+    double file_size;
+    double mtime;
+    cv::Size image_size;
+    bool found;
+    std::vector<cv::Point2f> corners;
+} CornerCacheEntry;
 
 CameraProfile::CameraProfile() {
-
+    generation = 0;
+    calibration_rms = -1;
+    lut_generation = 0;
+    lut_mutex = std::make_shared<std::mutex>();
 }
 
 int CameraProfile::load_profile(const std::string& input_file) {
     cv::FileStorage infile(input_file, cv::FileStorage::READ);
+    file_path = input_file;
 
     infile["device"] >> device;
     infile["profile_descriptor"] >> profile_descriptor;
@@ -35,174 +58,387 @@ int CameraProfile::load_profile(const std::string& input_file) {
     infile["dist_coeffs"] >> dist_coeffs;
     infile["zoom_level"] >> zoom_level;
     infile["focal_length_mm"] >> focal_length_mm;
+
+    // Profiles written before per view results were saved have none of these
+    infile["board_size"] >> board_size;
+    infile["image_size"] >> calibration_image_size;
+    calibration_rms = -1;
+    if (!infile["calibration_rms"].empty()) {
+        infile["calibration_rms"] >> calibration_rms;
+    }
+
+    calibration_views.clear();
+    cv::FileNode views = infile["calibration_views"];
+    for (cv::FileNodeIterator it = views.begin(); it != views.end(); ++it) {
+        CalibrationView view;
+        int found = 0;
+        (*it)["image"] >> view.image_path;
+        (*it)["found"] >> found;
+        (*it)["reprojection_error"] >> view.reprojection_error;
+        (*it)["corners"] >> view.corners;
+        view.found = found != 0;
+        calibration_views.push_back(view);
+    }
+
+    // Intrinsics changed, anything projected with the old profile is stale
+    generation++;
     return 0;
 }
 
-void CameraProfile::calibrate(const std::string& input_file_dir, std::vector<int> checkerboard_dims) {
-    //cv::setNumThreads(0);
-    assert(checkerboard_dims.size() == 2);
+/**
+* Lists the calibration images in a directory (.jpg, .jpeg and .png, any case)
+*
+* @param input_file_dir directory with the checkerboard images
+*
+* @return sorted image paths
+*/
+static std::vector<std::string> list_calibration_images(const std::string& input_file_dir) {
+    std::vector<cv::String> files;
+    try {
+        cv::glob(input_file_dir, files, false);
+    }
+    catch (const cv::Exception&) {
+        files.clear();
+    }
 
-    // Creating vector to store vectors of 3D points for each checkerboard image
-    std::vector<std::vector<cv::Point3f> > objpoints;
+    std::vector<std::string> images;
+    for (size_t i = 0; i < files.size(); i++) {
+        std::string ext = files[i].substr(files[i].find_last_of(".") + 1);
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return (char)std::tolower(c); });
+        if (ext == "jpg" || ext == "jpeg" || ext == "png") {
+            images.push_back(files[i]);
+        }
+    }
+    std::sort(images.begin(), images.end());
+    return images;
+}
 
-    // Creating vector to store vectors of 2D points for each checkerboard image
-    std::vector<std::vector<cv::Point2f> > imgpoints;
+/**
+* Get the name a calibration image is stored under in the corner cache
+*
+* @param image_path path of the image
+*
+* @return file name without the directory
+*/
+static std::string calibration_image_name(const std::string& image_path) {
+    return image_path.substr(image_path.find_last_of("/\\") + 1);
+}
 
-    // Defining the world coordinates for 3D points
-    std::vector<cv::Point3f> objp;
-    for (int i{ 0 }; i < checkerboard_dims[1]; i++)
-    {
-        for (int j{ 0 }; j < checkerboard_dims[0]; j++)
-            objp.push_back(cv::Point3f(j, i, 0));
+/**
+* Decodes one calibration image and finds the checkerboard corners in it. Only touches its arguments, so it can
+* run on several images at once.
+*
+* @param image_path path of the image
+* @param checkerboard_dims number of inner corners of the checkerboard (width, height)
+* @param image_size set to the size of the image, or an empty size if it could not be read
+*
+* @return view with the refined corners if the checkerboard was found
+*/
+static CalibrationView detect_calibration_view(const std::string& image_path, cv::Size checkerboard_dims, cv::Size& image_size) {
+    CalibrationView view;
+    view.image_path = image_path;
+    view.found = false;
+    view.reprojection_error = -1;
+
+    // Decoding straight to grayscale skips the color conversion and a full size BGR buffer
+    cv::Mat gray = cv::imread(image_path, cv::IMREAD_GRAYSCALE);
+    image_size = gray.size();
+    if (gray.empty()) {
+        return view;
     }
 
+    view.found = cv::findChessboardCorners(
+        gray,
+        checkerboard_dims,
+        view.corners,
+        cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_FAST_CHECK | cv::CALIB_CB_NORMALIZE_IMAGE);
 
-    // Extracting path of individual image stored in a given directory
-    std::vector<cv::String> images;
-    // Path of the folder containing checkerboard images
-    cv::glob(input_file_dir + "\\*.jpg", images);
+    if (view.found) {
+        cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
 
-    cv::Mat frame, gray;
-    // vector to store the pixel coordinates of detected checker board corners 
-    std::vector<cv::Point2f> corner_pts;
-    bool success;
-    cv::namedWindow("image", cv::WINDOW_NORMAL);
-    // Looping over all the images in the directory
-    for (int i{ 0 }; i < images.size(); i++)
-    {
-        std::cout << "Image " << i << std::endl;
-        std::cout << images[i] << std::endl;
-
-        frame = cv::imread(images[i]);
-        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-        // Finding checker board corners
-        // If desired number of corners are found in the image then success = true  
-        success = cv::findChessboardCorners(
-            gray, 
-            cv::Size(checkerboard_dims[0], checkerboard_dims[1]), 
-            corner_pts, 
-            cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_FAST_CHECK | cv::CALIB_CB_NORMALIZE_IMAGE);
-        //success = cv::findChessboardCorners(gray, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE);
-
-        /*
-         * If desired number of corner are detected,
-         * we refine the pixel coordinates and display
-         * them on the images of checker board
-        */
-        if (success)
-        {
-            cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
-
-            // refining pixel coordinates for given 2d points.
-            cv::cornerSubPix(gray, corner_pts, cv::Size(11, 11), cv::Size(-1, -1), criteria);
-
-            // Displaying the detected corner points on the checker board
-            cv::drawChessboardCorners(frame, cv::Size(checkerboard_dims[0], checkerboard_dims[1]), corner_pts, success);
+        // refining pixel coordinates for given 2d points.
+        cv::cornerSubPix(gray, view.corners, cv::Size(11, 11), cv::Size(-1, -1), criteria);
+    }
+    else {
+        view.corners.clear();
+    }
 
-            objpoints.push_back(objp);
-            imgpoints.push_back(corner_pts);
+    return view;
+}
+
+/**
+* Get the file size and modification time of a calibration image, which together identify a version of the image
+* in the corner cache
+*
+* @param image_path path of the image
+* @param entry file_size and mtime are set
+*
+* @return false if the file cannot be accessed
+*/
+static bool stat_calibration_image(const std::string& image_path, CornerCacheEntry& entry) {
+    struct stat buffer;
+    if (stat(image_path.c_str(), &buffer) != 0) {
+        return false;
+    }
+    entry.file_size = (double)buffer.st_size;
+    entry.mtime = (double)buffer.st_mtime;
+    return true;
+}
+
+/**
+* Reads the corner cache of a calibration image directory. Entries for a different checkerboard are ignored.
+*
+* @param cache_path path of the cache file
+* @param checkerboard_dims number of inner corners of the checkerboard (width, height)
+* @param cache filled with the cached entries by image file name
+*/
+static void load_corner_cache(const std::string& cache_path, cv::Size checkerboard_dims,
+    std::map<std::string, CornerCacheEntry>& cache) {
+    cache.clear();
+
+    try {
+        cv::FileStorage infile(cache_path, cv::FileStorage::READ);
+        if (!infile.isOpened()) {
+            return;
+        }
+
+        cv::Size cached_board;
+        infile["board_size"] >> cached_board;
+        if (cached_board != checkerboard_dims) {
+            return;
         }
 
-        cv::imshow("image", frame);
-        cv::waitKey(0);
+        cv::FileNode images = infile["images"];
+        for (cv::FileNodeIterator it = images.begin(); it != images.end(); ++it) {
+            std::string name;
+            CornerCacheEntry entry;
+            int found = 0;
+            (*it)["image"] >> name;
+            (*it)["file_size"] >> entry.file_size;
+            (*it)["mtime"] >> entry.mtime;
+            (*it)["image_size"] >> entry.image_size;
+            (*it)["found"] >> found;
+            (*it)["corners"] >> entry.corners;
+            entry.found = found != 0;
+            cache[name] = entry;
+        }
+    }
+    catch (const cv::Exception&) {
+        // A damaged cache only costs the detection time
+        cache.clear();
     }
+}
 
+/**
+* Writes the corner cache of a calibration image directory. Failing to write it (e.g. a read only directory) only
+* prints a warning.
+*
+* @param cache_path path of the cache file
+* @param checkerboard_dims number of inner corners of the checkerboard (width, height)
+* @param cache entries by image file name
+*/
+static void save_corner_cache(const std::string& cache_path, cv::Size checkerboard_dims,
+    const std::map<std::string, CornerCacheEntry>& cache) {
+    try {
+        cv::FileStorage outfile(cache_path, cv::FileStorage::WRITE);
+        if (!outfile.isOpened()) {
+            printf("Warning: could not write corner cache %s\n", cache_path.c_str());
+            return;
+        }
 
-    cv::Mat camera_intrinsic, dist_coeffs, R, T;
+        outfile << "board_size" << checkerboard_dims;
+        outfile << "images" << "[";
+        for (std::map<std::string, CornerCacheEntry>::const_iterator it = cache.begin(); it != cache.end(); ++it) {
+            outfile << "{";
+            outfile << "image" << it->first;
+            outfile << "file_size" << it->second.file_size;
+            outfile << "mtime" << it->second.mtime;
+            outfile << "image_size" << it->second.image_size;
+            outfile << "found" << (int)it->second.found;
+            outfile << "corners" << it->second.corners;
+            outfile << "}";
+        }
+        outfile << "]";
+    }
+    catch (const cv::Exception& e) {
+        printf("Warning: could not write corner cache %s: %s\n", cache_path.c_str(), e.what());
+    }
+}
 
-    /*
-     * Performing camera calibration by
-     * passing the value of known 3D points (objpoints)
-     * and corresponding pixel coordinates of the
-     * detected corners (imgpoints)
-    */
-    cv::calibrateCamera(objpoints, imgpoints, cv::Size(gray.rows, gray.cols), camera_intrinsic, dist_coeffs, R, T);
+/**
+* Calibrates the camera from a directory of checkerboard images. Images are decoded and searched for corners in
+* parallel, then the intrinsics are solved from every view where the whole checkerboard was found. Nothing is
+* displayed, progress is reported through the callback instead.
+*
+* The corners found in each image are cached in a sidecar file in the image directory, so running the calibration
+* again only detects corners in images that were added or changed since.
+*
+* @param input_file_dir directory with the checkerboard images
+* @param checkerboard_dims number of inner corners of the checkerboard (width, height)
+* @param progress called after each image is processed. May be empty.
+* @param thread_count number of images processed at once. 0 uses one per hardware thread.
+*
+* @return CALIBRATION_SUCCESS, or the reason the calibration failed. The profile is unchanged if it failed.
+*/
+int CameraProfile::calibrate(const std::string& input_file_dir, cv::Size checkerboard_dims,
+    CalibrationProgressCallback progress, size_t thread_count) {
+    if (checkerboard_dims.width < 2 || checkerboard_dims.height < 2) {
+        printf("Error: invalid checkerboard dimensions %d x %d\n", checkerboard_dims.width, checkerboard_dims.height);
+        return CALIBRATION_INVALID_BOARD;
+    }
 
-    //sstd::cout << "cameraMatrix : " << cameraMatrix << std::endl;
-    //sstd::cout << "distCoeffs : " << distCoeffs << std::endl;
-    //sstd::cout << "Rotation vector : " << R << std::endl;
-    //sstd::cout << "Translation vector : " << T << std::endl;
+    std::vector<std::string> images = list_calibration_images(input_file_dir);
+    if (images.empty()) {
+        printf("Error: no calibration images in %s\n", input_file_dir.c_str());
+        return CALIBRATION_NO_IMAGES;
+    }
 
-   //e cv::FileStorage K("C:\\pixel_6_pro.mat", cv::FileStorage::WRITE);
-   //e K << "camera_matrix" << cameraMatrix;
-   //e K << "dist_coeffs" << distCoeffs;
+    std::vector<CalibrationView> views(images.size());
+    std::vector<cv::Size> image_sizes(images.size());
+    std::mutex progress_mutex;
+    int images_done = 0;
+
+    // Images whose size and modification time match the cache reuse the cached corners
+    std::string cache_path = input_file_dir + "/" + CORNER_CACHE_FILE;
+    std::map<std::string, CornerCacheEntry> cache;
+    load_corner_cache(cache_path, checkerboard_dims, cache);
+
+    std::vector<CornerCacheEntry> image_files(images.size());
+    std::vector<size_t> to_detect;
+    for (size_t i = 0; i < images.size(); i++) {
+        if (!stat_calibration_image(images[i], image_files[i])) {
+            to_detect.push_back(i);
+            continue;
+        }
 
-    cv::destroyAllWindows();
-}
+        std::map<std::string, CornerCacheEntry>::const_iterator cached = cache.find(calibration_image_name(images[i]));
+        if (cached == cache.end() || cached->second.file_size != image_files[i].file_size ||
+            cached->second.mtime != image_files[i].mtime) {
+            to_detect.push_back(i);
+            continue;
+        }
 
-void CameraProfile::calibrate(const std::string& input_file_dir, int* checkerboard_dims) {
-    //cv::setNumThreads(0);
-    //assert(checkerboard_dims.size() == 2);
+        views[i].image_path = images[i];
+        views[i].found = cached->second.found;
+        views[i].corners = cached->second.corners;
+        views[i].reprojection_error = -1;
+        image_sizes[i] = cached->second.image_size;
 
-    // Creating vector to store vectors of 3D points for each checkerboard image
-    std::vector<std::vector<cv::Point3f> > objpoints;
+        images_done++;
+        if (progress) {
+            progress(images_done, (int)images.size(), views[i]);
+        }
+    }
 
-    // Creating vector to store vectors of 2D points for each checkerboard image
-    std::vector<std::vector<cv::Point2f> > imgpoints;
+    if (!to_detect.empty()) {
+        // The queue only holds paths and each worker frees its image before taking the next one, so at most
+        // one decoded image per thread is in memory
+        ThreadPool pool(std::min(thread_count == 0 ? ThreadPool::default_thread_count() : thread_count, to_detect.size()));
+        for (size_t j = 0; j < to_detect.size(); j++) {
+            size_t i = to_detect[j];
+            pool.submit([&, i] {
+                views[i] = detect_calibration_view(images[i], checkerboard_dims, image_sizes[i]);
+
+                std::unique_lock<std::mutex> lock(progress_mutex);
+                images_done++;
+                if (progress) {
+                    progress(images_done, (int)images.size(), views[i]);
+                }
+            });
+        }
+        pool.wait();
+    }
 
-    // Defining the world coordinates for 3D points
-    std::vector<cv::Point3f> objp;
-    for (int i{ 0 }; i < checkerboard_dims[1]; i++)
-    {
-        for (int j{ 0 }; j < checkerboard_dims[0]; j++)
-            objp.push_back(cv::Point3f(j, i, 0));
+    // Rewrite the cache if anything was detected or images were removed from the directory
+    if (!to_detect.empty() || cache.size() != images.size()) {
+        std::map<std::string, CornerCacheEntry> new_cache;
+        for (size_t i = 0; i < images.size(); i++) {
+            if (image_sizes[i].empty()) {
+                continue; // Could not be read, try again next time
+            }
+            CornerCacheEntry& entry = new_cache[calibration_image_name(images[i])];
+            entry = image_files[i];
+            entry.image_size = image_sizes[i];
+            entry.found = views[i].found;
+            entry.corners = views[i].corners;
+        }
+        save_corner_cache(cache_path, checkerboard_dims, new_cache);
+    }
+
+    // All views have to be the same size as the first one that was found
+    cv::Size image_size;
+    for (size_t i = 0; i < views.size(); i++) {
+        if (!views[i].found) {
+            continue;
+        }
+        if (image_size.empty()) {
+            image_size = image_sizes[i];
+        }
+        else if (image_sizes[i] != image_size) {
+            printf("Warning: skipping %s, it is %d x %d instead of %d x %d\n", views[i].image_path.c_str(),
+                image_sizes[i].width, image_sizes[i].height, image_size.width, image_size.height);
+            views[i].found = false;
+            views[i].corners.clear();
+        }
     }
 
+    CameraProfile result = *this;
+    result.calibration_views = views;
+    result.board_size = checkerboard_dims;
+    result.calibration_image_size = image_size;
 
-    // Extracting path of individual image stored in a given directory
-    std::vector<cv::String> images;
-    // Path of the folder containing checkerboard images
-    cv::glob(input_file_dir + "\\*.jpg", images);
+    int status = result.solve_calibration();
+    if (status != CALIBRATION_SUCCESS) {
+        return status;
+    }
 
-    cv::Mat frame, gray;
-    // vector to store the pixel coordinates of detected checker board corners 
-    std::vector<cv::Point2f> corner_pts;
-    bool success;
-    cv::namedWindow("image", cv::WINDOW_NORMAL);
-    // Looping over all the images in the directory
-    for (int i{ 0 }; i < images.size(); i++)
+    set_calibration(result);
+    return CALIBRATION_SUCCESS;
+}
+
+int CameraProfile::calibrate(const std::string& input_file_dir, int* checkerboard_dims) {
+    return calibrate(input_file_dir, cv::Size(checkerboard_dims[0], checkerboard_dims[1]));
+}
+
+int CameraProfile::calibrate(const std::string& input_file_dir, std::vector<int> checkerboard_dims) {
+    assert(checkerboard_dims.size() == 2);
+    return calibrate(input_file_dir, cv::Size(checkerboard_dims[0], checkerboard_dims[1]));
+}
+
+/**
+* Solves the intrinsics and distortion coefficients from the calibration views where the checkerboard was found,
+* and stores the reprojection error of each view
+*
+* @return CALIBRATION_SUCCESS, or CALIBRATION_TOO_FEW_VIEWS if fewer than 3 views can be used
+*/
+int CameraProfile::solve_calibration() {
+    // Defining the world coordinates for 3D points
+    std::vector<cv::Point3f> objp;
+    for (int i{ 0 }; i < board_size.height; i++)
     {
-        std::cout << "Image " << i << std::endl;
-        std::cout << images[i] << std::endl;
-
-        frame = cv::imread(images[i]);
-        cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
-
-        // Finding checker board corners
-        // If desired number of corners are found in the image then success = true  
-        success = cv::findChessboardCorners(
-            gray,
-            cv::Size(checkerboard_dims[0], checkerboard_dims[1]),
-            corner_pts,
-            cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_FAST_CHECK | cv::CALIB_CB_NORMALIZE_IMAGE);
-        //success = cv::findChessboardCorners(gray, cv::Size(CHECKERBOARD[0], CHECKERBOARD[1]), corner_pts, cv::CALIB_CB_ADAPTIVE_THRESH | cv::CALIB_CB_NORMALIZE_IMAGE);
-
-        /*
-         * If desired number of corner are detected,
-         * we refine the pixel coordinates and display
-         * them on the images of checker board
-        */
-        if (success)
-        {
-            cv::TermCriteria criteria(cv::TermCriteria::EPS | cv::TermCriteria::MAX_ITER, 30, 0.001);
-
-            // refining pixel coordinates for given 2d points.
-            cv::cornerSubPix(gray, corner_pts, cv::Size(11, 11), cv::Size(-1, -1), criteria);
-
-            // Displaying the detected corner points on the checker board
-            cv::drawChessboardCorners(frame, cv::Size(checkerboard_dims[0], checkerboard_dims[1]), corner_pts, success);
+        for (int j{ 0 }; j < board_size.width; j++)
+            objp.push_back(cv::Point3f(j, i, 0));
+    }
 
+    std::vector<std::vector<cv::Point3f> > objpoints;
+    std::vector<std::vector<cv::Point2f> > imgpoints;
+    std::vector<int> used_views;
+    for (size_t i = 0; i < calibration_views.size(); i++) {
+        calibration_views[i].reprojection_error = -1;
+        if (calibration_views[i].found && calibration_views[i].corners.size() == objp.size()) {
             objpoints.push_back(objp);
-            imgpoints.push_back(corner_pts);
+            imgpoints.push_back(calibration_views[i].corners);
+            used_views.push_back((int)i);
         }
-
-        cv::imshow("image", frame);
-        cv::waitKey(0);
     }
 
+    if (used_views.size() < 3) {
+        printf("Error: the checkerboard was only found in %d images, at least 3 are needed\n", (int)used_views.size());
+        return CALIBRATION_TOO_FEW_VIEWS;
+    }
 
-    cv::Mat R, T;
+    // Solve into new matrices, camera_intrinsic and dist_coeffs may share their data with a copy of the profile
+    cv::Mat new_intrinsic, new_dist_coeffs, R, T, std_intrinsics, std_extrinsics, per_view_errors;
 
     /*
      * Performing camera calibration by
@@ -210,22 +446,67 @@ void CameraProfile::calibrate(const std::string& input_file_dir, int* checkerboa
      * and corresponding pixel coordinates of the
      * detected corners (imgpoints)
     */
-    cv::calibrateCamera(objpoints, imgpoints, cv::Size(gray.rows, gray.cols), camera_intrinsic, dist_coeffs, R, T);
+    calibration_rms = cv::calibrateCamera(objpoints, imgpoints, calibration_image_size, new_intrinsic, new_dist_coeffs,
+        R, T, std_intrinsics, std_extrinsics, per_view_errors);
+    camera_intrinsic = new_intrinsic;
+    dist_coeffs = new_dist_coeffs;
 
-    //sstd::cout << "cameraMatrix : " << cameraMatrix << std::endl;
-    //sstd::cout << "distCoeffs : " << distCoeffs << std::endl;
-    //sstd::cout << "Rotation vector : " << R << std::endl;
-    //sstd::cout << "Translation vector : " << T << std::endl;
+    for (size_t i = 0; i < used_views.size(); i++) {
+        calibration_views[used_views[i]].reprojection_error = per_view_errors.at<double>((int)i);
+    }
 
-   //e cv::FileStorage K("C:\\pixel_6_pro.mat", cv::FileStorage::WRITE);
-   //e K << "camera_matrix" << cameraMatrix;
-   //e K << "dist_coeffs" << distCoeffs;
+    generation++;
+    return CALIBRATION_SUCCESS;
+}
+
+/**
+* Removes views from the calibration and solves it again from the corners already found, e.g. to drop blurry
+* images with a high reprojection error
+*
+* @param view_indices indices of the views to remove
+*
+* @return CALIBRATION_SUCCESS, or CALIBRATION_TOO_FEW_VIEWS if too few views are left. The profile is unchanged
+* if it failed.
+*/
+int CameraProfile::drop_calibration_views(std::vector<int> view_indices) {
+    std::sort(view_indices.begin(), view_indices.end());
+
+    CameraProfile result = *this;
+    for (size_t i = view_indices.size(); i-- > 0;) {
+        if (view_indices[i] >= 0 && view_indices[i] < (int)result.calibration_views.size() &&
+            (i + 1 == view_indices.size() || view_indices[i] != view_indices[i + 1])) {
+            result.calibration_views.erase(result.calibration_views.begin() + view_indices[i]);
+        }
+    }
 
-    cv::destroyAllWindows();
+    int status = result.solve_calibration();
+    if (status != CALIBRATION_SUCCESS) {
+        return status;
+    }
+
+    set_calibration(result);
+    return CALIBRATION_SUCCESS;
+}
+
+/**
+* Copies the calibration of another profile (intrinsics, distortion coefficients and calibration views). The
+* device and descriptor fields are left alone.
+*
+* @param other profile to copy the calibration from
+*/
+void CameraProfile::set_calibration(const CameraProfile& other) {
+    camera_intrinsic = other.camera_intrinsic.clone();
+    dist_coeffs = other.dist_coeffs.clone();
+    calibration_views = other.calibration_views;
+    board_size = other.board_size;
+    calibration_image_size = other.calibration_image_size;
+    calibration_rms = other.calibration_rms;
+    generation++;
 }
 
 void CameraProfile::write_profile(const std::string& output_file) {
     cv::FileStorage outfile(output_file, cv::FileStorage::WRITE);
+    file_path = output_file;
 
     outfile << "device" << device;
     outfile << "profile_descriptor" << profile_descriptor;
@@ -233,71 +514,188 @@ void CameraProfile::write_profile(const std::string& output_file) {
     outfile << "dist_coeffs" << dist_coeffs;
     outfile << "zoom_level" << zoom_level;
     outfile << "focal_length_mm" << focal_length_mm;
+
+    if (!calibration_views.empty()) {
+        outfile << "board_size" << board_size;
+        outfile << "image_size" << calibration_image_size;
+        outfile << "calibration_rms" << calibration_rms;
+
+        // Per view results, so bad views can be dropped later without detecting corners again
+        outfile << "calibration_views" << "[";
+        for (size_t i = 0; i < calibration_views.size(); i++) {
+            outfile << "{";
+            outfile << "image" << calibration_views[i].image_path;
+            outfile << "found" << (int)calibration_views[i].found;
+            outfile << "reprojection_error" << calibration_views[i].reprojection_error;
+            outfile << "corners" << calibration_views[i].corners;
+            outfile << "}";
+        }
+        outfile << "]";
+    }
 }
 
 void CameraProfile::undistort(cv::Mat src_img, cv::Mat dst_img) {
 	cv::undistort(src_img, dst_img, camera_intrinsic, dist_coeffs);
 }
 
-std::vector<cv::Point2f> CameraProfile::img_to_world_transform(std::vector<cv::Point2f> img_points, CameraPose camera_pose) {
-	cv::Mat cam_translation = (cv::Mat_<double>(3, 1) << camera_pose.x_pos, camera_pose.y_pos, camera_pose.z_pos);
-	cv::Mat cam_rotation = (cv::Mat_<double>(3,3) << 1., 0., 0.,
-		0., 0., -1.,
-		0., 1., 0.);
+/**
+* Creates a ground projector for this camera profile and the given camera pose. Use this instead of
+* img_to_world_transform when projecting several batches of points with the same pose. The lens distortion is
+* removed with the undistortion table of the profile, which is built on the first call.
+*
+* @param camera_pose position and rotation of the camera in the world coordinate frame
+*
+* @return projector with the inverse intrinsic matrix, undistortion table and yaw transform precomputed
+*/
+GroundProjector CameraProfile::get_ground_projector(const CameraPose& camera_pose) {
+	return GroundProjector(camera_intrinsic, camera_pose, get_undistortion_lut());
+}
 
-    cv::Mat yaw_matrix = cv::getRotationMatrix2D(cv::Point2f(camera_pose.x_pos, camera_pose.y_pos), camera_pose.yaw_angle, 1.0);
+/**
+* Get the undistortion table of the profile. It is loaded from the cache file next to the profile if that was built
+* for the current intrinsics, and built in parallel and written to the cache otherwise. Safe to call from several
+* threads, the table is built once.
+*
+* @return undistortion table, null if the profile has no intrinsics or no lens distortion
+*/
+std::shared_ptr<const UndistortionLut> CameraProfile::get_undistortion_lut() {
+	std::unique_lock<std::mutex> lock(*lut_mutex);
+
+	if (lut_generation == generation && generation != 0) {
+		return undistortion_lut;
+	}
 
-	//cv::Mat yaw_matrix = (cv::Mat_<double>(2, 2) << 
-	//	cosd(camera_pose.yaw_angle), 
-	//	-sind(camera_pose.yaw_angle), 
-	//	sind(camera_pose.yaw_angle), 
-	//	cosd(camera_pose.yaw_angle));
+	lut_generation = generation;
+	undistortion_lut.reset();
 
+	// Without distortion the inverse intrinsic matrix is exact, there is nothing to look up
+	cv::Size image_size = get_image_size();
+	if (camera_intrinsic.total() != 9 || image_size.empty() || dist_coeffs.empty() || cv::countNonZero(dist_coeffs) == 0) {
+		return undistortion_lut;
+	}
 
-	std::vector<cv::Point2f> world_points(img_points.size());
-	for (int i = 0; i < img_points.size(); i++) {
+	std::shared_ptr<UndistortionLut> lut = std::make_shared<UndistortionLut>();
+	std::string lut_path = get_lut_path();
 
-		cv::Mat img_pixel = (cv::Mat_<double>(3, 1) << img_points[i].x, img_points[i].y, 1);
+	if (lut_path.empty() || lut->load(lut_path) != LUT_SUCCESS ||
+		!lut->matches(camera_intrinsic, dist_coeffs, image_size, UNDISTORTION_LUT_STEP)) {
+		if (lut->build(camera_intrinsic, dist_coeffs, image_size, UNDISTORTION_LUT_STEP) != LUT_SUCCESS) {
+			return undistortion_lut;
+		}
 
-		cv::Mat r = (camera_intrinsic.inv() * img_pixel);
+		// Failing to write the cache (e.g. a read only directory) only costs the build time next time
+		if (!lut_path.empty() && lut->save(lut_path) != LUT_SUCCESS) {
+			printf("Warning: could not write undistortion table %s\n", lut_path.c_str());
+		}
+	}
 
-		cv::Mat r_scaled = r * (focal_length_mm / 10.f);
+	undistortion_lut = lut;
+	return undistortion_lut;
+}
 
-		cv::Mat world_coord = cam_rotation * r_scaled + cam_translation;
+/**
+* Get the path of the undistortion table cache, the profile file with the extension replaced by .lut
+*
+* @return cache path, empty if the profile was not loaded from or written to a file
+*/
+std::string CameraProfile::get_lut_path() const {
+	if (file_path.empty()) {
+		return "";
+	}
 
-		// Intersect parametrically defined line with plane z = 0
-		// s: parameter variable of line
+	size_t dot = file_path.find_last_of('.');
+	size_t slash = file_path.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return file_path + ".lut";
+	}
+	return file_path.substr(0, dot) + ".lut";
+}
 
-		float s = (cam_translation.at<double>(2, 0)) / (world_coord.at<double>(2, 0) - cam_translation.at<double>(2, 0));
-		
-        cv::Mat intercept = (cv::Mat_<double>(3,1) <<
-			(world_coord.at<double>(0,0) - cam_translation.at<double>(0,0))*s + cam_translation.at<double>(0,0), 
-			-1*(world_coord.at<double>(1,0) - cam_translation.at<double>(1,0)) * s + cam_translation.at<double>(1,0), 1.0);
-        
-        cv::Mat ground_point = yaw_matrix * intercept;
-		//cv::Mat intercept_mat = cv::Mat(intercept, false);
-        //
-		//intercept_mat = yaw_matrix * intercept_mat;
-		//
-		//intercept_mat.copyTo(cv::Mat(intercept, false));
+/**
+* Get the size of the images the intrinsics are for. Profiles written before the image size was saved assume the
+* principal point is at the image center.
+*
+* @return image size in pixels, empty if unknown
+*/
+cv::Size CameraProfile::get_image_size() const {
+	if (!calibration_image_size.empty()) {
+		return calibration_image_size;
+	}
+	if (camera_intrinsic.total() != 9) {
+		return cv::Size();
+	}
 
-		world_points[i].x = ground_point.at<double>(0,0);
-        world_points[i].y = ground_point.at<double>(1, 0);
+	cv::Mat k;
+	camera_intrinsic.convertTo(k, CV_64F);
+	return cv::Size((int)std::round(2 * k.at<double>(0, 2)), (int)std::round(2 * k.at<double>(1, 2)));
+}
 
-	}
+/**
+* Projects image points onto the ground plane (z = 0) using this camera profile and the given camera pose
+*
+* @param img_points points in image u v coordinates
+* @param camera_pose position and rotation of the camera in the world coordinate frame
+*
+* @return projected points in the world coordinate frame
+*/
+std::vector<cv::Point2f> CameraProfile::img_to_world_transform(const std::vector<cv::Point2f>& img_points, const CameraPose& camera_pose) {
+	std::vector<cv::Point2f> world_points;
+
+	img_to_world_transform(img_points, camera_pose, world_points);
 
 	return world_points;
 }
 
-std::vector<cv::Point2f> CameraProfile::undistort_points(std::vector<cv::Point2f> src_points) {
+/**
+* Projects image points onto the ground plane (z = 0) into a caller provided buffer. The input and output may be
+* the same buffer, then the points are projected in place.
+*
+* @param img_points points in image u v coordinates, a std::vector<cv::Point2f> or a 2 channel float Mat
+* @param camera_pose position and rotation of the camera in the world coordinate frame
+* @param world_points receives the projected points in the world coordinate frame. Its memory is reused if it is
+* large enough.
+*/
+void CameraProfile::img_to_world_transform(cv::InputArray img_points, const CameraPose& camera_pose, cv::OutputArray world_points) {
+	cv::Mat src = img_points.getMat();
+	int count = src.empty() ? 0 : src.checkVector(2, CV_32F);
+	CV_Assert(count >= 0 && (count == 0 || src.isContinuous()));
+
+	world_points.create(count, 1, CV_32FC2);
+	if (count == 0) {
+		return;
+	}
 
-    std::vector<cv::Point2f> undistorted(src_points.size());
+	cv::Mat dst = world_points.getMat();
+	get_ground_projector(camera_pose).project(src.ptr<cv::Point2f>(), dst.ptr<cv::Point2f>(), (size_t)count);
+}
 
-    cv::undistortPoints(src_points, undistorted, camera_intrinsic, dist_coeffs);
+/**
+* Removes the lens distortion of image points
+*
+* @param src_points distorted points in image u v coordinates
+*
+* @return undistorted points in normalized camera coordinates
+*/
+std::vector<cv::Point2f> CameraProfile::undistort_points(const std::vector<cv::Point2f>& src_points) {
+
+    std::vector<cv::Point2f> undistorted;
+
+    undistort_points(src_points, undistorted);
 
     return undistorted;
 }
 
+/**
+* Removes the lens distortion of image points into a caller provided buffer
+*
+* @param src_points distorted points in image u v coordinates
+* @param dst_points receives the undistorted points in normalized camera coordinates. Its memory is reused if it is
+* large enough.
+*/
+void CameraProfile::undistort_points(cv::InputArray src_points, cv::OutputArray dst_points) {
+    cv::undistortPoints(src_points, dst_points, camera_intrinsic, dist_coeffs);
+}
+
 
 float* CameraProfile::get_focal_length_ptr() {
     return &focal_length_mm;
@@ -319,4 +717,32 @@ cv::Mat CameraProfile::get_camera_matrix() {
 
 cv::Mat CameraProfile::get_dist_coeffs() {
     return dist_coeffs;
+}
+
+/**
+* Get the generation of the camera profile. The generation is incremented every time the intrinsics change
+* (loading a profile or calibrating), so callers can tell whether results derived from the profile are stale.
+*
+* @return generation counter
+*/
+unsigned int CameraProfile::get_generation() {
+    return generation;
+}
+
+/**
+* Get the views of the last calibration with their reprojection errors
+*
+* @return calibration views in image name order, empty if the profile was not calibrated or was saved without them
+*/
+const std::vector<CalibrationView>& CameraProfile::get_calibration_views() const {
+    return calibration_views;
+}
+
+/**
+* Get the overall RMS reprojection error of the last calibration
+*
+* @return RMS reprojection error in pixels, negative if unknown
+*/
+double CameraProfile::get_calibration_rms() const {
+    return calibration_rms;
 }
\ No newline at end of file
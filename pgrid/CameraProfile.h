@@ -1,8 +1,32 @@
 #pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 #include <opencv2/opencv.hpp>
 #include "CameraPose.h"
-#include "imgui_stdlib.h"
+#include "GroundProjector.h"
+#include "UndistortionLut.h"
+
+#define CALIBRATION_SUCCESS 0
+#define CALIBRATION_INVALID_BOARD 1
+#define CALIBRATION_NO_IMAGES 2
+#define CALIBRATION_TOO_FEW_VIEWS 3
+
+// Distance in pixels between the nodes of the undistortion table
+#define UNDISTORTION_LUT_STEP 16
+
+// One checkerboard image used for calibration
+typedef struct {
+	std::string image_path;
+	bool found; // true if the whole checkerboard was detected
+	std::vector<cv::Point2f> corners; // refined corners in image pixels, empty if not found
+	double reprojection_error; // RMS reprojection error in pixels, negative if the view was not used
+} CalibrationView;
+
+// Called after each calibration image is processed. Calls are serialized but come from worker threads.
+typedef std::function<void(int images_done, int image_count, const CalibrationView& view)> CalibrationProgressCallback;
 
 class CameraProfile
 {
@@ -21,6 +45,20 @@ private:
 
 	float focal_length_mm;
 
+	// Incremented whenever camera_intrinsic or dist_coeffs change
+	unsigned int generation;
+
+	// Views and results of the last calibration, kept so bad views can be dropped without detecting corners again
+	std::vector<CalibrationView> calibration_views;
+	cv::Size board_size;
+	cv::Size calibration_image_size;
+	double calibration_rms;
+
+	// Undistortion table, built the first time it is needed and cached next to the profile file. The mutex is
+	// shared with copies of the profile, they only ever replace the table as a whole.
+	std::shared_ptr<const UndistortionLut> undistortion_lut;
+	unsigned int lut_generation;
+	std::shared_ptr<std::mutex> lut_mutex;
 
 public:
 	std::string profile_descriptor; // e.g. Pixel 6 Pro Standard
@@ -33,12 +71,32 @@ public:
 
 	void undistort(cv::Mat src_img, cv::Mat dst_img);
 
-	std::vector<cv::Point2f> undistort_points(std::vector<cv::Point2f> src_pts);
+	std::vector<cv::Point2f> undistort_points(const std::vector<cv::Point2f>& src_pts);
+
+	void undistort_points(cv::InputArray src_pts, cv::OutputArray dst_pts);
+
+	int calibrate(const std::string& input_file_dir, cv::Size checkerboard_dims,
+		CalibrationProgressCallback progress = CalibrationProgressCallback(), size_t thread_count = 0);
+	int calibrate(const std::string& input_file_dir, int* checkerboard_dims);
+	int calibrate(const std::string& input_file_dir, std::vector<int> checkerboard_dims);
+
+	int solve_calibration();
+
+	int drop_calibration_views(std::vector<int> view_indices);
+
+	void set_calibration(const CameraProfile& other);
+
+	GroundProjector get_ground_projector(const CameraPose& camera_pose);
+
+	std::shared_ptr<const UndistortionLut> get_undistortion_lut();
+
+	std::string get_lut_path() const;
+
+	cv::Size get_image_size() const;
 
-	void calibrate(const std::string& input_file_dir, int* checkerboard_dims);
-	void calibrate(const std::string& input_file_dir, std::vector<int> checkerboard_dims);
+	std::vector<cv::Point2f> img_to_world_transform(const std::vector<cv::Point2f>& img_points, const CameraPose& camera_pose);
 
-	std::vector<cv::Point2f> img_to_world_transform(std::vector<cv::Point2f> img_points, CameraPose camera_pose);
+	void img_to_world_transform(cv::InputArray img_points, const CameraPose& camera_pose, cv::OutputArray world_points);
 
 	float* get_focal_length_ptr();
 	float* get_zoom_level_ptr();
@@ -48,6 +106,9 @@ public:
 
 	cv::Mat get_camera_matrix();
 	cv::Mat get_dist_coeffs();
+	unsigned int get_generation();
+	const std::vector<CalibrationView>& get_calibration_views() const;
+	double get_calibration_rms() const;
 	//std::string* get_camera_ptr();
 };
 
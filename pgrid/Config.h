@@ -14,6 +14,7 @@ class OutputFile;
 class MarkerIndex;
 class PerspectivePanel;
 class CameraProfile;
+class FramebufferPool;
 
 enum app_mode {
 	GRID,
@@ -43,6 +44,9 @@ typedef struct {
 	//}
 
 	bool image_loaded;
+
+	// GPU memory budget for cached image tiles
+	int tile_cache_mb;
 }ImageConfig;
 
 typedef struct {
@@ -80,6 +84,7 @@ typedef struct {
 	OutputFile* outfile;
 	MarkerIndex* marker_index;
 	PerspectivePanel* perspective_panel;
+	FramebufferPool* framebuffer_pool;
 
 	//template<class Archive>
 	//void serialize(Archive& archive)
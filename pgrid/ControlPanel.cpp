@@ -18,6 +18,7 @@ limitations under the License.
 #include "Config.h"
 #include "Painter.h"
 #include "Image.h"
+#include "MarkerIndex.h"
 #include "PerspectivePanel.h"
 #include "nfd.h"
 
@@ -30,6 +31,22 @@ ControlPanel::ControlPanel(SessionConfig* config) {
 	measurement_config = config->measurement_config;
 	img_config = config->img_config;
 	paint_config = config->paint_config;
+	output_status = FILE_OPEN_SUCCESS;
+}
+
+/**
+* Writes the projected points to the output file and keeps the status for the Output Settings
+*
+* @param overwrite replace the output file if it exists
+*/
+void ControlPanel::write_output(bool overwrite) {
+	output_status = app_config->outfile->open(overwrite);
+	if (output_status != FILE_OPEN_SUCCESS) {
+		return;
+	}
+
+	app_config->outfile->write_output(app_config->painter->project_points());
+	output_status = app_config->outfile->close();
 }
 
 void ControlPanel::choose_output_file() {
@@ -67,7 +84,7 @@ void ControlPanel::choose_calibration_dir() {
 
 		wchar_t** path = NULL;
 
-		img_config->camera_profile->calibrate(cal_dir, { 12,9 });
+		img_config->camera_profile->calibrate(cal_dir, cv::Size(12, 9));
 
 		//strcpy_s(app_config->outfile_path, (char*)outpath);
 		//free(outpath);
@@ -172,9 +189,20 @@ void ControlPanel::layout() {
 		ImGui::Combo("Alignment Mode", &(grid_config->calibration_mode),
 			grid_calibration_modes, IM_ARRAYSIZE(grid_calibration_modes));
 
-		if (ImGui::Button("Find Markers")) {
+		if (app_config->image->is_finding_markers()) {
+			ImGui::Text("Finding markers...");
+		}
+		else if (ImGui::Button("Find Markers")) {
 			app_config->image->find_markers();
 		}
+
+		int index_status = app_config->marker_index->get_status();
+		if (index_status == MARKER_INDEX_FILE_ERROR) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Marker index not found: %s", app_config->marker_index_filepath);
+		}
+		else if (index_status != MARKER_INDEX_SUCCESS) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Marker index is damaged: %s", app_config->marker_index_filepath);
+		}
 	}
 
 	ImGui::SetNextItemOpen(true, ImGuiCond_Once);
@@ -187,6 +215,33 @@ void ControlPanel::layout() {
 
 		ImGui::SeparatorText("Camera Rotation");
 		ImGui::InputDouble("Yaw Angle (deg)", &(img_config->cam_pose->yaw_angle), 1.0, 1.0, "%.3f");
+		ImGui::InputDouble("Pitch Angle (deg)", &(img_config->cam_pose->pitch_angle), 0.1, 1.0, "%.3f");
+		ImGui::InputDouble("Roll Angle (deg)", &(img_config->cam_pose->roll_angle), 0.1, 1.0, "%.3f");
+
+		ImGui::SeparatorText("Pose From Markers");
+		if (app_config->image->is_finding_markers()) {
+			ImGui::Text("Finding markers and solving the pose...");
+		}
+		else if (ImGui::Button("Estimate Pose From Markers")) {
+			app_config->image->estimate_pose();
+		}
+
+		int pose_status = app_config->image->get_pose_status();
+		if (pose_status == POSE_SUCCESS) {
+			const PoseSolution& solution = app_config->image->get_pose_solution();
+			ImGui::Text("Solved from %d markers, %d of %d corners within %.1f px, RMS %.2f px",
+				(int)app_config->image->get_pose_marker_count(), solution.inlier_count, (int)solution.residuals.size(),
+				PoseEstimator().get_reprojection_threshold(), solution.inlier_rms);
+		}
+		else if (pose_status == POSE_NO_CAMERA_PROFILE) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "No pose, load a camera profile first");
+		}
+		else if (pose_status == POSE_TOO_FEW_POINTS) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "No pose, no markers from the marker index were found");
+		}
+		else if (pose_status >= 0) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "No pose, the markers do not agree on one");
+		}
 	}
 
 	ImGui::SetNextItemOpen(true, ImGuiCond_Once);
@@ -241,11 +296,15 @@ void ControlPanel::layout() {
 		ImGui::Text("Mouse X: %f, Mouse Y: %f", (view_config->mouse_x), (view_config->mouse_y));
 		ImGui::Text("Scene X: %f, Scene Y: %f", (view_config->scene_x), (view_config->scene_y));
 		if (img_config->image_loaded) {
-			std::vector<double> uv_coord = app_config->painter->scene_to_uv_coord(view_config->scene_x, view_config->scene_y);
-			assert(uv_coord.size() == 2);
+			Affine2D<SceneFrame, UvFrame> to_uv = app_config->image->get_scene_to_uv();
 
-			ImGui::Text("Image U: %f, Image V: %f", uv_coord[0], uv_coord[1]);
+			ImGui::Text("Image U: %f, Image V: %f", to_uv.apply_x(view_config->scene_x, view_config->scene_y),
+				to_uv.apply_y(view_config->scene_x, view_config->scene_y));
 		}
+
+		FramebufferPool* framebuffer_pool = app_config->framebuffer_pool;
+		ImGui::Text("Framebuffers: %u allocated, %u reused, %.1f MB", framebuffer_pool->get_allocation_count(),
+			framebuffer_pool->get_reuse_count(), framebuffer_pool->get_allocated_bytes() / (1024.0 * 1024.0));
 		//World x and world y;
 	}
 
@@ -296,6 +355,28 @@ void ControlPanel::layout() {
 		ImGui::InputFloat("Grid height (meters)", &(grid_config->height), 0, 100);
 		ImGui::InputInt("Longitudinal divisions", &(grid_config->divs_x), 1, 100);
 		ImGui::InputInt("Lateral divisions", &(grid_config->divs_y), 1, 100);
+
+		ImGui::Text("Transform solved %u times, last solve %.2f ms", grid_config->grid->get_solve_count(),
+			grid_config->grid->get_last_solve_ms());
+
+		if (grid_config->calibration_mode == 1 || grid_config->calibration_mode == 2) {
+			const HomographySolution& solution = grid_config->grid->get_homography_solution();
+			if (solution.H.empty()) {
+				ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "No homography, at least 4 points are needed");
+			}
+			else {
+				ImGui::Text("%s homography, %d of %d points within %.1f px, RMS %.2f px",
+					HomographySolver::method_name(solution.method).c_str(), solution.inlier_count,
+					(int)solution.residuals.size(), grid_config->grid->get_inlier_threshold(), solution.inlier_rms);
+
+				for (size_t i = 0; i < solution.residuals.size(); i++) {
+					if (!solution.inliers[i]) {
+						ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "%s %d is off by %.1f px",
+							grid_config->calibration_mode == 1 ? "Reference point" : "Marker corner", (int)i, solution.residuals[i]);
+					}
+				}
+			}
+		}
 	}
 
 	ImGui::SetNextItemOpen(false, ImGuiCond_Once);
@@ -310,6 +391,17 @@ void ControlPanel::layout() {
 			ImGui::InputFloat("X coord", &(ref_point->ref_x));
 			ImGui::InputFloat("Y coord", &(ref_point->ref_y));
 
+			// Residuals are only meaningful for the points the current transform was solved from
+			const HomographySolution& solution = grid_config->grid->get_homography_solution();
+			if (grid_config->calibration_mode == 1 && (size_t)i < solution.residuals.size()) {
+				if (solution.inliers[i]) {
+					ImGui::Text("Residual %.2f px", solution.residuals[i]);
+				}
+				else {
+					ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Residual %.2f px, outlier", solution.residuals[i]);
+				}
+			}
+
 			if (ImGui::Button("Delete Point")) {
 				grid_config->ref_points.erase(grid_config->ref_points.begin() + i);
 			}
@@ -346,14 +438,53 @@ void ControlPanel::layout() {
 		ImGui::Combo("Seat Height", app_config->outfile->get_seat_height_ptr(),
 			app_config->outfile->seat_height_options_display, IM_ARRAYSIZE(app_config->outfile->seat_height_options_display));
 		ImGui::Checkbox("Append?", app_config->outfile->get_append_ptr());
+		if (ImGui::Combo("Format", app_config->outfile->get_format_ptr(),
+			app_config->outfile->format_options_display, IM_ARRAYSIZE(app_config->outfile->format_options_display))) {
+			// Swap the extension of the output file to match the format
+			app_config->outfile->set_outfile_name(app_config->outfile_name);
+		}
 
 		if (ImGui::Button("Write Output")) {
-			int status = app_config->outfile->open();
-			// TODO: logic for edge cases
+			write_output(false);
+			if (output_status == FILE_OPEN_CHECK_OVERWRITE) {
+				ImGui::OpenPopup("Overwrite Output?");
+			}
+		}
+
+		ImVec2 center = ImGui::GetMainViewport()->GetCenter();
+		ImGui::SetNextWindowPos(center, ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
+		if (ImGui::BeginPopupModal("Overwrite Output?", NULL, ImGuiWindowFlags_AlwaysAutoResize)) {
+			ImGui::Text("%s already exists.\nReplace it, or check Append? to add to it?", app_config->outfile_path);
+			ImGui::Separator();
+			if (ImGui::Button("Replace", ImVec2(120, 0))) {
+				write_output(true);
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::SetItemDefaultFocus();
+			ImGui::SameLine();
+			if (ImGui::Button("Cancel", ImVec2(120, 0))) {
+				output_status = FILE_OPEN_SUCCESS;
+				ImGui::CloseCurrentPopup();
+			}
+			ImGui::EndPopup();
+		}
 
-			app_config->outfile->write_output(app_config->painter->project_points());
-			app_config->outfile->close();
+		if (output_status == FILE_OPEN_APPEND_TO_NONEXISTENT) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Nothing to append to, uncheck Append? to create the file");
 		}
+		else if (output_status == FILE_OPEN_EMPTY_PATH) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "No output file, choose one first");
+		}
+		else if (output_status == FILE_OPEN_SCHEMA_MISMATCH) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Not appended, the file has other columns or another format");
+		}
+		else if (output_status == FILE_OPEN_ERROR) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Could not open the output file");
+		}
+		else if (output_status == FILE_WRITE_ERROR) {
+			ImGui::TextColored(ImVec4(1.0f, 0.3f, 0.3f, 1.0f), "Write failed, the output file was left as it was");
+		}
+
 		if (app_config->outfile->is_saved()) {
 			ImGui::Text("Output has been saved");
 		}
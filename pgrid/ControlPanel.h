@@ -4,6 +4,7 @@
 #include "imgui.h"
 #include "Grid.h"
 #include "OutputFile.h"
+#include "FramebufferPool.h"
 
 class ControlPanel
 {
@@ -14,6 +15,11 @@ class ControlPanel
 	ImageConfig* img_config;
 	PainterConfig* paint_config;
 
+	// Status of the last Write Output, FILE_OPEN_SUCCESS or one of the FILE_ errors
+	int output_status;
+
+	void write_output(bool overwrite);
+
 public:
 	ControlPanel(SessionConfig* config);
 	
@@ -0,0 +1,38 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "CoordinateFrames.h"
+
+/**
+* Applies a 2x3 affine matrix to an array of points. Uses cv::transform over headers on the arrays, which is
+* vectorized and works in place, so no points are copied.
+*
+* @param m row major 2x3 affine matrix
+* @param src points to transform
+* @param dst receives the transformed points, may be src
+* @param count number of points
+*/
+void transform_points(const double* m, const cv::Point2f* src, cv::Point2f* dst, size_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	cv::Mat matrix(2, 3, CV_64F, (void*)m);
+	cv::Mat src_header((int)count, 1, CV_32FC2, (void*)src);
+	cv::Mat dst_header((int)count, 1, CV_32FC2, (void*)dst);
+
+	cv::transform(src_header, dst_header, matrix);
+}
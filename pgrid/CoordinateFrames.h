@@ -0,0 +1,145 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <opencv2/core.hpp>
+
+// Coordinate frames of the application. They are only used as template arguments, so a transform can only be
+// applied to and composed with the frames it was made for.
+//
+//   MouseFrame   window pixels, origin at the top left of the window, y down
+//   SceneFrame   perspective scene, image pixels with the origin at the image center, y up
+//   UvFrame      image pixels, origin at the top left of the image, y down (OpenCV image coordinates)
+//   OrthoFrame   ground plane in cm, as the grid transform solves it
+//   WorldFrame   ground plane in meters from the measurement origin, as points are exported
+struct MouseFrame {};
+struct SceneFrame {};
+struct UvFrame {};
+struct OrthoFrame {};
+struct WorldFrame {};
+
+void transform_points(const double* m, const cv::Point2f* src, cv::Point2f* dst, size_t count);
+
+/**
+* The Affine2D class is a 2D affine transform from one coordinate frame to another,
+*
+*   x' = xx * x + xy * y + x0
+*   y' = yx * x + yy * y + y0
+*
+* Transforms are constexpr, so fixed ones can be composed and inverted at compile time. Arrays of points are
+* transformed in place with cv::transform, which is vectorized.
+*/
+template <typename From, typename To>
+class Affine2D
+{
+public:
+	double xx, xy, x0;
+	double yx, yy, y0;
+
+	constexpr Affine2D(double xx, double xy, double x0, double yx, double yy, double y0) :
+		xx(xx), xy(xy), x0(x0), yx(yx), yy(yy), y0(y0) {}
+
+	static constexpr Affine2D identity() {
+		return Affine2D(1, 0, 0, 0, 1, 0);
+	}
+
+	constexpr double apply_x(double x, double y) const {
+		return xx * x + xy * y + x0;
+	}
+
+	constexpr double apply_y(double x, double y) const {
+		return yx * x + yy * y + y0;
+	}
+
+	cv::Point2d apply(const cv::Point2d& point) const {
+		return cv::Point2d(apply_x(point.x, point.y), apply_y(point.x, point.y));
+	}
+
+	cv::Point2f apply(const cv::Point2f& point) const {
+		return cv::Point2f((float)apply_x(point.x, point.y), (float)apply_y(point.x, point.y));
+	}
+
+	// Transforms count points from src into dst. src and dst may be the same array.
+	void apply(const cv::Point2f* src, cv::Point2f* dst, size_t count) const {
+		const double m[6] = { xx, xy, x0, yx, yy, y0 };
+		transform_points(m, src, dst, count);
+	}
+
+	void apply(cv::Point2f* points, size_t count) const {
+		apply(points, points, count);
+	}
+
+	void apply(std::vector<cv::Point2f>& points) const {
+		apply(points.data(), points.data(), points.size());
+	}
+
+	// Homogeneous 3x3 matrix of the transform, e.g. to fold it into a homography
+	cv::Matx33d matrix() const {
+		return cv::Matx33d(xx, xy, x0, yx, yy, y0, 0, 0, 1);
+	}
+
+	// Inverse transform. The transform must not be singular.
+	constexpr Affine2D<To, From> inverse() const {
+		return Affine2D<To, From>(
+			yy / (xx * yy - xy * yx), -xy / (xx * yy - xy * yx),
+			(xy * y0 - yy * x0) / (xx * yy - xy * yx),
+			-yx / (xx * yy - xy * yx), xx / (xx * yy - xy * yx),
+			(yx * x0 - xx * y0) / (xx * yy - xy * yx));
+	}
+
+	// Composition, (this * first) applies first and then this
+	template <typename Before>
+	constexpr Affine2D<Before, To> operator*(const Affine2D<Before, From>& first) const {
+		return Affine2D<Before, To>(
+			xx * first.xx + xy * first.yx, xx * first.xy + xy * first.yy, xx * first.x0 + xy * first.y0 + x0,
+			yx * first.xx + yy * first.yx, yx * first.xy + yy * first.yy, yx * first.x0 + yy * first.y0 + y0);
+	}
+};
+
+/**
+* Scene to uv coordinates of an image. The scene origin is at the image center, rounded down to whole pixels like
+* the image is drawn.
+*
+* @param image_width width of the image in pixels
+* @param image_height height of the image in pixels
+*/
+constexpr Affine2D<SceneFrame, UvFrame> scene_to_uv(int image_width, int image_height) {
+	return Affine2D<SceneFrame, UvFrame>(1, 0, image_width / 2, 0, -1, image_height / 2);
+}
+
+/**
+* Uv to scene coordinates of an image, the inverse of scene_to_uv
+*
+* @param image_width width of the image in pixels
+* @param image_height height of the image in pixels
+*/
+constexpr Affine2D<UvFrame, SceneFrame> uv_to_scene(int image_width, int image_height) {
+	return scene_to_uv(image_width, image_height).inverse();
+}
+
+/**
+* Mouse to scene coordinates of a panel showing the scene
+*
+* @param panel_x x position of the panel in the window in pixels
+* @param panel_y y position of the panel in the window in pixels
+* @param panel_width width of the panel in pixels
+* @param panel_height height of the panel in pixels
+* @param zoom zoom of the panel view
+* @param pan_x pan of the panel view in scene units
+* @param pan_y pan of the panel view in scene units, positive down
+*/
+constexpr Affine2D<MouseFrame, SceneFrame> mouse_to_scene(double panel_x, double panel_y, double panel_width,
+	double panel_height, double zoom, double pan_x, double pan_y) {
+	return Affine2D<MouseFrame, SceneFrame>(
+		1 / zoom, 0, -(panel_x + panel_width / 2) / zoom + pan_x,
+		0, -1 / zoom, (panel_y + panel_height / 2) / zoom - pan_y);
+}
+
+/**
+* Ortho (cm) to world (meters) coordinates
+*
+* @param origin_x x of the measurement origin in ortho coordinates
+* @param origin_y y of the measurement origin in ortho coordinates
+*/
+constexpr Affine2D<OrthoFrame, WorldFrame> ortho_to_world(double origin_x, double origin_y) {
+	return Affine2D<OrthoFrame, WorldFrame>(0.01, 0, -origin_x / 100, 0, 0.01, -origin_y / 100);
+}
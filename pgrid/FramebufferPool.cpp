@@ -0,0 +1,241 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "FramebufferPool.h"
+#include <iostream>
+
+/**
+* Creates an empty pool. No GL calls are made until the first framebuffer is acquired.
+*
+* @param max_free number of released framebuffers kept for reuse, the oldest is deleted beyond that
+* @param size_step attachments are allocated in multiples of this many pixels, so small resizes reuse them
+*/
+FramebufferPool::FramebufferPool(size_t max_free, GLsizei size_step) {
+	this->max_free = max_free;
+	this->size_step = size_step > 0 ? size_step : 1;
+
+	allocation_count = 0;
+	reuse_count = 0;
+	allocated_bytes = 0;
+}
+
+/**
+* Rounds a size up to the next allocation step
+*
+* @param size requested size in pixels
+*
+* @return size to allocate in pixels
+*/
+GLsizei FramebufferPool::round_up(GLsizei size) const {
+	return ((size + size_step - 1) / size_step) * size_step;
+}
+
+/**
+* Estimates the GPU memory of a framebuffer. RGB color is stored with 4 bytes per pixel by most drivers, plus 4
+* bytes of depth and stencil.
+*
+* @param framebuffer allocated framebuffer
+*
+* @return size of the attachments in bytes
+*/
+size_t FramebufferPool::framebuffer_bytes(const Framebuffer& framebuffer) {
+	return (size_t)framebuffer.alloc_width * framebuffer.alloc_height * 8;
+}
+
+/**
+* Allocates the framebuffer object and its color texture and depth/stencil attachments
+*
+* @param alloc_width width of the attachments in pixels
+* @param alloc_height height of the attachments in pixels
+* @param framebuffer receives the new framebuffer
+*
+* @return FRAMEBUFFER_SUCCESS, or FRAMEBUFFER_INCOMPLETE if the driver rejected the attachments
+*/
+int FramebufferPool::allocate(GLsizei alloc_width, GLsizei alloc_height, Framebuffer& framebuffer) {
+	framebuffer.alloc_width = alloc_width;
+	framebuffer.alloc_height = alloc_height;
+
+	glGenFramebuffers(1, &framebuffer.fbo);
+	glGenTextures(1, &framebuffer.tex);
+	glGenRenderbuffers(1, &framebuffer.rbo);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
+
+	glBindTexture(GL_TEXTURE_2D, framebuffer.tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
+		alloc_width, alloc_height, 0,
+		GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebuffer.tex, 0);
+
+	glBindRenderbuffer(GL_RENDERBUFFER, framebuffer.rbo);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, alloc_width, alloc_height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, framebuffer.rbo);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	allocation_count++;
+	allocated_bytes += framebuffer_bytes(framebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE) {
+		std::cout << "Framebuffer of " << alloc_width << "x" << alloc_height << " is incomplete, status " << status << std::endl;
+		destroy(framebuffer);
+		return FRAMEBUFFER_INCOMPLETE;
+	}
+	return FRAMEBUFFER_SUCCESS;
+}
+
+/**
+* Deletes the GL objects of a framebuffer
+*
+* @param framebuffer framebuffer to delete, reset to empty
+*/
+void FramebufferPool::destroy(Framebuffer& framebuffer) {
+	if (framebuffer.fbo == 0) {
+		return;
+	}
+
+	glDeleteFramebuffers(1, &framebuffer.fbo);
+	glDeleteTextures(1, &framebuffer.tex);
+	glDeleteRenderbuffers(1, &framebuffer.rbo);
+
+	allocated_bytes -= framebuffer_bytes(framebuffer);
+	framebuffer = Framebuffer();
+}
+
+/**
+* Gets a framebuffer of at least the requested size, reusing a released one if one of the same allocation size is
+* available. Needs a current GL context.
+*
+* @param width width the panel draws at in pixels
+* @param height height the panel draws at in pixels
+* @param framebuffer receives the framebuffer. Must be empty, or it is leaked.
+*
+* @return FRAMEBUFFER_SUCCESS, FRAMEBUFFER_INVALID_SIZE for an empty size or FRAMEBUFFER_INCOMPLETE
+*/
+int FramebufferPool::acquire(GLsizei width, GLsizei height, Framebuffer& framebuffer) {
+	framebuffer = Framebuffer();
+	if (width <= 0 || height <= 0) {
+		return FRAMEBUFFER_INVALID_SIZE;
+	}
+
+	GLsizei alloc_width = round_up(width);
+	GLsizei alloc_height = round_up(height);
+
+	// Most recently released first, it is the most likely to be resident
+	for (size_t i = free_framebuffers.size(); i > 0; i--) {
+		if (free_framebuffers[i - 1].alloc_width == alloc_width && free_framebuffers[i - 1].alloc_height == alloc_height) {
+			framebuffer = free_framebuffers[i - 1];
+			free_framebuffers.erase(free_framebuffers.begin() + (i - 1));
+			framebuffer.width = width;
+			framebuffer.height = height;
+			reuse_count++;
+			return FRAMEBUFFER_SUCCESS;
+		}
+	}
+
+	int status = allocate(alloc_width, alloc_height, framebuffer);
+	framebuffer.width = width;
+	framebuffer.height = height;
+	return status;
+}
+
+/**
+* Fits a framebuffer to a new panel size. The attachments are only swapped if the size crosses an allocation step,
+* otherwise only the used size changes. Needs a current GL context.
+*
+* @param framebuffer framebuffer of the panel, may be empty
+* @param width width the panel draws at in pixels
+* @param height height the panel draws at in pixels
+*
+* @return FRAMEBUFFER_SUCCESS, FRAMEBUFFER_INVALID_SIZE for an empty size or FRAMEBUFFER_INCOMPLETE
+*/
+int FramebufferPool::resize(Framebuffer& framebuffer, GLsizei width, GLsizei height) {
+	if (width <= 0 || height <= 0) {
+		return FRAMEBUFFER_INVALID_SIZE;
+	}
+
+	if (framebuffer.fbo != 0 &&
+		framebuffer.alloc_width == round_up(width) && framebuffer.alloc_height == round_up(height)) {
+		framebuffer.width = width;
+		framebuffer.height = height;
+		return FRAMEBUFFER_SUCCESS;
+	}
+
+	release(framebuffer);
+	return acquire(width, height, framebuffer);
+}
+
+/**
+* Returns a framebuffer to the pool for reuse. Needs a current GL context if the pool is full.
+*
+* @param framebuffer framebuffer to release, reset to empty
+*/
+void FramebufferPool::release(Framebuffer& framebuffer) {
+	if (framebuffer.fbo == 0) {
+		return;
+	}
+
+	free_framebuffers.push_back(framebuffer);
+	framebuffer = Framebuffer();
+
+	while (free_framebuffers.size() > max_free) {
+		destroy(free_framebuffers.front());
+		free_framebuffers.erase(free_framebuffers.begin());
+	}
+}
+
+/**
+* Deletes every released framebuffer. Framebuffers still held by panels must be released first. Needs a current GL
+* context.
+*/
+void FramebufferPool::clear() {
+	for (size_t i = 0; i < free_framebuffers.size(); i++) {
+		destroy(free_framebuffers[i]);
+	}
+	free_framebuffers.clear();
+}
+
+/**
+* Get the number of framebuffers allocated so far
+*
+* @return allocation count
+*/
+unsigned int FramebufferPool::get_allocation_count() const {
+	return allocation_count;
+}
+
+/**
+* Get the number of requests that were served with a released framebuffer instead of allocating one
+*
+* @return reuse count
+*/
+unsigned int FramebufferPool::get_reuse_count() const {
+	return reuse_count;
+}
+
+/**
+* Get the estimated GPU memory of all framebuffers, held by panels or released
+*
+* @return bytes allocated
+*/
+size_t FramebufferPool::get_allocated_bytes() const {
+	return allocated_bytes;
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <GL/glew.h>
+#include <GL/GL.h>
+#include <cstddef>
+#include <vector>
+
+#define FRAMEBUFFER_SUCCESS 0
+#define FRAMEBUFFER_INCOMPLETE 1
+#define FRAMEBUFFER_INVALID_SIZE 2
+
+// Offscreen render target of a panel. The attachments are allocated in steps, so they can be larger than the part
+// the panel draws into.
+typedef struct {
+	GLuint fbo;
+	GLuint tex;
+	GLuint rbo;
+
+	// Part of the attachments the panel uses
+	GLsizei width;
+	GLsizei height;
+
+	// Size the attachments were allocated with
+	GLsizei alloc_width;
+	GLsizei alloc_height;
+} Framebuffer;
+
+/**
+* The FramebufferPool class owns the offscreen framebuffers the panels render into. Attachments are only allocated
+* when a panel grows past its allocated size, and framebuffers released by one panel are reused by the next request
+* of the same allocation size, from any panel. Allocations are counted so the cost of resizing can be checked.
+*/
+class FramebufferPool
+{
+private:
+	// Framebuffers released for reuse, oldest first
+	std::vector<Framebuffer> free_framebuffers;
+	size_t max_free;
+
+	// Attachments are allocated in multiples of this many pixels
+	GLsizei size_step;
+
+	unsigned int allocation_count;
+	unsigned int reuse_count;
+	size_t allocated_bytes;
+
+	GLsizei round_up(GLsizei size) const;
+
+	static size_t framebuffer_bytes(const Framebuffer& framebuffer);
+
+	int allocate(GLsizei alloc_width, GLsizei alloc_height, Framebuffer& framebuffer);
+
+	void destroy(Framebuffer& framebuffer);
+
+public:
+	FramebufferPool(size_t max_free = 4, GLsizei size_step = 128);
+
+	int acquire(GLsizei width, GLsizei height, Framebuffer& framebuffer);
+
+	int resize(Framebuffer& framebuffer, GLsizei width, GLsizei height);
+
+	void release(Framebuffer& framebuffer);
+
+	void clear();
+
+	unsigned int get_allocation_count() const;
+
+	unsigned int get_reuse_count() const;
+
+	size_t get_allocated_bytes() const;
+};
@@ -36,9 +36,100 @@ Grid::Grid(SessionConfig* session_config, float x0, float y0,
 	//corner[1] = GridCorner(x1, y1, false);
 	//corner[2] = GridCorner(x2, y2, false);
 	//corner[3] = GridCorner(x3, y3, false);
+
+	revision = 0;
+
+	// Nothing has been solved or built yet
+	transform_inputs = TransformInputs();
+	transform_solved = false;
+	solve_count = 0;
+	last_solve_ms = 0;
+
+	line_inputs = LineInputs();
+	lines_built = false;
+	ortho_line_inputs = LineInputs();
+	ortho_lines_built = false;
 }
 
+/**
+* Keeps the perspective transform (pM and pM_inv) up to date. The transform is cached and only solved again when
+* one of its inputs changed: the grid corners in corner mode, the reference points in point calibration mode, or
+* the detected marker points in marker mode, and the grid dimensions. Called every frame by the perspective panel.
+*/
 void Grid::compute_perspective_transform() {
+	// There is no grid in markerless mode
+	if (grid_config->calibration_mode == 3) {
+		return;
+	}
+
+	if (transform_solved && transform_inputs_equal(get_transform_inputs(), transform_inputs)) {
+		return;
+	}
+
+	cv::TickMeter timer;
+	timer.start();
+	solve_perspective_transform();
+	timer.stop();
+
+	last_solve_ms = timer.getTimeMilli();
+	solve_count++;
+
+	// Point and marker modes move the corners to the solved grid, so the inputs are captured after solving
+	transform_inputs = get_transform_inputs();
+	transform_solved = true;
+}
+
+/**
+* Captures the current value of every input the perspective transform is solved from
+*
+* @return current transform inputs
+*/
+Grid::TransformInputs Grid::get_transform_inputs() {
+	TransformInputs inputs = TransformInputs();
+
+	inputs.calibration_mode = grid_config->calibration_mode;
+	inputs.width = grid_config->width;
+	inputs.height = grid_config->height;
+	for (unsigned int i = 0; i < corner.size(); i++) {
+		inputs.corners.push_back(cv::Point2f(corner[i].x, corner[i].y));
+	}
+
+	if (grid_config->calibration_mode == 1) {
+		for (unsigned int i = 0; i < grid_config->ref_points.size(); i++) {
+			inputs.src_points.push_back(cv::Point2f((float)grid_config->ref_points[i].get_x(), (float)grid_config->ref_points[i].get_y()));
+			inputs.dst_points.push_back(cv::Point2f(grid_config->ref_points[i].get_ref_x(), grid_config->ref_points[i].get_ref_y()));
+		}
+	}
+	else if (grid_config->calibration_mode == 2) {
+		inputs.src_points = img_config->scene_points;
+		inputs.dst_points = img_config->world_points;
+	}
+
+	return inputs;
+}
+
+/**
+* Compares two sets of transform inputs
+*
+* @param a first set of transform inputs
+* @param b second set of transform inputs
+*
+* @return true if a transform solved from a is still valid for b
+*/
+bool Grid::transform_inputs_equal(const TransformInputs& a, const TransformInputs& b) {
+	return a.calibration_mode == b.calibration_mode &&
+		a.width == b.width &&
+		a.height == b.height &&
+		a.corners == b.corners &&
+		a.src_points == b.src_points &&
+		a.dst_points == b.dst_points;
+}
+
+/**
+* Solves the perspective transform from the inputs of the current calibration mode. In point and marker calibration
+* modes the homography solver is used and the corners are moved to the solved grid.
+*/
+void Grid::solve_perspective_transform() {
 
 	if(grid_config->calibration_mode == 0) {
 		std::vector<cv::Point2f> src_shape(4);
@@ -54,8 +145,8 @@ void Grid::compute_perspective_transform() {
 		dst_shape[2] = cv::Point2f(corner[0].x + (grid_config->width)*100, corner[0].y + (grid_config->height) * 100);
 		dst_shape[3] = cv::Point2f(corner[0].x + (grid_config->width)*100, corner[0].y);
 
-		this->pM = cv::getPerspectiveTransform(dst_shape, src_shape);
-		this->pM_inv = cv::getPerspectiveTransform(src_shape, dst_shape);
+		set_transform(cv::getPerspectiveTransform(dst_shape, src_shape),
+			cv::getPerspectiveTransform(src_shape, dst_shape));
 		return;
 	}
 	else if (grid_config->calibration_mode == 1) {
@@ -69,82 +160,20 @@ void Grid::compute_perspective_transform() {
 			
 			dst_shape[i].x = grid_config->ref_points[i].get_ref_x() * 100;
 			dst_shape[i].y = grid_config->ref_points[i].get_ref_y()* 100;
-			//src_shape[i] = cv::Point2f(grid_config->ref_points[i].get_x(), grid_config->ref_points[i].get_y());
-			//dst_shape[i] = cv::Point2f(grid_config->ref_points[i].get_ref_x(), grid_config->ref_points[i].get_ref_y());
 		}
 
-
-		this->pM = cv::findHomography(dst_shape, src_shape,
-			cv::RHO,
-			8, cv::noArray(), 5000);
-		this->pM_inv = cv::findHomography(src_shape, dst_shape,
-			cv::RHO,
-			8, cv::noArray(), 5000);
-
-		std::vector<cv::Point2f> ortho_corners(4);
-		ortho_corners[0].x = 0;
-		ortho_corners[0].y = 0;
-		ortho_corners[1].x = 0;
-		ortho_corners[1].y = (grid_config->height)*100;
-		ortho_corners[2].x = (grid_config->width)*100;
-		ortho_corners[2].y = (grid_config->height)*100;
-		ortho_corners[3].x = (grid_config->width)*100;
-		ortho_corners[3].y = 0;
-
-		std::vector < cv::Point2f> persp_corners(4);
-
-		cv::perspectiveTransform(ortho_corners, persp_corners, pM);
-		corner[0].x = persp_corners[0].x;
-		corner[0].y = persp_corners[0].y;
-		corner[1].x = persp_corners[1].x;
-		corner[1].y = persp_corners[1].y;
-		corner[2].x = persp_corners[2].x;
-		corner[2].y = persp_corners[2].y;
-		corner[3].x = persp_corners[3].x;
-		corner[3].y = persp_corners[3].y;
-				
-		//this->pM = cv::getPerspectiveTransform(dst_shape, src_shape);
-		//this->pM_inv = cv::getPerspectiveTransform(src_shape, dst_shape);
+		solve_homography(dst_shape, src_shape);
 		return;
 	}
 	else if (grid_config->calibration_mode == 2) {
-		//this->pM = cv::getPerspectiveTransform(img_config->world_points, img_config->scene_points);
-		//this->pM_inv = cv::getPerspectiveTransform(img_config->scene_points, img_config->world_points);
-
 		std::vector<cv::Point2f> scaled_world_points(img_config->world_points.size());
 
-
 		for (int i = 0; i < scaled_world_points.size(); i++) {
 			scaled_world_points[i].x = img_config->world_points[i].x * 100;
 			scaled_world_points[i].y = img_config->world_points[i].y * 100;
 		}
 
-		this->pM = cv::findHomography(scaled_world_points, img_config->scene_points, cv::RHO, 8, cv::noArray(), 5000);
-		this->pM_inv = cv::findHomography(img_config->scene_points, scaled_world_points, cv::RHO, 8, cv::noArray(), 5000);
-
-		std::vector<cv::Point2f> ortho_corners(4);
-		ortho_corners[0].x = 0;
-		ortho_corners[0].y = 0;
-		ortho_corners[1].x = 0;
-		ortho_corners[1].y = (grid_config->height)*100;
-		ortho_corners[2].x = (grid_config->width)*100;
-		ortho_corners[2].y = (grid_config->height)*100;
-		ortho_corners[3].x = (grid_config->width)*100;
-		ortho_corners[3].y = 0;
-		
-		std::vector < cv::Point2f> persp_corners(4);
-		
-		cv::perspectiveTransform(ortho_corners, persp_corners, pM);
-		
-		corner[0].x = persp_corners[0].x;
-		corner[0].y = persp_corners[0].y;
-		corner[1].x = persp_corners[1].x;
-		corner[1].y = persp_corners[1].y;
-		corner[2].x = persp_corners[2].x;
-		corner[2].y = persp_corners[2].y;
-		corner[3].x = persp_corners[3].x;
-		corner[3].y = persp_corners[3].y;
-
+		solve_homography(scaled_world_points, img_config->scene_points);
 		return;
 	}
 	else if (grid_config->calibration_mode == 3) {
@@ -153,207 +182,288 @@ void Grid::compute_perspective_transform() {
 	
 }
 
-void Grid::draw_ortho() {
+/**
+* Solves the transform of point and marker calibration with the homography solver and moves the corners to the
+* solved grid. The solver estimates world to scene once and inverts it, instead of estimating both directions.
+* Without a solution the transform is cleared and the corners stay where they are.
+*
+* @param world_points world coordinates of the reference points or marker corners in cm
+* @param scene_points scene coordinates of the same points
+*/
+void Grid::solve_homography(const std::vector<cv::Point2f>& world_points, const std::vector<cv::Point2f>& scene_points) {
+	int status = homography_solver.solve(world_points, scene_points, homography_solution);
+	if (status != HOMOGRAPHY_SUCCESS || homography_solution.H_inv.empty()) {
+		set_transform(cv::Mat(), cv::Mat());
+		return;
+	}
 
-	std::vector<cv::Point2f> src_shape(4);
-	std::vector<cv::Point2f> dst_shape(4);
+	set_transform(homography_solution.H, homography_solution.H_inv);
+
+	std::vector<cv::Point2f> ortho_corners(4);
+	ortho_corners[0].x = 0;
+	ortho_corners[0].y = 0;
+	ortho_corners[1].x = 0;
+	ortho_corners[1].y = (grid_config->height)*100;
+	ortho_corners[2].x = (grid_config->width)*100;
+	ortho_corners[2].y = (grid_config->height)*100;
+	ortho_corners[3].x = (grid_config->width)*100;
+	ortho_corners[3].y = 0;
+
+	std::vector<cv::Point2f> persp_corners(4);
+
+	cv::perspectiveTransform(ortho_corners, persp_corners, pM);
+
+	for (unsigned int i = 0; i < 4; i++) {
+		corner[i].x = persp_corners[i].x;
+		corner[i].y = persp_corners[i].y;
+	}
+}
+
+/**
+* Stores a newly computed perspective transform and its inverse. The revision is only incremented when the
+* transform actually changed, since compute_perspective_transform is called every frame.
+*
+* @param new_pM transform from world coordinates to scene coordinates
+* @param new_pM_inv transform from scene coordinates to world coordinates
+*/
+void Grid::set_transform(const cv::Mat& new_pM, const cv::Mat& new_pM_inv) {
+	bool changed = new_pM_inv.size() != pM_inv.size() || new_pM_inv.type() != pM_inv.type() ||
+		(!new_pM_inv.empty() && cv::norm(new_pM_inv, pM_inv, cv::NORM_INF) != 0);
+
+	pM = new_pM;
+	pM_inv = new_pM_inv;
+
+	if (changed) {
+		revision++;
+	}
+}
+
+/**
+* Captures the current value of every input the grid lines are built from
+*
+* @return current line inputs
+*/
+Grid::LineInputs Grid::get_line_inputs() {
+	LineInputs inputs = LineInputs();
+
+	inputs.revision = revision;
+	inputs.width = grid_config->width;
+	inputs.height = grid_config->height;
+	inputs.divs_x = grid_config->divs_x;
+	inputs.divs_y = grid_config->divs_y;
+
+	return inputs;
+}
+
+/**
+* Compares two sets of line inputs
+*
+* @param a first set of line inputs
+* @param b second set of line inputs
+*
+* @return true if lines built from a are still valid for b
+*/
+bool Grid::line_inputs_equal(const LineInputs& a, const LineInputs& b) {
+	return a.revision == b.revision &&
+		a.width == b.width &&
+		a.height == b.height &&
+		a.divs_x == b.divs_x &&
+		a.divs_y == b.divs_y;
+}
+
+/**
+* Builds the vertices of the grid outline and grid lines in the perspective scene. The grid lines are laid out in
+* world coordinates and transformed into the scene with a single perspectiveTransform call.
+*/
+void Grid::build_lines() {
+	line_vertices.clear();
+	line_colors.clear();
 
+	// TODO: make line colors a configurable option
+	const cv::Point3f orange(1.00f, 0.38f, 0.00f);
+	const cv::Point3f cyan(0.00f, 1.00f, 1.00f);
+	const cv::Point3f magenta(1.00f, 0.00f, 1.00f);
+
+	// Outline through the corners
+	for (int i = 0; i < 4; i++) {
+		line_vertices.push_back(cv::Point2f(corner[i].x, corner[i].y));
+		line_vertices.push_back(cv::Point2f(corner[(i + 1) % 4].x, corner[(i + 1) % 4].y));
+		line_colors.push_back(orange);
+		line_colors.push_back(orange);
+	}
+
+	line_inputs = get_line_inputs();
+	lines_built = true;
+
+	if (pM.empty() || pM_inv.empty()) {
+		return;
+	}
+
+	std::vector<cv::Point2f> src_shape(4);
 	src_shape[0] = cv::Point2f(corner[0].x, corner[0].y);
 	src_shape[1] = cv::Point2f(corner[1].x, corner[1].y);
 	src_shape[2] = cv::Point2f(corner[2].x, corner[2].y);
 	src_shape[3] = cv::Point2f(corner[3].x, corner[3].y);
 
-	dst_shape[0] = cv::Point2f(0, 0);
-	dst_shape[1] = cv::Point2f(0, grid_config->height*100);
-	dst_shape[2] = cv::Point2f( grid_config->width*100,  grid_config->height*100);
-	dst_shape[3] = cv::Point2f(grid_config->width*100, 0);
-
 	std::vector<cv::Point2f> ortho_corners(4);
-
 	cv::perspectiveTransform(src_shape, ortho_corners, pM_inv);
-	glLineWidth(1);
-
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glColor3f(0.0f, 0.0f, 1.0f);
 
-	for (unsigned int i = 0; i < ortho_corners.size(); i++) {
-		glBegin(GL_POLYGON);
-		glVertex2f(dst_shape[i].x - 50, dst_shape[i].y - 50);
-		glVertex2f(dst_shape[i].x - 50, dst_shape[i].y + 50);
-		glVertex2f(dst_shape[i].x + 50, dst_shape[i].y + 50);
-		glVertex2f(dst_shape[i].x + 50, dst_shape[i].y - 50);
-		glEnd();
-	}
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	std::vector<cv::Point2f> world_points;
 
 	float x_offset = (grid_config->width * 100) / grid_config->divs_x;
 	for (int i = 1; i < grid_config->divs_x; i++) {
-		std::vector<cv::Point2f> points(2);
-		std::vector<cv::Point2f> ortho(2);
-		points[0] = cv::Point2f(dst_shape[0].x + x_offset * i, dst_shape[0].y);
-		points[1] = cv::Point2f(dst_shape[1].x + x_offset * i, dst_shape[1].y);
-
-		cv::perspectiveTransform(points, ortho, pM);
+		world_points.push_back(cv::Point2f(ortho_corners[0].x + x_offset * i, ortho_corners[0].y));
+		world_points.push_back(cv::Point2f(ortho_corners[1].x + x_offset * i, ortho_corners[1].y));
 
-		glColor3f(1.00f, 0.38f, 0.00f);
-		if ((grid_config->divs_x - i + 3) % 5 == 0) {
-			glColor3f(0.00f, 1.00f, 1.00f);
-		}
-
-		//glBegin(GL_LINES);
-		//glVertex2f(ortho[0].x, ortho[0].y);
-		//glVertex2f(ortho[1].x, ortho[1].y);
-		//glEnd();
-		glBegin(GL_LINES);
-		glVertex2f(points[0].x, points[0].y);
-		glVertex2f(points[1].x, points[1].y);
-		glEnd();
+		cv::Point3f color = ((grid_config->divs_x - i + 3) % 5 == 0) ? cyan : orange;
+		line_colors.push_back(color);
+		line_colors.push_back(color);
 	}
 
 	float y_offset = (grid_config->height * 100) / grid_config->divs_y;
-
 	for (int i = 1; i < grid_config->divs_y; i++) {
-		std::vector<cv::Point2f> points(2);
-		std::vector<cv::Point2f> ortho(2);
-
-		points[0] = cv::Point2f(dst_shape[0].x, dst_shape[0].y + y_offset * i);
-		points[1] = cv::Point2f(dst_shape[3].x, dst_shape[3].y + y_offset * i);
+		world_points.push_back(cv::Point2f(ortho_corners[0].x, ortho_corners[0].y + y_offset * i));
+		world_points.push_back(cv::Point2f(ortho_corners[3].x, ortho_corners[3].y + y_offset * i));
 
-		cv::perspectiveTransform(points, ortho, pM);
-
-		glColor3f(1.00f, 0.38f, 0.00f);
-		if ((grid_config->divs_y - i + 0) % 5 == 0) {
-			glColor3f(1.00f, 0.00f, 1.00f);
-		}
+		cv::Point3f color = ((grid_config->divs_y - i + 0) % 5 == 0) ? magenta : orange;
+		line_colors.push_back(color);
+		line_colors.push_back(color);
+	}
 
-		//glBegin(GL_LINES);
-		//glVertex2f(ortho[0].x, ortho[0].y);
-		//glVertex2f(ortho[1].x, ortho[1].y);
-		//glEnd();
-		glBegin(GL_LINES);
-		glVertex2f(points[0].x, points[0].y);
-		glVertex2f(points[1].x, points[1].y);
-		glEnd();
+	if (world_points.empty()) {
+		return;
 	}
+
+	std::vector<cv::Point2f> scene_points;
+	cv::perspectiveTransform(world_points, scene_points, pM);
+	line_vertices.insert(line_vertices.end(), scene_points.begin(), scene_points.end());
 }
 
-void Grid::draw() {
-	for (int i = 0; i < 4; i++) {
-		corner[i].draw();
-	}
+/**
+* Builds the vertices of the corner markers and grid lines in the orthographic scene
+*/
+void Grid::build_ortho_lines() {
+	ortho_line_vertices.clear();
+	ortho_line_colors.clear();
 
-	// TODO: make line colors a configurable option
-	glColor3f(1.00f, 0.38f, 0.00f);
-
-	glBegin(GL_LINES);
-		glVertex2f(corner[0].x, corner[0].y);
-		glVertex2f(corner[1].x, corner[1].y);
-	glEnd();
-	glBegin(GL_LINES);
-		glVertex2f(corner[1].x, corner[1].y);
-		glVertex2f(corner[2].x, corner[2].y);
-	glEnd();
-	glBegin(GL_LINES);
-		glVertex2f(corner[2].x, corner[2].y);
-		glVertex2f(corner[3].x, corner[3].y);
-	glEnd();
-	glBegin(GL_LINES);
-		glVertex2f(corner[3].x, corner[3].y);
-		glVertex2f(corner[0].x, corner[0].y);
-	glEnd();
+	const cv::Point3f blue(0.00f, 0.00f, 1.00f);
+	const cv::Point3f orange(1.00f, 0.38f, 0.00f);
+	const cv::Point3f cyan(0.00f, 1.00f, 1.00f);
+	const cv::Point3f magenta(1.00f, 0.00f, 1.00f);
 
-	std::vector<cv::Point2f> src_shape(4);
 	std::vector<cv::Point2f> dst_shape(4);
-	
-	src_shape[0] = cv::Point2f(corner[0].x, corner[0].y);
-	src_shape[1] = cv::Point2f(corner[1].x, corner[1].y);
-	src_shape[2] = cv::Point2f(corner[2].x, corner[2].y);
-	src_shape[3] = cv::Point2f(corner[3].x, corner[3].y);
-	
-	dst_shape[0] = cv::Point2f(corner[0].x, corner[0].y);
-	dst_shape[1] = cv::Point2f(corner[0].x, corner[0].y + grid_config->height);
-	dst_shape[2] = cv::Point2f(corner[0].x + grid_config->width, corner[0].y + grid_config->height);
-	dst_shape[3] = cv::Point2f(corner[0].x + grid_config->width, corner[0].y);
+	dst_shape[0] = cv::Point2f(0, 0);
+	dst_shape[1] = cv::Point2f(0, grid_config->height*100);
+	dst_shape[2] = cv::Point2f( grid_config->width*100,  grid_config->height*100);
+	dst_shape[3] = cv::Point2f(grid_config->width*100, 0);
 
-	//pM = cv::getPerspectiveTransform(dst_shape, src_shape);
-	//pM_inv = cv::getPerspectiveTransform(src_shape, dst_shape);
+	// Square outline around each corner
+	for (unsigned int i = 0; i < dst_shape.size(); i++) {
+		cv::Point2f square[4] = {
+			cv::Point2f(dst_shape[i].x - 50, dst_shape[i].y - 50),
+			cv::Point2f(dst_shape[i].x - 50, dst_shape[i].y + 50),
+			cv::Point2f(dst_shape[i].x + 50, dst_shape[i].y + 50),
+			cv::Point2f(dst_shape[i].x + 50, dst_shape[i].y - 50) };
+
+		for (int j = 0; j < 4; j++) {
+			ortho_line_vertices.push_back(square[j]);
+			ortho_line_vertices.push_back(square[(j + 1) % 4]);
+			ortho_line_colors.push_back(blue);
+			ortho_line_colors.push_back(blue);
+		}
+	}
 
-	//std::vector<cv::Point2f> perspective_corners(4);
-	if (grid_config->calibration_mode == 1) {
-		//static int prev_ref_point_size = grid_config->ref_points.size();
-		compute_perspective_transform();
+	float x_offset = (grid_config->width * 100) / grid_config->divs_x;
+	for (int i = 1; i < grid_config->divs_x; i++) {
+		ortho_line_vertices.push_back(cv::Point2f(dst_shape[0].x + x_offset * i, dst_shape[0].y));
+		ortho_line_vertices.push_back(cv::Point2f(dst_shape[1].x + x_offset * i, dst_shape[1].y));
+
+		cv::Point3f color = ((grid_config->divs_x - i + 3) % 5 == 0) ? cyan : orange;
+		ortho_line_colors.push_back(color);
+		ortho_line_colors.push_back(color);
 	}
-	else {
-		compute_perspective_transform();
+
+	float y_offset = (grid_config->height * 100) / grid_config->divs_y;
+	for (int i = 1; i < grid_config->divs_y; i++) {
+		ortho_line_vertices.push_back(cv::Point2f(dst_shape[0].x, dst_shape[0].y + y_offset * i));
+		ortho_line_vertices.push_back(cv::Point2f(dst_shape[3].x, dst_shape[3].y + y_offset * i));
+
+		cv::Point3f color = ((grid_config->divs_y - i + 0) % 5 == 0) ? magenta : orange;
+		ortho_line_colors.push_back(color);
+		ortho_line_colors.push_back(color);
 	}
 
-	std::vector<cv::Point2f> ortho_corners(4);
+	ortho_line_inputs = get_line_inputs();
+	ortho_lines_built = true;
+}
 
-	cv::perspectiveTransform(src_shape, ortho_corners, pM_inv);
-	glLineWidth(1);
+/**
+* Draws line segments from client side vertex arrays with a single draw call
+*
+* @param vertices start and end point of every segment
+* @param colors color of every vertex
+*/
+void Grid::draw_lines(const std::vector<cv::Point2f>& vertices, const std::vector<cv::Point3f>& colors) {
+	if (vertices.empty()) {
+		return;
+	}
 
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	//glColor3f(0.0f, 0.0f, 1.0f);
-	//
-	//for (unsigned int i = 0; i < ortho_corners.size(); i++) {
-	//	glBegin(GL_POLYGON);
-	//		glVertex2f(ortho_corners[i].x - 50, ortho_corners[i].y - 50);
-	//		glVertex2f(ortho_corners[i].x - 50, ortho_corners[i].y + 50);
-	//		glVertex2f(ortho_corners[i].x + 50, ortho_corners[i].y + 50);
-	//		glVertex2f(ortho_corners[i].x + 50, ortho_corners[i].y - 50);
-	//	glEnd();
-	//}
-	//glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2, GL_FLOAT, 0, vertices.data());
+	glColorPointer(3, GL_FLOAT, 0, colors.data());
 
-	float x_offset = (grid_config->width * 100) / grid_config->divs_x;
-	for(int i = 1; i < grid_config->divs_x; i++) {
-		std::vector<cv::Point2f> points(2);
-		std::vector<cv::Point2f> ortho(2);
-		points[0] = cv::Point2f(ortho_corners[0].x + x_offset * i, ortho_corners[0].y);
-		points[1] = cv::Point2f(ortho_corners[1].x + x_offset * i, ortho_corners[1].y);
+	glDrawArrays(GL_LINES, 0, (GLsizei)vertices.size());
 
-		cv::perspectiveTransform(points, ortho, pM);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
 
-		glColor3f(1.00f, 0.38f, 0.00f);
-		if ((grid_config->divs_x - i + 3) % 5 == 0) {
-			glColor3f(0.00f, 1.00f, 1.00f);
-		}
+/**
+* Get the vertices of the grid outline and grid lines in the perspective scene, rebuilt only if the grid changed
+*
+* @return start and end point of every line segment
+*/
+const std::vector<cv::Point2f>& Grid::get_line_vertices() {
+	if (!lines_built || !line_inputs_equal(get_line_inputs(), line_inputs)) {
+		build_lines();
+	}
+	return line_vertices;
+}
 
-		glBegin(GL_LINES);
-			glVertex2f(ortho[0].x, ortho[0].y);
-			glVertex2f(ortho[1].x, ortho[1].y);
-		glEnd();
-		//glBegin(GL_LINES);
-		//	glVertex2f(points[0].x, points[0].y);
-		//	glVertex2f(points[1].x, points[1].y);
-		//glEnd();
+/**
+* Get the vertices of the corner markers and grid lines in the orthographic scene, rebuilt only if the grid changed
+*
+* @return start and end point of every line segment
+*/
+const std::vector<cv::Point2f>& Grid::get_ortho_line_vertices() {
+	if (!ortho_lines_built || !line_inputs_equal(get_line_inputs(), ortho_line_inputs)) {
+		build_ortho_lines();
 	}
+	return ortho_line_vertices;
+}
 
-	float y_offset = (grid_config->height* 100) / grid_config->divs_y;
+void Grid::draw_ortho() {
+	glLineWidth(1);
 
-	for (int i = 1; i < grid_config->divs_y; i++) {
-		std::vector<cv::Point2f> points(2);
-		std::vector<cv::Point2f> ortho(2);
+	draw_lines(get_ortho_line_vertices(), ortho_line_colors);
 
-		points[0] = cv::Point2f(ortho_corners[0].x, ortho_corners[0].y + y_offset * i);
-		points[1] = cv::Point2f(ortho_corners[3].x, ortho_corners[3].y + y_offset * i);
+	glColor3f(1.0f, 1.0f, 1.0f);
+}
 
-		cv::perspectiveTransform(points, ortho, pM);
+/**
+* Draws the corners, the grid lines and the reference points in the perspective scene. The perspective panel calls
+* compute_perspective_transform every frame, also when it is not redrawn, so the transform is already up to date here.
+*/
+void Grid::draw() {
+	for (int i = 0; i < 4; i++) {
+		corner[i].draw();
+	}
 
-		glColor3f(1.00f, 0.38f, 0.00f);
-		if ((grid_config->divs_y - i + 0) % 5 == 0) {
-			glColor3f(1.00f, 0.00f, 1.00f);
-		}
+	glLineWidth(1);
+
+	draw_lines(get_line_vertices(), line_colors);
 
-		glBegin(GL_LINES);
-			glVertex2f(ortho[0].x, ortho[0].y);
-			glVertex2f(ortho[1].x, ortho[1].y);
-		glEnd();
-		//glBegin(GL_LINES);
-		//	glVertex2f(points[0].x, points[0].y);
-		//	glVertex2f(points[1].x, points[1].y);
-		//glEnd();
-	}  
 	for (unsigned int i = 0; i < grid_config->ref_points.size(); i++) {
 		grid_config->ref_points[i].draw();
 	}
@@ -366,23 +476,27 @@ float Grid::distance(float x0, float y0,
 	return sqrt(pow(x1 - x0, 2) + pow(y1 - y0, 2));
 }
 
+/**
+* Finds the grid corner under the mouse
+*
+* @param x x position in scene coordinates
+* @param y y position in scene coordinates
+*
+* @return index of the closest corner within the click radius, or -1 if there is none
+*/
 int Grid::grab(float x, float y) {
-	static int click_radius = 100;
-	if (distance(x, y, corner[0].x, corner[0].y) <= click_radius) {
-		return 0;
-	}
-	else if (distance(x, y, corner[1].x, corner[1].y) <= click_radius) {
-		return 1;
-	}
-	else if (distance(x, y, corner[2].x, corner[2].y) <= click_radius) {
-		return 2;
-	}
-	else if (distance(x, y, corner[3].x, corner[3].y) <= click_radius) {
-		return 3;
-	}
-	else {
-		return -1;
+	// There are only four corners, a scan is all it takes
+	int nearest = -1;
+	float nearest_distance = corner_click_radius * corner_click_radius;
+	for (unsigned int i = 0; i < corner.size(); i++) {
+		float dx = corner[i].x - x;
+		float dy = corner[i].y - y;
+		if (dx * dx + dy * dy <= nearest_distance) {
+			nearest = (int)i;
+			nearest_distance = dx * dx + dy * dy;
+		}
 	}
+	return nearest;
 }
 
 
@@ -393,12 +507,14 @@ void Grid::move_corner(int corner_idx,
 	}
 	corner[corner_idx].x = x;
 	corner[corner_idx].y = y;
+	revision++;
 }
 
 void Grid::nudge_corner(int corner_idx,
 	float x, float y) {
 	corner[corner_idx].x += x;
 	corner[corner_idx].y += y;
+	revision++;
 }
 
 void Grid::add_ref_point(double mx, double my) {
@@ -416,4 +532,51 @@ cv::Mat Grid::get_perspective_transform() {
 
 cv::Mat Grid::get_inverse_transform() {
 	return pM_inv;
+}
+
+/**
+* Get the number of times the perspective transform was solved
+*
+* @return solve count
+*/
+unsigned int Grid::get_solve_count() {
+	return solve_count;
+}
+
+/**
+* Get the time the last solve of the perspective transform took. Frames that reuse the cached transform do not
+* change it.
+*
+* @return solve time in milliseconds
+*/
+double Grid::get_last_solve_ms() {
+	return last_solve_ms;
+}
+
+/**
+* Get the homography solution of the last point or marker calibration solve, with the residual of every point
+*
+* @return last homography solution. Residuals are in scene units and in the order of the reference points or markers.
+*/
+const HomographySolution& Grid::get_homography_solution() {
+	return homography_solution;
+}
+
+/**
+* Get the largest residual of a reference point or marker corner that still counts as an inlier
+*
+* @return inlier threshold in scene units
+*/
+double Grid::get_inlier_threshold() {
+	return homography_solver.get_inlier_threshold();
+}
+
+/**
+* Get the revision of the grid transform. The revision is incremented whenever the perspective transform or
+* a grid corner changes, so callers can tell whether points projected with the grid are stale.
+*
+* @return revision counter
+*/
+unsigned int Grid::get_revision() {
+	return revision;
 }
\ No newline at end of file
@@ -13,6 +13,7 @@
 #include "GridCorner.h"
 #include "Config.h"
 #include "ReferencePoint.h"
+#include "HomographySolver.h"
 #include <vector>
 
 class Grid
@@ -28,6 +29,73 @@ private:
 	cv::Mat pM;
 	cv::Mat pM_inv;
 
+	// Incremented whenever pM_inv or a corner changes
+	unsigned int revision;
+
+	void set_transform(const cv::Mat& new_pM, const cv::Mat& new_pM_inv);
+
+	// Everything the perspective transform is solved from, captured when pM and pM_inv were last solved
+	typedef struct {
+		int calibration_mode;
+		float width;
+		float height;
+		std::vector<cv::Point2f> corners;
+		std::vector<cv::Point2f> src_points;
+		std::vector<cv::Point2f> dst_points;
+	} TransformInputs;
+
+	TransformInputs transform_inputs;
+	bool transform_solved;
+
+	// Number of times the transform was solved and how long the last solve took
+	unsigned int solve_count;
+	double last_solve_ms;
+
+	TransformInputs get_transform_inputs();
+
+	bool transform_inputs_equal(const TransformInputs& a, const TransformInputs& b);
+
+	void solve_perspective_transform();
+
+	// Solves point and marker calibration, and the residuals of their points under the last solved transform
+	HomographySolver homography_solver;
+	HomographySolution homography_solution;
+
+	void solve_homography(const std::vector<cv::Point2f>& world_points, const std::vector<cv::Point2f>& scene_points);
+
+	// Everything the grid lines are built from, captured when the line vertices were last built
+	typedef struct {
+		unsigned int revision;
+		float width;
+		float height;
+		int divs_x;
+		int divs_y;
+	} LineInputs;
+
+	// Grid lines in the perspective scene, with one color per vertex
+	LineInputs line_inputs;
+	bool lines_built;
+	std::vector<cv::Point2f> line_vertices;
+	std::vector<cv::Point3f> line_colors;
+
+	// Grid lines in the orthographic scene
+	LineInputs ortho_line_inputs;
+	bool ortho_lines_built;
+	std::vector<cv::Point2f> ortho_line_vertices;
+	std::vector<cv::Point3f> ortho_line_colors;
+
+	LineInputs get_line_inputs();
+
+	bool line_inputs_equal(const LineInputs& a, const LineInputs& b);
+
+	void build_lines();
+
+	void build_ortho_lines();
+
+	void draw_lines(const std::vector<cv::Point2f>& vertices, const std::vector<cv::Point3f>& colors);
+
+	static constexpr float corner_click_radius = 100;
+
 	//std::vector<ReferencePoint> ref_points;
 
 
@@ -49,6 +117,20 @@ public:
 
 	cv::Mat get_inverse_transform();
 
+	unsigned int get_revision();
+
+	const std::vector<cv::Point2f>& get_line_vertices();
+
+	const std::vector<cv::Point2f>& get_ortho_line_vertices();
+
+	unsigned int get_solve_count();
+
+	double get_last_solve_ms();
+
+	const HomographySolution& get_homography_solution();
+
+	double get_inlier_threshold();
+
 	float distance(float x0, float y0, float x1, float y1);
 
 	int grab(float x, float y);
@@ -0,0 +1,266 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "GroundProjector.h"
+#include <algorithm>
+#include <cmath>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+* Rotation of the camera from its own frame (x right, y down, z along the optical axis) to the world frame
+* (x right, y forward, z up). The camera is rolled about its optical axis, then pitched, then yawed.
+*
+* The yaw is the same rotation about the camera position that cv::getRotationMatrix2D gave the original
+* implementation, so poses without roll and pitch project exactly as before.
+*
+* @param camera_pose rotation angles of the camera in degrees
+*
+* @return camera to world rotation
+*/
+cv::Matx33d GroundProjector::camera_to_world_rotation(const CameraPose& camera_pose) {
+	const double roll = camera_pose.roll_angle * M_PI / 180;
+	const double pitch = camera_pose.pitch_angle * M_PI / 180;
+	const double yaw = camera_pose.yaw_angle * M_PI / 180;
+
+	// Camera axes to world axes for a level camera looking along world y
+	const cv::Matx33d axes(
+		1, 0, 0,
+		0, 0, 1,
+		0, -1, 0);
+
+	// Positive roll turns the top of the camera (world z) towards world x
+	const cv::Matx33d roll_rotation(
+		std::cos(roll), 0, std::sin(roll),
+		0, 1, 0,
+		-std::sin(roll), 0, std::cos(roll));
+
+	// Positive pitch turns the optical axis (world y) towards the sky (world z)
+	const cv::Matx33d pitch_rotation(
+		1, 0, 0,
+		0, std::cos(pitch), -std::sin(pitch),
+		0, std::sin(pitch), std::cos(pitch));
+
+	const cv::Matx33d yaw_rotation(
+		std::cos(yaw), std::sin(yaw), 0,
+		-std::sin(yaw), std::cos(yaw), 0,
+		0, 0, 1);
+
+	return yaw_rotation * pitch_rotation * roll_rotation * axes;
+}
+
+/**
+* Creates a projector for one camera profile and camera pose. This is where all of the per pose work happens.
+*
+* Projecting onto the plane z = 0 is a homography. A pixel p has the world direction d = R * K^-1 * p, and the ray
+* from the camera position C meets the ground at C + d * z_pos / -d_z. In homogeneous coordinates that is
+*
+*   [x y w] = B * d,   B = [ z_pos 0 -x_pos ; 0 z_pos -y_pos ; 0 0 -1 ]
+*
+* so B * R * K^-1 maps pixels straight to the ground, and B * R maps normalized rays (for the undistortion table).
+*
+* @param camera_intrinsic 3x3 camera intrinsic matrix from the camera profile
+* @param camera_pose position and rotation of the camera in the world coordinate frame
+* @param lut undistortion table of the camera profile, or null to ignore the lens distortion
+*/
+GroundProjector::GroundProjector(const cv::Mat& camera_intrinsic, const CameraPose& camera_pose,
+	std::shared_ptr<const UndistortionLut> lut) : lut(lut) {
+	cv::Mat k_inv_mat;
+	cv::Mat(camera_intrinsic.inv()).convertTo(k_inv_mat, CV_64F);
+	const cv::Matx33d k_inv((const double*)k_inv_mat.ptr<double>());
+
+	const cv::Matx33d intersect(
+		camera_pose.z_pos, 0, -camera_pose.x_pos,
+		0, camera_pose.z_pos, -camera_pose.y_pos,
+		0, 0, -1);
+
+	const cv::Matx33d ray_homography = intersect * camera_to_world_rotation(camera_pose);
+	const cv::Matx33d pixel_homography = ray_homography * k_inv;
+
+	std::copy(ray_homography.val, ray_homography.val + 9, ray_to_ground);
+	std::copy(pixel_homography.val, pixel_homography.val + 9, pixel_to_ground);
+}
+
+/**
+* Applies a homography to points stored as separate arrays, one fused multiply and divide per point. This is the
+* arithmetic shared by projecting pixels and normalized rays.
+*
+* @param h row major 3x3 homography
+* @param u x coordinates of the input points
+* @param v y coordinates of the input points
+* @param x output x coordinates
+* @param y output y coordinates
+* @param count number of points
+*/
+static void apply_homography(const double* h, const float* u, const float* v, float* x, float* y, size_t count) {
+
+	// Copy everything to locals so the compiler knows none of it aliases the output arrays
+	const double h00 = h[0], h01 = h[1], h02 = h[2];
+	const double h10 = h[3], h11 = h[4], h12 = h[5];
+	const double h20 = h[6], h21 = h[7], h22 = h[8];
+
+	for (size_t i = 0; i < count; i++) {
+		const double pu = u[i];
+		const double pv = v[i];
+
+		const double w = 1 / (h20 * pu + h21 * pv + h22);
+		x[i] = (float)((h00 * pu + h01 * pv + h02) * w);
+		y[i] = (float)((h10 * pu + h11 * pv + h12) * w);
+	}
+}
+
+/**
+* Projects points stored as separate u and v arrays (structure of arrays) onto the ground plane. Without an
+* undistortion table this is the pixel to ground homography. With one, the normalized ray of each point is looked
+* up in the table and projected with the ray to ground homography.
+*
+* @param u u coordinates of the image points
+* @param v v coordinates of the image points
+* @param x output x coordinates in the world coordinate frame
+* @param y output y coordinates in the world coordinate frame
+* @param count number of points
+*/
+void GroundProjector::project(const float* u, const float* v, float* x, float* y, size_t count) const {
+	if (!lut) {
+		apply_homography(pixel_to_ground, u, v, x, y, count);
+		return;
+	}
+
+	const size_t block_size = 256;
+
+	cv::Point2f rays[block_size];
+	float ray_x[block_size];
+	float ray_y[block_size];
+
+	for (size_t start = 0; start < count; start += block_size) {
+		const size_t n = std::min(block_size, count - start);
+
+		for (size_t i = 0; i < n; i++) {
+			rays[i] = cv::Point2f(u[start + i], v[start + i]);
+		}
+
+		lut->lookup(rays, rays, n);
+
+		for (size_t i = 0; i < n; i++) {
+			ray_x[i] = rays[i].x;
+			ray_y[i] = rays[i].y;
+		}
+
+		project_rays(ray_x, ray_y, x + start, y + start, n);
+	}
+}
+
+/**
+* Projects normalized camera rays (undistorted points with the intrinsics removed, as cv::undistortPoints returns
+* them) onto the ground plane
+*
+* @param ray_x x / z of the camera rays
+* @param ray_y y / z of the camera rays
+* @param x output x coordinates in the world coordinate frame
+* @param y output y coordinates in the world coordinate frame
+* @param count number of points
+*/
+void GroundProjector::project_rays(const float* ray_x, const float* ray_y, float* x, float* y, size_t count) const {
+	apply_homography(ray_to_ground, ray_x, ray_y, x, y, count);
+}
+
+/**
+* Projects points stored as cv::Point2f (array of structures) onto the ground plane. Points are deinterleaved
+* in fixed size blocks on the stack so no memory is allocated. img_points and world_points may be the same array.
+*
+* @param img_points points in image u v coordinates
+* @param world_points output points in the world coordinate frame
+* @param count number of points
+*/
+void GroundProjector::project(const cv::Point2f* img_points, cv::Point2f* world_points, size_t count) const {
+	const size_t block_size = 256;
+
+	float u[block_size];
+	float v[block_size];
+	float x[block_size];
+	float y[block_size];
+
+	for (size_t start = 0; start < count; start += block_size) {
+		const size_t n = std::min(block_size, count - start);
+
+		if (lut) {
+			// Look up the rays straight from the interleaved points, into the output block as scratch space
+			lut->lookup(&img_points[start], &world_points[start], n);
+
+			for (size_t i = 0; i < n; i++) {
+				u[i] = world_points[start + i].x;
+				v[i] = world_points[start + i].y;
+			}
+
+			project_rays(u, v, x, y, n);
+		}
+		else {
+			for (size_t i = 0; i < n; i++) {
+				u[i] = img_points[start + i].x;
+				v[i] = img_points[start + i].y;
+			}
+
+			project(u, v, x, y, n);
+		}
+
+		for (size_t i = 0; i < n; i++) {
+			world_points[start + i].x = x[i];
+			world_points[start + i].y = y[i];
+		}
+	}
+}
+
+/**
+* Projects a vector of image points onto the ground plane. world_points is resized to match img_points, and
+* its storage is reused if it is already large enough.
+*
+* @param img_points points in image u v coordinates
+* @param world_points output points in the world coordinate frame
+*/
+void GroundProjector::project(const std::vector<cv::Point2f>& img_points, std::vector<cv::Point2f>& world_points) const {
+	world_points.resize(img_points.size());
+	project(img_points.data(), world_points.data(), img_points.size());
+}
+
+/**
+* Projects points onto the ground plane for exported measurements. The world coordinate frame is scaled to cm
+* for numerical stability, so the results are divided by 100 to get meters. img_points and world_points may be
+* the same array.
+*
+* @param img_points points in image u v coordinates
+* @param world_points output points in the world coordinate frame, in meters
+* @param count number of points
+*/
+void GroundProjector::project_meters(const cv::Point2f* img_points, cv::Point2f* world_points, size_t count) const {
+	project(img_points, world_points, count);
+
+	for (size_t i = 0; i < count; i++) {
+		world_points[i].x = world_points[i].x / 100;
+		world_points[i].y = world_points[i].y / 100;
+	}
+}
+
+/**
+* Get the homography from image pixels to the ground plane. It ignores the lens distortion, the undistortion table
+* (if any) is applied before the ray to ground homography instead.
+*
+* @return row major 3x3 homography from u v coordinates to the world coordinate frame in cm
+*/
+cv::Matx33d GroundProjector::get_pixel_to_ground() const {
+	return cv::Matx33d(pixel_to_ground);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "CameraPose.h"
+#include "UndistortionLut.h"
+
+/**
+* The GroundProjector class projects image (u v) coordinates onto the ground plane (z = 0) for markerless mode.
+* Projection onto a plane is a homography, so everything that depends on the camera profile and camera pose
+* (inverse intrinsic matrix, roll, pitch, yaw and position) is folded into one 3x3 matrix when the projector is
+* created. Projecting a batch of points is then one matrix-vector product and divide per point, without any
+* per-point allocation.
+*
+* A projector created with an undistortion table removes the lens distortion first, by looking up the normalized
+* ray of each point in the table and projecting it with the homography that leaves out the intrinsic matrix.
+*/
+class GroundProjector
+{
+private:
+	// Homography from u v coordinates to the ground plane, row major
+	double pixel_to_ground[9];
+
+	// Homography from normalized camera rays to the ground plane, row major
+	double ray_to_ground[9];
+
+	// Undistortion table of the camera profile, null to ignore the lens distortion
+	std::shared_ptr<const UndistortionLut> lut;
+
+public:
+	GroundProjector(const cv::Mat& camera_intrinsic, const CameraPose& camera_pose,
+		std::shared_ptr<const UndistortionLut> lut = std::shared_ptr<const UndistortionLut>());
+
+	void project(const float* u, const float* v, float* x, float* y, size_t count) const;
+
+	void project_rays(const float* ray_x, const float* ray_y, float* x, float* y, size_t count) const;
+
+	void project(const cv::Point2f* img_points, cv::Point2f* world_points, size_t count) const;
+
+	void project(const std::vector<cv::Point2f>& img_points, std::vector<cv::Point2f>& world_points) const;
+
+	void project_meters(const cv::Point2f* img_points, cv::Point2f* world_points, size_t count) const;
+
+	cv::Matx33d get_pixel_to_ground() const;
+
+	static cv::Matx33d camera_to_world_rotation(const CameraPose& camera_pose);
+};
@@ -0,0 +1,251 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "HomographySolver.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+
+// Methods tried by every solve. RHO comes first so it wins ties, it is what the grid used before.
+static const int solver_methods[] = { cv::RHO, cv::RANSAC, cv::LMEDS, 0 };
+static const size_t solver_method_count = sizeof(solver_methods) / sizeof(solver_methods[0]);
+
+/**
+* Creates a solver and its worker threads
+*
+* @param inlier_threshold largest residual of an inlier, in dst units. Also the RANSAC and RHO threshold.
+* @param max_iters most iterations of RANSAC, RHO and LMEDS
+* @param confidence confidence level of RANSAC, RHO and LMEDS
+* @param thread_count number of methods run at once, 0 for one per method up to one per hardware thread
+*/
+HomographySolver::HomographySolver(double inlier_threshold, int max_iters, double confidence, size_t thread_count) :
+	pool(thread_count == 0 ? std::min(solver_method_count, ThreadPool::default_thread_count()) : thread_count) {
+	this->inlier_threshold = inlier_threshold;
+	this->max_iters = max_iters;
+	this->confidence = confidence;
+}
+
+/**
+* Estimates a homography from src to dst with the method of a candidate and scores it against every point
+*
+* @param src source points
+* @param dst destination points, same size as src
+* @param candidate candidate with its method set, receives the homography and its score
+*/
+void HomographySolver::solve_candidate(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst,
+	HomographyCandidate& candidate) const {
+
+	cv::TickMeter timer;
+	timer.start();
+
+	try {
+		candidate.H = cv::findHomography(src, dst, candidate.method, inlier_threshold, cv::noArray(), max_iters, confidence);
+	}
+	catch (const cv::Exception&) {
+		// Degenerate point sets (e.g. all points on a line) are rejected by some methods
+		candidate.H = cv::Mat();
+	}
+
+	timer.stop();
+	candidate.solve_ms = timer.getTimeMilli();
+
+	if (candidate.H.empty()) {
+		candidate.score = HUGE_VAL;
+		candidate.inlier_count = 0;
+		return;
+	}
+
+	std::vector<double> point_residuals;
+	residuals(candidate.H, src, dst, point_residuals);
+	candidate.score = score(point_residuals, &candidate.inlier_count);
+}
+
+/**
+* Scores a set of residuals by their mean squared value, with every residual capped at the inlier threshold so that a
+* few bad points do not outweigh how well the rest fit
+*
+* @param residuals residual of every point
+* @param inlier_count set to the number of residuals within the inlier threshold
+*
+* @return score, lower is better
+*/
+double HomographySolver::score(const std::vector<double>& residuals, int* inlier_count) const {
+	double threshold_sq = inlier_threshold * inlier_threshold;
+	double sum = 0;
+
+	*inlier_count = 0;
+	for (size_t i = 0; i < residuals.size(); i++) {
+		double residual_sq = residuals[i] * residuals[i];
+		if (residual_sq <= threshold_sq) {
+			sum += residual_sq;
+			(*inlier_count)++;
+		}
+		else {
+			sum += threshold_sq;
+		}
+	}
+
+	return residuals.empty() ? 0 : sum / residuals.size();
+}
+
+/**
+* Estimates the homography from src to dst with every method, in parallel, and keeps the one with the lowest capped
+* reprojection error
+*
+* @param src source points, e.g. world coordinates of reference points
+* @param dst destination points, e.g. scene coordinates of the same reference points
+* @param solution receives the best homography, its inverse and the residual of every point
+*
+* @return HOMOGRAPHY_SUCCESS, HOMOGRAPHY_SIZE_MISMATCH, HOMOGRAPHY_TOO_FEW_POINTS or HOMOGRAPHY_NO_SOLUTION if no
+* method found a homography
+*/
+int HomographySolver::solve(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst,
+	HomographySolution& solution) {
+
+	solution = HomographySolution();
+	solution.method = -1;
+
+	if (src.size() != dst.size()) {
+		return HOMOGRAPHY_SIZE_MISMATCH;
+	}
+	if (src.size() < 4) {
+		return HOMOGRAPHY_TOO_FEW_POINTS;
+	}
+
+	solution.candidates.resize(solver_method_count);
+	for (size_t i = 0; i < solver_method_count; i++) {
+		HomographyCandidate* candidate = &solution.candidates[i];
+		candidate->method = solver_methods[i];
+		pool.submit([this, &src, &dst, candidate]() {
+			solve_candidate(src, dst, *candidate);
+		});
+	}
+	pool.wait();
+
+	const HomographyCandidate* best = NULL;
+	for (size_t i = 0; i < solution.candidates.size(); i++) {
+		const HomographyCandidate& candidate = solution.candidates[i];
+		if (!candidate.H.empty() && (best == NULL || candidate.score < best->score)) {
+			best = &candidate;
+		}
+	}
+
+	if (best == NULL) {
+		return HOMOGRAPHY_NO_SOLUTION;
+	}
+
+	solution.H = best->H;
+	solution.H_inv = invert(best->H);
+	solution.method = best->method;
+
+	residuals(solution.H, src, dst, solution.residuals);
+
+	double sum_sq = 0;
+	solution.inliers.resize(solution.residuals.size());
+	solution.inlier_count = 0;
+	for (size_t i = 0; i < solution.residuals.size(); i++) {
+		solution.inliers[i] = solution.residuals[i] <= inlier_threshold ? 1 : 0;
+		if (solution.inliers[i]) {
+			sum_sq += solution.residuals[i] * solution.residuals[i];
+			solution.inlier_count++;
+		}
+	}
+	solution.inlier_rms = solution.inlier_count > 0 ? std::sqrt(sum_sq / solution.inlier_count) : 0;
+
+	return HOMOGRAPHY_SUCCESS;
+}
+
+/**
+* Get the largest residual a point can have and still count as an inlier
+*
+* @return inlier threshold in dst units
+*/
+double HomographySolver::get_inlier_threshold() const {
+	return inlier_threshold;
+}
+
+/**
+* Computes the distance between every source point mapped by a homography and its destination point
+*
+* @param H 3x3 homography from src to dst
+* @param src source points
+* @param dst destination points, same size as src
+* @param residuals receives one residual per point, in dst units. Points mapped to infinity get HUGE_VAL.
+*/
+void HomographySolver::residuals(const cv::Mat& H, const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst,
+	std::vector<double>& residuals) {
+
+	cv::Matx33d h;
+	H.convertTo(h, CV_64F);
+
+	residuals.resize(src.size());
+	for (size_t i = 0; i < src.size(); i++) {
+		double w = h(2, 0) * src[i].x + h(2, 1) * src[i].y + h(2, 2);
+		if (std::fabs(w) < 1e-12) {
+			residuals[i] = HUGE_VAL;
+			continue;
+		}
+
+		double x = (h(0, 0) * src[i].x + h(0, 1) * src[i].y + h(0, 2)) / w;
+		double y = (h(1, 0) * src[i].x + h(1, 1) * src[i].y + h(1, 2)) / w;
+		residuals[i] = std::sqrt((x - dst[i].x) * (x - dst[i].x) + (y - dst[i].y) * (y - dst[i].y));
+	}
+}
+
+/**
+* Inverts a homography, normalized so that the bottom right element is 1 like the output of cv::findHomography
+*
+* @param H 3x3 homography
+*
+* @return inverse homography as CV_64F, or an empty matrix if H is singular
+*/
+cv::Mat HomographySolver::invert(const cv::Mat& H) {
+	cv::Mat H_64;
+	H.convertTo(H_64, CV_64F);
+
+	cv::Mat H_inv;
+	if (cv::invert(H_64, H_inv, cv::DECOMP_LU) == 0) {
+		return cv::Mat();
+	}
+
+	double scale = H_inv.at<double>(2, 2);
+	if (std::fabs(scale) > 1e-12) {
+		H_inv /= scale;
+	}
+	return H_inv;
+}
+
+/**
+* Get the display name of an estimation method
+*
+* @param method cv::RHO, cv::RANSAC, cv::LMEDS or 0
+*
+* @return name of the method
+*/
+std::string HomographySolver::method_name(int method) {
+	switch (method) {
+	case cv::RHO:
+		return "RHO";
+	case cv::RANSAC:
+		return "RANSAC";
+	case cv::LMEDS:
+		return "LMEDS";
+	case 0:
+		return "DLT";
+	default:
+		return "none";
+	}
+}
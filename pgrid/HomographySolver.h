@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+#include "ThreadPool.h"
+
+#define HOMOGRAPHY_SUCCESS 0
+#define HOMOGRAPHY_TOO_FEW_POINTS 1
+#define HOMOGRAPHY_SIZE_MISMATCH 2
+#define HOMOGRAPHY_NO_SOLUTION 3
+
+// Result of one estimation method
+typedef struct {
+	// cv::RHO, cv::RANSAC, cv::LMEDS or 0 for the least squares DLT
+	int method;
+
+	// Empty if the method found no solution
+	cv::Mat H;
+
+	// Mean squared reprojection error with every residual capped at the inlier threshold, lower is better
+	double score;
+
+	int inlier_count;
+	double solve_ms;
+} HomographyCandidate;
+
+// Best homography from src to dst points, with the residual of every point under it
+typedef struct {
+	cv::Mat H;
+
+	// Inverse of H, dst to src
+	cv::Mat H_inv;
+
+	// Method of the candidate H was taken from
+	int method;
+
+	// Distance between H applied to each src point and its dst point, in dst units
+	std::vector<double> residuals;
+
+	// 1 for points with a residual within the inlier threshold
+	std::vector<unsigned char> inliers;
+
+	int inlier_count;
+
+	// RMS residual of the inliers
+	double inlier_rms;
+
+	// Every method that was tried, in the order they were tried
+	std::vector<HomographyCandidate> candidates;
+} HomographySolution;
+
+/**
+* The HomographySolver class estimates the homography between two sets of corresponding points with several
+* robust methods at once and keeps the one that reprojects the points best. The homography is estimated in one
+* direction only, the inverse is computed from it. The residual of every point is kept so that bad reference
+* points or markers can be shown to the user.
+*
+* The methods are run on a thread pool owned by the solver, so one solver must not be used from several threads
+* at once.
+*/
+class HomographySolver
+{
+private:
+	double inlier_threshold;
+	int max_iters;
+	double confidence;
+
+	ThreadPool pool;
+
+	void solve_candidate(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst,
+		HomographyCandidate& candidate) const;
+
+	double score(const std::vector<double>& residuals, int* inlier_count) const;
+
+public:
+	HomographySolver(double inlier_threshold = 8, int max_iters = 5000, double confidence = 0.995, size_t thread_count = 0);
+
+	int solve(const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst, HomographySolution& solution);
+
+	double get_inlier_threshold() const;
+
+	static void residuals(const cv::Mat& H, const std::vector<cv::Point2f>& src, const std::vector<cv::Point2f>& dst,
+		std::vector<double>& residuals);
+
+	static cv::Mat invert(const cv::Mat& H);
+
+	static std::string method_name(int method);
+};
@@ -15,6 +15,8 @@ limitations under the License.
 ***********************************************************************/
 
 #include "Image.h"
+#include <algorithm>
+#include <fstream>
 #include <string>
 #include <regex>
 #include <vector>
@@ -22,7 +24,11 @@ limitations under the License.
 #include "PerspectivePanel.h"
 #include "MarkerIndex.h"
 
-Image::Image(SessionConfig* session_config) {
+Image::Image(SessionConfig* session_config) : marker_corner_markers(5.0f, 0.0f) {
+	file_path = NULL;
+	generation = 0;
+	pose_status = -1;
+	pose_marker_count = 0;
 	app_config = session_config->app_config;
 	img_config = session_config->img_config;
 	grid_config = session_config->grid_config;
@@ -56,6 +62,77 @@ inline bool Image::hasFile(const std::string& name) {
 	return (base_file != "" && no_ext != "");
 }
 
+/**
+* Reads the size of a JPEG from its frame header and matches it to a reduced decode of the image, since decoding
+* applies the EXIF orientation and can swap width and height
+*
+* @param name filepath of the JPEG
+* @param reduced_size size of the image decoded at 1 / reduction scale
+* @param reduction scale the reduced image was decoded at
+* @param size set to the full resolution size of the decoded image
+*
+* @return false if the file is not a JPEG or the sizes do not match
+*/
+bool Image::read_jpeg_size(const std::string& name, cv::Size reduced_size, int reduction, cv::Size& size) {
+	std::ifstream file(name, std::ios::binary);
+	if (file.get() != 0xFF || file.get() != 0xD8) {
+		return false;
+	}
+
+	// Big endian 16 bit value
+	auto read_u16 = [&file]() {
+		int high = file.get();
+		int low = file.get();
+		return (high << 8) | low;
+	};
+
+	while (file) {
+		// Find the next marker, markers can be padded with any number of 0xFF
+		int marker = file.get();
+		if (marker != 0xFF) {
+			return false;
+		}
+		while (marker == 0xFF) {
+			marker = file.get();
+		}
+
+		// Markers without a length
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			continue;
+		}
+		if (marker == 0xD9 || marker == 0xDA || marker < 0) {
+			return false; // end of image or start of scan before the frame header
+		}
+
+		int length = read_u16();
+
+		// Start of frame markers, except DHT (C4), JPG (C8) and DAC (CC)
+		if (marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			file.get(); // sample precision
+			int height = read_u16();
+			int width = read_u16();
+			if (!file) {
+				return false;
+			}
+
+			// The reduced decode rounds up
+			cv::Size expected((width + reduction - 1) / reduction, (height + reduction - 1) / reduction);
+			if (expected == reduced_size) {
+				size = cv::Size(width, height);
+				return true;
+			}
+			if (expected.width == reduced_size.height && expected.height == reduced_size.width) {
+				size = cv::Size(height, width);
+				return true;
+			}
+			return false;
+		}
+
+		file.seekg(length - 2, std::ios::cur);
+	}
+	return false;
+}
+
 //void Image::add_image_point(float x, float y) {
 //
 //}
@@ -79,142 +156,352 @@ void Image::load() {
 	app_config->outfile->set_img_last4(this->get_last4());
 	app_config->outfile->set_outfile_name(this->get_filename());
 
-	cv_img = cv::imread(file_path, cv::IMREAD_COLOR);
+	// Anything still decoding or estimating belongs to the previous image, its result is dropped
+	decode_job.reset();
+	marker_job.reset();
+	pose_status = -1;
+	pose_marker_count = 0;
+	cv_img.release();
+	img_size = cv::Size();
+	generation++;
+	pyramid.set_budget((size_t)img_config->tile_cache_mb * 1024 * 1024);
+
+	// A JPEG decoded at 1/8 scale (DCT scaling, most of the decode is skipped) shows up almost at once. The full
+	// resolution image is decoded on a worker thread and replaces it when done.
+	cv::Size full_size;
+	cv::Mat preview = cv::imread(file_path, cv::IMREAD_REDUCED_COLOR_8);
+	if (preview.empty() || !read_jpeg_size(file_path, preview.size(), 8, full_size)) {
+		// Not a JPEG, or the size cannot be predicted. Decode the full image right away.
+		adopt_full_image(cv::imread(file_path, cv::IMREAD_COLOR));
+		return;
+	}
+
+	img_config->image_loaded = true;
+	img_size = full_size;
+	pyramid.set_image(preview, full_size);
+
+	std::shared_ptr<DecodeJob> job = std::make_shared<DecodeJob>();
+	job->done = false;
+	decode_job = job;
+
+	std::string path = file_path;
+	std::thread([job, path] {
+		cv::Mat img = cv::imread(path, cv::IMREAD_COLOR);
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->img = img;
+		job->done = true;
+		job->finished.notify_all();
+
+		// Wake the main loop in case it is idle, so the full resolution image gets picked up
+		glfwPostEmptyEvent();
+	}).detach();
+}
+
+/**
+* Makes a fully decoded image the one shown and used for marker detection. Needs the GL context.
+*
+* @param img full resolution BGR image
+*/
+void Image::adopt_full_image(cv::Mat img) {
+	cv_img = img;
+	generation++;
 
 	if (cv_img.empty()) {
 		std::cout << "file empty" << std::endl;
 		return;
 	}
 	img_config->image_loaded = true;
-	//cv::Mat undistorted;
-	//cv::undistort(cv_img, undistorted, img_config->camera_profile->get_camera_matrix(), img_config->camera_profile->get_dist_coeffs());
-	//undistorted.copyTo(cv_img);
-	cv_img.copyTo(raw_img);
+	// The image is shown as taken. Points are placed on the distorted image, and markerless projection removes the
+	// lens distortion from the points with the undistortion table of the camera profile.
 
+	if (!img_size.empty() && img_size != cv_img.size()) {
+		std::cout << "Image size changed from the preview, points placed during loading may be offset" << std::endl;
+	}
+	img_size = cv_img.size();
 
-	//cv_img.
-	cv::cvtColor(cv_img, cv_img, cv::COLOR_BGR2RGBA);
-	cv::flip(cv_img, cv_img, 0);
-	//cv::imshow("wooder", cv_img);
-	//cv::waitKey(0);
+	// The pyramid draws straight from the BGR image, it is not converted or flipped
+	pyramid.set_image(cv_img);
+}
 
+/**
+* Picks up the full resolution image once the worker thread has decoded it. Needs the GL context.
+*
+* @param wait block until the image is decoded
+*
+* @return true if the full resolution image is loaded
+*/
+bool Image::finish_loading(bool wait) {
+	if (!decode_job) {
+		return !cv_img.empty();
+	}
 
-	img_size = cv_img.size();
+	cv::Mat img;
+	{
+		std::unique_lock<std::mutex> lock(decode_job->mutex);
+		if (wait) {
+			decode_job->finished.wait(lock, [this] { return decode_job->done; });
+		}
+		else if (!decode_job->done) {
+			return false;
+		}
+		img = decode_job->img;
+	}
 
-	glGenTextures(1, &img_tex);
-	glBindTexture(GL_TEXTURE_2D, img_tex);
+	decode_job.reset();
+	adopt_full_image(img);
+	return !cv_img.empty();
+}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+/**
+* Draws the image and the detected markers
+*
+* @param camera camera the perspective panel is drawn with, used to only draw the visible part of the image
+*/
+void Image::render(const Camera2D& camera) {
+	finish_loading(false);
 
+	double scale = camera.get_scale();
+	if (scale > 0) {
+		// Scene coordinates have y up with the image centered on the origin
+		int half_width = img_size.width / 2;
+		int half_height = img_size.height / 2;
 
+		glm::dvec4 scene_rect = camera.get_visible_scene_rect();
+		cv::Rect2d visible(scene_rect.x + half_width, half_height - scene_rect.w,
+			scene_rect.z - scene_rect.x, scene_rect.w - scene_rect.y);
+
+		pyramid.draw(visible, scale, (float)-half_width, (float)half_height);
+	}
 
+	// Draw the corners of the detected markers in yellow
+	marker_corner_markers.update(marker_corner_points);
+	marker_corner_markers.draw(1.0f, 1.0f, 0.0f);
 }
 
-void Image::render() {
-	glEnable(GL_TEXTURE_2D);
+void Image::close() {
+	pyramid.release();
+	marker_corner_markers.release();
+}
 
-	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, cv_img.cols, cv_img.rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, cv_img.ptr());
-	glGenerateMipmap(GL_TEXTURE_2D);
-	
-	float half_width = img_size.width / 2;
-	float half_height = img_size.height / 2;
+/**
+* Check whether the image has tiles left to upload, i.e. another frame is needed to show it at full detail. A full
+* resolution image still decoding does not count, the decode wakes the main loop itself when it is done.
+*
+* @return true if tiles are pending
+*/
+bool Image::has_pending_tiles() {
+	return pyramid.has_pending_tiles();
+}
 
-	glBegin(GL_QUADS);
-		glTexCoord2i(0, 0); glVertex2i(-half_width, -half_height);
-		glTexCoord2i(0, 1); glVertex2i(-half_width, half_height);
-		glTexCoord2i(1, 1); glVertex2i(half_width, half_height);
-		glTexCoord2i(1, 0); glVertex2i(half_width, -half_height);
-	glEnd();
+/**
+* Get the generation of the image. The generation is incremented whenever a new image is loaded, the full
+* resolution image replaces the preview or markers are detected, so the perspective panel can tell whether it has to
+* be drawn again.
+*
+* @return generation counter
+*/
+unsigned int Image::get_generation() {
+	return generation;
+}
 
-	
-	glDisable(GL_TEXTURE_2D);
+/**
+* Starts finding the markers in the image on a worker thread. The markers are picked up by finish_marker_job.
+*/
+void Image::find_markers() {
+	start_marker_job(false);
+}
 
+/**
+* Stores detected markers for the marker calibration and for drawing. The corners of markers in the marker index are
+* added to the scene and world points the grid transform is solved from.
+*
+* @param detection markers found in the full resolution image, corners in u v coordinates
+*/
+void Image::apply_markers(const MarkerDetection& detection) {
+	if (detection.ids.empty()) {
+		return;
+	}
 
-	static int view_radius = 5;
+	img_config->ids = detection.ids;
 
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-	glColor3f(1.0f, 1.0f, 0.0f);
-	for (unsigned int i = 0; i < img_config->corners.size(); i++) {
-		for (unsigned int j = 0; j < img_config->corners[i].size(); j++) {
-			glBegin(GL_POLYGON);
-				glVertex2f(img_config->corners[i][j].x - view_radius, img_config->corners[i][j].y - view_radius);
-				glVertex2f(img_config->corners[i][j].x - view_radius, img_config->corners[i][j].y + view_radius);
-				glVertex2f(img_config->corners[i][j].x + view_radius, img_config->corners[i][j].y + view_radius);
-				glVertex2f(img_config->corners[i][j].x + view_radius, img_config->corners[i][j].y - view_radius);
-			glEnd();
+	// Detected corners are in u v coordinates, they are drawn and solved in scene coordinates
+	std::vector<cv::Point2f> corner_points;
+	std::vector<cv::Point3f> world_points;
+	MarkerDetector::corner_correspondences(detection, *app_config->marker_index, corner_points, world_points);
+
+	Affine2D<UvFrame, SceneFrame> to_scene = get_uv_to_scene();
+	to_scene.apply(corner_points);
+
+	// The grid transform maps the ground plane, raised markers only count for the camera pose
+	for (size_t i = 0; i < world_points.size(); i++) {
+		if (world_points[i].z == 0) {
+			img_config->scene_points.push_back(corner_points[i]);
+			img_config->world_points.push_back(cv::Point2f(world_points[i].x, world_points[i].y));
 		}
 	}
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glColor3f(1.0f, 1.0f, 1.0f);
+
+	img_config->corners = detection.corners;
+	for (size_t i = 0; i < img_config->corners.size(); i++) {
+		to_scene.apply(img_config->corners[i]);
+	}
+
+	// Flatten the corners for drawing, every corner is uploaded again
+	marker_corner_points.clear();
+	for (unsigned int i = 0; i < img_config->corners.size(); i++) {
+		marker_corner_points.insert(marker_corner_points.end(), img_config->corners[i].begin(), img_config->corners[i].end());
+	}
+	marker_corner_markers.invalidate(0);
+	generation++;
 }
 
-void Image::close() {
-	glDeleteTextures(1, &img_tex);
+/**
+* Starts estimating the camera pose from the markers in the image on a worker thread, so the UI stays responsive
+* while the markers are detected. The result is picked up by finish_marker_job, which fills the camera pose and the
+* detected markers.
+*/
+void Image::estimate_pose() {
+	start_marker_job(true);
 }
 
-void Image::find_markers() {
-	cv::aruco::DetectorParameters detectorParams = cv::aruco::DetectorParameters();
-
-	// Setings for aruco marker detection
-	// 
-	//detectorParams.polygonalApproxAccuracyRate = 0.1;
-	//detectorParams.minCornerDistanceRate = 0.01;
-	//detectorParams.minMarkerDistanceRate = 0.01;
-	detectorParams.perspectiveRemovePixelPerCell = 10;
-	//detectorParams.perspectiveRemoveIgnoredMarginPerCell = 0.3;
-	//detectorParams.maxErroneousBitsInBorderRate = 0.50;
-	detectorParams.cornerRefinementMethod = cv::aruco::CORNER_REFINE_CONTOUR;
-	detectorParams.cornerRefinementMinAccuracy = 0.01;
-	detectorParams.cornerRefinementMaxIterations = 5000;
-	
-	// IF YOU ARE USING MARKERS WITH DIFFERENT GRID SIZES LIKE 6X6 or 7X7 THIS MUST BE CHANGED TO DICT_NXN_50
-	cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_4X4_50);
-	cv::aruco::ArucoDetector detector(dictionary, detectorParams);
-	
-	std::vector<int> ids;
-	std::vector<std::vector<cv::Point2f>> corners, rejected;
-	detector.detectMarkers(raw_img, corners, ids, rejected);
-	if (ids.size() > 0) {
-		img_config->ids = ids;
-		img_config->corners = app_config->perspective_panel->image_to_scene_pos(corners);
-		for (int i = 0; i < img_config->corners.size(); i++) {
-			img_config->scene_points.push_back(img_config->corners[i][3]);
-			img_config->scene_points.push_back(img_config->corners[i][0]);
-			img_config->scene_points.push_back(img_config->corners[i][1]);
-			img_config->scene_points.push_back(img_config->corners[i][2]);
-			cv::Point2f world_point = app_config->marker_index->lookup(img_config->ids[i]);
-			cv::Point2f corner0 = cv::Point2f(world_point.x, world_point.y + 0.30);
-			cv::Point2f corner1 = cv::Point2f(world_point.x + 0.30, world_point.y + 0.30);
-			cv::Point2f corner2 = cv::Point2f(world_point.x + 0.30, world_point.y);
-			img_config->world_points.push_back(world_point);
-			img_config->world_points.push_back(corner0);
-			img_config->world_points.push_back(corner1);
-			img_config->world_points.push_back(corner2);
+/**
+* Queues marker detection for the image. If the full resolution image is still decoding, the detection is started
+* by finish_marker_job once it is in, markers are always found at full resolution.
+*
+* @param solve_pose also solve the camera pose from the markers
+*/
+void Image::start_marker_job(bool solve_pose) {
+	if (marker_job || (cv_img.empty() && !decode_job)) {
+		return;
+	}
+
+	std::shared_ptr<MarkerJob> job = std::make_shared<MarkerJob>();
+	job->status = POSE_NO_SOLUTION;
+	job->solve_pose = solve_pose;
+	job->started = false;
+	job->done = false;
+	marker_job = job;
+
+	if (!decode_job) {
+		launch_marker_job();
+	}
+}
+
+/**
+* Hands the full resolution image to the marker detector. Everything the worker reads is copied or reference
+* counted, so loading another image meanwhile is safe.
+*/
+void Image::launch_marker_job() {
+	std::shared_ptr<MarkerJob> job = marker_job;
+	job->started = true;
+
+	cv::Mat camera_intrinsic;
+	cv::Mat dist_coeffs;
+	if (job->solve_pose) {
+		camera_intrinsic = img_config->camera_profile->get_camera_matrix().clone();
+		dist_coeffs = img_config->camera_profile->get_dist_coeffs().clone();
+	}
+	MarkerIndex* marker_index = app_config->marker_index;
+
+	MarkerDetector(marker_index->get_dictionary()).detect_async(cv_img, [job, camera_intrinsic, dist_coeffs, marker_index](MarkerDetection& detection) {
+		PoseSolution solution;
+		int status = POSE_NO_SOLUTION;
+		if (job->solve_pose) {
+			std::vector<cv::Point2f> img_points;
+			std::vector<cv::Point3f> world_points;
+			MarkerDetector::corner_correspondences(detection, *marker_index, img_points, world_points);
+			status = PoseEstimator().solve(img_points, world_points, camera_intrinsic, dist_coeffs, solution);
+		}
+
+		std::unique_lock<std::mutex> lock(job->mutex);
+		job->detection = std::move(detection);
+		job->solution = solution;
+		job->status = status;
+		job->done = true;
+
+		// Wake the main loop in case it is idle, so the markers get picked up
+		glfwPostEmptyEvent();
+	});
+}
+
+/**
+* Picks up the result of find_markers or estimate_pose once the worker thread is done, and starts the detection if
+* it was waiting for the full resolution image. The detected markers are kept, and if the pose was estimated the
+* camera pose is replaced with the solved one on success. Called by the perspective panel every frame, the worker
+* wakes the main loop when it is done. Needs the GL context.
+*
+* @return true if a result was picked up
+*/
+bool Image::finish_marker_job() {
+	if (!marker_job) {
+		return false;
+	}
+
+	std::shared_ptr<MarkerJob> job = marker_job;
+	if (!job->started) {
+		if (!decode_job && !cv_img.empty()) {
+			launch_marker_job();
 		}
-	//	cv::aruco::drawDetectedMarkers(raw_img, corners, ids);
+		return false;
 	}
 
-	//raw_img.copyTo(cv_img);
-	//cv::Mat image_copy = cv_img.clone();
-	//
-	//cv_img.copyTo(image_copy);
-	//
-	//cv::aruco::DetectorParameters detectorParams = cv::aruco::DetectorParameters();
-	//cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(cv::aruco::DICT_7X7_250);
-	//cv::aruco::ArucoDetector detector(dictionary, detectorParams);
-	//
-	//std::vector<int> ids;
-	//std::vector<std::vector<cv::Point2f>> corners, rejected;
-	//ids.size();
-	//detector.detectMarkers(image_copy, corners, ids, rejected);
+	{
+		std::unique_lock<std::mutex> lock(job->mutex);
+		if (!job->done) {
+			return false;
+		}
+	}
+	marker_job.reset();
+
+	// Redraw even if nothing was found, the panel only draws when something changed
+	apply_markers(job->detection);
+	generation++;
+
+	if (job->solve_pose) {
+		pose_status = job->status;
+		pose_solution = job->solution;
+		pose_marker_count = job->detection.ids.size();
+		if (pose_status == POSE_SUCCESS) {
+			*img_config->cam_pose = pose_solution.pose;
+		}
+	}
+	return true;
+}
 
-	//detector.detectMarkers(cv_img, corners, ids, rejected);
+/**
+* Check whether markers are being found, or the camera pose estimated, on a worker thread
+*
+* @return true until the result is picked up
+*/
+bool Image::is_finding_markers() {
+	return marker_job != nullptr;
+}
 
-	//if (ids.size() > 0) {
-		//cv::aruco::drawDetectedMarkers(cv_img, corners, ids);
-	//}
+/**
+* Get the status of the last pose estimation of this image
+*
+* @return POSE_SUCCESS or one of the POSE_ error codes, -1 if the pose was not estimated
+*/
+int Image::get_pose_status() {
+	return pose_status;
+}
+
+/**
+* Get the number of markers found by the last pose estimation of this image
+*
+* @return number of markers, including ones that are not in the marker index
+*/
+size_t Image::get_pose_marker_count() {
+	return pose_marker_count;
+}
+
+/**
+* Get the result of the last pose estimation of this image
+*
+* @return solved pose and the residual of every marker corner, empty if get_pose_status is not POSE_SUCCESS
+*/
+const PoseSolution& Image::get_pose_solution() {
+	return pose_solution;
 }
 
 /**
@@ -249,3 +536,23 @@ int Image::get_width() {
 int Image::get_height() {
 	return img_size.height;
 }
+
+/**
+* Get the transform from scene coordinates (origin at the center of the image) to u v coordinates (origin at the
+* top-left corner of the image) of this image
+*
+* @return scene to uv transform
+*/
+Affine2D<SceneFrame, UvFrame> Image::get_scene_to_uv() {
+	return scene_to_uv(img_size.width, img_size.height);
+}
+
+/**
+* Get the transform from u v coordinates (origin at the top-left corner of the image) to scene coordinates (origin
+* at the center of the image) of this image
+*
+* @return uv to scene transform
+*/
+Affine2D<UvFrame, SceneFrame> Image::get_uv_to_scene() {
+	return uv_to_scene(img_size.width, img_size.height);
+}
@@ -3,7 +3,11 @@
 #include <glfw3.h>
 
 #include <GL/GL.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 
@@ -14,19 +18,71 @@
 #include <opencv2/aruco.hpp>
 //#include <opencv2/aruco/aruco_calib.hpp>
 #include "Config.h"
+#include "CoordinateFrames.h"
 #include "CameraPose.h"
 #include "CameraProfile.h"
+#include "Camera2D.h"
+#include "ImagePyramid.h"
+#include "MarkerDetector.h"
+#include "PointMarkerRenderer.h"
+#include "PoseEstimator.h"
+
+// Full resolution decode running on a worker thread
+typedef struct {
+	std::mutex mutex;
+	std::condition_variable finished;
+	cv::Mat img;
+	bool done;
+} DecodeJob;
+
+// Marker detection, and optionally pose estimation, running on a worker thread
+typedef struct {
+	std::mutex mutex;
+	MarkerDetection detection;
+	PoseSolution solution;
+	int status;
+	bool solve_pose;
+	bool started;
+	bool done;
+} MarkerJob;
 
 class Image
 {
 private:
 	const char* file_path;
 	cv::Size img_size;
-	cv::Mat raw_img;
-	cv::Mat cv_img;
+	cv::Mat cv_img; // BGR, as decoded. The only full size copy of the image, the pyramid and marker detection derive from it.
 	cv::Mat cam_intrinsic;
 	cv::Mat cam_rotation_translation;
-	GLuint img_tex;
+	ImagePyramid pyramid;
+
+	// Corners of the detected markers in scene coordinates, and the buffer they are drawn from
+	std::vector<cv::Point2f> marker_corner_points;
+	PointMarkerRenderer marker_corner_markers;
+
+	// Set while the full resolution image is decoding and a preview is shown
+	std::shared_ptr<DecodeJob> decode_job;
+
+	// Set while markers are being detected, and the camera pose estimated from them
+	std::shared_ptr<MarkerJob> marker_job;
+
+	// Result of the last pose estimation, pose_status is -1 if there was none for this image
+	PoseSolution pose_solution;
+	int pose_status;
+	size_t pose_marker_count;
+
+	// Incremented whenever what render() draws changes
+	unsigned int generation;
+
+	static bool read_jpeg_size(const std::string& name, cv::Size reduced_size, int reduction, cv::Size& size);
+
+	void adopt_full_image(cv::Mat img);
+
+	void apply_markers(const MarkerDetection& detection);
+
+	void start_marker_job(bool solve_pose);
+
+	void launch_marker_job();
 	ApplicationConfig* app_config;
 	ImageConfig* img_config;
 	GridConfig* grid_config;
@@ -36,21 +92,43 @@ public:
 	
 	void load();
 
+	bool finish_loading(bool wait);
+
 	inline static bool exists(const std::string& name);
 	inline static bool hasFile(const std::string& name);
 
 	void compute_intrinsics();
 
-	void render();
+	void render(const Camera2D& camera);
 
 	void close();
 
+	bool has_pending_tiles();
+
+	unsigned int get_generation();
+
 	void find_markers();
 
+	void estimate_pose();
+
+	bool finish_marker_job();
+
+	bool is_finding_markers();
+
+	int get_pose_status();
+
+	size_t get_pose_marker_count();
+
+	const PoseSolution& get_pose_solution();
+
 	int get_last4();
 
 	int get_width();
 	int get_height();
+
+	Affine2D<SceneFrame, UvFrame> get_scene_to_uv();
+
+	Affine2D<UvFrame, SceneFrame> get_uv_to_scene();
 	std::string get_filename();
 
 };
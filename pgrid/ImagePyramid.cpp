@@ -0,0 +1,435 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "ImagePyramid.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_set>
+#include <opencv2/imgproc.hpp>
+
+/**
+* Creates an empty pyramid
+*
+* @param tile_size side length of a tile in pixels of its level
+*/
+ImagePyramid::ImagePyramid(int tile_size) {
+	this->tile_size = tile_size;
+	max_uploads_per_frame = 8;
+	resident_bytes = 0;
+	budget_bytes = (size_t)512 * 1024 * 1024;
+	overview_tex = 0;
+	frame = 0;
+	tiles_pending = false;
+}
+
+/**
+* Get the key a tile is stored under
+*
+* @param level pyramid level
+* @param tile_x tile column
+* @param tile_y tile row
+*
+* @return key unique to the tile
+*/
+uint64_t ImagePyramid::tile_key(int level, int tile_x, int tile_y) {
+	return ((uint64_t)level << 48) | ((uint64_t)(uint32_t)tile_y << 24) | (uint64_t)(uint32_t)tile_x;
+}
+
+/**
+* Replaces the image shown by the pyramid. Only the single tile overview is created and uploaded here, the other
+* tiles are created the first time they are visible. Needs a current GL context.
+*
+* @param img 8 bit image with 1, 3 (BGR) or 4 (BGRA) channels. The pyramid shares its data, it is not copied.
+* @param image_size size the image is drawn at, e.g. the full resolution size when img is a reduced preview.
+* Defaults to the size of img.
+*/
+void ImagePyramid::set_image(const cv::Mat& img, cv::Size image_size) {
+	release();
+
+	if (img.empty()) {
+		return;
+	}
+
+	this->image_size = image_size.empty() ? img.size() : image_size;
+	source = img;
+
+	// Halve the size until the whole image fits in one tile
+	level_sizes.push_back(img.size());
+	while (std::max(level_sizes.back().width, level_sizes.back().height) > tile_size) {
+		cv::Size prev = level_sizes.back();
+		level_sizes.push_back(cv::Size((prev.width + 1) / 2, (prev.height + 1) / 2));
+	}
+
+	// The overview only lives on the GPU
+	int top = (int)level_sizes.size() - 1;
+	cv::Mat overview = img;
+	if (top > 0) {
+		cv::resize(img, overview, level_sizes[top], 0, 0, cv::INTER_AREA);
+	}
+	overview_tex = upload(overview, cv::Rect(cv::Point(0, 0), level_sizes[top]));
+}
+
+/**
+* Deletes all textures and drops the reference to the image. Needs a current GL context.
+*/
+void ImagePyramid::release() {
+	for (std::unordered_map<uint64_t, Tile>::iterator it = tiles.begin(); it != tiles.end(); ++it) {
+		glDeleteTextures(1, &it->second.tex);
+	}
+	tiles.clear();
+	lru.clear();
+	resident_bytes = 0;
+
+	if (overview_tex != 0) {
+		glDeleteTextures(1, &overview_tex);
+		overview_tex = 0;
+	}
+
+	source.release();
+	level_sizes.clear();
+	image_size = cv::Size();
+	tiles_pending = false;
+}
+
+/**
+* Sets how much GPU memory the cached tiles may use. Tiles visible in the current frame are never evicted, so the
+* budget can be exceeded while a very large window is open.
+*
+* @param bytes memory budget in bytes
+*/
+void ImagePyramid::set_budget(size_t bytes) {
+	budget_bytes = bytes;
+	evict();
+}
+
+/**
+* Get the part of the level 0 image a region of a level covers
+*
+* @param level pyramid level
+* @param region region in pixels of the level
+*
+* @return region in level 0 pixels, rounded out to whole pixels
+*/
+cv::Rect ImagePyramid::source_region(int level, cv::Rect region) const {
+	// Level sizes are rounded up when halving, so scale by the actual ratio instead of 2^level
+	double scale_x = (double)level_sizes[0].width / level_sizes[level].width;
+	double scale_y = (double)level_sizes[0].height / level_sizes[level].height;
+
+	int x0 = (int)std::floor(region.x * scale_x);
+	int y0 = (int)std::floor(region.y * scale_y);
+	int x1 = (int)std::ceil((region.x + region.width) * scale_x);
+	int y1 = (int)std::ceil((region.y + region.height) * scale_y);
+
+	return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(cv::Point(0, 0), level_sizes[0]);
+}
+
+/**
+* Uploads part of an image to a new texture. The rows are read straight from the image, nothing is copied or
+* converted on the CPU.
+*
+* @param img 8 bit image with 1, 3 (BGR) or 4 (BGRA) channels
+* @param region part of the image to upload
+*
+* @return texture name
+*/
+GLuint ImagePyramid::upload(const cv::Mat& img, cv::Rect region) {
+	GLenum format = GL_BGR;
+	GLint internal_format = GL_RGB8;
+	if (img.channels() == 4) {
+		format = GL_BGRA;
+		internal_format = GL_RGBA8;
+	}
+	else if (img.channels() == 1) {
+		format = GL_LUMINANCE;
+		internal_format = GL_LUMINANCE8;
+	}
+
+	GLuint tex;
+	glGenTextures(1, &tex);
+	glBindTexture(GL_TEXTURE_2D, tex);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, (GLint)(img.step / img.elemSize()));
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, region.width, region.height, 0, format, GL_UNSIGNED_BYTE,
+		img.ptr(region.y, region.x));
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	// Tiles are drawn at most 2x smaller than their level, no mipmaps needed
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	return tex;
+}
+
+/**
+* Looks up a resident tile and marks it as used in this frame
+*
+* @param level pyramid level
+* @param tile_x tile column
+* @param tile_y tile row
+*
+* @return the tile, or NULL if it is not resident
+*/
+ImagePyramid::Tile* ImagePyramid::find_tile(int level, int tile_x, int tile_y) {
+	std::unordered_map<uint64_t, Tile>::iterator it = tiles.find(tile_key(level, tile_x, tile_y));
+	if (it == tiles.end()) {
+		return NULL;
+	}
+
+	lru.splice(lru.begin(), lru, it->second.lru_pos);
+	it->second.last_used_frame = frame;
+	return &it->second;
+}
+
+/**
+* Downsamples a tile from the level 0 image and uploads it. Level 0 tiles are uploaded straight from the image.
+*
+* @param level pyramid level
+* @param tile_x tile column
+* @param tile_y tile row
+*
+* @return the new tile
+*/
+ImagePyramid::Tile* ImagePyramid::create_tile(int level, int tile_x, int tile_y) {
+	cv::Rect region(tile_x * tile_size, tile_y * tile_size, tile_size, tile_size);
+	region &= cv::Rect(cv::Point(0, 0), level_sizes[level]);
+
+	uint64_t key = tile_key(level, tile_x, tile_y);
+	Tile& tile = tiles[key];
+
+	if (level == 0) {
+		tile.tex = upload(source, region);
+	}
+	else {
+		// Only lives until it is uploaded
+		cv::Mat tile_img;
+		cv::resize(source(source_region(level, region)), tile_img, region.size(), 0, 0, cv::INTER_AREA);
+		tile.tex = upload(tile_img, cv::Rect(cv::Point(0, 0), region.size()));
+	}
+
+	// Drivers pad 3 channel textures to 4 bytes per pixel
+	tile.bytes = (size_t)region.area() * (source.channels() == 1 ? 1 : 4);
+	tile.last_used_frame = frame;
+	lru.push_front(key);
+	tile.lru_pos = lru.begin();
+
+	resident_bytes += tile.bytes;
+	return &tile;
+}
+
+/**
+* Deletes the least recently used tiles until the cache is within its budget. Tiles used in the current frame are
+* kept.
+*/
+void ImagePyramid::evict() {
+	while (resident_bytes > budget_bytes && !lru.empty()) {
+		std::unordered_map<uint64_t, Tile>::iterator it = tiles.find(lru.back());
+		if (it->second.last_used_frame == frame) {
+			break;
+		}
+
+		glDeleteTextures(1, &it->second.tex);
+		resident_bytes -= it->second.bytes;
+		lru.pop_back();
+		tiles.erase(it);
+	}
+}
+
+/**
+* Draws a texture over part of the image. The first texture row is drawn at the top, so images do not have to be
+* flipped before they are uploaded.
+*
+* @param tex texture to draw
+* @param u0 left edge in image pixels
+* @param v0 top edge in image pixels
+* @param u1 right edge in image pixels
+* @param v1 bottom edge in image pixels
+* @param origin_x scene x position of the top left corner of the image
+* @param origin_y scene y position of the top left corner of the image
+*/
+void ImagePyramid::draw_quad(GLuint tex, double u0, double v0, double u1, double v1, float origin_x, float origin_y) {
+	float x0 = (float)(origin_x + u0);
+	float x1 = (float)(origin_x + u1);
+	float y0 = (float)(origin_y - v0);
+	float y1 = (float)(origin_y - v1);
+
+	glBindTexture(GL_TEXTURE_2D, tex);
+	glBegin(GL_QUADS);
+		glTexCoord2i(0, 1); glVertex2f(x0, y1);
+		glTexCoord2i(0, 0); glVertex2f(x0, y0);
+		glTexCoord2i(1, 0); glVertex2f(x1, y0);
+		glTexCoord2i(1, 1); glVertex2f(x1, y1);
+	glEnd();
+}
+
+/**
+* Draws a tile at its position in the image
+*
+* @param level pyramid level of the tile
+* @param tile_x tile column
+* @param tile_y tile row
+* @param tex texture of the tile
+* @param origin_x scene x position of the top left corner of the image
+* @param origin_y scene y position of the top left corner of the image
+*/
+void ImagePyramid::draw_tile(int level, int tile_x, int tile_y, GLuint tex, float origin_x, float origin_y) {
+	const cv::Size& level_size = level_sizes[level];
+
+	// Level sizes are rounded up when halving, so scale by the actual ratio instead of 2^level
+	double scale_x = (double)image_size.width / level_size.width;
+	double scale_y = (double)image_size.height / level_size.height;
+
+	int x0 = tile_x * tile_size;
+	int y0 = tile_y * tile_size;
+	int x1 = std::min(x0 + tile_size, level_size.width);
+	int y1 = std::min(y0 + tile_size, level_size.height);
+
+	draw_quad(tex, x0 * scale_x, y0 * scale_y, x1 * scale_x, y1 * scale_y, origin_x, origin_y);
+}
+
+/**
+* Get the pyramid level to draw at a zoom, i.e. the coarsest level that still has at least one texel per screen
+* pixel
+*
+* @param scale screen pixels per image pixel, in the coordinates draw() is called with
+*
+* @return pyramid level
+*/
+int ImagePyramid::select_level(double scale) const {
+	if (level_sizes.empty() || scale <= 0) {
+		return 0;
+	}
+
+	// Screen pixels per level 0 pixel
+	double level0_scale = scale * image_size.width / level_sizes[0].width;
+
+	int level = (int)std::floor(std::log2(1.0 / level0_scale));
+	return std::max(0, std::min(level, (int)level_sizes.size() - 1));
+}
+
+/**
+* Draws the visible part of the image. Needs a current GL context with the scene transform applied.
+*
+* @param visible visible part of the image in image pixels (see set_image)
+* @param scale screen pixels per image pixel
+* @param origin_x scene x position of the top left corner of the image
+* @param origin_y scene y position of the top left corner of the image
+*/
+void ImagePyramid::draw(cv::Rect2d visible, double scale, float origin_x, float origin_y) {
+	if (overview_tex == 0) {
+		return;
+	}
+
+	frame++;
+	tiles_pending = false;
+
+	glEnable(GL_TEXTURE_2D);
+	glColor3f(1.0f, 1.0f, 1.0f);
+
+	// The overview covers the whole image, tiles that are not uploaded yet show it instead of a hole
+	draw_quad(overview_tex, 0, 0, image_size.width, image_size.height, origin_x, origin_y);
+
+	int level = select_level(scale);
+	int top = (int)level_sizes.size() - 1;
+	if (level < top) {
+		const cv::Size& level_size = level_sizes[level];
+		double to_level_x = (double)level_size.width / image_size.width;
+		double to_level_y = (double)level_size.height / image_size.height;
+
+		int tile_cols = (level_size.width + tile_size - 1) / tile_size;
+		int tile_rows = (level_size.height + tile_size - 1) / tile_size;
+
+		int tile_x0 = std::max(0, (int)std::floor(visible.x * to_level_x / tile_size));
+		int tile_y0 = std::max(0, (int)std::floor(visible.y * to_level_y / tile_size));
+		int tile_x1 = std::min(tile_cols - 1, (int)std::floor((visible.x + visible.width) * to_level_x / tile_size));
+		int tile_y1 = std::min(tile_rows - 1, (int)std::floor((visible.y + visible.height) * to_level_y / tile_size));
+
+		std::vector<cv::Point> ready;
+		std::unordered_set<uint64_t> fallbacks_drawn;
+		int uploads = 0;
+
+		for (int tile_y = tile_y0; tile_y <= tile_y1; tile_y++) {
+			for (int tile_x = tile_x0; tile_x <= tile_x1; tile_x++) {
+				Tile* tile = find_tile(level, tile_x, tile_y);
+				if (tile == NULL && uploads < max_uploads_per_frame) {
+					tile = create_tile(level, tile_x, tile_y);
+					uploads++;
+				}
+
+				if (tile != NULL) {
+					ready.push_back(cv::Point(tile_x, tile_y));
+					continue;
+				}
+
+				// Show the closest coarser tile that is resident until this one is uploaded in a later frame
+				tiles_pending = true;
+				for (int coarse = level + 1; coarse < top; coarse++) {
+					int d = coarse - level;
+					Tile* fallback = find_tile(coarse, tile_x >> d, tile_y >> d);
+					if (fallback != NULL) {
+						if (fallbacks_drawn.insert(tile_key(coarse, tile_x >> d, tile_y >> d)).second) {
+							draw_tile(coarse, tile_x >> d, tile_y >> d, fallback->tex, origin_x, origin_y);
+						}
+						break;
+					}
+				}
+			}
+		}
+
+		// Drawn last so the coarser fallbacks never cover them
+		for (size_t i = 0; i < ready.size(); i++) {
+			GLuint tex = tiles[tile_key(level, ready[i].x, ready[i].y)].tex;
+			draw_tile(level, ready[i].x, ready[i].y, tex, origin_x, origin_y);
+		}
+
+		evict();
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDisable(GL_TEXTURE_2D);
+}
+
+/**
+* Check whether the last draw had to leave out tiles because of the per frame upload limit
+*
+* @return true if another frame is needed to show the image at full detail
+*/
+bool ImagePyramid::has_pending_tiles() const {
+	return tiles_pending;
+}
+
+/**
+* Get the GPU memory used by cached tiles, not counting the overview
+*
+* @return memory in bytes
+*/
+size_t ImagePyramid::get_resident_bytes() const {
+	return resident_bytes;
+}
+
+/**
+* Get the number of pyramid levels
+*
+* @return number of levels, 0 if there is no image
+*/
+int ImagePyramid::get_level_count() const {
+	return (int)level_sizes.size();
+}
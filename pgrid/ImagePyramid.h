@@ -0,0 +1,82 @@
+#pragma once
+#include <GL/glew.h>
+#include <GL/GL.h>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+* The ImagePyramid class draws an image as tiles from a multi-resolution pyramid, so images larger than the maximum
+* texture size can be shown and the GPU only holds what is on screen. Level 0 is the full resolution image and
+* every level above it is half the size of the one below. Only level 0 is kept on the CPU. Each frame only the tiles that cover the visible part of
+* the image, at the level matching the zoom, are drawn. Missing tiles are downsampled and uploaded on demand and
+* kept in an LRU cache bounded by a memory budget. A single tile overview of the whole image is always resident
+* and is drawn under the tiles, so the image never has holes while tiles are still being uploaded.
+*/
+class ImagePyramid
+{
+private:
+	typedef struct {
+		GLuint tex;
+		size_t bytes;
+		unsigned int last_used_frame;
+		std::list<uint64_t>::iterator lru_pos;
+	} Tile;
+
+	int tile_size;
+	int max_uploads_per_frame;
+
+	// Level 0 image, shared with the caller. Coarser levels are never stored, each tile is downsampled straight
+	// from the part of the source it covers, so the pyramid adds no CPU memory of its own.
+	cv::Mat source;
+	std::vector<cv::Size> level_sizes;
+
+	// Size of the image in the coordinates draw() is called with. Larger than level 0 when showing a preview.
+	cv::Size image_size;
+
+	std::unordered_map<uint64_t, Tile> tiles;
+	std::list<uint64_t> lru; // most recently used first
+	size_t resident_bytes;
+	size_t budget_bytes;
+
+	GLuint overview_tex;
+	unsigned int frame;
+	bool tiles_pending;
+
+	static uint64_t tile_key(int level, int tile_x, int tile_y);
+
+	cv::Rect source_region(int level, cv::Rect region) const;
+
+	GLuint upload(const cv::Mat& img, cv::Rect region);
+
+	Tile* find_tile(int level, int tile_x, int tile_y);
+
+	Tile* create_tile(int level, int tile_x, int tile_y);
+
+	void evict();
+
+	void draw_quad(GLuint tex, double u0, double v0, double u1, double v1, float origin_x, float origin_y);
+
+	void draw_tile(int level, int tile_x, int tile_y, GLuint tex, float origin_x, float origin_y);
+
+public:
+	ImagePyramid(int tile_size = 512);
+
+	void set_image(const cv::Mat& img, cv::Size image_size = cv::Size());
+
+	void release();
+
+	void set_budget(size_t bytes);
+
+	int select_level(double scale) const;
+
+	void draw(cv::Rect2d visible, double scale, float origin_x, float origin_y);
+
+	bool has_pending_tiles() const;
+
+	size_t get_resident_bytes() const;
+
+	int get_level_count() const;
+};
@@ -53,8 +53,11 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLi
 	session_config->img_config->cam_pose->x_pos = 0;
 	session_config->img_config->cam_pose->y_pos = 0;
 	session_config->img_config->cam_pose->z_pos = 0;
+	session_config->img_config->cam_pose->roll_angle = 0;
+	session_config->img_config->cam_pose->pitch_angle = 0;
 	session_config->img_config->cam_pose->yaw_angle = 0;
 	session_config->img_config->image_loaded = false;
+	session_config->img_config->tile_cache_mb = 512;
 
 	session_config->img_config->camera_profile = new CameraProfile;
 
@@ -0,0 +1,143 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() {
+	data = nullptr;
+	size = 0;
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+/**
+* Maps a file, replacing any file mapped before. An empty file opens with no data.
+*
+* @param path file to map
+*
+* @return true if the file was mapped
+*/
+bool MappedFile::open(const std::string& path) {
+	close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		return false;
+	}
+	file_handle = file;
+	size = (size_t)file_size.QuadPart;
+	if (size == 0) {
+		return true;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		close();
+		return false;
+	}
+	mapping_handle = mapping;
+
+	data = (const unsigned char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr) {
+		close();
+		return false;
+	}
+#else
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		::close(fd);
+		return false;
+	}
+	size = (size_t)file_stat.st_size;
+	if (size > 0) {
+		void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			::close(fd);
+			size = 0;
+			return false;
+		}
+		data = (const unsigned char*)mapped;
+	}
+
+	// The mapping stays valid after the descriptor is closed
+	::close(fd);
+#endif
+
+	return true;
+}
+
+/**
+* Releases the mapping, pointers into the data are invalid afterwards
+*/
+void MappedFile::close() {
+#ifdef _WIN32
+	if (data != nullptr) {
+		UnmapViewOfFile(data);
+	}
+	if (mapping_handle != nullptr) {
+		CloseHandle((HANDLE)mapping_handle);
+	}
+	if (file_handle != nullptr) {
+		CloseHandle((HANDLE)file_handle);
+	}
+#else
+	if (data != nullptr) {
+		munmap((void*)data, size);
+	}
+#endif
+
+	data = nullptr;
+	size = 0;
+	file_handle = nullptr;
+	mapping_handle = nullptr;
+}
+
+const unsigned char* MappedFile::get_data() const {
+	return data;
+}
+
+size_t MappedFile::get_size() const {
+	return size;
+}
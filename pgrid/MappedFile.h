@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/**
+* The MappedFile class maps a whole file read only into memory. Opening costs the same whatever the size of the file,
+* pages are only read from disk when they are touched. The mapping is released when the object is destroyed, so
+* pointers into get_data() must not outlive it.
+*/
+class MappedFile
+{
+private:
+	const unsigned char* data;
+	size_t size;
+
+	// Platform handles of the open file and the mapping
+	void* file_handle;
+	void* mapping_handle;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string& path);
+
+	void close();
+
+	const unsigned char* get_data() const;
+
+	size_t get_size() const;
+};
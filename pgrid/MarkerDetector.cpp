@@ -0,0 +1,247 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "MarkerDetector.h"
+#include <algorithm>
+#include <thread>
+#include <utility>
+#include <opencv2/imgproc.hpp>
+#include "MarkerIndex.h"
+#include "ThreadPool.h"
+
+/**
+* Creates a detector with the settings the marker calibration has always used
+*
+* @param dictionary_id cv::aruco::PredefinedDictionaryType the markers are printed from, see MarkerIndex::get_dictionary
+* @param thread_count threads the full resolution regions are searched on, 0 for one per hardware thread
+*/
+MarkerDetector::MarkerDetector(int dictionary_id, size_t thread_count) {
+	this->thread_count = thread_count;
+
+	cv::aruco::DetectorParameters detectorParams = cv::aruco::DetectorParameters();
+
+	// Setings for aruco marker detection
+	//
+	//detectorParams.polygonalApproxAccuracyRate = 0.1;
+	//detectorParams.minCornerDistanceRate = 0.01;
+	//detectorParams.minMarkerDistanceRate = 0.01;
+	detectorParams.perspectiveRemovePixelPerCell = 10;
+	//detectorParams.perspectiveRemoveIgnoredMarginPerCell = 0.3;
+	//detectorParams.maxErroneousBitsInBorderRate = 0.50;
+	detectorParams.cornerRefinementMethod = cv::aruco::CORNER_REFINE_CONTOUR;
+	detectorParams.cornerRefinementMinAccuracy = 0.01;
+	detectorParams.cornerRefinementMaxIterations = 5000;
+
+	// The dictionary comes from the marker index, DICT_4X4_50 unless it names another
+	cv::aruco::Dictionary dictionary = cv::aruco::getPredefinedDictionary(dictionary_id);
+	detector = cv::aruco::ArucoDetector(dictionary, detectorParams);
+
+	// The coarse pass only has to locate the markers, the corners are refined at full resolution
+	cv::aruco::DetectorParameters coarseParams = detectorParams;
+	coarseParams.cornerRefinementMethod = cv::aruco::CORNER_REFINE_NONE;
+	coarse_detector = cv::aruco::ArucoDetector(dictionary, coarseParams);
+}
+
+/**
+* Finds the markers in an image. Images larger than MARKER_COARSE_MAX_SIZE are searched in two passes: candidates
+* are found on a downscaled level, then only the regions around them are searched at full resolution, in parallel.
+* The ids and corners are the same as a full resolution search of the whole image, sorted by id.
+*
+* @param img BGR or grayscale image
+* @param detection receives the ids and u v corners of the markers found
+*/
+void MarkerDetector::detect(const cv::Mat& img, MarkerDetection& detection) const {
+	detection.ids.clear();
+	detection.corners.clear();
+
+	if (img.empty()) {
+		return;
+	}
+
+	// ArUco works on grayscale, convert just for the detection instead of keeping a gray copy around
+	cv::Mat gray;
+	if (img.channels() == 1) {
+		gray = img;
+	}
+	else {
+		cv::cvtColor(img, gray, cv::COLOR_BGR2GRAY);
+	}
+
+	// A small image is searched whole, as one region
+	std::vector<cv::Rect> regions;
+	if (std::max(gray.cols, gray.rows) <= MARKER_COARSE_MAX_SIZE) {
+		regions.push_back(cv::Rect(0, 0, gray.cols, gray.rows));
+	}
+	else {
+		find_regions(gray, regions);
+	}
+
+	// Regions do not overlap and every candidate lies entirely in one, so no marker is found twice
+	std::vector<MarkerDetection> region_detections(regions.size());
+	if (regions.size() > 1 && thread_count != 1) {
+		ThreadPool pool(std::min(thread_count > 0 ? thread_count : ThreadPool::default_thread_count(), regions.size()));
+		for (size_t i = 0; i < regions.size(); i++) {
+			pool.submit([this, &gray, &regions, &region_detections, i] {
+				detect_full(gray(regions[i]), region_detections[i]);
+			});
+		}
+		pool.wait();
+	}
+	else {
+		for (size_t i = 0; i < regions.size(); i++) {
+			detect_full(gray(regions[i]), region_detections[i]);
+		}
+	}
+
+	std::vector<std::pair<int, std::vector<cv::Point2f>>> markers;
+	for (size_t i = 0; i < regions.size(); i++) {
+		cv::Point2f offset((float)regions[i].x, (float)regions[i].y);
+		for (size_t j = 0; j < region_detections[i].ids.size(); j++) {
+			std::vector<cv::Point2f> corners = region_detections[i].corners[j];
+			for (cv::Point2f& corner : corners) {
+				corner += offset;
+			}
+			markers.push_back(std::make_pair(region_detections[i].ids[j], corners));
+		}
+	}
+
+	std::sort(markers.begin(), markers.end(), [](const std::pair<int, std::vector<cv::Point2f>>& a,
+		const std::pair<int, std::vector<cv::Point2f>>& b) {
+		return a.first < b.first || (a.first == b.first && a.second[0].x < b.second[0].x);
+	});
+	for (size_t i = 0; i < markers.size(); i++) {
+		detection.ids.push_back(markers[i].first);
+		detection.corners.push_back(markers[i].second);
+	}
+}
+
+/**
+* Searches a whole grayscale image at full resolution, the way markers were always found
+*
+* @param gray grayscale image or region of one
+* @param detection receives the ids and corners of the markers found, in the coordinates of gray
+*/
+void MarkerDetector::detect_full(const cv::Mat& gray, MarkerDetection& detection) const {
+	std::vector<std::vector<cv::Point2f>> rejected;
+	detector.detectMarkers(gray, detection.corners, detection.ids, rejected);
+}
+
+/**
+* Finds the regions of a large image that may hold markers. Markers are looked for without corner refinement on the
+* first pyramid level no larger than MARKER_COARSE_MAX_SIZE. Rejected candidates are kept too, a marker too small to
+* decode at that level may still decode at full resolution. Each candidate is padded by MARKER_ROI_MARGIN so its
+* border and quiet zone are searched, and overlapping regions are merged.
+*
+* @param gray full resolution grayscale image
+* @param regions receives the regions to search at full resolution, in full resolution pixels
+*/
+void MarkerDetector::find_regions(const cv::Mat& gray, std::vector<cv::Rect>& regions) const {
+	regions.clear();
+
+	cv::Mat level = gray;
+	int scale = 1;
+	while (std::max(level.cols, level.rows) > MARKER_COARSE_MAX_SIZE) {
+		cv::Mat smaller;
+		cv::pyrDown(level, smaller);
+		level = smaller;
+		scale *= 2;
+	}
+
+	std::vector<int> ids;
+	std::vector<std::vector<cv::Point2f>> candidates;
+	std::vector<std::vector<cv::Point2f>> rejected;
+	coarse_detector.detectMarkers(level, candidates, ids, rejected);
+	candidates.insert(candidates.end(), rejected.begin(), rejected.end());
+
+	cv::Rect image_rect(0, 0, gray.cols, gray.rows);
+	for (const std::vector<cv::Point2f>& candidate : candidates) {
+		cv::Rect bounds = cv::boundingRect(candidate);
+
+		// One extra coarse pixel on every side covers the rounding of the pyramid
+		int margin = (int)(std::max(bounds.width, bounds.height) * MARKER_ROI_MARGIN + 1) * scale;
+		cv::Rect region(bounds.x * scale - margin, bounds.y * scale - margin,
+			bounds.width * scale + 2 * margin, bounds.height * scale + 2 * margin);
+		region &= image_rect;
+		if (region.area() > 0) {
+			regions.push_back(region);
+		}
+	}
+
+	// Merge until no two regions overlap
+	bool merged = true;
+	while (merged) {
+		merged = false;
+		for (size_t i = 0; i < regions.size(); i++) {
+			for (size_t j = i + 1; j < regions.size(); j++) {
+				if ((regions[i] & regions[j]).area() > 0) {
+					regions[i] |= regions[j];
+					regions.erase(regions.begin() + j);
+					merged = true;
+					j = i;
+				}
+			}
+		}
+	}
+}
+
+/**
+* Finds the markers in an image on a worker thread
+*
+* @param img BGR or grayscale image, shared with the worker until it is done
+* @param on_done called on the worker thread with the markers found
+*/
+void MarkerDetector::detect_async(cv::Mat img, std::function<void(MarkerDetection&)> on_done) const {
+	// The ArUco detectors are reference counted, the copy shares them
+	MarkerDetector worker_detector = *this;
+	std::thread([worker_detector, img, on_done] {
+		MarkerDetection detection;
+		worker_detector.detect(img, detection);
+		on_done(detection);
+	}).detach();
+}
+
+/**
+* Pairs the corners of detected markers with their world positions from the marker board model. Each marker gives
+* four pairs, starting at the bottom left corner of the marker, which is the marker position in the index. Markers
+* that are not in the index are skipped.
+*
+* @param detection markers found in an image
+* @param marker_index placements of the markers
+* @param img_points receives the marker corners in the coordinates of the detection
+* @param world_points receives the world position of every corner in meters
+*/
+void MarkerDetector::corner_correspondences(const MarkerDetection& detection, const MarkerIndex& marker_index,
+	std::vector<cv::Point2f>& img_points, std::vector<cv::Point3f>& world_points) {
+	// Bottom left, top left, top right, bottom right of the marker
+	static const int corner_order[4] = { 3, 0, 1, 2 };
+
+	img_points.clear();
+	world_points.clear();
+
+	for (size_t i = 0; i < detection.ids.size(); i++) {
+		MarkerPlacement marker;
+		if (!marker_index.find(detection.ids[i], marker)) {
+			continue;
+		}
+
+		cv::Point3f world_corners[4];
+		marker_index.corners(marker, world_corners);
+		for (int corner : corner_order) {
+			img_points.push_back(detection.corners[i][corner]);
+			world_points.push_back(world_corners[corner]);
+		}
+	}
+}
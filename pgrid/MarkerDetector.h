@@ -0,0 +1,56 @@
+#pragma once
+#include <functional>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/objdetect/aruco_detector.hpp>
+
+class MarkerIndex;
+
+// Longest side of the pyramid level the coarse pass looks for markers in. Smaller images are searched directly.
+#define MARKER_COARSE_MAX_SIZE 2048
+
+// Margin around a coarse candidate searched at full resolution, as a fraction of the candidate size
+#define MARKER_ROI_MARGIN 0.5
+
+// Markers found in one image, corners in u v coordinates in the order ArUco returns them (top left, top right,
+// bottom right, bottom left of the marker)
+typedef struct {
+	std::vector<int> ids;
+	std::vector<std::vector<cv::Point2f>> corners;
+} MarkerDetection;
+
+/**
+* The MarkerDetector class finds the ArUco markers of the marker calibration in an image, and pairs their corners
+* with the world positions of the marker index. It does not touch any GL state or configuration, so it can run on
+* worker threads and in pgrid-batch. detect is const and may be called from several threads at once.
+*
+* Large images are searched in two passes. A coarse pass without corner refinement finds candidate markers on a
+* downscaled level of the image, then the regions around the candidates are searched at full resolution with the
+* usual refinement, in parallel. Only the regions around markers pay for the full resolution search.
+*/
+class MarkerDetector
+{
+private:
+	// Full resolution search, with contour corner refinement
+	cv::aruco::ArucoDetector detector;
+
+	// Coarse pass on the downscaled image, without corner refinement
+	cv::aruco::ArucoDetector coarse_detector;
+
+	// Threads the full resolution regions are searched on, 0 for one per hardware thread
+	size_t thread_count;
+
+	void detect_full(const cv::Mat& gray, MarkerDetection& detection) const;
+
+	void find_regions(const cv::Mat& gray, std::vector<cv::Rect>& regions) const;
+
+public:
+	MarkerDetector(int dictionary_id = cv::aruco::DICT_4X4_50, size_t thread_count = 0);
+
+	void detect(const cv::Mat& img, MarkerDetection& detection) const;
+
+	void detect_async(cv::Mat img, std::function<void(MarkerDetection&)> on_done) const;
+
+	static void corner_correspondences(const MarkerDetection& detection, const MarkerIndex& marker_index,
+		std::vector<cv::Point2f>& img_points, std::vector<cv::Point3f>& world_points);
+};
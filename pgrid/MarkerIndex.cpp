@@ -1,46 +1,609 @@
-/***********************************************************************
-Copyright 2023 Insurance Institute for Highway Safety
+#include "MarkerIndex.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <opencv2/objdetect/aruco_dictionary.hpp>
 
-Licensed under the Apache License, Version 2.0 (the "License");
-you may not use this file except in compliance with the License.
-You may obtain a copy of the License at
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
 
-http://www.apache.org/licenses/LICENSE-2.0
+// First bytes of a binary marker index, followed by the header and the arrays. All fields are 4 bytes, little
+// endian:
+//
+//   magic[8] version dictionary marker_count slot_count checksum reserved
+//   ids[marker_count] x[marker_count] y[...] z[...] size[...] rotation[...] slots[slot_count]
+//
+// The checksum is the FNV-1a hash of everything after the header.
+#define MARKER_INDEX_MAGIC "PGRIDMKI"
+#define MARKER_INDEX_VERSION 1
+#define MARKER_INDEX_HEADER_SIZE 32
 
-Unless required by applicable law or agreed to in writing, software
-distributed under the License is distributed on an "AS IS" BASIS,
-WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
-See the License for the specific language governing permissions and
-limitations under the License.
-***********************************************************************/
+// Marker values stored per marker after the id: x, y, z, size, rotation
+#define MARKER_INDEX_VALUES 5
 
-#include "MarkerIndex.h"
+// validation before a binary index is checked
+#define MARKER_INDEX_UNCHECKED -1
+
+typedef struct {
+	const char* name;
+	int dictionary;
+} DictionaryName;
+
+static const DictionaryName dictionary_names[] = {
+	{ "DICT_4X4_50", cv::aruco::DICT_4X4_50 },
+	{ "DICT_4X4_100", cv::aruco::DICT_4X4_100 },
+	{ "DICT_4X4_250", cv::aruco::DICT_4X4_250 },
+	{ "DICT_4X4_1000", cv::aruco::DICT_4X4_1000 },
+	{ "DICT_5X5_50", cv::aruco::DICT_5X5_50 },
+	{ "DICT_5X5_100", cv::aruco::DICT_5X5_100 },
+	{ "DICT_5X5_250", cv::aruco::DICT_5X5_250 },
+	{ "DICT_5X5_1000", cv::aruco::DICT_5X5_1000 },
+	{ "DICT_6X6_50", cv::aruco::DICT_6X6_50 },
+	{ "DICT_6X6_100", cv::aruco::DICT_6X6_100 },
+	{ "DICT_6X6_250", cv::aruco::DICT_6X6_250 },
+	{ "DICT_6X6_1000", cv::aruco::DICT_6X6_1000 },
+	{ "DICT_7X7_50", cv::aruco::DICT_7X7_50 },
+	{ "DICT_7X7_100", cv::aruco::DICT_7X7_100 },
+	{ "DICT_7X7_250", cv::aruco::DICT_7X7_250 },
+	{ "DICT_7X7_1000", cv::aruco::DICT_7X7_1000 },
+	{ "DICT_ARUCO_ORIGINAL", cv::aruco::DICT_ARUCO_ORIGINAL },
+	{ "DICT_APRILTAG_16h5", cv::aruco::DICT_APRILTAG_16h5 },
+	{ "DICT_APRILTAG_25h9", cv::aruco::DICT_APRILTAG_25h9 },
+	{ "DICT_APRILTAG_36h10", cv::aruco::DICT_APRILTAG_36h10 },
+	{ "DICT_APRILTAG_36h11", cv::aruco::DICT_APRILTAG_36h11 },
+};
+
+MarkerIndex::MarkerIndex() {
+	app_config = nullptr;
+	validation = MARKER_INDEX_UNCHECKED;
+	clear();
+}
 
 MarkerIndex::MarkerIndex(SessionConfig* session_config) {
 	app_config = session_config->app_config;
+	validation = MARKER_INDEX_UNCHECKED;
+	clear();
 
 	build_index();
 }
 
-cv::Point2f MarkerIndex::lookup(unsigned int id) {
-	return cv::Point2f(x_coords[id], y_coords[id]);
+/**
+* Empties the index, lookups find nothing until an index is loaded
+*/
+void MarkerIndex::clear() {
+	status = MARKER_INDEX_FILE_ERROR;
+	dictionary = cv::aruco::DICT_4X4_50;
+	marker_count = 0;
+	slot_count = 0;
+	ids = nullptr;
+	x_coords = y_coords = z_coords = sizes = rotations = nullptr;
+	slots = nullptr;
+	owned_ids.clear();
+	owned_values.clear();
+	owned_slots.clear();
+	mapped_file.reset();
+	checksum = 0;
+	validation = MARKER_INDEX_FILE_ERROR;
 }
 
-void MarkerIndex::build_index() {
-	std::ifstream index_file;
+/**
+* Spreads marker ids over the hash table. Ids are usually small and consecutive, the multiplication keeps them from
+* filling one run of slots. The binary format stores the table, so this must not change without a new version.
+*
+* @param id marker id
+*
+* @return hash of the id, reduce it to a slot with the table mask
+*/
+size_t MarkerIndex::hash_id(int id) {
+	return (size_t)((uint32_t)id * 2654435761u);
+}
 
-	index_file.open(app_config->marker_index_filepath);
+/**
+* FNV-1a hash of a block of bytes, the checksum of the binary format
+*
+* @param data bytes to hash
+* @param length number of bytes
+*
+* @return 32 bit hash
+*/
+uint32_t MarkerIndex::compute_checksum(const unsigned char* data, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ data[i]) * 16777619u;
+	}
+	return hash;
+}
 
-	if (!index_file.is_open()) {
-		exit(30);
+/**
+* Reads the marker index file of the application config
+*
+* @return MARKER_INDEX_SUCCESS or one of the MARKER_INDEX_ errors, see load
+*/
+int MarkerIndex::build_index() {
+	if (app_config == nullptr) {
+		clear();
+		return status;
 	}
 
-	int id;
-	float x, y;
-	std::string ignore;
-	while (index_file >> ignore >> id >> ignore >> x >> ignore >> y) {
-		marker_ids.push_back(id);
-		x_coords.push_back(x);
-		y_coords.push_back(y);
+	return load(app_config->marker_index_filepath);
+}
+
+/**
+* Reads a marker index, text or binary. A binary index is only mapped here, it is validated on the first lookup or
+* by validate. On failure the index is empty and an error is printed, the application keeps running.
+*
+* @param path marker index file
+*
+* @return MARKER_INDEX_SUCCESS, MARKER_INDEX_FILE_ERROR if the file cannot be opened or MARKER_INDEX_FORMAT_ERROR if
+* a binary index is truncated or from another version
+*/
+int MarkerIndex::load(const std::string& path) {
+	clear();
+
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(path)) {
+		printf("Error: could not open marker index %s\n", path.c_str());
+		return status;
 	}
-}
\ No newline at end of file
+
+	const unsigned char* data = file->get_data();
+	size_t length = file->get_size();
+	if (length >= sizeof(MARKER_INDEX_MAGIC) - 1 && memcmp(data, MARKER_INDEX_MAGIC, sizeof(MARKER_INDEX_MAGIC) - 1) == 0) {
+		mapped_file = std::move(file);
+		status = load_binary(data, length);
+	}
+	else {
+		status = load_text((const char*)data, length);
+	}
+
+	if (status != MARKER_INDEX_SUCCESS) {
+		printf("Error: %s is not a valid marker index\n", path.c_str());
+		int failed = status;
+		clear();
+		status = failed;
+		validation = failed;
+	}
+	return status;
+}
+
+/**
+* Parses a text marker index. Lines that cannot be read are reported and skipped, so one bad line does not lose the
+* whole marker field.
+*
+* @param text content of the file
+* @param length number of characters
+*
+* @return MARKER_INDEX_SUCCESS
+*/
+int MarkerIndex::load_text(const char* text, size_t length) {
+	std::istringstream lines(std::string(text != nullptr ? text : "", length));
+	std::vector<MarkerPlacement> markers;
+
+	float default_size = MARKER_DEFAULT_SIZE_M;
+	std::string line;
+	int line_number = 0;
+	while (std::getline(lines, line)) {
+		line_number++;
+
+		size_t comment = line.find('#');
+		if (comment != std::string::npos) {
+			line.erase(comment);
+		}
+
+		std::istringstream tokens(line);
+		std::string key;
+		if (!(tokens >> key)) {
+			continue;
+		}
+
+		if (key == "dictionary") {
+			std::string name;
+			if (!(tokens >> name) || !parse_dictionary(name, dictionary)) {
+				printf("Error: unknown marker dictionary on line %d of the marker index\n", line_number);
+			}
+			continue;
+		}
+		if (key == "size") {
+			float size;
+			if (!(tokens >> size) || size <= 0) {
+				printf("Error: invalid marker size on line %d of the marker index\n", line_number);
+			}
+			else {
+				default_size = size;
+			}
+			continue;
+		}
+		if (key != "id") {
+			printf("Error: unexpected %s on line %d of the marker index\n", key.c_str(), line_number);
+			continue;
+		}
+
+		MarkerPlacement marker = MarkerPlacement();
+		marker.size = default_size;
+		bool has_id = false, has_x = false, has_y = false, valid = true;
+		std::string value_key = key;
+		do {
+			float value;
+			if (!(tokens >> value)) {
+				valid = false;
+				break;
+			}
+
+			if (value_key == "id" && value >= 0 && value == std::floor(value)) {
+				marker.id = (int)value;
+				has_id = true;
+			}
+			else if (value_key == "x") {
+				marker.x = value;
+				has_x = true;
+			}
+			else if (value_key == "y") {
+				marker.y = value;
+				has_y = true;
+			}
+			else if (value_key == "z") {
+				marker.z = value;
+			}
+			else if (value_key == "size" && value > 0) {
+				marker.size = value;
+			}
+			else if (value_key == "rotation") {
+				marker.rotation = value;
+			}
+			else {
+				valid = false;
+				break;
+			}
+		} while (tokens >> value_key);
+
+		if (!valid || !has_id || !has_x || !has_y) {
+			printf("Error: invalid marker on line %d of the marker index\n", line_number);
+			continue;
+		}
+		markers.push_back(marker);
+	}
+
+	adopt_markers(markers);
+	validation = MARKER_INDEX_SUCCESS;
+	return MARKER_INDEX_SUCCESS;
+}
+
+/**
+* Takes the markers of a text index into the owned arrays, sorted by id, and builds the hash table. Of markers with
+* the same id the last one is kept.
+*
+* @param markers markers in file order, sorted in place
+*/
+void MarkerIndex::adopt_markers(std::vector<MarkerPlacement>& markers) {
+	std::stable_sort(markers.begin(), markers.end(), [](const MarkerPlacement& a, const MarkerPlacement& b) {
+		return a.id < b.id;
+	});
+
+	std::vector<MarkerPlacement> unique_markers;
+	for (size_t i = 0; i < markers.size(); i++) {
+		if (i + 1 < markers.size() && markers[i + 1].id == markers[i].id) {
+			printf("Warning: marker %d is in the marker index twice, the last placement is used\n", markers[i].id);
+			continue;
+		}
+		unique_markers.push_back(markers[i]);
+	}
+
+	marker_count = unique_markers.size();
+	owned_ids.resize(marker_count);
+	owned_values.resize(marker_count * MARKER_INDEX_VALUES);
+	for (size_t i = 0; i < marker_count; i++) {
+		owned_ids[i] = unique_markers[i].id;
+		owned_values[i] = unique_markers[i].x;
+		owned_values[marker_count + i] = unique_markers[i].y;
+		owned_values[2 * marker_count + i] = unique_markers[i].z;
+		owned_values[3 * marker_count + i] = unique_markers[i].size;
+		owned_values[4 * marker_count + i] = unique_markers[i].rotation;
+	}
+
+	// At most half of the slots are used, so probes stay short and always reach an empty slot
+	slot_count = 16;
+	while (slot_count < marker_count * 2) {
+		slot_count *= 2;
+	}
+	owned_slots.assign(slot_count, -1);
+	size_t mask = slot_count - 1;
+	for (size_t i = 0; i < marker_count; i++) {
+		size_t slot = hash_id(owned_ids[i]) & mask;
+		while (owned_slots[slot] >= 0) {
+			slot = (slot + 1) & mask;
+		}
+		owned_slots[slot] = (int32_t)i;
+	}
+
+	ids = owned_ids.data();
+	x_coords = owned_values.data();
+	y_coords = x_coords + marker_count;
+	z_coords = y_coords + marker_count;
+	sizes = z_coords + marker_count;
+	rotations = sizes + marker_count;
+	slots = owned_slots.data();
+}
+
+/**
+* Points the arrays into a mapped binary index. Only the header is read, the arrays are checked by validate.
+*
+* @param data mapped file
+* @param length size of the file in bytes
+*
+* @return MARKER_INDEX_SUCCESS, or MARKER_INDEX_FORMAT_ERROR if the header does not fit the file
+*/
+int MarkerIndex::load_binary(const unsigned char* data, size_t length) {
+	if (length < MARKER_INDEX_HEADER_SIZE) {
+		return MARKER_INDEX_FORMAT_ERROR;
+	}
+
+	uint32_t header[6];
+	memcpy(header, data + 8, sizeof(header));
+	uint32_t version = header[0];
+	uint32_t count = header[2];
+	uint32_t table_size = header[3];
+
+	uint64_t expected_length = MARKER_INDEX_HEADER_SIZE +
+		4 * ((uint64_t)count * (1 + MARKER_INDEX_VALUES) + table_size);
+	if (version != MARKER_INDEX_VERSION || expected_length != length || table_size <= count ||
+		(table_size & (table_size - 1)) != 0) {
+		return MARKER_INDEX_FORMAT_ERROR;
+	}
+
+	dictionary = (int)header[1];
+	marker_count = count;
+	slot_count = table_size;
+	checksum = header[4];
+
+	// The header is 32 bytes and every array a multiple of 4, so the arrays are aligned in the mapping
+	const unsigned char* arrays = data + MARKER_INDEX_HEADER_SIZE;
+	ids = (const int32_t*)arrays;
+	x_coords = (const float*)(arrays + 4 * marker_count);
+	y_coords = x_coords + marker_count;
+	z_coords = y_coords + marker_count;
+	sizes = z_coords + marker_count;
+	rotations = sizes + marker_count;
+	slots = (const int32_t*)(rotations + marker_count);
+
+	validation = MARKER_INDEX_UNCHECKED;
+	return MARKER_INDEX_SUCCESS;
+}
+
+/**
+* Checks the checksum of a binary index, and that the ids are sorted and the hash table only holds valid positions
+* with an empty slot to end every probe. Runs once, lookups call it before they read the arrays.
+*
+* @return MARKER_INDEX_SUCCESS, or the error of a failed load or check
+*/
+int MarkerIndex::validate() const {
+	int result = validation.load(std::memory_order_acquire);
+	if (result != MARKER_INDEX_UNCHECKED) {
+		return result;
+	}
+
+	std::lock_guard<std::mutex> lock(validation_mutex);
+	result = validation.load(std::memory_order_relaxed);
+	if (result == MARKER_INDEX_UNCHECKED) {
+		result = check_arrays();
+		if (result != MARKER_INDEX_SUCCESS) {
+			printf("Error: the marker index is damaged, no markers can be looked up\n");
+		}
+		validation.store(result, std::memory_order_release);
+	}
+	return result;
+}
+
+/**
+* Checks the arrays of a mapped binary index
+*
+* @return MARKER_INDEX_SUCCESS, MARKER_INDEX_CHECKSUM_ERROR or MARKER_INDEX_FORMAT_ERROR
+*/
+int MarkerIndex::check_arrays() const {
+	const unsigned char* arrays = mapped_file->get_data() + MARKER_INDEX_HEADER_SIZE;
+	if (compute_checksum(arrays, mapped_file->get_size() - MARKER_INDEX_HEADER_SIZE) != checksum) {
+		return MARKER_INDEX_CHECKSUM_ERROR;
+	}
+
+	for (size_t i = 1; i < marker_count; i++) {
+		if (ids[i - 1] >= ids[i]) {
+			return MARKER_INDEX_FORMAT_ERROR;
+		}
+	}
+
+	bool has_empty_slot = false;
+	for (size_t i = 0; i < slot_count; i++) {
+		if (slots[i] < 0) {
+			has_empty_slot = true;
+		}
+		else if ((size_t)slots[i] >= marker_count) {
+			return MARKER_INDEX_FORMAT_ERROR;
+		}
+	}
+	return has_empty_slot ? MARKER_INDEX_SUCCESS : MARKER_INDEX_FORMAT_ERROR;
+}
+
+/**
+* Writes the index in the binary format. load reads it back by mapping the file, without parsing.
+*
+* @param path binary index file
+*
+* @return MARKER_INDEX_SUCCESS, MARKER_INDEX_FILE_ERROR if the file could not be written, or the error of the index
+*/
+int MarkerIndex::save_binary(const std::string& path) const {
+	int result = validate();
+	if (result != MARKER_INDEX_SUCCESS) {
+		return result;
+	}
+
+	std::vector<unsigned char> arrays(4 * (marker_count * (1 + MARKER_INDEX_VALUES) + slot_count));
+	unsigned char* out = arrays.data();
+	memcpy(out, ids, 4 * marker_count);
+	out += 4 * marker_count;
+	const float* values[MARKER_INDEX_VALUES] = { x_coords, y_coords, z_coords, sizes, rotations };
+	for (const float* value : values) {
+		memcpy(out, value, 4 * marker_count);
+		out += 4 * marker_count;
+	}
+	memcpy(out, slots, 4 * slot_count);
+
+	const uint32_t header[6] = { MARKER_INDEX_VERSION, (uint32_t)dictionary, (uint32_t)marker_count,
+		(uint32_t)slot_count, compute_checksum(arrays.data(), arrays.size()), 0 };
+
+	std::ofstream outfile(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open()) {
+		return MARKER_INDEX_FILE_ERROR;
+	}
+	outfile.write(MARKER_INDEX_MAGIC, 8);
+	outfile.write((const char*)header, sizeof(header));
+	outfile.write((const char*)arrays.data(), arrays.size());
+	outfile.close();
+
+	return outfile ? MARKER_INDEX_SUCCESS : MARKER_INDEX_FILE_ERROR;
+}
+
+/**
+* Finds the placement of a marker
+*
+* @param id marker id
+* @param marker receives the placement of the marker if it is in the index
+*
+* @return true if the marker is in the index
+*/
+bool MarkerIndex::find(int id, MarkerPlacement& marker) const {
+	if (marker_count == 0 || validate() != MARKER_INDEX_SUCCESS) {
+		return false;
+	}
+
+	size_t mask = slot_count - 1;
+	size_t slot = hash_id(id) & mask;
+	while (slots[slot] >= 0) {
+		if (ids[slots[slot]] == id) {
+			return get_marker((size_t)slots[slot], marker);
+		}
+		slot = (slot + 1) & mask;
+	}
+	return false;
+}
+
+/**
+* Gets a marker by its position in the index, markers are sorted by id
+*
+* @param index position of the marker, below size()
+* @param marker receives the placement of the marker
+*
+* @return true if there is a marker at that position
+*/
+bool MarkerIndex::get_marker(size_t index, MarkerPlacement& marker) const {
+	if (index >= marker_count || validate() != MARKER_INDEX_SUCCESS) {
+		return false;
+	}
+
+	marker.id = ids[index];
+	marker.x = x_coords[index];
+	marker.y = y_coords[index];
+	marker.z = z_coords[index];
+	marker.size = sizes[index];
+	marker.rotation = rotations[index];
+	return true;
+}
+
+/**
+* Checks whether a marker is in the index
+*
+* @param id marker id
+*
+* @return true if find(id) finds a placement
+*/
+bool MarkerIndex::contains(int id) const {
+	MarkerPlacement marker;
+	return find(id, marker);
+}
+
+/**
+* Gets the world positions of the corners of a marker in the order ArUco returns the image corners: top left, top
+* right, bottom right, bottom left of the marker
+*
+* @param marker placement of the marker
+* @param world_corners receives the corners in meters
+*/
+void MarkerIndex::corners(const MarkerPlacement& marker, cv::Point3f world_corners[4]) const {
+	static const float offsets[4][2] = { { 0, 1 }, { 1, 1 }, { 1, 0 }, { 0, 0 } };
+
+	float angle = (float)(marker.rotation * M_PI / 180);
+	float c = std::cos(angle) * marker.size;
+	float s = std::sin(angle) * marker.size;
+	for (int i = 0; i < 4; i++) {
+		world_corners[i] = cv::Point3f(marker.x + offsets[i][0] * c - offsets[i][1] * s,
+			marker.y + offsets[i][0] * s + offsets[i][1] * c, marker.z);
+	}
+}
+
+/**
+* Get the ArUco dictionary the markers are printed from
+*
+* @return cv::aruco::PredefinedDictionaryType of the dictionary
+*/
+int MarkerIndex::get_dictionary() const {
+	return dictionary;
+}
+
+/**
+* Get the number of markers in the index
+*
+* @return number of markers
+*/
+size_t MarkerIndex::size() const {
+	return marker_count;
+}
+
+/**
+* Get the result of the last load, and of the validation of a binary index if a lookup has run it. Does not start the
+* validation itself.
+*
+* @return MARKER_INDEX_SUCCESS or one of the MARKER_INDEX_ errors
+*/
+int MarkerIndex::get_status() const {
+	int result = validation.load(std::memory_order_acquire);
+	if (status != MARKER_INDEX_SUCCESS || result == MARKER_INDEX_UNCHECKED) {
+		return status;
+	}
+	return result;
+}
+
+/**
+* Looks up a predefined ArUco dictionary by the name of its OpenCV constant, e.g. DICT_4X4_50
+*
+* @param name name of the dictionary
+* @param dictionary receives the cv::aruco::PredefinedDictionaryType if the name is known
+*
+* @return true if the name is known
+*/
+bool MarkerIndex::parse_dictionary(const std::string& name, int& dictionary) {
+	for (const DictionaryName& entry : dictionary_names) {
+		if (name == entry.name) {
+			dictionary = entry.dictionary;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+* Gets the name of a predefined ArUco dictionary, as the marker index names it
+*
+* @param dictionary cv::aruco::PredefinedDictionaryType
+*
+* @return name of the dictionary, or "unknown"
+*/
+const char* MarkerIndex::dictionary_name(int dictionary) {
+	for (const DictionaryName& entry : dictionary_names) {
+		if (entry.dictionary == dictionary) {
+			return entry.name;
+		}
+	}
+	return "unknown";
+}
@@ -1,22 +1,116 @@
 #pragma once
-#include <glm/glm.hpp>
-#include "Config.h"
-#include <Windows.h>
-#include <fstream>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 #include <opencv2/core/core.hpp>
+#include "Config.h"
+#include "MappedFile.h"
+
+// Edge length of the printed markers in meters, unless the marker index sets another
+#define MARKER_DEFAULT_SIZE_M 0.30f
+
+#define MARKER_INDEX_SUCCESS 0
+#define MARKER_INDEX_FILE_ERROR 1
+#define MARKER_INDEX_FORMAT_ERROR 2
+#define MARKER_INDEX_CHECKSUM_ERROR 3
+
+// Where one marker of the board lies in the world
+typedef struct {
+	int id;
+
+	// Bottom left corner of the marker in meters, z is the height above the ground
+	float x;
+	float y;
+	float z;
 
+	// Edge length in meters
+	float size;
+
+	// Rotation about the bottom left corner in degrees, counterclockwise seen from above. At 0 the top of the marker
+	// faces +y.
+	float rotation;
+} MarkerPlacement;
+
+/**
+* The MarkerIndex class holds the marker board model of the marker calibration: the ArUco dictionary the markers are
+* printed from and the placement of every marker, read from the marker index file. The file is either text, lines of
+*
+*   dictionary DICT_4X4_50                    (optional, the default)
+*   size 0.30                                 (optional, default edge length in meters for the markers after it)
+*   id 0 x 0.0 y 5.0                          (one marker, position in meters)
+*   id 1 x 0.0 y 7.5 size 0.2 rotation 90 z 0.5
+*
+* where # starts a comment, or the binary format save_binary writes (pgrid-batch compile-markers). The format is told
+* from the content. A binary index is memory mapped and used in place, so it opens in the same time however many
+* markers it holds. Its checksum is checked on the first lookup, not when it is opened.
+*
+* Markers are kept sorted by id in a structure of arrays and found through a flat open addressing hash table, so ids
+* may be sparse and any number of markers is looked up in constant time. Lookups never write, so they are safe from
+* several threads.
+*/
 class MarkerIndex
 {
 private:
 	ApplicationConfig* app_config;
-	char* index_filepath;
-	std::vector<unsigned int> marker_ids;
-	std::vector<float> x_coords; // TODO: figure out this thing
-	std::vector<float> y_coords;
+	int status;
+	int dictionary;
+	size_t marker_count;
+	size_t slot_count;
+
+	// Ids in ascending order and the placement of each marker, in the owned arrays or the mapped file
+	const int32_t* ids;
+	const float* x_coords;
+	const float* y_coords;
+	const float* z_coords;
+	const float* sizes;
+	const float* rotations;
+
+	// Position in ids of the marker hashed to each slot, -1 for empty slots. slot_count is a power of two.
+	const int32_t* slots;
+
+	// Arrays of an index read from text
+	std::vector<int32_t> owned_ids;
+	std::vector<float> owned_values;
+	std::vector<int32_t> owned_slots;
+
+	// Binary index, validated on the first lookup
+	std::unique_ptr<MappedFile> mapped_file;
+	uint32_t checksum;
+	mutable std::atomic<int> validation;
+	mutable std::mutex validation_mutex;
+
+	void clear();
+
+	int load_text(const char* text, size_t length);
+
+	int load_binary(const unsigned char* data, size_t length);
+
+	void adopt_markers(std::vector<MarkerPlacement>& markers);
+
+	int check_arrays() const;
+
+	static size_t hash_id(int id);
+
+	static uint32_t compute_checksum(const unsigned char* data, size_t length);
+
 public:
+	MarkerIndex();
 	MarkerIndex(SessionConfig* session_config);
-	void build_index();
-	cv::Point2f lookup(unsigned int id);
-};
+	int build_index();
+	int load(const std::string& path);
+	int save_binary(const std::string& path) const;
+	int validate() const;
+	bool find(int id, MarkerPlacement& marker) const;
+	bool get_marker(size_t index, MarkerPlacement& marker) const;
+	bool contains(int id) const;
+	void corners(const MarkerPlacement& marker, cv::Point3f world_corners[4]) const;
+	int get_dictionary() const;
+	size_t size() const;
+	int get_status() const;
 
+	static bool parse_dictionary(const std::string& name, int& dictionary);
+	static const char* dictionary_name(int dictionary);
+};
@@ -19,6 +19,11 @@ limitations under the License.
 OrthoPanel::OrthoPanel(SessionConfig* session_config): camera(session_config->ortho_view_config){
 	this->width = 0;
 	this->height = 0;
+	framebuffer = Framebuffer();
+
+	// Nothing has been rendered yet
+	render_inputs = RenderInputs();
+	rendered = false;
 
 	view_config = session_config->ortho_view_config;
 	app_config = session_config->app_config;
@@ -30,9 +35,8 @@ void OrthoPanel::set_window_pointer(GLFWwindow* window) {
 }
 
 void OrthoPanel::init() {
-	glGenFramebuffers(1, &fbo);
-	glGenTextures(1, &tex);
-	glGenRenderbuffers(1, &rbo);
+	// The framebuffer is taken from the framebuffer pool on the first render, once the size is known
+	framebuffer = Framebuffer();
 }
 
 void OrthoPanel::render() {
@@ -47,51 +51,98 @@ void OrthoPanel::render() {
 	camera.set_width(width);
 	camera.update();
 
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	// Project points added since the last frame. This is cached, so it is cheap when nothing changed.
+	if (app_config->painter->size() > 0) {
+		app_config->painter->project_points_display();
+	}
 
-	glBindTexture(GL_TEXTURE_2D, tex);
+	// Only draw when something the panel shows has changed, otherwise the texture still holds the last frame
+	RenderInputs inputs = get_render_inputs();
+	if (!rendered || !render_inputs_equal(inputs, render_inputs)) {
+		render_inputs = inputs;
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-		width, height, 0,
-		GL_RGB, GL_UNSIGNED_BYTE, NULL);
+		// Attachments are only reallocated when the window grows past them
+		int framebuffer_status = app_config->framebuffer_pool->resize(framebuffer, inputs.width, inputs.height);
+		if (framebuffer_status == FRAMEBUFFER_INCOMPLETE) {
+			MessageBox(NULL, "There was a fatal error when binding an OpenGL framebuffer to OrthoPanel", "Error!", MB_OK);
+			exit(1);
+		}
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
+		// Nothing to draw into while the window has no area, e.g. while it is collapsed
+		rendered = (framebuffer_status == FRAMEBUFFER_SUCCESS);
+		if (rendered) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
 
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
+			glViewport(0, 0, framebuffer.width, framebuffer.height);
 
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "Framebuff complete" << std::endl;
-	}
-	else {
-		std::cout << "nobuff" << std::endl;
-	}
+			glClearColor(0.00f, 0.00f, 0.00f, 1.00f);
+			glClear(GL_COLOR_BUFFER_BIT);
 
-	glViewport(0.0, 0.0, width, height);
+			camera.apply_cam();
 
-	glClearColor(0.00f, 0.00f, 0.00f, 1.00f);
-	glClear(GL_COLOR_BUFFER_BIT);
+			grid_config->grid->draw_ortho();
+			app_config->painter->draw_ortho();
 
-	if (app_config->painter->size() > 0) {
-		app_config->painter->project_points_display();
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
 	}
 
-	camera.apply_cam();
-
-	grid_config->grid->draw_ortho();
-	app_config->painter->draw_ortho();
+	// The panel only uses the bottom left part of the texture if the framebuffer was allocated larger
+	if (rendered) {
+		ImGui::Image((ImTextureID)static_cast<uintptr_t>(framebuffer.tex),
+			ImGui::GetContentRegionAvail(),
+			ImVec2(0, (float)framebuffer.height / framebuffer.alloc_height),
+			ImVec2((float)framebuffer.width / framebuffer.alloc_width, 0));
+	}
+	ImGui::End();
+}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+/**
+* Captures the current value of every input the panel contents depend on. The display projections of the points
+* must be up to date, their changes are part of the painter revision.
+*
+* @return current render inputs
+*/
+OrthoPanel::RenderInputs OrthoPanel::get_render_inputs() {
+	RenderInputs inputs = RenderInputs();
+
+	inputs.width = (GLsizei) width;
+	inputs.height = (GLsizei) height;
+	inputs.zoom = view_config->zoom;
+	inputs.pan_x = view_config->pan_x;
+	inputs.pan_y = view_config->pan_y;
+	inputs.calibration_mode = grid_config->calibration_mode;
+	inputs.grid_revision = grid_config->grid->get_revision();
+	inputs.grid_width = grid_config->width;
+	inputs.grid_height = grid_config->height;
+	inputs.divs_x = grid_config->divs_x;
+	inputs.divs_y = grid_config->divs_y;
+	inputs.painter_revision = app_config->painter->get_revision();
+
+	return inputs;
+}
 
-	ImGui::Image((ImTextureID)tex,
-		ImGui::GetContentRegionAvail(),
-		ImVec2(0, 1),
-		ImVec2(1, 0));
-	ImGui::End();
+/**
+* Compares two sets of render inputs
+*
+* @param a first set of render inputs
+* @param b second set of render inputs
+*
+* @return true if a frame rendered with a still shows b
+*/
+bool OrthoPanel::render_inputs_equal(const RenderInputs& a, const RenderInputs& b) {
+	return a.width == b.width &&
+		a.height == b.height &&
+		a.zoom == b.zoom &&
+		a.pan_x == b.pan_x &&
+		a.pan_y == b.pan_y &&
+		a.calibration_mode == b.calibration_mode &&
+		a.grid_revision == b.grid_revision &&
+		a.grid_width == b.grid_width &&
+		a.grid_height == b.grid_height &&
+		a.divs_x == b.divs_x &&
+		a.divs_y == b.divs_y &&
+		a.painter_revision == b.painter_revision;
 }
 
 bool OrthoPanel::is_mouse_on(double mx, double my) {
@@ -102,8 +153,6 @@ bool OrthoPanel::is_mouse_on(double mx, double my) {
 
 
 void OrthoPanel::close() {
-	glDeleteFramebuffers(1, &fbo);
-	glDeleteTextures(1, &tex);
-	glDeleteRenderbuffers(1, &rbo);
+	app_config->framebuffer_pool->release(framebuffer);
 }
 
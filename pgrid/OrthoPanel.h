@@ -1,6 +1,7 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <windows.h>
 #include <glfw3.h>
 #include <GL/GL.h>
 #include <imgui.h>
@@ -11,6 +12,7 @@
 #include "Grid.h"
 #include "Camera2D.h"
 #include "Painter.h"
+#include "FramebufferPool.h"
 
 class OrthoPanel
 {
@@ -23,12 +25,36 @@ private:
 	float width, height;
 	Camera2D camera;
 
-	GLuint fbo;
-	GLuint tex;
-	GLuint rbo;
+	// Allocated from the shared framebuffer pool
+	Framebuffer framebuffer;
 
 	ImVec2 window_pos;
 
+	// Everything the panel contents depend on, captured when the framebuffer was last rendered
+	typedef struct {
+		GLsizei width;
+		GLsizei height;
+		double zoom;
+		float pan_x;
+		float pan_y;
+		int calibration_mode;
+		unsigned int grid_revision;
+		float grid_width;
+		float grid_height;
+		int divs_x;
+		int divs_y;
+		unsigned int painter_revision;
+	} RenderInputs;
+
+	RenderInputs render_inputs;
+
+	// False until the framebuffer holds a rendered frame
+	bool rendered;
+
+	RenderInputs get_render_inputs();
+
+	bool render_inputs_equal(const RenderInputs& a, const RenderInputs& b);
+
 public:
 	OrthoPanel(SessionConfig* session_config);
 
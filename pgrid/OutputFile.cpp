@@ -15,6 +15,36 @@ limitations under the License.
 ***********************************************************************/
 
 #include "OutputFile.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Bytes formatted before they are written, one write per buffer
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+// Most characters format_fixed writes, including the terminating null of the snprintf fallback
+#define OUTPUT_NUMBER_MAX 64
+
+// Rows end the way the text mode stream used to end them
+#ifdef _WIN32
+#define OUTPUT_LINE_END "\r\n"
+#else
+#define OUTPUT_LINE_END "\n"
+#endif
+
+#define OUTPUT_CSV_HEADER "x,y,description,img_last4,neck,seat_track,seat_height"
+
+// Columnar output is a sequence of chunks, one per write_output call, so appending adds a chunk. Each chunk is
+//
+//   magic[8] version:u32 metadata_length:u32 row_count:u64
+//   metadata[metadata_length]        description,img_last4,neck,seat_track,seat_height as in the CSV, zero padded
+//   x:f32[row_count] y:f32[row_count]
+//
+// little endian, with the columns 8 byte aligned within the chunk.
+#define OUTPUT_COLUMNAR_MAGIC "PGRIDCOL"
+#define OUTPUT_COLUMNAR_VERSION 1
+
 OutputFile::OutputFile(SessionConfig* session_config) {
 
 	app_config = session_config->app_config;
@@ -28,6 +58,16 @@ OutputFile::OutputFile(SessionConfig* session_config) {
 	neck = 0;
 	seat_height = 0;
 	seat_track = 0;
+	format = OUTPUT_FORMAT_CSV;
+	outfile = NULL;
+	journal_format = OUTPUT_FORMAT_CSV;
+	write_failed = false;
+	buffered = 0;
+}
+
+OutputFile::~OutputFile() {
+	close();
+	close_session();
 }
 
 bool OutputFile::file_exists() {
@@ -35,67 +75,362 @@ bool OutputFile::file_exists() {
 	return (stat(app_config->outfile_path, &buffer) == 0);
 }
 
-int OutputFile::open() {
-	if (!app_config->outfile_path) {
+/**
+* Opens the output file for one write. A new file is written next to the output file and only replaces it on close,
+* so a write that does not finish leaves the old file as it was. Appends go through the journal of the file, see
+* OutputJournal. Appending to the file of the last append continues with the same journal.
+*
+* @param overwrite replace the output file if it exists
+*
+* @return FILE_OPEN_SUCCESS, FILE_OPEN_CHECK_OVERWRITE if the file exists and overwrite is false,
+* FILE_OPEN_APPEND_TO_NONEXISTENT, FILE_OPEN_EMPTY_PATH, FILE_OPEN_SCHEMA_MISMATCH if the file to append to has
+* other columns or another format, or FILE_OPEN_ERROR
+*/
+int OutputFile::open(bool overwrite) {
+	if (app_config->outfile_path[0] == '\0') {
 		return FILE_OPEN_EMPTY_PATH;
 	}
+	if (outfile != NULL) {
+		// A new file that was never closed is dropped
+		fclose(outfile);
+		outfile = NULL;
+		remove(temp_path.c_str());
+	}
+	write_failed = false;
+	buffered = 0;
 
-	if (!append) {
-		if (file_exists()) {
-			return FILE_OPEN_CHECK_OVERWRITE;
+	if (append) {
+		if (journal.is_open() && journal.get_path() == app_config->outfile_path && journal_format == format) {
+			return FILE_OPEN_SUCCESS;
 		}
+		close_session();
 
-		outfile.open(app_config->outfile_path, std::ios::out | std::ios::trunc);
+		// Left over from a write that did not finish, the file is checked as it was after the last complete append
+		OutputJournal::recover(app_config->outfile_path);
+		if (!file_exists()) {
+			return FILE_OPEN_APPEND_TO_NONEXISTENT;
+		}
+		if (!check_schema()) {
+			return FILE_OPEN_SCHEMA_MISMATCH;
+		}
+		if (journal.open(app_config->outfile_path) != JOURNAL_SUCCESS) {
+			return FILE_OPEN_ERROR;
+		}
+		journal_format = format;
 		return FILE_OPEN_SUCCESS;
 	}
 
-	if (!file_exists()) {
-		return FILE_OPEN_APPEND_TO_NONEXISTENT;
+	// Appends are made durable before the file they went to can be replaced
+	close_session();
+	OutputJournal::recover(app_config->outfile_path);
+	if (file_exists() && !overwrite) {
+		return FILE_OPEN_CHECK_OVERWRITE;
 	}
-	
-	outfile.open(app_config->outfile_path, std::ios::out | std::ios::app);
+
+	temp_path = std::string(app_config->outfile_path) + ".tmp";
+	outfile = fopen(temp_path.c_str(), "wb");
+	if (outfile == NULL) {
+		return FILE_OPEN_ERROR;
+	}
+	setvbuf(outfile, NULL, _IONBF, 0);
 	return FILE_OPEN_SUCCESS;
 }
 
-void OutputFile::write_output(std::vector<cv::Point2f> data_points) {
-	
+/**
+* Checks that the file to append to was written in the current format, with the same CSV header
+*
+* @return true if the rows can be appended
+*/
+bool OutputFile::check_schema() {
+	FILE* file = fopen(app_config->outfile_path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+	char start[128] = {};
+	size_t length = fread(start, 1, sizeof(start) - 1, file);
+	fclose(file);
+
+	if (format == OUTPUT_FORMAT_COLUMNAR) {
+		uint32_t version = 0;
+		if (length < 12 || memcmp(start, OUTPUT_COLUMNAR_MAGIC, 8) != 0) {
+			return false;
+		}
+		memcpy(&version, start + 8, sizeof(version));
+		return version == OUTPUT_COLUMNAR_VERSION;
+	}
+
+	// The header line, with either line ending
+	size_t header_length = strcspn(start, "\r\n");
+	return header_length == strlen(OUTPUT_CSV_HEADER) && memcmp(start, OUTPUT_CSV_HEADER, header_length) == 0 &&
+		(start[header_length] == '\r' || start[header_length] == '\n');
+}
+
+/**
+* Writes one CSV row per point, or one columnar chunk. The measurement offsets and flips of grid corner mode are
+* applied while writing, so the points are read once and not copied. Rows are formatted into a reused buffer that is
+* written whenever it fills up, and once after the last row.
+*
+* @param data_points projected points in meters
+* @param count number of points
+*/
+void OutputFile::write_output(const cv::Point2f* data_points, size_t count) {
+	float flip_x = 1;
+	float flip_y = 1;
+	float x_offset = 0;
+	float y_offset = 0;
+
 	if (grid_config->calibration_mode == 0) {
-		float flip_x = 1;
-		float flip_y = 1;
 		if (measurement_config->flip_x) {
 			flip_x = -1;
 		}
 		if (measurement_config->flip_y) {
 			flip_y = -1;
 		}
-		for (int i = 0; i < data_points.size(); i++) {
-			data_points[i].x = flip_x * (data_points[i].x - measurement_config->x_offset);
-			data_points[i].y = flip_y * (data_points[i].y - measurement_config->y_offset);
-		}
+		x_offset = measurement_config->x_offset;
+		y_offset = measurement_config->y_offset;
+	}
+
+	if (outfile == NULL && !journal.is_open()) {
+		return;
+	}
+	if (write_buffer.empty()) {
+		write_buffer.resize(OUTPUT_BUFFER_SIZE);
+	}
+
+	if (format == OUTPUT_FORMAT_COLUMNAR) {
+		write_columnar(data_points, count, flip_x, flip_y, x_offset, y_offset);
 	}
 	else {
-		for (int i = 0; i < data_points.size(); i++) {
-			data_points[i].x = data_points[i].x;
-			data_points[i].y = data_points[i].y;
-		}
+		write_csv(data_points, count, flip_x, flip_y, x_offset, y_offset);
 	}
+	flush_buffer();
+}
 
+/**
+* Renders the columns that are the same on every row: description, img_last4, neck, seat_track, seat_height
+*
+* @param out receives the columns separated by commas
+* @param size size of out
+*
+* @return number of characters written, without the terminating null
+*/
+int OutputFile::render_metadata(char* out, size_t size) {
+	int length = snprintf(out, size, "%s,%04d,%s,%s,%s", img_description, img_last4, neck_options_output[neck],
+		seat_track_options_output[seat_track], seat_height_options_output[seat_height]);
+	return std::max(0, std::min(length, (int)size - 1));
+}
+
+/**
+* Formats the CSV rows into the write buffer. The metadata columns are rendered once, each row only formats its two
+* coordinates, the same way std::fixed did.
+*/
+void OutputFile::write_csv(const cv::Point2f* data_points, size_t count, float flip_x, float flip_y, float x_offset,
+	float y_offset) {
 	if (!append) {
-		outfile << "x,y,description,img_last4,neck,seat_track,seat_height" << std::endl;
+		const char header[] = OUTPUT_CSV_HEADER OUTPUT_LINE_END;
+		buffer_bytes(header, sizeof(header) - 1);
+	}
+
+	char suffix[160];
+	suffix[0] = ',';
+	size_t suffix_length = 1 + render_metadata(suffix + 1, sizeof(suffix) - 1 - strlen(OUTPUT_LINE_END));
+	memcpy(suffix + suffix_length, OUTPUT_LINE_END, strlen(OUTPUT_LINE_END));
+	suffix_length += strlen(OUTPUT_LINE_END);
+
+	const size_t row_max = 2 * OUTPUT_NUMBER_MAX + suffix_length;
+	for (size_t i = 0; i < count; i++) {
+		if (write_buffer.size() - buffered < row_max) {
+			flush_buffer();
+		}
+
+		char* row = write_buffer.data() + buffered;
+		char* end = row;
+		end += format_fixed(flip_x * (data_points[i].x - x_offset), end);
+		*end++ = ',';
+		end += format_fixed(flip_y * (data_points[i].y - y_offset), end);
+		memcpy(end, suffix, suffix_length);
+		end += suffix_length;
+		buffered += end - row;
+	}
+}
+
+/**
+* Writes the points as one chunk of the columnar format, x column then y column
+*/
+void OutputFile::write_columnar(const cv::Point2f* data_points, size_t count, float flip_x, float flip_y,
+	float x_offset, float y_offset) {
+	char metadata[168] = {};
+	uint32_t metadata_length = (uint32_t)render_metadata(metadata, sizeof(metadata) - 8);
+	metadata_length = (metadata_length + 7) & ~7u;
+
+	const uint32_t version = OUTPUT_COLUMNAR_VERSION;
+	const uint64_t row_count = count;
+	buffer_bytes(OUTPUT_COLUMNAR_MAGIC, 8);
+	buffer_bytes(&version, sizeof(version));
+	buffer_bytes(&metadata_length, sizeof(metadata_length));
+	buffer_bytes(&row_count, sizeof(row_count));
+	buffer_bytes(metadata, metadata_length);
+
+	for (int column = 0; column < 2; column++) {
+		float flip = column == 0 ? flip_x : flip_y;
+		float offset = column == 0 ? x_offset : y_offset;
+		for (size_t i = 0; i < count; i++) {
+			if (write_buffer.size() - buffered < sizeof(float)) {
+				flush_buffer();
+			}
+			float value = flip * ((column == 0 ? data_points[i].x : data_points[i].y) - offset);
+			memcpy(write_buffer.data() + buffered, &value, sizeof(float));
+			buffered += sizeof(float);
+		}
+	}
+}
+
+/**
+* Appends bytes to the write buffer, writing it out whenever it fills up
+*
+* @param data bytes to write
+* @param length number of bytes
+*/
+void OutputFile::buffer_bytes(const void* data, size_t length) {
+	const char* bytes = (const char*)data;
+	while (length > 0) {
+		if (buffered == write_buffer.size()) {
+			flush_buffer();
+		}
+		size_t n = std::min(length, write_buffer.size() - buffered);
+		memcpy(write_buffer.data() + buffered, bytes, n);
+		buffered += n;
+		bytes += n;
+		length -= n;
+	}
+}
+
+/**
+* Writes the buffered bytes to the file in one call. The file is unbuffered, so that is one write to the system. When
+* appending the journal writes the bytes twice, once to itself and once to the file.
+*/
+void OutputFile::flush_buffer() {
+	if (buffered > 0 && !write_failed) {
+		if (outfile != NULL) {
+			write_failed = fwrite(write_buffer.data(), 1, buffered, outfile) != buffered;
+		}
+		else if (journal.is_open()) {
+			write_failed = journal.append(write_buffer.data(), buffered) != JOURNAL_SUCCESS;
+		}
+	}
+	buffered = 0;
+}
+
+/**
+* Formats a coordinate exactly as std::fixed does at the default precision of 6 decimals, without a stream. A float
+* times 10^6 is exact in a double (24 + 14 bits of mantissa), so rounding it to the nearest integer in the current
+* rounding mode is the same rounding printf does. Values too large for that, infinities and NaN go through snprintf.
+*
+* @param value number to format
+* @param out receives the characters, room for OUTPUT_NUMBER_MAX. Not null terminated.
+*
+* @return number of characters written
+*/
+int OutputFile::format_fixed(float value, char* out) {
+	double scaled = (double)value * 1000000.0;
+	if (!(std::fabs(scaled) < 9.0e15)) {
+		return snprintf(out, OUTPUT_NUMBER_MAX, "%f", (double)value);
+	}
+
+	uint64_t digits = (uint64_t)std::fabs(std::nearbyint(scaled));
+	uint64_t integer = digits / 1000000;
+	uint32_t fraction = (uint32_t)(digits % 1000000);
+
+	char* end = out;
+	if (std::signbit(value)) {
+		*end++ = '-';
+	}
+
+	char reversed[20];
+	int n = 0;
+	do {
+		reversed[n++] = (char)('0' + integer % 10);
+		integer /= 10;
+	} while (integer > 0);
+	while (n > 0) {
+		*end++ = reversed[--n];
+	}
+
+	*end++ = '.';
+	for (int i = 5; i >= 0; i--) {
+		end[i] = (char)('0' + fraction % 10);
+		fraction /= 10;
 	}
-	for (unsigned int i = 0; i < data_points.size(); i++) {
-		outfile << std::fixed << data_points[i].x << "," <<
-			std::fixed << data_points[i].y << "," <<
-			img_description << "," <<
-			std::setw(4) << std::setfill('0') << img_last4 << "," <<
-			neck_options_output[neck] << "," <<
-			seat_track_options_output[seat_track] << "," <<
-			seat_height_options_output[seat_height] << std::endl;
+	end += 6;
+
+	return (int)(end - out);
+}
+
+/**
+* Writes one CSV row per point
+*
+* @param data_points projected points in meters, a std::vector<cv::Point2f> or a 2 channel float Mat
+*/
+void OutputFile::write_output(cv::InputArray data_points) {
+	cv::Mat points = data_points.getMat();
+	if (points.empty()) {
+		write_output(NULL, 0);
+		return;
 	}
+
+	CV_Assert(points.isContinuous() && points.checkVector(2, CV_32F) >= 0);
+	write_output(points.ptr<cv::Point2f>(), (size_t)points.checkVector(2, CV_32F));
 }
 
-void OutputFile::close() {
-	outfile.close();
+/**
+* Finishes the write. A new file is synced and renamed over the output file. An append is committed to the journal,
+* which syncs it along with the other appends of its batch, and the file stays open for the next append.
+*
+* @return FILE_OPEN_SUCCESS, or FILE_WRITE_ERROR if the output file was left as it was before the write
+*/
+int OutputFile::close() {
+	if (outfile != NULL) {
+		flush_buffer();
+		bool written = !write_failed && OutputJournal::sync_file(outfile);
+		written = fclose(outfile) == 0 && written;
+		outfile = NULL;
+
+		if (!written || !OutputJournal::replace_file(temp_path, app_config->outfile_path)) {
+			remove(temp_path.c_str());
+			return FILE_WRITE_ERROR;
+		}
+		saved = true;
+		return FILE_OPEN_SUCCESS;
+	}
+
+	if (journal.is_open()) {
+		flush_buffer();
+		if (write_failed || journal.commit() != JOURNAL_SUCCESS) {
+			journal.abort();
+			return FILE_WRITE_ERROR;
+		}
+		saved = true;
+	}
+	return FILE_OPEN_SUCCESS;
+}
+
+/**
+* Ends the appends to the output file: the file is synced and its journal removed. Called when another file is
+* opened and when the application exits.
+*/
+void OutputFile::close_session() {
+	journal.close();
+}
+
+/**
+* Syncs appends that have waited long enough for the rest of their batch. Called every frame by the main loop, which
+* wakes at least every idle timeout. An append that cannot be synced is rolled back.
+*/
+void OutputFile::sync_pending() {
+	if (journal.is_open() && journal.sync_if_due() != JOURNAL_SUCCESS) {
+		journal.abort();
+		saved = false;
+	}
 }
 
 char* OutputFile::get_filepath_buf() {
@@ -127,8 +462,26 @@ bool* OutputFile::get_append_ptr() {
 	return &append;
 }
 
+int* OutputFile::get_format_ptr() {
+	return &format;
+}
+
+/**
+* Get the file extension of the output format
+*
+* @return ".csv" or ".pgcol"
+*/
+const char* OutputFile::get_extension() {
+	return format == OUTPUT_FORMAT_COLUMNAR ? ".pgcol" : ".csv";
+}
+
+/**
+* Check whether the last write is on disk. An append only counts once its batch is synced.
+*
+* @return true if the last write is saved
+*/
 bool OutputFile::is_saved() {
-	return saved;
+	return saved && !journal.has_pending();
 }
 
 void OutputFile::set_outfile_name(std::string new_filename) {
@@ -137,10 +490,10 @@ void OutputFile::set_outfile_name(std::string new_filename) {
 		// find the last / or \ to determine the location of the file name in the path
 		size_t last_slash = fpath.find_last_of("/\\");
 		// replace the file name with the new file name
-		std::string new_csv_filename = new_filename.substr(0, new_filename.find_last_of(".")) + ".csv";
+		std::string new_csv_filename = new_filename.substr(0, new_filename.find_last_of(".")) + get_extension();
 		std::string new_path = fpath.substr(0, last_slash + 1) + new_csv_filename;
 		// set the new file path and name
-		strcpy_s(app_config->outfile_path, new_path.c_str());
-		strcpy_s(app_config->outfile_name, new_csv_filename.c_str());
+		snprintf(app_config->outfile_path, sizeof(app_config->outfile_path), "%s", new_path.c_str());
+		snprintf(app_config->outfile_name, sizeof(app_config->outfile_name), "%s", new_csv_filename.c_str());
 	}
 }
\ No newline at end of file
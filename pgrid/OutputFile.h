@@ -1,16 +1,24 @@
 #pragma once
 #include <stdio.h>
+#include <sys/stat.h>
 #include <iostream>
+#include <iomanip>
 #include <fstream>
 #include <vector>
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/core.hpp>
 #include "Config.h"
-#include "Image.h"
-#define FILE_OPEN_SUCCESS 0;
-#define FILE_OPEN_CHECK_OVERWRITE 1;
-#define FILE_OPEN_APPEND_TO_NONEXISTENT 2;
-#define FILE_OPEN_EMPTY_PATH 3;
+#include "OutputJournal.h"
+#define FILE_OPEN_SUCCESS 0
+#define FILE_OPEN_CHECK_OVERWRITE 1
+#define FILE_OPEN_APPEND_TO_NONEXISTENT 2
+#define FILE_OPEN_EMPTY_PATH 3
+#define FILE_OPEN_SCHEMA_MISMATCH 4
+#define FILE_OPEN_ERROR 5
+#define FILE_WRITE_ERROR 6
+
+#define OUTPUT_FORMAT_CSV 0
+#define OUTPUT_FORMAT_COLUMNAR 1
 
 class OutputFile
 {
@@ -28,7 +36,31 @@ private:
 	int img_last4;
 	char img_description[50];
 
-	std::ofstream outfile;
+	int format;
+
+	// Unbuffered, rows are formatted into write_buffer and written one buffer at a time. A new file is written to
+	// temp_path and renamed over the output file on close, appends go through the journal, which stays open between
+	// writes to the same file.
+	FILE* outfile;
+	std::string temp_path;
+	OutputJournal journal;
+	int journal_format;
+	bool write_failed;
+	std::vector<char> write_buffer;
+	size_t buffered;
+
+	bool check_schema();
+
+	int render_metadata(char* out, size_t size);
+
+	void write_csv(const cv::Point2f* data_points, size_t count, float flip_x, float flip_y, float x_offset, float y_offset);
+
+	void write_columnar(const cv::Point2f* data_points, size_t count, float flip_x, float flip_y, float x_offset,
+		float y_offset);
+
+	void buffer_bytes(const void* data, size_t length);
+
+	void flush_buffer();
 	//const char* neck;
 	//const char* 
 public:
@@ -38,16 +70,24 @@ public:
 	const char* neck_options_output[3] = { "5th_female", "50th_male", "95th_male" };
 	const char* seat_height_options_output[3] = { "down", "mid", "up" };
 	const char* seat_track_options_output[3] = { "forward", "mid", "rearward" };
+	const char* format_options_display[2] = { "CSV", "Columnar binary" };
 
 	OutputFile(SessionConfig* session_config);
+	~OutputFile();
 
 	bool file_exists();
 
-	int open();
+	int open(bool overwrite = false);
 
-	void write_output(std::vector<cv::Point2f> data_points);
+	void write_output(const cv::Point2f* data_points, size_t count);
 
-	void close();
+	void write_output(cv::InputArray data_points);
+
+	int close();
+
+	void close_session();
+
+	void sync_pending();
 
 	char* get_filepath_buf();
 
@@ -63,8 +103,14 @@ public:
 
 	bool* get_append_ptr();
 
+	int* get_format_ptr();
+
+	const char* get_extension();
+
 	bool is_saved();
 
 	void set_outfile_name(std::string newfilename);
+
+	static int format_fixed(float value, char* out);
 };
 
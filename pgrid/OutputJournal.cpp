@@ -0,0 +1,489 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "OutputJournal.h"
+#include <cstring>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+
+// The journal is a header followed by one record per append, and a commit record after the appends of each write:
+//
+//   header: magic[8] version:u32 reserved:u32 base_length:u64
+//   record: length:u32 checksum:u32 offset:u64 data[length]
+//
+// little endian. base_length is the length of the output file when the journal was started, which is synced by then.
+// offset is where the data goes in the output file, the first record starts at base_length and each one where the last
+// one ended. checksum is the FNV-1a hash of offset and data, so a record that was only partly written is not replayed.
+// A commit record has no data, its offset is the length of the output file once the write is done. Appends after the
+// last commit record belong to a write that did not finish and are dropped.
+#define JOURNAL_MAGIC "PGRIDJNL"
+#define JOURNAL_VERSION 1
+#define JOURNAL_HEADER_SIZE 24
+#define JOURNAL_RECORD_HEADER_SIZE 16
+
+/**
+* FNV-1a hash of a block of bytes, continuing from hash
+*/
+static uint32_t hash_bytes(uint32_t hash, const void* data, size_t length) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < length; i++) {
+		hash = (hash ^ bytes[i]) * 16777619u;
+	}
+	return hash;
+}
+
+static uint32_t record_checksum(uint64_t offset, const void* data, size_t length) {
+	return hash_bytes(hash_bytes(2166136261u, &offset, sizeof(offset)), data, length);
+}
+
+static bool seek_file(FILE* file, uint64_t offset, int origin) {
+#ifdef _WIN32
+	return _fseeki64(file, (__int64)offset, origin) == 0;
+#else
+	return fseeko(file, (off_t)offset, origin) == 0;
+#endif
+}
+
+static uint64_t tell_file(FILE* file) {
+#ifdef _WIN32
+	return (uint64_t)_ftelli64(file);
+#else
+	return (uint64_t)ftello(file);
+#endif
+}
+
+static bool truncate_file(FILE* file, uint64_t length) {
+	fflush(file);
+#ifdef _WIN32
+	return _chsize_s(_fileno(file), (__int64)length) == 0;
+#else
+	return ftruncate(fileno(file), (off_t)length) == 0;
+#endif
+}
+
+OutputJournal::OutputJournal() {
+	target = NULL;
+	journal = NULL;
+	target_length = 0;
+	journal_length = 0;
+	committed_length = 0;
+	pending = 0;
+}
+
+OutputJournal::~OutputJournal() {
+	close();
+}
+
+/**
+* Recovers the output file from a journal left behind by an append that did not finish, then opens the file for
+* appending with an empty journal
+*
+* @param path output file, which must exist
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if the file or the journal cannot be opened
+*/
+int OutputJournal::open(const std::string& path) {
+	close();
+
+	if (recover(path) != JOURNAL_SUCCESS) {
+		return JOURNAL_FILE_ERROR;
+	}
+
+	target_path = path;
+	journal_path = path + ".journal";
+
+	target = fopen(target_path.c_str(), "ab");
+	if (target == NULL) {
+		printf("Error: could not open %s\n", target_path.c_str());
+		return JOURNAL_FILE_ERROR;
+	}
+	setvbuf(target, NULL, _IONBF, 0);
+	seek_file(target, 0, SEEK_END);
+	target_length = tell_file(target);
+	committed_length = target_length;
+
+	if (start_journal() != JOURNAL_SUCCESS) {
+		fclose(target);
+		target = NULL;
+		return JOURNAL_FILE_ERROR;
+	}
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Starts the journal over, from the current length of the output file
+*/
+int OutputJournal::start_journal() {
+	if (journal != NULL) {
+		fclose(journal);
+	}
+
+	journal = fopen(journal_path.c_str(), "wb");
+	if (journal == NULL) {
+		printf("Error: could not create %s\n", journal_path.c_str());
+		return JOURNAL_FILE_ERROR;
+	}
+	setvbuf(journal, NULL, _IONBF, 0);
+
+	unsigned char header[JOURNAL_HEADER_SIZE] = {};
+	const uint32_t version = JOURNAL_VERSION;
+	memcpy(header, JOURNAL_MAGIC, 8);
+	memcpy(header + 8, &version, sizeof(version));
+	memcpy(header + 16, &target_length, sizeof(target_length));
+
+	// The header is synced right away, so recover can always cut the file back to base_length, even if the first
+	// commit never reached the disk
+	if (fwrite(header, 1, sizeof(header), journal) != sizeof(header) || !sync_file(journal)) {
+		return JOURNAL_FILE_ERROR;
+	}
+
+	journal_length = sizeof(header);
+	pending = 0;
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Writes one record to the journal
+*
+* @param offset where the data goes in the output file
+* @param data bytes of the record, NULL for a commit record
+* @param length number of bytes, 0 for a commit record
+*
+* @return true if the record was written
+*/
+bool OutputJournal::write_record(uint64_t offset, const void* data, size_t length) {
+	unsigned char record[JOURNAL_RECORD_HEADER_SIZE];
+	const uint32_t record_length = (uint32_t)length;
+	const uint32_t checksum = record_checksum(offset, data, length);
+	memcpy(record, &record_length, sizeof(record_length));
+	memcpy(record + 4, &checksum, sizeof(checksum));
+	memcpy(record + 8, &offset, sizeof(offset));
+
+	if (fwrite(record, 1, sizeof(record), journal) != sizeof(record) ||
+		(length > 0 && fwrite(data, 1, length, journal) != length)) {
+		return false;
+	}
+	journal_length += sizeof(record) + length;
+	return true;
+}
+
+/**
+* Appends a block of bytes to the output file, after writing it to the journal. Nothing is synced here, and the bytes
+* are only kept by recover once the write they belong to is committed.
+*
+* @param data bytes to append
+* @param length number of bytes, less than 4 GB
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if a write failed. The file should then be given up with abort.
+*/
+int OutputJournal::append(const void* data, size_t length) {
+	if (target == NULL || journal == NULL) {
+		return JOURNAL_FILE_ERROR;
+	}
+
+	// A record without data is a commit record
+	if (length == 0) {
+		return JOURNAL_SUCCESS;
+	}
+
+	if (!write_record(target_length, data, length) || fwrite(data, 1, length, target) != length) {
+		return JOURNAL_FILE_ERROR;
+	}
+	target_length += length;
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Ends one write of the output file with a commit record, so recover keeps its appends. The journal is synced if enough
+* writes are pending or the oldest is old enough, and started over if it has grown too large.
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if the commit record could not be written or synced. The file should
+* then be given up with abort, which takes the appends of this write back out.
+*/
+int OutputJournal::commit() {
+	if (journal == NULL) {
+		return JOURNAL_FILE_ERROR;
+	}
+
+	if (journal_length >= JOURNAL_CHECKPOINT_SIZE) {
+		// Once the output file itself is synced the journal is not needed anymore
+		if (!sync_file(target) || start_journal() != JOURNAL_SUCCESS) {
+			return JOURNAL_FILE_ERROR;
+		}
+		committed_length = target_length;
+		return JOURNAL_SUCCESS;
+	}
+
+	if (!write_record(target_length, NULL, 0)) {
+		return JOURNAL_FILE_ERROR;
+	}
+	if (pending == 0) {
+		oldest_pending = std::chrono::steady_clock::now();
+	}
+	pending++;
+
+	int status = pending >= JOURNAL_SYNC_BATCH ? sync() : sync_if_due();
+	if (status == JOURNAL_SUCCESS) {
+		committed_length = target_length;
+	}
+	return status;
+}
+
+/**
+* Syncs the journal, which makes every pending write durable
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if syncing failed
+*/
+int OutputJournal::sync() {
+	if (journal == NULL) {
+		return JOURNAL_FILE_ERROR;
+	}
+	if (pending > 0 && !sync_file(journal)) {
+		return JOURNAL_FILE_ERROR;
+	}
+	pending = 0;
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Syncs the journal if the oldest pending write has waited JOURNAL_SYNC_INTERVAL_MS. Called after every append and
+* periodically by the owner, so the last append of a burst is synced too.
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if syncing failed
+*/
+int OutputJournal::sync_if_due() {
+	if (pending == 0) {
+		return JOURNAL_SUCCESS;
+	}
+	if (std::chrono::steady_clock::now() - oldest_pending < std::chrono::milliseconds(JOURNAL_SYNC_INTERVAL_MS)) {
+		return JOURNAL_SUCCESS;
+	}
+	return sync();
+}
+
+/**
+* Check whether writes are committed but not synced yet
+*
+* @return true if a write would be lost if the machine stopped now
+*/
+bool OutputJournal::has_pending() const {
+	return pending > 0;
+}
+
+/**
+* Syncs the output file, closes it and removes the journal
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if syncing failed, in which case the journal is kept
+*/
+int OutputJournal::close() {
+	if (target == NULL) {
+		return JOURNAL_SUCCESS;
+	}
+
+	bool synced = sync_file(target);
+	synced = fclose(target) == 0 && synced;
+	target = NULL;
+	if (journal != NULL) {
+		fclose(journal);
+		journal = NULL;
+	}
+	pending = 0;
+
+	if (!synced) {
+		printf("Error: could not sync %s, the journal is kept\n", target_path.c_str());
+		return JOURNAL_FILE_ERROR;
+	}
+	remove(journal_path.c_str());
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Gives up the output file after a failed append or commit. The file is cut back to the end of the last committed
+* write, so the write that failed leaves nothing behind. If that fails too the journal is left to recover.
+*/
+void OutputJournal::abort() {
+	if (target == NULL) {
+		return;
+	}
+
+	bool cut = truncate_file(target, committed_length) && sync_file(target);
+	fclose(target);
+	target = NULL;
+	if (journal != NULL) {
+		fclose(journal);
+		journal = NULL;
+	}
+	pending = 0;
+
+	if (cut) {
+		remove(journal_path.c_str());
+	}
+	else {
+		recover(target_path);
+	}
+}
+
+bool OutputJournal::is_open() const {
+	return target != NULL;
+}
+
+const std::string& OutputJournal::get_path() const {
+	return target_path;
+}
+
+/**
+* Replays the journal of an output file, if there is one. Complete records are written again where they belong and
+* the file is cut back to the end of the last commit record, removing whatever an unfinished write left behind, even
+* the appends of it that did reach the journal. Records are written at their offset, so replaying a journal twice gives
+* the same file. The journal is removed afterwards.
+*
+* @param path output file
+*
+* @return JOURNAL_SUCCESS, or JOURNAL_FILE_ERROR if the output file could not be repaired
+*/
+int OutputJournal::recover(const std::string& path) {
+	std::string journal_path = path + ".journal";
+	FILE* journal = fopen(journal_path.c_str(), "rb");
+	if (journal == NULL) {
+		return JOURNAL_SUCCESS;
+	}
+
+	unsigned char header[JOURNAL_HEADER_SIZE];
+	uint32_t version = 0;
+	uint64_t base_length = 0;
+	bool valid = fread(header, 1, sizeof(header), journal) == sizeof(header) &&
+		memcmp(header, JOURNAL_MAGIC, 8) == 0;
+	if (valid) {
+		memcpy(&version, header + 8, sizeof(version));
+		memcpy(&base_length, header + 16, sizeof(base_length));
+		valid = version == JOURNAL_VERSION;
+	}
+
+	FILE* target = valid ? fopen(path.c_str(), "r+b") : NULL;
+	if (target == NULL) {
+		// Nothing was appended under a journal without a complete header, and a removed file is not brought back
+		fclose(journal);
+		remove(journal_path.c_str());
+		return JOURNAL_SUCCESS;
+	}
+
+	uint64_t end = base_length;
+	uint64_t committed = base_length;
+	size_t replayed = 0;
+	std::vector<unsigned char> data;
+	unsigned char record[JOURNAL_RECORD_HEADER_SIZE];
+	bool written = true;
+	while (fread(record, 1, sizeof(record), journal) == sizeof(record)) {
+		uint32_t length, checksum;
+		uint64_t offset;
+		memcpy(&length, record, sizeof(length));
+		memcpy(&checksum, record + 4, sizeof(checksum));
+		memcpy(&offset, record + 8, sizeof(offset));
+		if (offset != end) {
+			break;
+		}
+
+		data.resize(length);
+		if (fread(data.data(), 1, length, journal) != length || record_checksum(offset, data.data(), length) != checksum) {
+			break;
+		}
+
+		if (length == 0) {
+			committed = end;
+			replayed++;
+			continue;
+		}
+		written = written && seek_file(target, offset, SEEK_SET) && fwrite(data.data(), 1, length, target) == length;
+		end += length;
+	}
+	fclose(journal);
+
+	seek_file(target, 0, SEEK_END);
+	uint64_t target_length = tell_file(target);
+	if (target_length > committed) {
+		written = truncate_file(target, committed) && written;
+	}
+	written = sync_file(target) && written;
+	written = fclose(target) == 0 && written;
+
+	if (!written) {
+		printf("Error: could not recover %s from %s\n", path.c_str(), journal_path.c_str());
+		return JOURNAL_FILE_ERROR;
+	}
+	if (replayed > 0 || target_length != committed) {
+		printf("Recovered %s from %s, %d writes kept\n", path.c_str(), journal_path.c_str(), (int)replayed);
+	}
+	remove(journal_path.c_str());
+	return JOURNAL_SUCCESS;
+}
+
+/**
+* Writes everything written to a file so far through to the disk
+*
+* @param file open file
+*
+* @return true if the file was synced
+*/
+bool OutputJournal::sync_file(FILE* file) {
+	if (fflush(file) != 0) {
+		return false;
+	}
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+/**
+* Replaces a file with another in one step, so the file is either the old or the new one even if the application or
+* the machine stops. from must be closed and synced.
+*
+* @param from file to move
+* @param to file to replace, which does not need to exist
+*
+* @return true if the file was replaced
+*/
+bool OutputJournal::replace_file(const std::string& from, const std::string& to) {
+#ifdef _WIN32
+	return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	if (rename(from.c_str(), to.c_str()) != 0) {
+		return false;
+	}
+
+	// The rename itself is only durable once the directory is synced
+	size_t last_slash = to.find_last_of('/');
+	std::string dir = last_slash == std::string::npos ? "." : to.substr(0, last_slash + 1);
+	int dir_fd = ::open(dir.c_str(), O_RDONLY);
+	if (dir_fd >= 0) {
+		fsync(dir_fd);
+		::close(dir_fd);
+	}
+	return true;
+#endif
+}
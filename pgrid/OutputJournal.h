@@ -0,0 +1,78 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#define JOURNAL_SUCCESS 0
+#define JOURNAL_FILE_ERROR 1
+
+// Writes are synced to disk together once this many are pending, or once the oldest pending one is this old
+#define JOURNAL_SYNC_BATCH 32
+#define JOURNAL_SYNC_INTERVAL_MS 1000
+
+// Once the journal grows past this size the output file is synced and the journal started over
+#define JOURNAL_CHECKPOINT_SIZE (16 << 20)
+
+/**
+* The OutputJournal class appends to an output file through a write ahead journal next to it, <file>.journal. Every
+* block of bytes is written to the journal with its length, offset and checksum before it is appended to the file, and
+* every write ends with a commit record. If the application or the machine stops halfway through a write, recover puts
+* the file back to the end of the last committed one. Only the journal is synced, and only once per batch of writes, so
+* appending often costs about the same as writing. A write that is not followed by others is synced by sync_if_due once
+* the interval is up, which the owner calls periodically. The file stays open between appends until close.
+*/
+class OutputJournal
+{
+private:
+	std::string target_path;
+	std::string journal_path;
+	FILE* target;
+	FILE* journal;
+
+	// Length of the output file with everything appended so far, and at the end of the last committed write
+	uint64_t target_length;
+	uint64_t committed_length;
+	uint64_t journal_length;
+
+	int pending;
+	std::chrono::steady_clock::time_point oldest_pending;
+
+	int start_journal();
+
+	bool write_record(uint64_t offset, const void* data, size_t length);
+
+	OutputJournal(const OutputJournal&) = delete;
+	OutputJournal& operator=(const OutputJournal&) = delete;
+
+public:
+	OutputJournal();
+	~OutputJournal();
+
+	int open(const std::string& path);
+
+	int append(const void* data, size_t length);
+
+	int commit();
+
+	int sync();
+
+	int sync_if_due();
+
+	bool has_pending() const;
+
+	int close();
+
+	void abort();
+
+	bool is_open() const;
+
+	const std::string& get_path() const;
+
+	static int recover(const std::string& path);
+
+	static bool sync_file(FILE* file);
+
+	static bool replace_file(const std::string& from, const std::string& to);
+};
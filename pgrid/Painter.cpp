@@ -16,6 +16,7 @@ limitations under the License.
 
 
 #include "Painter.h"
+#include <algorithm>
 
 
 /**
@@ -23,7 +24,9 @@ limitations under the License.
 * 
 * @param session_config Pointer to SessionConfig struct
 */
-Painter::Painter(SessionConfig* session_config) {
+Painter::Painter(SessionConfig* session_config) : point_index(32.0f),
+	scene_markers((float)view_radius, (float)crosshair_size),
+	ortho_markers((float)view_radius, (float)crosshair_size) {
 
 	// Copy pointer addresses to Painter object for easy access
 	grid_config = session_config->grid_config;
@@ -31,6 +34,11 @@ Painter::Painter(SessionConfig* session_config) {
 	img_config = session_config->img_config;
 	app_config = session_config->app_config;
 	measurement_config = session_config->measurement_config;
+
+	// Nothing has been projected yet
+	projection_inputs = ProjectionInputs();
+	projected_count = 0;
+	revision = 0;
 }
 
 /**
@@ -52,8 +60,10 @@ void Painter::add_point(float x, float y) {
 
 		// Add a new point to the list
 		points.push_back(cv::Point2f(x, y));
+		point_index.insert((int)points.size() - 1, x, y);
+		revision++;
 
-		// Reproject the points for display code
+		// Project the new point for display code, the points before it are already projected
 		project_points_display();
 
 		// reset paint_density_counter
@@ -75,286 +85,291 @@ void Painter::add_point(float x, float y) {
 */
 void Painter::add_point_at_click(float x, float y) {
 	points.push_back(cv::Point2f(x, y));
+	point_index.insert((int)points.size() - 1, x, y);
+	revision++;
 	project_points_display();
 }
 
 /**
-* Draws point in the perspective panel
+* Adds a list of Nearest Visible Points (NVP) to the Painter object, e.g. when loading an existing annotation. The new points are
+* projected for display the next time project_points_display is called.
+*
+* @param new_points points to add in the perspective scene coordinate system
 */
-void Painter::draw() {
+void Painter::add_points(const std::vector<cv::Point2f>& new_points) {
+	points.insert(points.end(), new_points.begin(), new_points.end());
+	revision++;
 
-	// Set color to red
-	glColor3f(1.0f, 0.0f, 0.0f);
+	// Building the index once is cheaper than inserting a large batch one point at a time
+	if (new_points.size() > point_index.size()) {
+		point_index.build(points);
+	}
+	else {
+		for (size_t i = points.size() - new_points.size(); i < points.size(); i++) {
+			point_index.insert((int)i, points[i].x, points[i].y);
+		}
+	}
+}
+
+/**
+* Draws point in the perspective panel. Points added since the last frame are appended to the marker buffer and
+* all markers are drawn with a single draw call.
+*/
+void Painter::draw() {
+	// View radius is half the side length of the square drawn around each point (in scene coordinate system)
+	scene_markers.update(points);
 
-	// Set polygon mode to line so that points display as square outlines
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+	// Draw the points in red
+	scene_markers.draw(1.0f, 0.0f, 0.0f);
+}
 
-	// Loop through all of the points in the painter object
-	for (unsigned int i = 0; i < points.size(); i++) {
+/**
+* Draws point in the orthographic panel. Only projections that changed since the last frame are uploaded.
+*/
+void Painter::draw_ortho() {
+	ortho_markers.update(projected_points_disp.data(), std::min(points.size(), projected_points_disp.size()));
 
-		// Draw square around the point. View radius is half the side length of drawn square (in scene coordinate system).
-		glBegin(GL_POLYGON);
-			glVertex2f(points[i].x - view_radius, points[i].y - view_radius);
-			glVertex2f(points[i].x - view_radius, points[i].y + view_radius);
-			glVertex2f(points[i].x + view_radius, points[i].y + view_radius);
-			glVertex2f(points[i].x + view_radius, points[i].y - view_radius);
-		glEnd();
+	// Draw the points in red
+	ortho_markers.draw(1.0f, 0.0f, 0.0f);
+}
 
+/**
+* Captures the current value of every input the display projection depends on in the current calibration mode. The
+* inputs other modes use are left at zero.
+*
+* @return current projection inputs, can_project is false if the grid, image, camera profile or camera pose the
+* projection needs is missing
+*/
+Painter::ProjectionInputs Painter::get_projection_inputs() {
+	ProjectionInputs inputs = ProjectionInputs();
 
-		// Draw crosshair that shows the center of the point.
-		glBegin(GL_LINES);
-			glVertex2f(points[i].x - 2, points[i].y);
-			glVertex2f(points[i].x + 2, points[i].y);
-		glEnd();
+	inputs.calibration_mode = grid_config->calibration_mode;
 
-		glBegin(GL_LINES);
-			glVertex2f(points[i].x, points[i].y + 2);
-			glVertex2f(points[i].x, points[i].y - 2);
-		glEnd();
+	if (inputs.calibration_mode == 0 || inputs.calibration_mode == 1 || inputs.calibration_mode == 2) {
+		if (grid_config->grid == NULL || (inputs.calibration_mode == 0 && measurement_config == NULL)) {
+			return inputs;
+		}
+		inputs.grid_revision = grid_config->grid->get_revision();
+
+		// Grid corner calibration also measures from corner 0 with the measurement offsets and flips
+		if (inputs.calibration_mode == 0) {
+			inputs.flip_x = measurement_config->flip_x;
+			inputs.flip_y = measurement_config->flip_y;
+			inputs.x_offset = measurement_config->x_offset;
+			inputs.y_offset = measurement_config->y_offset;
+			inputs.corner0_x = grid_config->grid->corner[0].x;
+			inputs.corner0_y = grid_config->grid->corner[0].y;
+		}
+		inputs.can_project = true;
+	}
+	else if (inputs.calibration_mode == 3) {
+		if (app_config->image == NULL || img_config->camera_profile == NULL || img_config->cam_pose == NULL) {
+			return inputs;
+		}
+		inputs.camera_profile_generation = img_config->camera_profile->get_generation();
+		inputs.cam_pose = *img_config->cam_pose;
+		inputs.img_width = app_config->image->get_width();
+		inputs.img_height = app_config->image->get_height();
+		inputs.can_project = true;
 	}
-	// Reset draw mode and color
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glColor3f(1.0f, 1.0f, 1.0f);
+
+	return inputs;
 }
 
 /**
-* Draws point in the orthographic panel
+* Compares two sets of projection inputs. Only the camera pose fields used by the ground projection are compared.
+*
+* @param a first set of projection inputs
+* @param b second set of projection inputs
+*
+* @return true if points projected with a are still valid for b
 */
-void Painter::draw_ortho() {
+bool Painter::projection_inputs_equal(const ProjectionInputs& a, const ProjectionInputs& b) {
+	return a.calibration_mode == b.calibration_mode &&
+		a.can_project == b.can_project &&
+		a.grid_revision == b.grid_revision &&
+		a.camera_profile_generation == b.camera_profile_generation &&
+		a.cam_pose.x_pos == b.cam_pose.x_pos &&
+		a.cam_pose.y_pos == b.cam_pose.y_pos &&
+		a.cam_pose.z_pos == b.cam_pose.z_pos &&
+		a.cam_pose.roll_angle == b.cam_pose.roll_angle &&
+		a.cam_pose.pitch_angle == b.cam_pose.pitch_angle &&
+		a.cam_pose.yaw_angle == b.cam_pose.yaw_angle &&
+		a.flip_x == b.flip_x &&
+		a.flip_y == b.flip_y &&
+		a.x_offset == b.x_offset &&
+		a.y_offset == b.y_offset &&
+		a.corner0_x == b.corner0_x &&
+		a.corner0_y == b.corner0_y &&
+		a.img_width == b.img_width &&
+		a.img_height == b.img_height;
+}
 
-	// Set color to red
-	glColor3f(1.0f, 0.0f, 0.0f);
-
-	// Set polygon mode to line so that points display as square outlines
-	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
-	// Loop through all of the points in the painter object
-	for (unsigned int i = 0; i < points.size(); i++) {
-		// Draw square around the point. view_radius is half the side length of the drawn square (in scene coordinate system)
-		glBegin(GL_POLYGON);
-			glVertex2f(projected_points_disp[i].x - view_radius, projected_points_disp[i].y - view_radius);
-			glVertex2f(projected_points_disp[i].x - view_radius, projected_points_disp[i].y + view_radius);
-			glVertex2f(projected_points_disp[i].x + view_radius, projected_points_disp[i].y + view_radius);
-			glVertex2f(projected_points_disp[i].x + view_radius, projected_points_disp[i].y - view_radius);
-		glEnd();
-
-		// Draw crosshair that shows the center of the point
-		glBegin(GL_LINES);
-			glVertex2f(projected_points_disp[i].x - crosshair_size, projected_points_disp[i].y);
-			glVertex2f(projected_points_disp[i].x + crosshair_size, projected_points_disp[i].y);
-		glEnd();
-
-		glBegin(GL_LINES);
-			glVertex2f(projected_points_disp[i].x, projected_points_disp[i].y + crosshair_size);
-			glVertex2f(projected_points_disp[i].x, projected_points_disp[i].y - crosshair_size);
-		glEnd();
-	}
-	// Reset draw mode and color
-	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	glColor3f(1.0f, 1.0f, 1.0f);
+/**
+* Marks all display projections as stale so the next call to project_points_display reprojects every point.
+* Must be called whenever points are removed or reordered.
+*/
+void Painter::invalidate_projection() {
+	projected_count = 0;
 }
 
 /**
-* Project points for display purposes (not the final exported measurements)
+* Project points for display purposes (not the final exported measurements). Projections are cached, so only
+* points added since the last call are projected. All points are reprojected only when the camera pose, camera
+* profile, grid transform, measurement config or image changed.
 */
 void Painter::project_points_display() {
 
-	// Check that there are points to project at all. If not, there is no need to proceed
-	if (points.size() > 0) {
+	ProjectionInputs inputs = get_projection_inputs();
 
+	// Reproject everything if any of the inputs changed since the cached projections were computed
+	if (!projection_inputs_equal(inputs, projection_inputs)) {
+		projection_inputs = inputs;
+		projected_count = 0;
+	}
 
-		//TODO: check for camera profile
-		//std::vector<cv::Point2f> uv_points = scene_to_uv_coord(points);
-		//std::vector<cv::Point2f> undistorted_points;
-		//if (true) {
-		//	undistorted_points = img_config->camera_profile->undistort_points(uv_points);
-		//}
-		//else {
-		//
-		//	undistorted_points = uv_coords_to_scene_coords(uv_points);
-		//}
+	// Nothing is projected until the grid or camera is there, every point is projected once it is
+	if (!inputs.can_project) {
+		return;
+	}
 
-		// Resize the projected_points_disp if points has changed size
-		projected_points_disp.reserve(points.size()); 
+	// Points were removed without invalidating the projections
+	if (projected_count > points.size()) {
+		projected_count = 0;
+	}
 
-		if (grid_config->calibration_mode == 2 || grid_config->calibration_mode == 1) {// If using Aruco marker calibration or point calibration
-			// Applies transformation matrix to points and stores results in projected_points_disp
-			//undistorted_points = uv_coords_to_scene_coords(undistorted_points);
-			cv::perspectiveTransform(points, projected_points_disp, grid_config->grid->get_inverse_transform());
-		}
-		else if (grid_config->calibration_mode == 0) {// If using grid corner calibration
-			//points = uv_coords_to_scene_coords(points);
-			// Applies transformation matrix to points and stores results in projected_points_disp
-			cv::perspectiveTransform(points, projected_points_disp, grid_config->grid->get_inverse_transform());
-
-			// Loop through all of the resulting points and apply grid offsets, measurement offsets, and flip_x/flip_y
-			for (unsigned int i = 0; i < projected_points_disp.size(); i++) {
-				// Check flip_x and flip_y for display
-				float flip_x = 1;
-				float flip_y = 1;
-				if (measurement_config->flip_x) {
-					flip_x = -1;
-				}
-				if (measurement_config->flip_y) {
-					flip_y = -1;
-				}
-				// measurement_config->x_offset and measurement_config->y_offset are multiplied by 100 to match the visual scale of the grid on screen since the offsets
-				// are internally stored in meters.
-				projected_points_disp[i].x = flip_x*(projected_points_disp[i].x - grid_config->grid->corner[0].x) - measurement_config->x_offset*100;
-				projected_points_disp[i].y = flip_y*(projected_points_disp[i].y - grid_config->grid->corner[0].y) - measurement_config->y_offset*100;
-			}
-		}
-		else if (grid_config->calibration_mode == 3) {// If using markerless calibration mode
+	// Check that there are new points to project at all. If not, there is no need to proceed
+	if (projected_count == points.size()) {
+		return;
+	}
 
-			// Convert scene points (origin at the center of image) to u v coordinates (origin at the top-left corner of the image)
-			std::vector<cv::Point2f> uv_points = scene_to_uv_coord(points);
+	// Resize projected_points_disp to hold the new points, the projections already computed are kept
+	projected_points_disp.resize(points.size());
 
-			// Use the img_to_world_transform defined by the current camera profile to transform uv_points to world points
-			projected_points_disp = img_config->camera_profile->img_to_world_transform(uv_points, *img_config->cam_pose);
+	project_points_display(projected_count, points.size());
 
-		}
-	}
+	projected_count = points.size();
 }
 
 /**
-* Project points for final exported measurements
-* 
-* @return list of projected 2D points in the world coordinate frame (bird's eye view above the vehicle with perspective removed) with units of meters
+* Project a range of points for display purposes and store the results at the same indices in projected_points_disp
+*
+* @param begin index of the first point to project
+* @param end index one past the last point to project
 */
-std::vector<cv::Point2f> Painter::project_points() {
-	std::vector<cv::Point2f> projected_points(points.size());
-
-	if (grid_config->calibration_mode == 2 || grid_config->calibration_mode == 1) { // If using point calibration or aruco marker calibration
-		// transform points to projected_points using grid inverse transform ([O] matrix)
-		cv::perspectiveTransform(points, projected_points, grid_config->grid->get_inverse_transform());
-
-		// Loop through all of the projected points
-		for (unsigned int i = 0; i < projected_points.size(); i++) {
+void Painter::project_points_display(size_t begin, size_t end) {
+	int n = (int)(end - begin);
 
-			// Points are initially scaled to cm (multiplied by 100) for numerical stability when converting 
-			// between scene/image coordinates and world coordinates this scaling has to be taken back out for the final output
-			// in meters.
-			projected_points[i].x = (projected_points[i].x) / 100;
-			projected_points[i].y = (projected_points[i].y) / 100;
-		}
+	if (n <= 0) {
+		return;
 	}
-	else if (grid_config->calibration_mode == 0) { // If using grid corner calibration
 
-		// transform points to projected_points using grid inverse transform ([O] matrix)
-		cv::perspectiveTransform(points, projected_points, grid_config->grid->get_inverse_transform());
+	// The orthographic markers of the range have to be uploaded again
+	ortho_markers.invalidate(begin);
+	revision++;
 
-		// Loop through all of the projected_points
-		for (unsigned int i = 0; i < projected_points.size(); i++) {
+	// Headers over the range so perspectiveTransform reads and writes the vectors directly
+	cv::Mat src(n, 1, CV_32FC2, &points[begin]);
+	cv::Mat dst(n, 1, CV_32FC2, &projected_points_disp[begin]);
 
-			// Points must be referenced from corner0 and divided by 100 to account for the prescaling
-			// World points are initially scaled to cm (multiplied by 100) for numerical stability when converting
-			// between scene/image coords and world coords. This scaling has to be taken away for the final output
-			// in meters.
-			projected_points[i].x = (projected_points[i].x - grid_config->grid->corner[0].x) / 100;
-			projected_points[i].y = (projected_points[i].y - grid_config->grid->corner[0].y) / 100;
-		}
+	if (grid_config->calibration_mode == 2 || grid_config->calibration_mode == 1) {// If using Aruco marker calibration or point calibration
+		// Applies transformation matrix to points and stores results in projected_points_disp
+		cv::perspectiveTransform(src, dst, grid_config->grid->get_inverse_transform());
 	}
-	else if (grid_config->calibration_mode == 3) { // if using markerless calibration
+	else if (grid_config->calibration_mode == 0) {// If using grid corner calibration
+		// Applies transformation matrix to points and stores results in projected_points_disp
+		cv::perspectiveTransform(src, dst, grid_config->grid->get_inverse_transform());
+
+		// Check flip_x and flip_y for display
+		float flip_x = 1;
+		float flip_y = 1;
+		if (measurement_config->flip_x) {
+			flip_x = -1;
+		}
+		if (measurement_config->flip_y) {
+			flip_y = -1;
+		}
 
-		// Convert scene points (origin at the center of image) to u v coordinates (origin at the top-left corner of the image)
-		std::vector<cv::Point2f> uv_points = scene_to_uv_coord(points);
-
-		// project uv_points using loaded camera profile and camera pose
-		projected_points = img_config->camera_profile->img_to_world_transform(uv_points, *img_config->cam_pose);
-
-		// Loop through all of the points
-		for (unsigned int i = 0; i < projected_points.size(); i++) {
-			// World points are initially scaled to cm (multiplied by 100) for numerical stability when converting
-			// between scene/image coords and world coords. This scaling has to be taken away for the final output
-			// in meters
-			projected_points[i].x = projected_points[i].x / 100;
-			projected_points[i].y = projected_points[i].y / 100;
+		// Loop through all of the resulting points and apply grid offsets, measurement offsets, and flip_x/flip_y
+		for (size_t i = begin; i < end; i++) {
+			// measurement_config->x_offset and measurement_config->y_offset are multiplied by 100 to match the visual scale of the grid on screen since the offsets
+			// are internally stored in meters.
+			projected_points_disp[i].x = flip_x*(projected_points_disp[i].x - grid_config->grid->corner[0].x) - measurement_config->x_offset*100;
+			projected_points_disp[i].y = flip_y*(projected_points_disp[i].y - grid_config->grid->corner[0].y) - measurement_config->y_offset*100;
 		}
 	}
+	else if (grid_config->calibration_mode == 3) {// If using markerless calibration mode
 
-	// return projected points
-	return projected_points;
-}
+		// Convert scene points (origin at the center of image) to u v coordinates (origin at the top-left corner of the image)
+		app_config->image->get_scene_to_uv().apply(&points[begin], &projected_points_disp[begin], end - begin);
 
-/**
-* 
-* Transform points in scene coordinates (origin at center of image) to a list of points in uv coordinates 
-* (origin at top-left corner of image)
-* 
-* @param scene_points vector of points in scene coordinates
-* 
-* @return List of points transformed to uv coordinates
-*/
-std::vector<cv::Point2f> Painter::scene_to_uv_coord(std::vector<cv::Point2f> scene_points) {
-	// Create vector for transformed points in uv coordinates
-	std::vector<cv::Point2f> uv_points(scene_points.size());
-
-	// Loop through vector of scene_points
-	for (unsigned int i = 0; i < scene_points.size(); i++) {
-		// Transform points based on loaded image
-		uv_points[i].x = scene_points[i].x + app_config->image->get_width()/2;
-		uv_points[i].y = -1*(scene_points[i].y - app_config->image->get_height()/2);
+		// Use the ground projector of the current camera profile to transform the u v points to world points in place.
+		// It removes the lens distortion with the undistortion table of the profile.
+		GroundProjector projector = img_config->camera_profile->get_ground_projector(*img_config->cam_pose);
+		projector.project(&projected_points_disp[begin], &projected_points_disp[begin], end - begin);
 	}
-
-	// return vector
-	return uv_points;
 }
 
 /**
-* Transform a point in scene coordinates (origin at center of image) to a  point in uv coordinates
-* (origin at top-left corner of image)
-* 
-* @param scene_x x coordinate in scene coordinates
-* @param scene_y y coordinate in scene coordinates
+* Project points for final exported measurements into a caller provided buffer. The grid transform and the
+* conversion to meters are folded into one homography, so the points are read and written once.
 * 
-* @return vector containing x (0th element of vector) and y (1st element of vector) in uv coords
+* @param projected_points receives one point per painted point in the world coordinate frame (bird's eye view above the
+* vehicle with perspective removed) with units of meters. Its memory is reused if it is large enough.
 */
-std::vector<double> Painter::scene_to_uv_coord(double scene_x, double scene_y) {
-	// Reserve storage for uv point
-	std::vector<double> uv_point(2);
+void Painter::project_points(cv::OutputArray projected_points) {
+	projected_points.create((int)points.size(), 1, CV_32FC2);
+	if (points.empty()) {
+		return;
+	}
 
-	// Transform points based on loaded image
-	uv_point[0] = scene_x + app_config->image->get_width() / 2;
-	uv_point[1] = -1*(scene_y - app_config->image->get_height() / 2);
+	cv::Mat src((int)points.size(), 1, CV_32FC2, points.data());
+	cv::Mat dst = projected_points.getMat();
 
-	// return uv_point
-	return uv_point;
-}
+	if (grid_config->calibration_mode == 2 || grid_config->calibration_mode == 1) { // If using point calibration or aruco marker calibration
+		// Points are initially scaled to cm (multiplied by 100) for numerical stability when converting 
+		// between scene/image coordinates and world coordinates this scaling has to be taken back out for the final output
+		// in meters.
+		cv::Mat to_world = cv::Mat(ortho_to_world(0, 0).matrix()) * grid_config->grid->get_inverse_transform();
 
-/**
-* Transform a point in scene coordinates (origin at center of image) to a  point in uv coordinates
-* (origin at top-left corner of image)
-*
-* @param scene_x x coordinate in scene coordinates
-* @param scene_y y coordinate in scene coordinates
-*
-* @return vector containing x (0th element of vector) and y (1st element of vector) in uv coords
-*/
-std::vector<double> Painter::uv_coord_to_scene_coord(double u, double v) {
-	// Reserve storage for uv point
-	std::vector<double> scene_coord(2);
+		// transform points to projected_points using grid inverse transform ([O] matrix)
+		cv::perspectiveTransform(src, dst, to_world);
+	}
+	else if (grid_config->calibration_mode == 0) { // If using grid corner calibration
 
-	// Transform points based on loaded image
-	scene_coord[0] = u - app_config->image->get_width() / 2;
-	scene_coord[1] = -1 * (u + app_config->image->get_height() / 2);
+		// Points must be referenced from corner0 and divided by 100 to account for the prescaling
+		// World points are initially scaled to cm (multiplied by 100) for numerical stability when converting
+		// between scene/image coords and world coords. This scaling has to be taken away for the final output
+		// in meters.
+		cv::Mat to_world = cv::Mat(ortho_to_world(grid_config->grid->corner[0].x, grid_config->grid->corner[0].y).matrix()) *
+			grid_config->grid->get_inverse_transform();
 
-	// return uv_point
-	return scene_coord;
-}
+		// transform points to projected_points using grid inverse transform ([O] matrix)
+		cv::perspectiveTransform(src, dst, to_world);
+	}
+	else if (grid_config->calibration_mode == 3) { // if using markerless calibration
+		cv::Point2f* world_points = dst.ptr<cv::Point2f>();
 
-std::vector<cv::Point2f> Painter::uv_coords_to_scene_coords(std::vector<cv::Point2f> uv_points) {
-	// Create vector for transformed points in uv coordinates
-	std::vector<cv::Point2f> scene_coords(uv_points.size());
+		// Convert scene points (origin at the center of image) to u v coordinates (origin at the top-left corner of the image)
+		app_config->image->get_scene_to_uv().apply(points.data(), world_points, points.size());
 
-	// Loop through vector of scene_points
-	for (unsigned int i = 0; i < uv_points.size(); i++) {
-		// Transform points based on loaded image
-		scene_coords[i].x = uv_points[i].x - app_config->image->get_width() / 2;
-		scene_coords[i].y = -1 * (uv_points[i].y + app_config->image->get_height() / 2);
+		// project the uv points in place using loaded camera profile and camera pose. World points are initially scaled
+		// to cm for numerical stability, project_meters takes this scaling away for the final output in meters. This
+		// is the same projection pgrid-batch uses, including the lens distortion.
+		GroundProjector projector = img_config->camera_profile->get_ground_projector(*img_config->cam_pose);
+		projector.project_meters(world_points, world_points, points.size());
 	}
+}
 
-	// return vector
-	return scene_coords;
+/**
+* Project points for final exported measurements into a buffer owned by the painter, which is reused by every export
+* 
+* @return list of projected 2D points in the world coordinate frame (bird's eye view above the vehicle with perspective
+* removed) with units of meters. Valid until the next call.
+*/
+const std::vector<cv::Point2f>& Painter::project_points() {
+	project_points(export_points);
+	return export_points;
 }
 
 /**
@@ -373,21 +388,65 @@ double Painter::distance(double x0, double y0,
 }
 
 /**
-* Removes points within a radius of requested x and y coordinate
+* Removes points within a radius of requested x and y coordinate. The points to remove are looked up in the spatial index,
+* then removed from points (and the cached display projections) in a single compaction pass that keeps the order of the
+* remaining points.
 * 
 * @param x x position to erase in scene coordinates
 * @param y y position to erase in scene coordinates
 */
 void Painter::erase(float x, float y) {
 
-	// Loop through all of the points
-	for (unsigned int i = 0; i < points.size(); i++) {
-		// check if the points are within the erase radius of requested erase location
-		if (distance(x, y, points[i].x, points[i].y) <= paint_config->erase_radius) {
-			// if point is in radius remove it from the vector of points
-			points.erase(std::remove(points.begin(), points.end(), points[i]), points.end());
+	// Find the points within the erase radius of requested erase location
+	std::vector<int> hits;
+	point_index.query_radius(x, y, (float)paint_config->erase_radius, hits);
+
+	// Nothing to erase, leave points and the index untouched
+	if (hits.empty()) {
+		return;
+	}
+
+	std::sort(hits.begin(), hits.end());
+
+	// Move every point that is kept down over the erased ones. Points before the first hit stay where they are.
+	size_t next_hit = 0;
+	size_t write = (size_t)hits[0];
+	size_t erased_projected = 0;
+	for (size_t read = (size_t)hits[0]; read < points.size(); read++) {
+		if (next_hit < hits.size() && (size_t)hits[next_hit] == read) {
+			next_hit++;
+			if (read < projected_count) {
+				erased_projected++;
+			}
+			continue;
 		}
+
+		points[write] = points[read];
+		if (read < projected_count) {
+			projected_points_disp[write] = projected_points_disp[read];
+		}
+		write++;
 	}
+
+	// Projections of the kept points moved along with them, so only the count has to change
+	projected_count -= erased_projected;
+	points.resize(write);
+	projected_points_disp.resize(std::min(projected_points_disp.size(), write));
+
+	// Indices after the first erased point have shifted, update the index and the marker buffers the same way
+	point_index.remove(hits);
+	scene_markers.invalidate((size_t)hits[0]);
+	ortho_markers.invalidate((size_t)hits[0]);
+	revision++;
+}
+
+/**
+* Get the points in the perspective scene coordinate system
+* 
+* @return copy of the list of points
+*/
+std::vector<cv::Point2f> Painter::get_points() {
+	return points;
 }
 
 /**
@@ -405,4 +464,19 @@ int Painter::size() {
 */
 void Painter::clear_points() {
 	points.clear();
-}
\ No newline at end of file
+	point_index.clear();
+	invalidate_projection();
+	scene_markers.invalidate(0);
+	ortho_markers.invalidate(0);
+	revision++;
+}
+
+/**
+* Get the revision of the points. The revision is incremented whenever a point is added or erased, or display
+* projections are recomputed, so the panels can tell whether they have to be drawn again.
+*
+* @return revision counter
+*/
+unsigned int Painter::get_revision() {
+	return revision;
+}
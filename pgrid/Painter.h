@@ -8,6 +8,8 @@
 #include "Grid.h"
 #include "CameraProfile.h"
 #include "Image.h"
+#include "SpatialIndex.h"
+#include "PointMarkerRenderer.h"
 
 class Painter
 {
@@ -20,34 +22,74 @@ private:
 
 	std::vector<cv::Point2f> points;
 	std::vector<cv::Point2f> projected_points_disp;
-	
+
+	// Scratch buffer of project_points, kept so repeated exports do not allocate
+	std::vector<cv::Point2f> export_points;
+
+	// Spatial hash over points in scene coordinates, used for erase queries
+	SpatialIndex point_index;
+
+	// Everything the display projection depends on, captured when projected_points_disp was last computed
+	typedef struct {
+		int calibration_mode;
+		unsigned int grid_revision;
+		unsigned int camera_profile_generation;
+		CameraPose cam_pose;
+		bool flip_x;
+		bool flip_y;
+		float x_offset;
+		float y_offset;
+		float corner0_x;
+		float corner0_y;
+		int img_width;
+		int img_height;
+		bool can_project;
+	} ProjectionInputs;
+
+	ProjectionInputs projection_inputs;
+
+	// Number of points at the front of projected_points_disp that are up to date with projection_inputs
+	size_t projected_count;
+
+	// Incremented whenever points or their display projections change
+	unsigned int revision;
+
+	ProjectionInputs get_projection_inputs();
+
+	bool projection_inputs_equal(const ProjectionInputs& a, const ProjectionInputs& b);
+
+	void project_points_display(size_t begin, size_t end);
 
 	const int view_radius = 6;
 	const int crosshair_size = 2;
 
+	// Vertex buffers of the point markers drawn in the perspective and orthographic panels
+	PointMarkerRenderer scene_markers;
+	PointMarkerRenderer ortho_markers;
+
 public:
 	Painter(SessionConfig* session_config);
-	std::vector<double> uv_coord_to_scene_coord(double u, double v);
-	std::vector<cv::Point2f> uv_coords_to_scene_coords(std::vector<cv::Point2f>);
-
-	std::vector<cv::Point2f> scene_to_uv_coord(std::vector<cv::Point2f> scene_points);
-
-	std::vector<double> scene_to_uv_coord(double scene_x, double scene_y);
 
 	void add_point(float x, float y);
 
 	void add_point_at_click(float x, float y);
 
+	void add_points(const std::vector<cv::Point2f>& new_points);
+
 	void draw();
 
 	void draw_ortho();
 
 	std::vector<cv::Point2f> get_points();
 
-	std::vector<cv::Point2f> project_points();
+	void project_points(cv::OutputArray projected_points);
+
+	const std::vector<cv::Point2f>& project_points();
 
 	void project_points_display();
 
+	void invalidate_projection();
+
 	double distance(double x0, double y0,
 		double x1, double y1);
 
@@ -56,5 +98,7 @@ public:
 	void clear_points();
 
 	int size();
+
+	unsigned int get_revision();
 };
 
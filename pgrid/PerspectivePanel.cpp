@@ -31,6 +31,11 @@ PerspectivePanel::PerspectivePanel(SessionConfig* session_config) :
 	image(session_config) {
 	this->width = 0;
 	this->height = 0;
+	framebuffer = Framebuffer();
+
+	// Nothing has been rendered yet
+	render_inputs = RenderInputs();
+	rendered = false;
 	
 	// setup pointers for easy config access
 	view_config = session_config->perspective_view_config;
@@ -51,14 +56,13 @@ void PerspectivePanel::set_window_pointer(GLFWwindow* window) {
 }
 
 /**
-* Initialize dynamically allocated framebuffer, texture, and renderbuffer for opengl to 
-* render to. This texture will be displayed in an ImGui window
+* Initialize the panel once the OpenGL context exists. The framebuffer, texture, and renderbuffer for opengl to
+* render to are taken from the framebuffer pool on the first render, once the size of the panel is known. This
+* texture will be displayed in an ImGui window
 * 
 */
 void PerspectivePanel::init() {
-	glGenFramebuffers(1, &fbo);
-	glGenTextures(1, &tex);
-	glGenRenderbuffers(1, &rbo);
+	framebuffer = Framebuffer();
 }
 
 /**
@@ -91,76 +95,146 @@ void PerspectivePanel::render() {
 	camera.set_width(width);
 	camera.update();
 
-	// Bind framebuffer and texture
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-	glBindTexture(GL_TEXTURE_2D, tex);
+	// Pick up a finished full resolution decode or marker job and keep the grid transform up to date. All of them can
+	// change what the panel shows, so they are checked every frame even when nothing is drawn. The workers wake the
+	// main loop when they are done, with nothing else changed.
+	image.finish_loading(false);
+	image.finish_marker_job();
+	if (grid_config->calibration_mode != 3) {
+		grid.compute_perspective_transform();
+	}
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB,
-		(GLsizei) width, (GLsizei) height, 0,
-		GL_RGB, GL_UNSIGNED_BYTE, NULL);
+	// Only draw when something the panel shows has changed, otherwise the texture still holds the last frame
+	RenderInputs inputs = get_render_inputs();
+	if (!rendered || !render_inputs_equal(inputs, render_inputs) || needs_redraw()) {
+		render_inputs = inputs;
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex, 0);
-	
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, (GLsizei) width, (GLsizei) height);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
-	// If there was a problem with the creation of the framebuffer, report the issue
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
-		MessageBox(NULL, "There was a fatal error when binding an OpenGL framebuffer to PerspectivePanel", "Error!", MB_OK);
-		exit(1);
-	}
+		// Fit the framebuffer to the window, the attachments are only reallocated when the window grows past them
+		int framebuffer_status = app_config->framebuffer_pool->resize(framebuffer, inputs.width, inputs.height);
 
-	// Set the viewport size to height and width of the window
-	glViewport((GLint) 0, (GLint) 0, (GLsizei) width, (GLsizei) height);
+		// If there was a problem with the creation of the framebuffer, report the issue
+		if (framebuffer_status == FRAMEBUFFER_INCOMPLETE) {
+			MessageBox(NULL, "There was a fatal error when binding an OpenGL framebuffer to PerspectivePanel", "Error!", MB_OK);
+			exit(1);
+		}
 
-	// Clear the screen
-	glClearColor(0.00f, 0.00f, 0.00f, 1.00f);
-	glClear(GL_COLOR_BUFFER_BIT);
+		// Nothing to draw into while the window has no area, e.g. while it is collapsed
+		rendered = (framebuffer_status == FRAMEBUFFER_SUCCESS);
+		if (rendered) {
+			glBindFramebuffer(GL_FRAMEBUFFER, framebuffer.fbo);
 
-	// Apply 2d camera transformation
-	camera.apply_cam();
+			// Set the viewport size to height and width of the window
+			glViewport((GLint) 0, (GLint) 0, framebuffer.width, framebuffer.height);
 
-	// Render the image to the screen
-	image.render();
+			// Clear the screen
+			glClearColor(0.00f, 0.00f, 0.00f, 1.00f);
+			glClear(GL_COLOR_BUFFER_BIT);
 
-	// Render the virtual grid to screen
-	// for any mode other than markerless
-	if (grid_config->calibration_mode != 3) {
-		grid.draw();
-	}
+			// Apply 2d camera transformation
+			camera.apply_cam();
 
-	// Draw painted nearest visible points (NVPs)
-	app_config->painter->draw();
+			// Render the image to the screen
+			image.render(camera);
 
-	// bind default framebuffer, i.e. render to main framebuffer instead of 
-	// perspective panel framebuffer
-	// Everything that is contained within the perspective panel window e.g. the perspective grid, 
-	// image, and NVPs should be rendered in the perspective panel framebuffer. That is 
-	// they should be rendered before this call to switch back to the default framebuffer
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			// Render the virtual grid to screen
+			// for any mode other than markerless
+			if (grid_config->calibration_mode != 3) {
+				grid.draw();
+			}
 
-	// Display the perspective panel texture as an image in ImGui window
-	ImGui::Image((ImTextureID)static_cast<uintptr_t>(tex),
-		ImGui::GetContentRegionAvail(),
-		ImVec2(0, 1),
-		ImVec2(1, 0));
+			// Draw painted nearest visible points (NVPs)
+			app_config->painter->draw();
+
+			// bind default framebuffer, i.e. render to main framebuffer instead of 
+			// perspective panel framebuffer
+			// Everything that is contained within the perspective panel window e.g. the perspective grid, 
+			// image, and NVPs should be rendered in the perspective panel framebuffer. That is 
+			// they should be rendered before this call to switch back to the default framebuffer
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		}
+	}
+
+	// Display the perspective panel texture as an image in ImGui window. The panel only uses the bottom left part
+	// of the texture if the framebuffer was allocated larger.
+	if (rendered) {
+		ImGui::Image((ImTextureID)static_cast<uintptr_t>(framebuffer.tex),
+			ImGui::GetContentRegionAvail(),
+			ImVec2(0, (float)framebuffer.height / framebuffer.alloc_height),
+			ImVec2((float)framebuffer.width / framebuffer.alloc_width, 0));
+	}
 
 	// End perspective panel window
 	ImGui::End();
 }
 
+/**
+* Captures the current value of every input the panel contents depend on
+*
+* @return current render inputs
+*/
+PerspectivePanel::RenderInputs PerspectivePanel::get_render_inputs() {
+	RenderInputs inputs = RenderInputs();
+
+	inputs.width = (GLsizei) width;
+	inputs.height = (GLsizei) height;
+	inputs.zoom = view_config->zoom;
+	inputs.pan_x = view_config->pan_x;
+	inputs.pan_y = view_config->pan_y;
+	inputs.calibration_mode = grid_config->calibration_mode;
+	inputs.grid_revision = grid.get_revision();
+	inputs.grid_width = grid_config->width;
+	inputs.grid_height = grid_config->height;
+	inputs.divs_x = grid_config->divs_x;
+	inputs.divs_y = grid_config->divs_y;
+	for (unsigned int i = 0; i < grid_config->ref_points.size(); i++) {
+		inputs.ref_points.push_back(cv::Point2d(grid_config->ref_points[i].get_x(), grid_config->ref_points[i].get_y()));
+	}
+	inputs.painter_revision = app_config->painter->get_revision();
+	inputs.image_generation = image.get_generation();
+
+	return inputs;
+}
+
+/**
+* Compares two sets of render inputs
+*
+* @param a first set of render inputs
+* @param b second set of render inputs
+*
+* @return true if a frame rendered with a still shows b
+*/
+bool PerspectivePanel::render_inputs_equal(const RenderInputs& a, const RenderInputs& b) {
+	return a.width == b.width &&
+		a.height == b.height &&
+		a.zoom == b.zoom &&
+		a.pan_x == b.pan_x &&
+		a.pan_y == b.pan_y &&
+		a.calibration_mode == b.calibration_mode &&
+		a.grid_revision == b.grid_revision &&
+		a.grid_width == b.grid_width &&
+		a.grid_height == b.grid_height &&
+		a.divs_x == b.divs_x &&
+		a.divs_y == b.divs_y &&
+		a.ref_points == b.ref_points &&
+		a.painter_revision == b.painter_revision &&
+		a.image_generation == b.image_generation;
+}
+
+/**
+* Check whether the panel needs another frame to finish drawing, i.e. image tiles are still being uploaded
+*
+* @return true if the panel has to be drawn again even if nothing changed
+*/
+bool PerspectivePanel::needs_redraw() {
+	return image.has_pending_tiles();
+}
+
 /**
 * Cleans up OpenGL memory and calls image deconstructor
 * 
 */
 void PerspectivePanel::close() {
-	glDeleteFramebuffers(1, &fbo);
-	glDeleteTextures(1, &tex);
-	glDeleteRenderbuffers(1, &rbo);
+	app_config->framebuffer_pool->release(framebuffer);
 
 	image.close();
 }
@@ -197,33 +271,6 @@ bool PerspectivePanel::is_mouse_on(double mx, double my) {
 }
 
 
-/**
-* Converts image u v coordinates to scene coordinates for aruco marker calibration and display
-* OpenCV uses uv coordinates to define the position of the detected aruco markers, but to draw the corners of detected markers
-* where they should be in the perspective panel requires the scene position.
-* 
-* @param quad_points vector of 4-element, Point2f vectors. Each element in the outer vector represents a detected marker quad and each element
-* in the inner vector represents the position of a corner of a marker quad in image coordinates
-* 
-* @return vector of 4-element, Point2f vectors with each element in the outer vector representing a detected marker quad and each element in the
-* inner vector representing the position of a corner of a marker quad in scene coordinates
-*/
-std::vector <std::vector<cv::Point2f>> PerspectivePanel::image_to_scene_pos(std::vector<std::vector<cv::Point2f>> quad_points) {
-
-	std::vector<std::vector<cv::Point2f>> transformed(quad_points.size());
-
-	for (int j = 0; j < quad_points.size(); j++) {
-		transformed[j] = std::vector<cv::Point2f>(4);
-		for (int k = 0; k < quad_points[j].size(); k++) {
-			transformed[j][k].x = quad_points[j][k].x - (app_config->image->get_width()/2);
-			transformed[j][k].y = -quad_points[j][k].y + (app_config->image->get_height()/2);
-		}
-		//std::cout << quad_points[j][0];
-	}
-
-	return transformed;
-}
-
 /**
 * Convert mouse coordinate to coordinate in the perspective scene (origin at the center scaled to image pixels)
 * This is typically called when the user interacts with the perspective panel to get the coordinates to draw a point or grab 
@@ -236,9 +283,10 @@ std::vector <std::vector<cv::Point2f>> PerspectivePanel::image_to_scene_pos(std:
 */
 glm::dvec2 PerspectivePanel::mouse_to_scene_pos(double mx, double my) {
 
-	glm::dvec2 scene_pos = glm::dvec2(
-		((mx - (window_pos.x)) - (width+10) / 2) / view_config->zoom + view_config->pan_x,
-		-1 * ((my - (window_pos.y)) - (height+28) / 2) / view_config->zoom - view_config->pan_y);
+	// The panel content is 10 px narrower and 28 px shorter than the window, for its border and title bar. The size is
+	// a float, so the center of a panel with an odd size is at a half pixel.
+	Affine2D<MouseFrame, SceneFrame> to_scene = mouse_to_scene(window_pos.x, window_pos.y, width + 10, height + 28,
+		view_config->zoom, view_config->pan_x, view_config->pan_y);
 
-	return scene_pos;
+	return glm::dvec2(to_scene.apply_x(mx, my), to_scene.apply_y(mx, my));
 }
\ No newline at end of file
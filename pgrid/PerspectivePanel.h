@@ -17,6 +17,7 @@
 #include "Image.h"
 #include "Camera2D.h"
 #include "Painter.h"
+#include "FramebufferPool.h"
 
 /**
 * The PerspectivePanel class encapsulates the Perspective Panel window 
@@ -46,10 +47,35 @@ private:
 	// Perspective grid
 	Grid grid;
 
-	// OpenGL framebuffer memory
-	GLuint fbo;
-	GLuint tex;
-	GLuint rbo;
+	// OpenGL framebuffer memory, allocated from the shared framebuffer pool
+	Framebuffer framebuffer;
+
+	// Everything the panel contents depend on, captured when the framebuffer was last rendered
+	typedef struct {
+		GLsizei width;
+		GLsizei height;
+		double zoom;
+		float pan_x;
+		float pan_y;
+		int calibration_mode;
+		unsigned int grid_revision;
+		float grid_width;
+		float grid_height;
+		int divs_x;
+		int divs_y;
+		std::vector<cv::Point2d> ref_points;
+		unsigned int painter_revision;
+		unsigned int image_generation;
+	} RenderInputs;
+
+	RenderInputs render_inputs;
+
+	// False until the framebuffer holds a rendered frame
+	bool rendered;
+
+	RenderInputs get_render_inputs();
+
+	bool render_inputs_equal(const RenderInputs& a, const RenderInputs& b);
 
 public:
 
@@ -63,6 +89,8 @@ public:
 
 	void render();
 
+	bool needs_redraw();
+
 	void close();
 
 	float get_pos_x();
@@ -73,7 +101,5 @@ public:
 
 	bool is_mouse_on(double mx, double my);
 
-	std::vector < std::vector<cv::Point2f>> image_to_scene_pos(std::vector<std::vector<cv::Point2f>> quad_points);
-
 };
 
@@ -0,0 +1,310 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "PointMarkerRenderer.h"
+#include <algorithm>
+#include <iostream>
+
+// Offsets the template vertex by the point of the instance. Uses the fixed function matrices the panels set up.
+static const char* marker_vertex_shader =
+	"#version 130\n"
+	"in vec2 offset;\n"
+	"in vec2 point;\n"
+	"void main() {\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * vec4(point + offset, 0.0, 1.0);\n"
+	"}\n";
+
+static const char* marker_fragment_shader =
+	"#version 130\n"
+	"uniform vec4 color;\n"
+	"void main() {\n"
+	"	gl_FragColor = color;\n"
+	"}\n";
+
+/**
+* Compiles one shader stage
+*
+* @param type GL_VERTEX_SHADER or GL_FRAGMENT_SHADER
+* @param source GLSL source
+*
+* @return shader name, or 0 if it did not compile
+*/
+static GLuint compile_shader(GLenum type, const char* source) {
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE) {
+		char log[512];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		std::cout << "Point marker shader did not compile: " << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+/**
+* Creates a renderer for one layer of markers. GL objects are created on first use, so it can be constructed before
+* there is a GL context.
+*
+* @param radius half the side length of the square drawn around each point, in scene units
+* @param crosshair_size half the length of the crosshair lines, in scene units. 0 draws no crosshair.
+*/
+PointMarkerRenderer::PointMarkerRenderer(float radius, float crosshair_size) {
+	this->radius = radius;
+	this->crosshair_size = crosshair_size;
+
+	initialized = false;
+	instanced = false;
+	program = 0;
+	color_location = -1;
+	template_vbo = 0;
+	point_vbo = 0;
+	capacity = 0;
+	valid_count = 0;
+	draw_count = 0;
+
+	// Square outline
+	marker_template.push_back(cv::Point2f(-radius, -radius));
+	marker_template.push_back(cv::Point2f(-radius, radius));
+	marker_template.push_back(cv::Point2f(-radius, radius));
+	marker_template.push_back(cv::Point2f(radius, radius));
+	marker_template.push_back(cv::Point2f(radius, radius));
+	marker_template.push_back(cv::Point2f(radius, -radius));
+	marker_template.push_back(cv::Point2f(radius, -radius));
+	marker_template.push_back(cv::Point2f(-radius, -radius));
+
+	// Crosshair
+	if (crosshair_size > 0) {
+		marker_template.push_back(cv::Point2f(-crosshair_size, 0));
+		marker_template.push_back(cv::Point2f(crosshair_size, 0));
+		marker_template.push_back(cv::Point2f(0, crosshair_size));
+		marker_template.push_back(cv::Point2f(0, -crosshair_size));
+	}
+}
+
+/**
+* Creates the buffers, and the instancing shader if the context supports it
+*/
+void PointMarkerRenderer::init() {
+	initialized = true;
+
+	glGenBuffers(1, &point_vbo);
+
+	if (!GLEW_VERSION_3_3) {
+		return;
+	}
+
+	GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER, marker_vertex_shader);
+	GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER, marker_fragment_shader);
+	if (vertex_shader == 0 || fragment_shader == 0) {
+		glDeleteShader(vertex_shader);
+		glDeleteShader(fragment_shader);
+		return;
+	}
+
+	program = glCreateProgram();
+	glAttachShader(program, vertex_shader);
+	glAttachShader(program, fragment_shader);
+
+	// The template goes in attribute 0, which compatibility contexts require to be an array
+	glBindAttribLocation(program, 0, "offset");
+	glBindAttribLocation(program, 1, "point");
+	glLinkProgram(program);
+
+	glDeleteShader(vertex_shader);
+	glDeleteShader(fragment_shader);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE) {
+		std::cout << "Point marker shader did not link, drawing markers without instancing" << std::endl;
+		glDeleteProgram(program);
+		program = 0;
+		return;
+	}
+	color_location = glGetUniformLocation(program, "color");
+
+	glGenBuffers(1, &template_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, template_vbo);
+	glBufferData(GL_ARRAY_BUFFER, marker_template.size() * sizeof(cv::Point2f), marker_template.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	instanced = true;
+}
+
+/**
+* Get the size of the data stored per point
+*
+* @return bytes per point in the point buffer
+*/
+size_t PointMarkerRenderer::bytes_per_point() const {
+	return instanced ? sizeof(cv::Point2f) : marker_template.size() * sizeof(cv::Point2f);
+}
+
+/**
+* Marks points as changed, e.g. after points were erased or reprojected. They are uploaded again by the next update.
+*
+* @param first_changed index of the first point that changed. Every point after it is uploaded again too.
+*/
+void PointMarkerRenderer::invalidate(size_t first_changed) {
+	valid_count = std::min(valid_count, first_changed);
+}
+
+/**
+* Writes a range of points to the point buffer, which must be bound and large enough
+*
+* @param points all points of the layer
+* @param begin index of the first point to write
+* @param end index one past the last point to write
+*/
+void PointMarkerRenderer::upload(const cv::Point2f* points, size_t begin, size_t end) {
+	if (begin >= end) {
+		return;
+	}
+
+	if (instanced) {
+		glBufferSubData(GL_ARRAY_BUFFER, begin * bytes_per_point(), (end - begin) * bytes_per_point(), points + begin);
+		return;
+	}
+
+	// Without instancing every marker is expanded to its line vertices
+	std::vector<cv::Point2f> vertices((end - begin) * marker_template.size());
+	size_t v = 0;
+	for (size_t i = begin; i < end; i++) {
+		for (size_t j = 0; j < marker_template.size(); j++) {
+			vertices[v++] = points[i] + marker_template[j];
+		}
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, begin * bytes_per_point(), (end - begin) * bytes_per_point(), vertices.data());
+}
+
+/**
+* Brings the point buffer up to date with the points of the layer. Only points appended since the last update, or
+* marked with invalidate, are uploaded. Needs a current GL context.
+*
+* @param points points of the layer in scene coordinates
+* @param count number of points
+*/
+void PointMarkerRenderer::update(const cv::Point2f* points, size_t count) {
+	if (!initialized) {
+		init();
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, point_vbo);
+
+	if (count > capacity) {
+		// Grow geometrically so a stroke of appended points does not reallocate every frame
+		capacity = std::max(count, std::max(capacity * 2, (size_t)1024));
+		glBufferData(GL_ARRAY_BUFFER, capacity * bytes_per_point(), NULL, GL_DYNAMIC_DRAW);
+		valid_count = 0;
+	}
+
+	upload(points, std::min(valid_count, count), count);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	valid_count = count;
+	draw_count = count;
+}
+
+/**
+* Brings the point buffer up to date with the points of the layer
+*
+* @param points points of the layer in scene coordinates
+*/
+void PointMarkerRenderer::update(const std::vector<cv::Point2f>& points) {
+	update(points.data(), points.size());
+}
+
+/**
+* Draws every marker of the layer with a single draw call
+*
+* @param r red component of the marker color
+* @param g green component of the marker color
+* @param b blue component of the marker color
+*/
+void PointMarkerRenderer::draw(float r, float g, float b) {
+	if (draw_count == 0) {
+		return;
+	}
+
+	if (instanced) {
+		glUseProgram(program);
+		glUniform4f(color_location, r, g, b, 1.0f);
+
+		glBindBuffer(GL_ARRAY_BUFFER, template_vbo);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+
+		glBindBuffer(GL_ARRAY_BUFFER, point_vbo);
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+		glVertexAttribDivisor(1, 1);
+
+		glDrawArraysInstanced(GL_LINES, 0, (GLsizei)marker_template.size(), (GLsizei)draw_count);
+
+		glVertexAttribDivisor(1, 0);
+		glDisableVertexAttribArray(1);
+		glDisableVertexAttribArray(0);
+		glUseProgram(0);
+	}
+	else {
+		glColor3f(r, g, b);
+
+		glBindBuffer(GL_ARRAY_BUFFER, point_vbo);
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(2, GL_FLOAT, 0, NULL);
+
+		glDrawArrays(GL_LINES, 0, (GLsizei)(draw_count * marker_template.size()));
+
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glColor3f(1.0f, 1.0f, 1.0f);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+* Deletes the GL objects. Needs a current GL context. The renderer can be used again afterwards.
+*/
+void PointMarkerRenderer::release() {
+	if (initialized) {
+		glDeleteBuffers(1, &point_vbo);
+		glDeleteBuffers(1, &template_vbo);
+		glDeleteProgram(program);
+	}
+
+	initialized = false;
+	instanced = false;
+	program = 0;
+	template_vbo = 0;
+	point_vbo = 0;
+	capacity = 0;
+	valid_count = 0;
+	draw_count = 0;
+}
+
+/**
+* Check whether markers are drawn with instancing
+*
+* @return true if instancing is used, false if markers are expanded on the CPU
+*/
+bool PointMarkerRenderer::is_instanced() const {
+	return instanced;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <GL/glew.h>
+#include <GL/GL.h>
+#include <cstddef>
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+* The PointMarkerRenderer class draws a layer of point markers (a square outline with an optional crosshair at each
+* point) from a vertex buffer that persists between frames. Only points appended or changed since the last update
+* are uploaded, and the whole layer is drawn with one draw call.
+*
+* With GL 3.3 the buffer holds one position per point and the marker outline is instanced from a shared template.
+* Older contexts get the expanded line vertices of every marker instead, still drawn with a single call.
+*/
+class PointMarkerRenderer
+{
+private:
+	float radius;
+	float crosshair_size;
+
+	bool initialized;
+	bool instanced;
+
+	GLuint program;
+	GLint color_location;
+	GLuint template_vbo;
+	GLuint point_vbo;
+
+	// Line vertices of one marker, relative to its point
+	std::vector<cv::Point2f> marker_template;
+
+	// Points the buffer has room for
+	size_t capacity;
+
+	// Points at the front of the buffer that match the caller's points
+	size_t valid_count;
+
+	// Points drawn by draw()
+	size_t draw_count;
+
+	void init();
+
+	size_t bytes_per_point() const;
+
+	void upload(const cv::Point2f* points, size_t begin, size_t end);
+
+public:
+	PointMarkerRenderer(float radius, float crosshair_size);
+
+	void invalidate(size_t first_changed);
+
+	void update(const cv::Point2f* points, size_t count);
+
+	void update(const std::vector<cv::Point2f>& points);
+
+	void draw(float r, float g, float b);
+
+	void release();
+
+	bool is_instanced() const;
+};
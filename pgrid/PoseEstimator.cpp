@@ -0,0 +1,191 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "PoseEstimator.h"
+#include <algorithm>
+#include <cmath>
+#include <opencv2/calib3d.hpp>
+#include "GroundProjector.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/**
+* Creates a pose estimator
+*
+* @param reprojection_threshold largest reprojection error of an inlier in pixels
+* @param max_iters most RANSAC iterations
+* @param confidence RANSAC confidence
+*/
+PoseEstimator::PoseEstimator(double reprojection_threshold, int max_iters, double confidence) {
+	this->reprojection_threshold = reprojection_threshold;
+	this->max_iters = max_iters;
+	this->confidence = confidence;
+}
+
+/**
+* Solves the camera pose from image points and their world positions. The world points are scaled to cm
+* like the camera position is entered.
+*
+* @param img_points distorted points in image u v coordinates
+* @param world_points world positions of the same points in meters, same order
+* @param camera_intrinsic 3x3 camera intrinsic matrix of the camera profile
+* @param dist_coeffs distortion coefficients of the camera profile
+* @param solution receives the pose and the residual of every point
+*
+* @return POSE_SUCCESS, POSE_TOO_FEW_POINTS, POSE_SIZE_MISMATCH, POSE_NO_CAMERA_PROFILE or POSE_NO_SOLUTION
+*/
+int PoseEstimator::solve(const std::vector<cv::Point2f>& img_points, const std::vector<cv::Point3f>& world_points,
+	const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, PoseSolution& solution) const {
+	solution.pose = CameraPose();
+	solution.rvec.release();
+	solution.tvec.release();
+	solution.residuals.clear();
+	solution.inliers.clear();
+	solution.inlier_count = 0;
+	solution.inlier_rms = 0;
+
+	if (img_points.size() != world_points.size()) {
+		return POSE_SIZE_MISMATCH;
+	}
+	if (img_points.size() < 4) {
+		return POSE_TOO_FEW_POINTS;
+	}
+	if (camera_intrinsic.total() != 9) {
+		return POSE_NO_CAMERA_PROFILE;
+	}
+
+	std::vector<cv::Point3f> object_points(world_points.size());
+	for (size_t i = 0; i < world_points.size(); i++) {
+		object_points[i] = world_points[i] * 100.0f;
+	}
+
+	cv::Mat rvec, tvec;
+	std::vector<int> inlier_indices;
+	bool found = false;
+	try {
+		found = cv::solvePnPRansac(object_points, img_points, camera_intrinsic, dist_coeffs, rvec, tvec, false,
+			max_iters, (float)reprojection_threshold, confidence, inlier_indices, cv::SOLVEPNP_AP3P);
+	}
+	catch (const cv::Exception&) {
+		found = false;
+	}
+	if (!found || inlier_indices.size() < 4) {
+		return POSE_NO_SOLUTION;
+	}
+
+	// Refine on the inliers with Levenberg-Marquardt, starting from the RANSAC pose
+	std::vector<cv::Point3f> inlier_object_points;
+	std::vector<cv::Point2f> inlier_img_points;
+	for (size_t i = 0; i < inlier_indices.size(); i++) {
+		inlier_object_points.push_back(object_points[inlier_indices[i]]);
+		inlier_img_points.push_back(img_points[inlier_indices[i]]);
+	}
+	cv::solvePnP(inlier_object_points, inlier_img_points, camera_intrinsic, dist_coeffs, rvec, tvec, true,
+		cv::SOLVEPNP_ITERATIVE);
+
+	CameraPose pose = pose_from_extrinsics(rvec, tvec);
+
+	// The mirror image of a planar target solves too, but puts the camera under the ground
+	if (!(pose.z_pos > 0)) {
+		return POSE_NO_SOLUTION;
+	}
+
+	std::vector<cv::Point2f> reprojected;
+	cv::projectPoints(object_points, rvec, tvec, camera_intrinsic, dist_coeffs, reprojected);
+
+	double squared_sum = 0;
+	solution.residuals.resize(img_points.size());
+	solution.inliers.resize(img_points.size());
+	for (size_t i = 0; i < img_points.size(); i++) {
+		solution.residuals[i] = cv::norm(reprojected[i] - img_points[i]);
+		solution.inliers[i] = solution.residuals[i] <= reprojection_threshold;
+		if (solution.inliers[i]) {
+			solution.inlier_count++;
+			squared_sum += solution.residuals[i] * solution.residuals[i];
+		}
+	}
+	solution.inlier_rms = solution.inlier_count > 0 ? std::sqrt(squared_sum / solution.inlier_count) : 0;
+
+	solution.pose = pose;
+	solution.rvec = rvec;
+	solution.tvec = tvec;
+	return POSE_SUCCESS;
+}
+
+/**
+* Converts a world to camera transform, as solvePnP returns it, to a camera pose. This is the inverse of the camera
+* rotation GroundProjector builds: the pitch and yaw follow from the optical axis, the roll from the camera x axis.
+*
+* @param rvec world to camera rotation (Rodrigues vector)
+* @param tvec world to camera translation in cm
+*
+* @return camera position in cm and roll, pitch and yaw in degrees
+*/
+CameraPose PoseEstimator::pose_from_extrinsics(const cv::Mat& rvec, const cv::Mat& tvec) {
+	cv::Mat rvec_64f, tvec_64f;
+	rvec.convertTo(rvec_64f, CV_64F);
+	tvec.convertTo(tvec_64f, CV_64F);
+
+	cv::Matx33d world_to_camera;
+	cv::Rodrigues(rvec_64f, world_to_camera);
+	cv::Matx33d camera_to_world = world_to_camera.t();
+
+	// The camera is at -R^T * t
+	cv::Vec3d translation(tvec_64f.ptr<double>());
+	cv::Vec3d position = -(camera_to_world * translation);
+
+	// Optical axis and x axis of the camera in world coordinates
+	cv::Vec3d forward(camera_to_world(0, 2), camera_to_world(1, 2), camera_to_world(2, 2));
+	cv::Vec3d right(camera_to_world(0, 0), camera_to_world(1, 0), camera_to_world(2, 0));
+
+	double pitch = std::asin(std::min(1.0, std::max(-1.0, forward[2])));
+	double yaw = std::atan2(forward[0], forward[1]);
+
+	// Right and up directions of the camera if it was not rolled
+	cv::Vec3d level_right(std::cos(yaw), -std::sin(yaw), 0);
+	cv::Vec3d level_up(-std::sin(yaw) * std::sin(pitch), -std::cos(yaw) * std::sin(pitch), std::cos(pitch));
+	double roll = std::atan2(-right.dot(level_up), right.dot(level_right));
+
+	CameraPose pose = CameraPose();
+	pose.x_pos = position[0];
+	pose.y_pos = position[1];
+	pose.z_pos = position[2];
+	pose.roll_angle = roll * 180 / M_PI;
+	pose.pitch_angle = pitch * 180 / M_PI;
+	pose.yaw_angle = yaw * 180 / M_PI;
+	return pose;
+}
+
+/**
+* Converts a camera pose to the world to camera transform solvePnP and projectPoints use
+*
+* @param camera_pose camera position in cm and rotation in degrees
+* @param rvec receives the world to camera rotation (Rodrigues vector)
+* @param tvec receives the world to camera translation in cm
+*/
+void PoseEstimator::extrinsics_from_pose(const CameraPose& camera_pose, cv::Mat& rvec, cv::Mat& tvec) {
+	cv::Matx33d world_to_camera = GroundProjector::camera_to_world_rotation(camera_pose).t();
+	cv::Vec3d position(camera_pose.x_pos, camera_pose.y_pos, camera_pose.z_pos);
+
+	cv::Rodrigues(cv::Mat(world_to_camera), rvec);
+	tvec = cv::Mat(-(world_to_camera * position));
+}
+
+double PoseEstimator::get_reprojection_threshold() const {
+	return reprojection_threshold;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include <opencv2/core.hpp>
+#include "CameraPose.h"
+
+#define POSE_SUCCESS 0
+#define POSE_TOO_FEW_POINTS 1
+#define POSE_SIZE_MISMATCH 2
+#define POSE_NO_SOLUTION 3
+#define POSE_NO_CAMERA_PROFILE 4
+
+// Camera pose solved from marker corners, with the reprojection error of every corner under it
+typedef struct {
+	CameraPose pose;
+
+	// World to camera rotation (Rodrigues vector) and translation in cm, as solvePnP returns them
+	cv::Mat rvec;
+	cv::Mat tvec;
+
+	// Distance between each world point projected with the pose and its image point, in pixels
+	std::vector<double> residuals;
+
+	// 1 for points with a residual within the reprojection threshold
+	std::vector<unsigned char> inliers;
+
+	int inlier_count;
+
+	// RMS residual of the inliers in pixels
+	double inlier_rms;
+} PoseSolution;
+
+/**
+* The PoseEstimator class solves the position and rotation of the camera from points on the ground with known world
+* positions, usually the corners of the markers, using the intrinsics and lens distortion of the camera profile.
+* solvePnPRansac finds the pose and the corners that agree with it, and the pose is refined on those corners.
+*
+* The solved pose is returned as a CameraPose (cm and degrees, roll then pitch then yaw) that projects with
+* GroundProjector. Nothing is shared between calls, so one estimator may be used from several threads at once.
+*/
+class PoseEstimator
+{
+private:
+	// Largest reprojection error of an inlier in pixels
+	double reprojection_threshold;
+
+	// Most RANSAC iterations
+	int max_iters;
+
+	// RANSAC confidence
+	double confidence;
+
+public:
+	PoseEstimator(double reprojection_threshold = 8, int max_iters = 1000, double confidence = 0.995);
+
+	int solve(const std::vector<cv::Point2f>& img_points, const std::vector<cv::Point3f>& world_points,
+		const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, PoseSolution& solution) const;
+
+	static CameraPose pose_from_extrinsics(const cv::Mat& rvec, const cv::Mat& tvec);
+
+	static void extrinsics_from_pose(const CameraPose& camera_pose, cv::Mat& rvec, cv::Mat& tvec);
+
+	double get_reprojection_threshold() const;
+};
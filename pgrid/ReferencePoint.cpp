@@ -15,6 +15,10 @@ limitations under the License.
 ***********************************************************************/
 
 #include "ReferencePoint.h"
+#include <GL/glew.h>
+#include <GL/GL.h>
+#include <glfw3.h>
+#include <imgui.h>
 
 ReferencePoint::ReferencePoint(SessionConfig* session_config, double x, double y, int idx) {
 	grid_config = session_config->grid_config;
@@ -1,8 +1,4 @@
 #pragma once
-#include <GL/glew.h>
-#include <GL/GL.h>
-#include <glfw3.h>
-#include <imgui.h>
 #include "Config.h"
 
 class ReferencePoint
@@ -0,0 +1,384 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "SpatialIndex.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+* Creates an empty spatial index
+*
+* @param cell_size side length of a grid cell in scene coordinates. Should be on the order of the query radius.
+*/
+SpatialIndex::SpatialIndex(float cell_size) {
+	this->cell_size = cell_size;
+	this->inv_cell_size = 1.0f / cell_size;
+	bucket_mask = 0;
+	bucket_start.assign(2, 0);
+}
+
+/**
+* Get the grid cell coordinate of a position along one axis
+*
+* @param v x or y position in scene coordinates
+*
+* @return cell coordinate, clamped so far away points do not overflow
+*/
+int SpatialIndex::cell_coord(float v) const {
+	double c = std::floor((double)v * inv_cell_size);
+	c = std::max(-1073741824.0, std::min(1073741823.0, c));
+	return (int)c;
+}
+
+/**
+* Get the bucket a grid cell is stored in. Several cells can share a bucket, so entries read from a bucket
+* still have to be checked against the cell.
+*
+* @param cell_x x cell coordinate
+* @param cell_y y cell coordinate
+*
+* @return bucket index
+*/
+size_t SpatialIndex::bucket_of(int cell_x, int cell_y) const {
+	uint32_t h = ((uint32_t)cell_x * 73856093u) ^ ((uint32_t)cell_y * 19349663u);
+	return (size_t)h & bucket_mask;
+}
+
+/**
+* Redistributes entries into buckets with a counting sort. The bucket count is the next power of two above the
+* number of entries, so buckets hold about one cell each.
+*
+* @param all_entries entries to index. The vector is reused as scratch space.
+*/
+void SpatialIndex::rebuild(std::vector<Entry>& all_entries) {
+	size_t bucket_count = 16;
+	while (bucket_count < all_entries.size()) {
+		bucket_count *= 2;
+	}
+	bucket_mask = bucket_count - 1;
+
+	// Count the entries in each bucket
+	bucket_start.assign(bucket_count + 1, 0);
+	for (size_t i = 0; i < all_entries.size(); i++) {
+		bucket_start[bucket_of(cell_coord(all_entries[i].x), cell_coord(all_entries[i].y)) + 1]++;
+	}
+
+	// Turn the counts into offsets
+	for (size_t b = 0; b < bucket_count; b++) {
+		bucket_start[b + 1] += bucket_start[b];
+	}
+
+	// Place each entry in its bucket
+	std::vector<size_t> next(bucket_start.begin(), bucket_start.end() - 1);
+	entries.resize(all_entries.size());
+	for (size_t i = 0; i < all_entries.size(); i++) {
+		size_t b = bucket_of(cell_coord(all_entries[i].x), cell_coord(all_entries[i].y));
+		entries[next[b]++] = all_entries[i];
+	}
+
+	pending.clear();
+}
+
+/**
+* Drops the removed entries from the buckets and renumbers the remaining ones to their current indices. The
+* buckets are compacted in place, nothing is rehashed.
+*/
+void SpatialIndex::compact() {
+	if (removed.empty()) {
+		return;
+	}
+
+	size_t write = 0;
+	size_t read = 0;
+	size_t bucket_count = bucket_start.size() - 1;
+	for (size_t b = 0; b < bucket_count; b++) {
+		size_t end = bucket_start[b + 1];
+		bucket_start[b] = write;
+		for (; read < end; read++) {
+			if (current_index(entries[read].idx, entries[read].idx)) {
+				entries[write++] = entries[read];
+			}
+		}
+	}
+	bucket_start[bucket_count] = write;
+	entries.resize(write);
+
+	write = 0;
+	for (read = 0; read < pending.size(); read++) {
+		if (current_index(pending[read].idx, pending[read].idx)) {
+			pending[write++] = pending[read];
+		}
+	}
+	pending.resize(write);
+
+	removed.clear();
+}
+
+/**
+* Maps the index stored in an entry to the current index of the point, i.e. shifts it down by the number of
+* points removed before it
+*
+* @param entry_idx index stored in the entry
+* @param idx set to the current index of the point
+*
+* @return false if the point has been removed
+*/
+bool SpatialIndex::current_index(int entry_idx, int& idx) const {
+	if (removed.empty() || entry_idx < removed.front()) {
+		idx = entry_idx;
+		return true;
+	}
+
+	std::vector<int>::const_iterator it = std::lower_bound(removed.begin(), removed.end(), entry_idx);
+	if (it != removed.end() && *it == entry_idx) {
+		return false;
+	}
+
+	idx = entry_idx - (int)(it - removed.begin());
+	return true;
+}
+
+/**
+* Replaces the contents of the index with an array of points. Each point is indexed by its position in the array.
+*
+* @param points array of points in scene coordinates
+* @param count number of points
+*/
+void SpatialIndex::build(const cv::Point2f* points, size_t count) {
+	std::vector<Entry> all_entries(count);
+	for (size_t i = 0; i < count; i++) {
+		all_entries[i].x = points[i].x;
+		all_entries[i].y = points[i].y;
+		all_entries[i].idx = (int)i;
+	}
+	removed.clear();
+	rebuild(all_entries);
+}
+
+/**
+* Replaces the contents of the index with a vector of points. Each point is indexed by its position in the vector.
+*
+* @param points vector of points in scene coordinates
+*/
+void SpatialIndex::build(const std::vector<cv::Point2f>& points) {
+	build(points.data(), points.size());
+}
+
+/**
+* Adds a point appended to the end of the indexed array. The buckets are rebuilt once enough points have been
+* inserted, so inserting is amortized constant time.
+*
+* @param idx position the point was appended at, i.e. the number of points before it
+* @param x x position in scene coordinates
+* @param y y position in scene coordinates
+*/
+void SpatialIndex::insert(int idx, float x, float y) {
+	Entry entry;
+	entry.x = x;
+	entry.y = y;
+
+	// Stored indices count the removed points too, and all of them come before an appended point
+	entry.idx = idx + (int)removed.size();
+	pending.push_back(entry);
+
+	if (pending.size() > std::max((size_t)256, entries.size() / 4)) {
+		compact();
+
+		std::vector<Entry> all_entries;
+		all_entries.reserve(entries.size() + pending.size());
+		all_entries.insert(all_entries.end(), entries.begin(), entries.end());
+		all_entries.insert(all_entries.end(), pending.begin(), pending.end());
+		rebuild(all_entries);
+	}
+}
+
+/**
+* Removes points from the index. The remaining points are renumbered the same way as removing the points from
+* the indexed array does (every index after a removed point moves down by one). Removals are only recorded,
+* the buckets are compacted once enough of them pile up.
+*
+* @param sorted_indices current indices of the points to remove, sorted in ascending order without duplicates
+*/
+void SpatialIndex::remove(const std::vector<int>& sorted_indices) {
+	if (sorted_indices.empty()) {
+		return;
+	}
+
+	// Convert the current indices to stored indices. j counts the earlier removals before the point.
+	std::vector<int> stored(sorted_indices.size());
+	size_t j = 0;
+	for (size_t i = 0; i < sorted_indices.size(); i++) {
+		while (j < removed.size() && removed[j] <= sorted_indices[i] + (int)j) {
+			j++;
+		}
+		stored[i] = sorted_indices[i] + (int)j;
+	}
+
+	std::vector<int> merged(removed.size() + stored.size());
+	std::merge(removed.begin(), removed.end(), stored.begin(), stored.end(), merged.begin());
+	removed.swap(merged);
+
+	if (removed.size() > std::max((size_t)1024, entries.size() / 16)) {
+		compact();
+	}
+}
+
+/**
+* Removes all points from the index
+*/
+void SpatialIndex::clear() {
+	entries.clear();
+	pending.clear();
+	removed.clear();
+	bucket_mask = 0;
+	bucket_start.assign(2, 0);
+}
+
+/**
+* Adds an entry found by a query to the results with its current index, unless the point has been removed
+*
+* @param entry entry found by the query
+* @param result query results
+*/
+void SpatialIndex::push_current(const Entry& entry, std::vector<Entry>& result) const {
+	Entry current = entry;
+	if (current_index(entry.idx, current.idx)) {
+		result.push_back(current);
+	}
+}
+
+/**
+* Finds the entries of all points within a radius of a position
+*
+* @param x x position in scene coordinates
+* @param y y position in scene coordinates
+* @param radius search radius in scene coordinates. Points exactly on the radius are included.
+* @param result cleared and filled with the entries found with their current indices, in no particular order
+*/
+void SpatialIndex::find_entries(float x, float y, float radius, std::vector<Entry>& result) const {
+	result.clear();
+
+	if (radius < 0) {
+		return;
+	}
+
+	const double r2 = (double)radius * radius;
+
+	int cell_x0 = cell_coord(x - radius);
+	int cell_x1 = cell_coord(x + radius);
+	int cell_y0 = cell_coord(y - radius);
+	int cell_y1 = cell_coord(y + radius);
+
+	double cell_count = ((double)cell_x1 - cell_x0 + 1) * ((double)cell_y1 - cell_y0 + 1);
+
+	if (cell_count > (double)(bucket_mask + 1)) {
+		// The circle covers more cells than there are buckets, a linear scan is cheaper
+		for (size_t i = 0; i < entries.size(); i++) {
+			double dx = entries[i].x - x;
+			double dy = entries[i].y - y;
+			if (dx * dx + dy * dy <= r2) {
+				push_current(entries[i], result);
+			}
+		}
+	}
+	else {
+		for (int cell_y = cell_y0; cell_y <= cell_y1; cell_y++) {
+			for (int cell_x = cell_x0; cell_x <= cell_x1; cell_x++) {
+				size_t b = bucket_of(cell_x, cell_y);
+
+				for (size_t i = bucket_start[b]; i < bucket_start[b + 1]; i++) {
+					const Entry& e = entries[i];
+
+					// Skip entries from other cells that share the bucket so no point is reported twice
+					if (cell_coord(e.x) != cell_x || cell_coord(e.y) != cell_y) {
+						continue;
+					}
+
+					double dx = e.x - x;
+					double dy = e.y - y;
+					if (dx * dx + dy * dy <= r2) {
+						push_current(e, result);
+					}
+				}
+			}
+		}
+	}
+
+	for (size_t i = 0; i < pending.size(); i++) {
+		double dx = pending[i].x - x;
+		double dy = pending[i].y - y;
+		if (dx * dx + dy * dy <= r2) {
+			push_current(pending[i], result);
+		}
+	}
+}
+
+/**
+* Finds all points within a radius of a position
+*
+* @param x x position in scene coordinates
+* @param y y position in scene coordinates
+* @param radius search radius in scene coordinates. Points exactly on the radius are included.
+* @param result cleared and filled with the indices of the points found, in no particular order
+*/
+void SpatialIndex::query_radius(float x, float y, float radius, std::vector<int>& result) const {
+	std::vector<Entry> found;
+	find_entries(x, y, radius, found);
+
+	result.resize(found.size());
+	for (size_t i = 0; i < found.size(); i++) {
+		result[i] = found[i].idx;
+	}
+}
+
+/**
+* Finds the point closest to a position
+*
+* @param x x position in scene coordinates
+* @param y y position in scene coordinates
+* @param radius search radius in scene coordinates
+*
+* @return index of the closest point within the radius, or -1 if there is none
+*/
+int SpatialIndex::nearest(float x, float y, float radius) const {
+	std::vector<Entry> found;
+	find_entries(x, y, radius, found);
+
+	int best_idx = -1;
+	double best_d2 = 0;
+	for (size_t i = 0; i < found.size(); i++) {
+		double dx = found[i].x - x;
+		double dy = found[i].y - y;
+		double d2 = dx * dx + dy * dy;
+
+		// Ties go to the lowest index so the result does not depend on bucket order
+		if (best_idx < 0 || d2 < best_d2 || (d2 == best_d2 && found[i].idx < best_idx)) {
+			best_idx = found[i].idx;
+			best_d2 = d2;
+		}
+	}
+
+	return best_idx;
+}
+
+/**
+* Get the number of points in the index
+*
+* @return number of points
+*/
+size_t SpatialIndex::size() const {
+	return entries.size() + pending.size() - removed.size();
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <opencv2/core.hpp>
+
+/**
+* The SpatialIndex class is a uniform grid spatial hash over 2D points in scene coordinates. Points are bucketed
+* by the grid cell they fall in, so a radius query only looks at the handful of cells the circle overlaps
+* instead of every point.
+*
+* The index refers to points by their position in the array the caller keeps them in. Buckets are stored
+* compactly (one entry array plus bucket offsets), which makes building the index two linear passes without
+* any per-cell allocation. Appended points go to a small pending list that is searched linearly, and removed
+* points are only recorded, so both are amortized constant time. The buckets are rebuilt or compacted once
+* enough changes pile up.
+*/
+class SpatialIndex
+{
+private:
+	typedef struct {
+		float x;
+		float y;
+		int idx;
+	} Entry;
+
+	float cell_size;
+	float inv_cell_size;
+
+	// Entries of bucket b are entries[bucket_start[b]] to entries[bucket_start[b + 1] - 1]
+	std::vector<Entry> entries;
+	std::vector<size_t> bucket_start;
+	size_t bucket_mask;
+
+	// Entries inserted since the last build
+	std::vector<Entry> pending;
+
+	// Entry indices removed since the buckets were last compacted, sorted. The entries still store the indices
+	// the points had before these removals, and are mapped to current indices when a query finds them.
+	std::vector<int> removed;
+
+	int cell_coord(float v) const;
+
+	size_t bucket_of(int cell_x, int cell_y) const;
+
+	void rebuild(std::vector<Entry>& all_entries);
+
+	void compact();
+
+	bool current_index(int entry_idx, int& idx) const;
+
+	void push_current(const Entry& entry, std::vector<Entry>& result) const;
+
+	void find_entries(float x, float y, float radius, std::vector<Entry>& result) const;
+
+public:
+	SpatialIndex(float cell_size);
+
+	void build(const cv::Point2f* points, size_t count);
+
+	void build(const std::vector<cv::Point2f>& points);
+
+	void insert(int idx, float x, float y);
+
+	void remove(const std::vector<int>& sorted_indices);
+
+	void clear();
+
+	void query_radius(float x, float y, float radius, std::vector<int>& result) const;
+
+	int nearest(float x, float y, float radius) const;
+
+	size_t size() const;
+};
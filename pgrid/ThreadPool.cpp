@@ -0,0 +1,121 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "ThreadPool.h"
+
+/**
+* Starts the worker threads
+*
+* @param thread_count number of worker threads. 0 uses one thread per hardware thread.
+*/
+ThreadPool::ThreadPool(size_t thread_count) {
+	unfinished = 0;
+	stopping = false;
+
+	if (thread_count == 0) {
+		thread_count = default_thread_count();
+	}
+
+	for (size_t i = 0; i < thread_count; i++) {
+		workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+	}
+}
+
+/**
+* Finishes all submitted tasks and joins the worker threads
+*/
+ThreadPool::~ThreadPool() {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	task_available.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		workers[i].join();
+	}
+}
+
+/**
+* Takes tasks off the queue and runs them until the pool is destroyed and the queue is empty
+*/
+void ThreadPool::worker_loop() {
+	while (true) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			task_available.wait(lock, [this] { return stopping || !tasks.empty(); });
+
+			if (tasks.empty()) {
+				return;
+			}
+
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+
+		task();
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			unfinished--;
+			if (unfinished == 0) {
+				tasks_done.notify_all();
+			}
+		}
+	}
+}
+
+/**
+* Queues a task to run on one of the worker threads
+*
+* @param task function to run. Must not throw.
+*/
+void ThreadPool::submit(std::function<void()> task) {
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		tasks.push_back(std::move(task));
+		unfinished++;
+	}
+	task_available.notify_one();
+}
+
+/**
+* Blocks until every submitted task has finished
+*/
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> lock(mutex);
+	tasks_done.wait(lock, [this] { return unfinished == 0; });
+}
+
+/**
+* Get the number of worker threads
+*
+* @return number of worker threads
+*/
+size_t ThreadPool::size() const {
+	return workers.size();
+}
+
+/**
+* Get the number of threads to use when no thread count is given
+*
+* @return number of hardware threads, or 1 if it cannot be determined
+*/
+size_t ThreadPool::default_thread_count() {
+	unsigned int hardware_threads = std::thread::hardware_concurrency();
+	return hardware_threads > 0 ? hardware_threads : 1;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* The ThreadPool class runs tasks on a fixed set of worker threads. Tasks are started in the order they are
+* submitted. Tasks report their results through whatever they capture, the pool itself only tracks whether
+* they are done.
+*/
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> tasks;
+
+	std::mutex mutex;
+	std::condition_variable task_available;
+	std::condition_variable tasks_done;
+
+	// Number of tasks queued or running
+	size_t unfinished;
+	bool stopping;
+
+	void worker_loop();
+
+public:
+	ThreadPool(size_t thread_count = 0);
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+
+	void wait();
+
+	size_t size() const;
+
+	static size_t default_thread_count();
+};
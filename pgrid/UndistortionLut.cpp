@@ -0,0 +1,266 @@
+/***********************************************************************
+Copyright 2023 Insurance Institute for Highway Safety
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+***********************************************************************/
+
+#include "UndistortionLut.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <opencv2/calib3d.hpp>
+#include "ThreadPool.h"
+
+// First bytes of a cache file, followed by the format version
+#define LUT_FILE_MAGIC "PGRIDLUT"
+#define LUT_FILE_VERSION 1
+
+// Rows of nodes solved by one task
+#define LUT_ROWS_PER_TASK 8
+
+/**
+* Copies the distortion coefficients of a profile into a flat vector, whatever the shape of the Mat
+*
+* @param dist_coeffs distortion coefficients, 4, 5, 8, 12 or 14 values or empty
+*
+* @return coefficients as doubles
+*/
+static std::vector<double> flatten_coeffs(const cv::Mat& dist_coeffs) {
+	std::vector<double> coeffs;
+	if (dist_coeffs.empty()) {
+		return coeffs;
+	}
+	cv::Mat flat;
+	dist_coeffs.reshape(1, 1).convertTo(flat, CV_64F);
+	coeffs.assign(flat.ptr<double>(), flat.ptr<double>() + flat.cols);
+	return coeffs;
+}
+
+UndistortionLut::UndistortionLut() {
+	std::fill(camera_matrix, camera_matrix + 9, 0.0);
+	step = 0;
+	nodes_x = 0;
+	nodes_y = 0;
+}
+
+/**
+* Builds the table by undistorting every node of the grid. Blocks of rows are solved in parallel on a thread pool.
+*
+* @param camera_intrinsic 3x3 camera intrinsic matrix
+* @param dist_coeffs distortion coefficients of the camera
+* @param image_size size of the images the intrinsics are for
+* @param step distance between nodes in pixels
+* @param thread_count number of threads to build with, 0 for one per hardware thread
+*
+* @return LUT_SUCCESS, or LUT_MISMATCH if the image size or step is not positive
+*/
+int UndistortionLut::build(const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, cv::Size image_size, int step,
+	size_t thread_count) {
+	if (image_size.width <= 0 || image_size.height <= 0 || step <= 0) {
+		printf("Error: cannot build an undistortion table for %d x %d pixels every %d pixels\n",
+			image_size.width, image_size.height, step);
+		return LUT_MISMATCH;
+	}
+
+	cv::Mat k;
+	camera_intrinsic.convertTo(k, CV_64F);
+	for (int i = 0; i < 9; i++) {
+		camera_matrix[i] = k.at<double>(i / 3, i % 3);
+	}
+	this->dist_coeffs = flatten_coeffs(dist_coeffs);
+	this->image_size = image_size;
+	this->step = step;
+
+	nodes_x = (image_size.width + step - 1) / step + 1;
+	nodes_y = (image_size.height + step - 1) / step + 1;
+	rays.resize((size_t)nodes_x * nodes_y);
+
+	// The default 5 iterations of undistortPoints leave errors of several pixels near the corners of wide angle
+	// lenses, the table is built once so it can afford to converge
+	const cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 100, 1e-10);
+	const cv::Mat coeffs = this->dist_coeffs.empty() ? cv::Mat() : cv::Mat(this->dist_coeffs);
+
+	ThreadPool pool(thread_count);
+	for (int first_row = 0; first_row < nodes_y; first_row += LUT_ROWS_PER_TASK) {
+		pool.submit([&, first_row] {
+			int last_row = std::min(first_row + LUT_ROWS_PER_TASK, nodes_y);
+			size_t begin = (size_t)first_row * nodes_x;
+			size_t count = (size_t)(last_row - first_row) * nodes_x;
+
+			std::vector<cv::Point2f> pixels;
+			pixels.reserve(count);
+			for (int j = first_row; j < last_row; j++) {
+				for (int i = 0; i < nodes_x; i++) {
+					pixels.push_back(cv::Point2f((float)(i * step), (float)(j * step)));
+				}
+			}
+
+			// Header over this task's rows, so each task writes its own part of the table
+			cv::Mat block((int)count, 1, CV_32FC2, &rays[begin]);
+			cv::undistortPoints(pixels, block, k, coeffs, cv::noArray(), cv::noArray(), criteria);
+		});
+	}
+	pool.wait();
+
+	return LUT_SUCCESS;
+}
+
+/**
+* Checks whether the table was built for the given camera and grid
+*
+* @param camera_intrinsic 3x3 camera intrinsic matrix
+* @param dist_coeffs distortion coefficients of the camera
+* @param image_size size of the images the intrinsics are for
+* @param step distance between nodes in pixels
+*
+* @return true if the table can be used as is
+*/
+bool UndistortionLut::matches(const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, cv::Size image_size, int step) const {
+	if (empty() || this->image_size != image_size || this->step != step || camera_intrinsic.total() != 9) {
+		return false;
+	}
+
+	cv::Mat k;
+	camera_intrinsic.convertTo(k, CV_64F);
+	for (int i = 0; i < 9; i++) {
+		if (camera_matrix[i] != k.at<double>(i / 3, i % 3)) {
+			return false;
+		}
+	}
+
+	return this->dist_coeffs == flatten_coeffs(dist_coeffs);
+}
+
+/**
+* Looks up the normalized camera rays of distorted image points. img_points and rays may be the same array.
+*
+* @param img_points distorted points in image u v coordinates
+* @param rays receives the undistorted points in normalized camera coordinates
+* @param count number of points
+*/
+void UndistortionLut::lookup(const cv::Point2f* img_points, cv::Point2f* rays, size_t count) const {
+	const float inv_step = 1.0f / (float)step;
+	const int max_cell_x = nodes_x - 2;
+	const int max_cell_y = nodes_y - 2;
+	const cv::Point2f* table = this->rays.data();
+
+	for (size_t i = 0; i < count; i++) {
+		const float gx = img_points[i].x * inv_step;
+		const float gy = img_points[i].y * inv_step;
+
+		// Points outside the grid use the nearest cell, so the weights extrapolate past 0 and 1
+		const int cx = std::min(std::max((int)std::floor(gx), 0), max_cell_x);
+		const int cy = std::min(std::max((int)std::floor(gy), 0), max_cell_y);
+		const float tx = gx - (float)cx;
+		const float ty = gy - (float)cy;
+
+		const cv::Point2f* row0 = table + (size_t)cy * nodes_x + cx;
+		const cv::Point2f* row1 = row0 + nodes_x;
+
+		const cv::Point2f top = row0[0] + (row0[1] - row0[0]) * tx;
+		const cv::Point2f bottom = row1[0] + (row1[1] - row1[0]) * tx;
+		rays[i] = top + (bottom - top) * ty;
+	}
+}
+
+/**
+* Reads a table from a cache file written by save. Use matches to check it belongs to the current profile.
+*
+* @param path cache file
+*
+* @return LUT_SUCCESS, or LUT_FILE_ERROR if the file is missing, damaged or from another version
+*/
+int UndistortionLut::load(const std::string& path) {
+	std::ifstream infile(path, std::ios::in | std::ios::binary);
+	if (!infile.is_open()) {
+		return LUT_FILE_ERROR;
+	}
+
+	char magic[8];
+	uint32_t version = 0;
+	int32_t header[5]; // width, height, step, nodes_x, nodes_y
+	uint32_t coeff_count = 0;
+
+	infile.read(magic, sizeof(magic));
+	infile.read((char*)&version, sizeof(version));
+	infile.read((char*)header, sizeof(header));
+	infile.read((char*)&coeff_count, sizeof(coeff_count));
+	if (!infile || memcmp(magic, LUT_FILE_MAGIC, sizeof(magic)) != 0 || version != LUT_FILE_VERSION ||
+		coeff_count > 14 || header[0] <= 0 || header[1] <= 0 || header[2] <= 0 ||
+		header[3] != (header[0] + header[2] - 1) / header[2] + 1 || header[4] != (header[1] + header[2] - 1) / header[2] + 1) {
+		return LUT_FILE_ERROR;
+	}
+
+	UndistortionLut lut;
+	lut.image_size = cv::Size(header[0], header[1]);
+	lut.step = header[2];
+	lut.nodes_x = header[3];
+	lut.nodes_y = header[4];
+	lut.dist_coeffs.resize(coeff_count);
+	lut.rays.resize((size_t)lut.nodes_x * lut.nodes_y);
+
+	infile.read((char*)lut.camera_matrix, sizeof(lut.camera_matrix));
+	infile.read((char*)lut.dist_coeffs.data(), coeff_count * sizeof(double));
+	infile.read((char*)lut.rays.data(), lut.rays.size() * sizeof(cv::Point2f));
+	if (!infile) {
+		return LUT_FILE_ERROR;
+	}
+
+	*this = std::move(lut);
+	return LUT_SUCCESS;
+}
+
+/**
+* Writes the table to a cache file. The file holds the intrinsics it was built for, so a stale cache is detected
+* when it is loaded.
+*
+* @param path cache file
+*
+* @return LUT_SUCCESS, or LUT_FILE_ERROR if the file could not be written
+*/
+int UndistortionLut::save(const std::string& path) const {
+	std::ofstream outfile(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!outfile.is_open()) {
+		return LUT_FILE_ERROR;
+	}
+
+	const uint32_t version = LUT_FILE_VERSION;
+	const int32_t header[5] = { image_size.width, image_size.height, step, nodes_x, nodes_y };
+	const uint32_t coeff_count = (uint32_t)dist_coeffs.size();
+
+	outfile.write(LUT_FILE_MAGIC, 8);
+	outfile.write((const char*)&version, sizeof(version));
+	outfile.write((const char*)header, sizeof(header));
+	outfile.write((const char*)&coeff_count, sizeof(coeff_count));
+	outfile.write((const char*)camera_matrix, sizeof(camera_matrix));
+	outfile.write((const char*)dist_coeffs.data(), coeff_count * sizeof(double));
+	outfile.write((const char*)rays.data(), rays.size() * sizeof(cv::Point2f));
+	outfile.close();
+
+	return outfile ? LUT_SUCCESS : LUT_FILE_ERROR;
+}
+
+bool UndistortionLut::empty() const {
+	return rays.empty();
+}
+
+int UndistortionLut::get_step() const {
+	return step;
+}
+
+cv::Size UndistortionLut::get_image_size() const {
+	return image_size;
+}
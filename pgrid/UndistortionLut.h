@@ -0,0 +1,54 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#define LUT_SUCCESS 0
+#define LUT_FILE_ERROR 1
+#define LUT_MISMATCH 2
+
+/**
+* The UndistortionLut class maps distorted image pixels to normalized camera rays (x / z, y / z) of one camera
+* profile. cv::undistortPoints is solved once for the nodes of a grid over the image, every step pixels, and points
+* are looked up by bilinear interpolation between the four surrounding nodes. Points outside the image are
+* extrapolated from the nearest cell.
+*
+* A table is only valid for the intrinsics, distortion coefficients, image size and step it was built with, and
+* matches() checks all of them, so a table loaded from a cache file can be checked before it is used.
+*/
+class UndistortionLut
+{
+private:
+	// Intrinsics the table was built for
+	double camera_matrix[9];
+	std::vector<double> dist_coeffs;
+	cv::Size image_size;
+	int step;
+
+	// Number of nodes in each direction, the last node is at or past the image border
+	int nodes_x, nodes_y;
+
+	// Normalized ray of every node, row major
+	std::vector<cv::Point2f> rays;
+
+public:
+	UndistortionLut();
+
+	int build(const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, cv::Size image_size, int step = 16,
+		size_t thread_count = 0);
+
+	bool matches(const cv::Mat& camera_intrinsic, const cv::Mat& dist_coeffs, cv::Size image_size, int step) const;
+
+	void lookup(const cv::Point2f* img_points, cv::Point2f* rays, size_t count) const;
+
+	int load(const std::string& path);
+
+	int save(const std::string& path) const;
+
+	bool empty() const;
+
+	int get_step() const;
+
+	cv::Size get_image_size() const;
+};